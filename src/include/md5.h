@@ -0,0 +1,132 @@
+#pragma once
+/**
+ * $Id$
+ *
+ * @note license is LGPL, but largely derived from a public domain source.
+ *
+ * @file include/md5.h
+ * @brief Structures and prototypes for md5.
+ */
+RCSIDH(md5_h, "$Id$")
+
+#ifdef HAVE_INTTYPES_H
+#  include <inttypes.h>
+#endif
+
+#ifdef HAVE_SYS_TYPES_H
+#  include <sys/types.h>
+#endif
+
+#ifdef HAVE_STDINT_H
+#  include <stdint.h>
+#endif
+
+#  include <string.h>
+
+#ifdef HAVE_OPENSSL_EVP_H
+#  include <openssl/evp.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef MD5_DIGEST_LENGTH
+#  define MD5_DIGEST_LENGTH 16
+#endif
+
+#ifndef HAVE_OPENSSL_EVP_H
+/*
+ * The MD5 code used here and in md5.c was originally retrieved from:
+ *   http://www.openbsd.org/cgi-bin/cvsweb/~checkout~/src/sys/crypto/md5.h?rev=1.1
+ *
+ * This code implements the MD5 message-digest algorithm.
+ * The algorithm is due to Ron Rivest.  This code was
+ * written by Colin Plumb in 1993, no copyright is claimed.
+ * This code is in the public domain; do with it what you wish.
+ *
+ * Equivalent code is available from RSA Data Security, Inc.
+ * This code has been tested against that, and is equivalent,
+ * except that you don't need to include two pages of legalese
+ * with every copy.
+ */
+#  define MD5_BLOCK_LENGTH 64
+typedef struct FR_MD5Context {
+	uint32_t state[4];			//!< State.
+	uint32_t count[2];			//!< Number of bits, mod 2^64.
+	uint8_t buffer[MD5_BLOCK_LENGTH];	//!< Input buffer.
+} FR_MD5_CTX;
+
+void 	fr_md5_init(FR_MD5_CTX *ctx);
+void	fr_md5_update(FR_MD5_CTX *ctx, uint8_t const *in, size_t inlen)
+	CC_BOUNDED(__string__, 2, 3);
+void	fr_md5_final(uint8_t out[MD5_DIGEST_LENGTH], FR_MD5_CTX *ctx)
+	CC_BOUNDED(__minbytes__, 1, MD5_DIGEST_LENGTH);
+void	fr_md5_transform(uint32_t state[4], uint8_t const block[MD5_BLOCK_LENGTH])
+	CC_BOUNDED(__size__, 1, 4, 4)
+	CC_BOUNDED(__minbytes__, 2, MD5_BLOCK_LENGTH);
+#  define fr_md5_copy(_out, _in)	memcpy(_out, _in, sizeof(*_out))
+#else  /* HAVE_OPENSSL_EVP_H */
+USES_APPLE_DEPRECATED_API
+#include <openssl/md5.h>
+#  define FR_MD5_CTX			MD5_CTX
+#  define fr_md5_init			MD5_Init
+#  define fr_md5_update			MD5_Update
+#  define fr_md5_final			MD5_Final
+#  define fr_md5_transform		MD5_Transform
+#  define fr_md5_copy(_out, _in)	memcpy(_out, _in, sizeof(*_out))
+#endif
+
+/** A message to hash with #fr_md5_calc_multi
+ *
+ * The message is the concatenation of in[0] and in[1], which saves
+ * copying for the common "packet + secret" case.
+ */
+typedef struct {
+	uint8_t const		*in[2];				//!< Data to hash.  in[1] may be NULL.
+	size_t			inlen[2];			//!< Length of each part of the data.
+	uint8_t			*out;				//!< Where to write the MD5 digest.
+} fr_md5_multi_t;
+
+/* hmac.c */
+void	fr_hmac_md5(uint8_t digest[MD5_DIGEST_LENGTH], uint8_t const *text, size_t text_len,
+		    uint8_t const *key, size_t key_len)
+	CC_BOUNDED(__minbytes__, 1, MD5_DIGEST_LENGTH);
+
+/** An HMAC-MD5 key, with the inner and outer pads already absorbed
+ *
+ * Deriving and hashing the pads costs two MD5 compression rounds, so
+ * where the same key is used for many messages, do it once with
+ * #fr_hmac_md5_key_init, and use #fr_hmac_md5_from_key for each message.
+ */
+typedef struct {
+	FR_MD5_CTX		ipad;				//!< Context with key XOR ipad absorbed.
+	FR_MD5_CTX		opad;				//!< Context with key XOR opad absorbed.
+} fr_hmac_md5_key_t;
+
+void	fr_hmac_md5_key_init(fr_hmac_md5_key_t *hkey, uint8_t const *key, size_t key_len);
+
+void	fr_hmac_md5_from_key(uint8_t digest[MD5_DIGEST_LENGTH], uint8_t const *text, size_t text_len,
+			     fr_hmac_md5_key_t const *hkey)
+	CC_BOUNDED(__minbytes__, 1, MD5_DIGEST_LENGTH);
+
+/** A message to authenticate with #fr_hmac_md5_multi
+ */
+typedef struct {
+	uint8_t const		*text;				//!< Data to authenticate.
+	size_t			text_len;			//!< Length of the data.
+	uint8_t const		*key;				//!< Authentication key.
+	size_t			key_len;			//!< Length of the key.
+	uint8_t			*digest;			//!< Where to write the HMAC.
+} fr_hmac_md5_multi_t;
+
+void	fr_hmac_md5_multi(fr_hmac_md5_multi_t *msgs, size_t num);
+
+/* md5.c */
+void	fr_md5_calc(uint8_t *out, uint8_t const *in, size_t inlen);
+
+void	fr_md5_calc_multi(fr_md5_multi_t *msgs, size_t num);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,168 @@
+#pragma once
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file include/parser.h
+ * @brief Condition parser API
+ *
+ * @copyright 2013 Alan DeKok <aland@freeradius.org>
+ */
+RCSIDH(parser_h, "$Id$")
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef RADIUSD_H
+/*
+ *	Also defined in radiusd.h for radius_evalute_cond()
+ */
+typedef struct fr_cond_t fr_cond_t;
+typedef struct fr_cond_prog_t fr_cond_prog_t;
+#endif
+
+typedef enum {
+	COND_NONE = 0,
+	COND_AND = '&',
+	COND_OR = '|'
+} fr_cond_op_t;
+
+typedef enum {
+	COND_TYPE_INVALID = 0,
+	COND_TYPE_TRUE,
+	COND_TYPE_FALSE,
+	COND_TYPE_EXISTS,
+	COND_TYPE_MAP,
+	COND_TYPE_CHILD
+} fr_cond_type_t;
+
+typedef enum {
+	PASS2_FIXUP_NONE = 0,
+	PASS2_FIXUP_ATTR,
+	PASS2_FIXUP_TYPE,
+	PASS2_PAIRCOMPARE
+} fr_cond_pass2_t;
+
+/*
+ *	Allow for the following structures:
+ *
+ *	FOO			no OP, RHS is NULL
+ *	FOO OP BAR
+ *	(COND)			no LHS/RHS, child is COND, child OP is true
+ *	(!(COND))		no LHS/RHS, child is COND, child OP is NOT
+ *	(COND1 OP COND2)	no LHS/RHS, next is COND2, next OP is OP
+ */
+struct fr_cond_t {
+	fr_cond_type_t		type;
+
+	CONF_ITEM const		*ci;
+	union {
+		vp_map_t		*map;
+		vp_tmpl_t		*vpt;
+		fr_cond_t  		*child;
+	} data;
+
+	bool			negate;
+	fr_cond_pass2_t		pass2_fixup;
+
+	fr_dict_attr_t const	*cast;
+
+	fr_cond_op_t		next_op;
+	fr_cond_t		*next;
+};
+
+/*
+ *	Conditions are lowered by the unlang compiler into a flat
+ *	sequence of instructions.  Each instruction evaluates one
+ *	operand or comparison, and then jumps to another instruction
+ *	depending on the result.  Nesting, negation, and short-circuit
+ *	&& / || are all resolved into jump targets at compile time.
+ */
+typedef enum {
+	COND_INST_INVALID = 0,
+	COND_INST_TRUE,				//!< Always matches.
+	COND_INST_FALSE,			//!< Never matches.
+	COND_INST_RCODE,			//!< Compare the return code of the previous module.
+	COND_INST_EXISTS,			//!< Check for an attribute or list.
+	COND_INST_TMPL,				//!< Any other template, evaluated with cond_eval_tmpl().
+	COND_INST_CMP,				//!< Compare attribute values to pre-cast data.
+	COND_INST_CMP_ATTR,			//!< Compare attribute values to values of the same type.
+	COND_INST_REGEX,			//!< Match string attribute values against a pre-compiled regex.
+	COND_INST_MAP				//!< Any other comparison, evaluated with cond_eval_map().
+} fr_cond_inst_type_t;
+
+#define COND_JUMP_TRUE	(-1)			//!< The condition matches.
+#define COND_JUMP_FALSE	(-2)			//!< The condition doesn't match.
+
+/** Comparison function specialised for a data type
+ *
+ * @return
+ *	- 1 if true.
+ *	- 0 if false.
+ *	- -1 on failure.
+ */
+typedef int (*fr_cond_cmp_t)(FR_TOKEN op, fr_value_box_t const *a, fr_value_box_t const *b);
+
+typedef struct {
+	fr_cond_inst_type_t	type;
+	fr_cond_t const		*c;		//!< Condition this instruction was lowered from.
+
+	int			on_true;	//!< Instruction to execute next on a match.
+	int			on_false;	//!< Instruction to execute next otherwise.
+
+	union {
+		int			modcode;	//!< #COND_INST_RCODE.
+		vp_tmpl_t const		*vpt;		//!< #COND_INST_EXISTS, #COND_INST_TMPL.
+		struct {
+			vp_tmpl_t const		*lhs;	//!< Attribute reference.
+			fr_dict_attr_t const	*cast;	//!< Attribute values are cast to this, or NULL.
+			FR_TOKEN		op;
+			fr_cond_cmp_t		cmp;	//!< Comparator for the type of both operands.
+			vp_tmpl_t const		*rhs_attr;	//!< #COND_INST_CMP_ATTR attribute reference.
+			fr_value_box_t		rhs;	//!< #COND_INST_CMP literal, already cast.
+		};
+	};
+} fr_cond_inst_t;
+
+struct fr_cond_prog_t {
+	fr_cond_t const		*cond;		//!< Condition the program was compiled from.
+	int			num_insts;
+	fr_cond_inst_t		*inst;		//!< Instructions, execution starts at the first one.
+};
+
+fr_cond_cmp_t cond_cmp_func(fr_type_t type);
+
+/*
+ *	One pass over the conditions means that all references must
+ *	exist at parse time.
+ *
+ *	Two pass means "soft fail", that some invalid references are
+ *	left for pass 2.
+ */
+#define FR_COND_ONE_PASS (0)
+#define FR_COND_TWO_PASS (1)
+
+ssize_t fr_cond_tokenize(TALLOC_CTX *ctx, CONF_ITEM *ci, char const *start, fr_cond_t **head, char const **error, int flag);
+size_t cond_snprint(char *buffer, size_t bufsize, fr_cond_t const *c);
+
+bool fr_cond_walk(fr_cond_t *head, bool (*callback)(void *, fr_cond_t *), void *ctx);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,136 @@
+#pragma once
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file include/radclient.h
+ * @brief Structures for the radclient utility.
+ *
+ * @copyright 2014  The FreeRADIUS server project
+ */
+RCSIDH(radclient_h, "$Id$")
+
+#include <freeradius-devel/libradius.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ *	Logging macros
+ */
+ #undef DEBUG
+#define DEBUG(fmt, ...)		if (do_output && (fr_debug_lvl > 0)) fprintf(fr_log_fp, fmt "\n", ## __VA_ARGS__)
+#undef DEBUG2
+#define DEBUG2(fmt, ...)	if (do_output && (fr_debug_lvl > 1)) fprintf(fr_log_fp, fmt "\n", ## __VA_ARGS__)
+
+
+#define ERROR(fmt, ...)		if (do_output) fr_perror("radclient: " fmt, ## __VA_ARGS__)
+#define WARN(fmt, ...)		if (do_output) fprintf(stderr, fmt "\n", ## __VA_ARGS__)
+
+#define RDEBUG_ENABLED()	(do_output && (fr_debug_lvl > 0))
+#define RDEBUG_ENABLED2()	(do_output && (fr_debug_lvl > 1))
+
+#define REDEBUG(fmt, ...)	if (do_output) fr_perror("(%" PRIu64 ") " fmt , request->num, ## __VA_ARGS__)
+#define RDEBUG(fmt, ...)	if (do_output && (fr_debug_lvl > 0)) fprintf(fr_log_fp, "(%" PRIu64 ") " fmt "\n", request->num, ## __VA_ARGS__)
+#define RDEBUG2(fmt, ...)	if (do_output && (fr_debug_lvl > 1)) fprintf(fr_log_fp, "(%" PRIu64 ") " fmt "\n", request->num, ## __VA_ARGS__)
+
+typedef struct rc_stats {
+	uint64_t accepted;		//!< Requests to which we received a accept
+	uint64_t rejected;		//!< Requests to which we received a reject
+	uint64_t lost;			//!< Requests to which we received no response
+	uint64_t passed;		//!< Requests which passed a filter
+	uint64_t failed;		//!< Requests which failed a fitler
+} rc_stats_t;
+
+typedef struct rc_file_pair {
+	char const *packets;		//!< The file containing the request packet
+	char const *filters;		//!< The file containing the definition of the
+					//!< packet we want to match.
+} rc_file_pair_t;
+
+typedef struct rc_request rc_request_t;
+
+struct rc_request {
+	uint64_t	num;		//!< The number (within the file) of the request were reading.
+
+	rc_request_t	*prev;
+	rc_request_t	*next;
+
+	rc_file_pair_t	*files;		//!< Request and response file names.
+
+	VALUE_PAIR	*password;	//!< Cleartext-Password
+	time_t		timestamp;
+
+	RADIUS_PACKET	*packet;	//!< The outgoing request.
+	RADIUS_PACKET	*reply;		//!< The incoming response.
+	VALUE_PAIR	*filter;	//!< If the reply passes the filter, then the request passes.
+	FR_CODE		filter_code;	//!< Expected code of the response packet.
+
+	int		resend;
+	int		tries;
+	bool		done;		//!< Whether the request is complete.
+
+	char const	*name;		//!< Test name (as specified in the request).
+};
+
+/*
+ *	radclient_load.c - open-loop load generation.
+ */
+typedef enum rc_load_type {
+	RC_LOAD_CONSTANT = 0,		//!< Constant rate.
+	RC_LOAD_RAMP,			//!< Rate changes linearly from rate to rate_end.
+	RC_LOAD_STEP			//!< Rate increases by rate_end every duration.
+} rc_load_type_t;
+
+typedef struct rc_load_schedule {
+	rc_load_type_t	type;		//!< Shape of the schedule.
+	double		rate;		//!< Initial packets per second.
+	double		rate_end;	//!< Final rate (ramp), or increment per step (step).
+	double		duration;	//!< Length of the test (constant, ramp), or of each step (step).
+	uint32_t	steps;		//!< Number of steps (step).
+} rc_load_schedule_t;
+
+typedef struct rc_load_template {
+	uint8_t const	*data;		//!< Encoded packet.  The ID and authenticators are filled in when sending.
+	size_t		data_len;	//!< Length of the packet.
+} rc_load_template_t;
+
+typedef struct rc_load_config {
+	rc_load_schedule_t	schedule;	//!< When to send packets.
+	uint32_t		num_threads;	//!< Number of sender threads.
+
+	fr_ipaddr_t		src_ipaddr;	//!< Address to send packets from.
+	fr_ipaddr_t		dst_ipaddr;	//!< Server to send packets to.
+	uint16_t		dst_port;	//!< Server port.
+	char const		*secret;	//!< Shared secret.
+	float			timeout;	//!< How long to wait for a reply before the packet is lost.
+
+	rc_load_template_t	*templates;	//!< Packets to send, in rotation.
+	size_t			num_templates;	//!< Number of templates.
+
+	char const		*json_file;	//!< Write results as JSON to this file ("-" for stdout).
+	bool			do_output;	//!< Print a summary to stdout.
+} rc_load_config_t;
+
+int rc_load_schedule_parse(rc_load_schedule_t *out, char const *spec);
+int rc_load_run(rc_load_config_t const *config);
+
+#ifdef __cplusplus
+}
+#endif
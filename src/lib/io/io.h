@@ -248,6 +248,34 @@ typedef ssize_t (*fr_io_data_write_t)(void *instance, void *packet_ctx, fr_time_
  */
 typedef int (*fr_io_data_inject_t)(void *instance,uint8_t *buffer, size_t buffer_len, fr_time_t recv_time);
 
+/** A packet which has been read by the network thread, but not yet sent to a worker.
+ *
+ */
+typedef struct {
+	void		*packet_ctx;			//!< As returned by read().
+	uint8_t		*packet;			//!< The raw packet.
+	size_t		packet_len;			//!< Length of the raw packet.
+	bool		is_dup;				//!< As returned by read().
+	bool		discard;			//!< Set by the preprocess function to discard the packet.
+} fr_io_preprocess_t;
+
+/** Check a batch of packets in the network thread, before they are sent to a worker.
+ *
+ *  This function allows the IO handler to do cheap checks (e.g.
+ *  authenticators) for many packets at once, so that invalid packets
+ *  do not use any worker time.
+ *
+ *  Packets which are marked as "discard" are freed by the network side,
+ *  and are not sent to a worker.  The called function MUST clean up
+ *  any state it has for those packets, as write() will never be called
+ *  for them.
+ *
+ * @param[in] instance		the context for this function
+ * @param[in,out] batch		the packets which were read.
+ * @param[in] num		the number of packets in the batch.
+ */
+typedef void (*fr_io_data_preprocess_t)(void *instance, fr_io_preprocess_t *batch, size_t num);
+
 /** Tell the IO handler that a VNODE has changed
  *
  * @param[in] instance		the context for this function
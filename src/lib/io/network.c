@@ -49,6 +49,7 @@ RCSID("$Id$")
 #define ERROR(fmt, ...) fr_log(nr->log, L_ERR, fmt, ## __VA_ARGS__)
 
 #define MAX_WORKERS 32
+#define NETWORK_READ_BATCH (16)	//!< maximum number of packets read from a socket at once
 
 fr_thread_local_setup(fr_ring_buffer_t *, fr_network_rb);	/* macro */
 
@@ -380,7 +381,61 @@ static void fr_network_socket_dead(fr_network_t *nr, fr_network_socket_t *s)
 }
 
 
-/** Read a packet from the network.
+/** Send a batch of packets which were read from one socket to the workers.
+ *
+ *  If the IO handler has a preprocess function, it gets to check all
+ *  of the packets first.  Packets which it discards are never seen by
+ *  a worker.
+ *
+ * @param[in] nr	the network.
+ * @param[in] s		the socket the packets were read from.
+ * @param[in] batch	the packets.
+ * @param[in] num	the number of packets.
+ */
+static void fr_network_send_batch(fr_network_t *nr, fr_network_socket_t *s, fr_channel_data_t **batch, int num)
+{
+	int i;
+	fr_app_io_t const *app_io = s->listen->app_io;
+	fr_io_preprocess_t pre[NETWORK_READ_BATCH];
+
+	rad_assert(num <= NETWORK_READ_BATCH);
+
+	if (app_io->preprocess) {
+		for (i = 0; i < num; i++) {
+			pre[i].packet_ctx = batch[i]->packet_ctx;
+			pre[i].packet = batch[i]->m.data;
+			pre[i].packet_len = batch[i]->m.data_size;
+			pre[i].is_dup = batch[i]->request.is_dup;
+			pre[i].discard = false;
+		}
+
+		app_io->preprocess(s->listen->app_io_instance, pre, num);
+	}
+
+	for (i = 0; i < num; i++) {
+		if (app_io->preprocess && pre[i].discard) {
+			DEBUG3("Network discarded packet size %zd", batch[i]->m.data_size);
+			fr_message_done(&batch[i]->m);
+			continue;
+		}
+
+		if (!fr_network_send_request(nr, batch[i])) {
+			fr_log(nr->log, L_ERR, "Failed sending packet to worker");
+			fr_message_done(&batch[i]->m);
+		}
+
+		/*
+		 *	One more packet sent to a worker.
+		 */
+		s->outstanding++;
+	}
+}
+
+
+/** Read packets from the network.
+ *
+ *  Up to NETWORK_READ_BATCH packets are read at a time, and then
+ *  sent to the workers together.
  *
  * @param[in] el	the event list.
  * @param[in] sockfd	the socket which is ready to read.
@@ -390,10 +445,12 @@ static void fr_network_socket_dead(fr_network_t *nr, fr_network_socket_t *s)
 static void fr_network_read(UNUSED fr_event_list_t *el, UNUSED int sockfd, UNUSED int flags, void *ctx)
 {
 	int num_messages = 0;
+	bool dead = false;
 	fr_network_socket_t *s = ctx;
 	fr_network_t *nr = talloc_parent(s);
 	ssize_t data_size;
 	fr_channel_data_t *cd, *next;
+	fr_channel_data_t *batch[NETWORK_READ_BATCH];
 	fr_time_t *recv_time;
 
 	rad_assert(s->fd == sockfd);
@@ -419,9 +476,9 @@ next_message:
 	 *	Poll this socket, but not too often.  We have to go
 	 *	service other sockets, too.
 	 */
-	if (num_messages > 16) {
+	if (num_messages >= NETWORK_READ_BATCH) {
 		s->cd = cd;
-		return;
+		goto send;
 	}
 
 	/*
@@ -449,16 +506,18 @@ next_message:
 		 *	blocking issues can happen for stream sockets.
 		 */
 		s->cd = cd;
-		return;
+		goto send;
 	}
 
 	/*
-	 *	Error: close the connection, and remove the fr_listen_t
+	 *	Error: close the connection, and remove the
+	 *	fr_listen_t.  But only after sending the packets we
+	 *	already have.
 	 */
 	if (data_size < 0) {
 //		fr_log(nr->log, L_DBG_ERR, "error from transport read on socket %d", sockfd);
-		fr_network_socket_dead(nr, s);
-		return;
+		dead = true;
+		goto send;
 	}
 	s->cd = NULL;
 
@@ -498,29 +557,29 @@ next_message:
 		}
 	}
 
-	if (!fr_network_send_request(nr, cd)) {
-		fr_log(nr->log, L_ERR, "Failed sending packet to worker");
-		fr_message_done(&cd->m);
-	}
-
-	/*
-	 *	One more packet sent to a worker.
-	 */
-	s->outstanding++;
+	batch[num_messages++] = cd;
 
 	/*
-	 *	If there is a next message, go read it from the buffer.
+	 *	Datagram sockets have no leftover data, so get a new
+	 *	buffer for the next packet.  If there isn't room, the
+	 *	next packet will be read the next time the socket is
+	 *	readable.
 	 *
 	 *	@todo - note that this calls read(), even if the
 	 *	app_io has paused the reader.  We likely want to be
-	 *	able to check that, too.  We might just remove this
-	 *	"goto"...
+	 *	able to check that, too.
 	 */
+	if (!next) next = (fr_channel_data_t *) fr_message_reserve(s->ms, s->listen->default_message_size);
+
 	if (next) {
 		cd = next;
-		num_messages++;
 		goto next_message;
 	}
+
+send:
+	if (num_messages > 0) fr_network_send_batch(nr, s, batch, num_messages);
+
+	if (dead) fr_network_socket_dead(nr, s);
 }
 
 
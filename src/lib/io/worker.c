@@ -806,7 +806,12 @@ static REQUEST *fr_worker_get_request(fr_worker_t *worker, fr_time_t now)
 		worker->num_decoded++;
 	} while (!cd);
 
-	ctx = request = request_alloc(NULL);
+	/*
+	 *	Allocate the request from a pool, so the packets
+	 *	and attributes it contains don't each need their
+	 *	own malloc.
+	 */
+	ctx = request = request_alloc_pooled(NULL, 128, worker->talloc_pool_size);
 	if (!request) goto nak;
 
 	request->el = worker->el;
@@ -1292,7 +1297,7 @@ nomem:
 	 *	@todo make these configurable
 	 */
 	worker->max_channels = max_channels;
-	worker->talloc_pool_size = 4096; /* at least enough for a REQUEST */
+	worker->talloc_pool_size = 16384; /* enough for the packets, and ~60 attributes */
 	worker->message_set_size = 1024;
 	worker->ring_buffer_size = (1 << 16);
 	worker->max_request_time = 30;
@@ -150,7 +150,17 @@ static int fr_ldap_rebind(LDAP *handle, LDAP_CONST char *url,
  */
 static int fr_ldap_connection_reset(fr_ldap_connection_t *c)
 {
-	talloc_free_children(c);	/* Force inverted free order */
+	fr_connection_t	*conn = c->conn;
+
+	/*
+	 *	We're called from the connection state machine's
+	 *	close and init callbacks, so it must survive the
+	 *	reset.  If the handle itself is being freed, talloc
+	 *	frees the state machine after we return.
+	 */
+	if (conn) talloc_steal(NULL, conn);
+	talloc_free_children(c);	/* Force inverted free order, also fails outstanding queries */
+	if (conn) talloc_steal(c, conn);
 
 	fr_ldap_control_clear(c);
 
@@ -465,7 +475,7 @@ fr_ldap_connection_t *fr_ldap_connection_alloc(TALLOC_CTX *ctx)
  * @param[in] log_prefix	to prepend to connection state messages.
  */
 fr_ldap_connection_t *fr_ldap_connection_state_alloc(TALLOC_CTX *ctx, fr_event_list_t *el,
-						     fr_ldap_config_t const *config, char *log_prefix)
+						     fr_ldap_config_t const *config, char const *log_prefix)
 {
 	fr_ldap_connection_t	*c;
 
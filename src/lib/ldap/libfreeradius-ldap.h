@@ -275,6 +275,8 @@ typedef struct {
 	struct timeval		reconnection_delay;	//!< How long to wait before attempting to reconnect.
 } fr_ldap_config_t;
 
+typedef struct fr_ldap_mux fr_ldap_mux_t;
+
 /** Tracks the state of a libldap connection handle
  *
  */
@@ -300,6 +302,9 @@ typedef struct fr_ldap_connection {
 
 	fr_ldap_state_t		state;			//!< LDAP connection state machine.
 
+	fr_ldap_mux_t		*mux;			//!< Outstanding async queries.  Only set in the
+							///< #FR_LDAP_STATE_RUN state.
+
 	void			*uctx;			//!< User data associated with the handle.
 } fr_ldap_connection_t;
 
@@ -352,6 +357,20 @@ typedef enum {
 							//!< exit, and retry the operation with a NULL cookie.
 } fr_ldap_rcode_t;
 
+/** An asynchronous search, sent on a connection in the #FR_LDAP_STATE_RUN state
+ *
+ */
+typedef struct fr_ldap_query {
+	REQUEST			*request;		//!< To resume when the result arrives.
+	fr_ldap_mux_t		*mux;			//!< The query is outstanding on.  NULL once complete.
+	int			msgid;			//!< libldap message ID.
+	char const		*dn;			//!< Base DN of the search.  Used for error messages.
+
+	fr_ldap_rcode_t		ret;			//!< Status of the query.  #LDAP_PROC_CONTINUE whilst
+							///< it's outstanding.
+	LDAPMessage		*result;		//!< Search result.  Freed with the query.
+} fr_ldap_query_t;
+
 /*
  *	Tables for resolving strings to LDAP constants
  */
@@ -492,7 +511,7 @@ fr_ldap_rcode_t	 fr_ldap_sasl_interactive(REQUEST *request,
 fr_ldap_connection_t *fr_ldap_connection_alloc(TALLOC_CTX *ctx);
 
 fr_ldap_connection_t *fr_ldap_connection_state_alloc(TALLOC_CTX *ctx, fr_event_list_t *el,
-						     fr_ldap_config_t const *config, char *log_prefix);
+						     fr_ldap_config_t const *config, char const *log_prefix);
 
 int		fr_ldap_connection_configure(fr_ldap_connection_t *c, fr_ldap_config_t const *config);
 
@@ -507,6 +526,15 @@ fr_ldap_state_t	fr_ldap_state_next(fr_ldap_connection_t *c);
 
 void		fr_ldap_state_error(fr_ldap_connection_t *c);
 
+/*
+ *	mux.c - Multiplex async queries over a connection
+ */
+int		fr_ldap_mux_async(fr_ldap_connection_t *c);
+
+fr_ldap_query_t	*fr_ldap_search_query(TALLOC_CTX *ctx, REQUEST *request, fr_ldap_connection_t *c,
+				      char const *dn, int scope, char const *filter, char const * const *attrs,
+				      LDAPControl **serverctrls, LDAPControl **clientctrls);
+
 /*
  *	start_tls.c - Mostly async start_tls
  */
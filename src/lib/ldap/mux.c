@@ -0,0 +1,322 @@
+/*
+ *   This program is is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or (at
+ *   your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ * @file lib/ldap/mux.c
+ * @brief Multiplex asynchronous queries over a single LDAP connection
+ *
+ * Once a connection reaches the #FR_LDAP_STATE_RUN state, a read handler
+ * is installed on its file descriptor.  Any number of queries may then be
+ * outstanding on the connection.  When a complete result arrives, it's
+ * matched to its query using the message ID, and the request which sent
+ * the query is marked as resumable.
+ *
+ * @copyright 2018 The FreeRADIUS server project
+ */
+RCSID("$Id$")
+
+#include "libfreeradius-ldap.h"
+#include <freeradius-devel/modules.h>
+#include <freeradius-devel/rad_assert.h>
+
+/** Per-connection mux/demux state
+ *
+ * Allocated when the connection enters the #FR_LDAP_STATE_RUN state, and
+ * freed (with the connection's other children) when the connection is reset.
+ */
+struct fr_ldap_mux {
+	fr_ldap_connection_t	*c;			//!< Connection we're multiplexing queries over.
+	fr_event_list_t		*el;			//!< Event list the read handler is inserted into.
+	int			fd;			//!< libldap's file descriptor.
+	rbtree_t		*queries;		//!< Outstanding queries, ordered by message ID.
+};
+
+static int ldap_query_cmp(void const *one, void const *two)
+{
+	fr_ldap_query_t const *a = one, *b = two;
+
+	return (a->msgid > b->msgid) - (a->msgid < b->msgid);
+}
+
+/** Mark a query as complete, and resume the request that sent it
+ *
+ * @param[in] query	that's complete.
+ * @param[in] ret	Status of the query.
+ */
+static void ldap_query_complete(fr_ldap_query_t *query, fr_ldap_rcode_t ret)
+{
+	rbtree_deletebydata(query->mux->queries, query);
+	query->mux = NULL;
+	query->ret = ret;
+
+	unlang_resumable(query->request);
+}
+
+/** Abandon a query that's still outstanding when it's freed
+ *
+ * @param[in] query	being freed.
+ * @return 0
+ */
+static int _ldap_query_free(fr_ldap_query_t *query)
+{
+	if (query->mux) {
+		fr_ldap_mux_t *mux = query->mux;
+
+		rbtree_deletebydata(mux->queries, query);
+		ldap_abandon_ext(mux->c->handle, query->msgid, NULL, NULL);
+		query->mux = NULL;
+	}
+
+	if (query->result) ldap_msgfree(query->result);
+
+	return 0;
+}
+
+/** Fail an outstanding query because its connection is going away
+ *
+ * @param[in] uctx	unused.
+ * @param[in] data	query to fail.
+ * @return 2 (delete the node and continue).
+ */
+static int _ldap_query_fail(UNUSED void *uctx, void *data)
+{
+	fr_ldap_query_t	*query = talloc_get_type_abort(data, fr_ldap_query_t);
+	REQUEST		*request = query->request;
+
+	RWDEBUG("Connection closed with search outstanding (message ID %i)", query->msgid);
+
+	query->mux = NULL;
+	query->ret = LDAP_PROC_BAD_CONN;
+	unlang_resumable(request);
+
+	return 2;
+}
+
+/** Fail all outstanding queries, and remove the read handler
+ *
+ * @param[in] mux	being freed.
+ * @return 0
+ */
+static int _ldap_mux_free(fr_ldap_mux_t *mux)
+{
+	fr_event_fd_delete(mux->el, mux->fd, FR_EVENT_FILTER_IO);
+
+	(void) rbtree_walk(mux->queries, RBTREE_DELETE_ORDER, _ldap_query_fail, NULL);
+
+	mux->c->mux = NULL;
+
+	return 0;
+}
+
+/** Process a complete result chain
+ *
+ * @param[in] mux	the result was received on.
+ * @param[in] result	chain, must be freed if it's not assigned to a query.
+ */
+static void ldap_mux_result(fr_ldap_mux_t *mux, LDAPMessage *result)
+{
+	fr_ldap_connection_t	*c = mux->c;
+	fr_ldap_query_t		find = { .msgid = ldap_msgid(result) }, *query;
+	fr_ldap_rcode_t		status = LDAP_PROC_SUCCESS;
+	LDAPMessage		*msg;
+	REQUEST			*request;
+
+	query = rbtree_finddata(mux->queries, &find);
+	if (!query) {
+		DEBUG3("Discarding result for message ID %i, query was abandoned", find.msgid);
+		ldap_msgfree(result);
+		return;
+	}
+	request = query->request;
+
+	for (msg = ldap_first_message(c->handle, result);
+	     msg;
+	     msg = ldap_next_message(c->handle, msg)) {
+		status = fr_ldap_error_check(NULL, c, msg, query->dn);
+		if (status != LDAP_PROC_SUCCESS) break;
+	}
+
+	switch (status) {
+	case LDAP_PROC_SUCCESS:
+		if (ldap_count_entries(c->handle, result) == 0) {
+			RDEBUG("Search returned no results");
+			status = LDAP_PROC_NO_RESULT;
+			break;
+		}
+		query->result = result;
+		result = NULL;
+		break;
+
+	default:
+		RPEDEBUG("Failed performing search");
+		break;
+	}
+
+	if (result) ldap_msgfree(result);
+
+	ldap_query_complete(query, status);
+}
+
+/** Read any results available on the connection
+ *
+ * @param[in] el	the event occurred in.
+ * @param[in] fd	the event occurred on.
+ * @param[in] flags	from kevent.
+ * @param[in] uctx	the #fr_ldap_mux_t for the connection.
+ */
+static void _ldap_mux_io_read(UNUSED fr_event_list_t *el, UNUSED int fd, UNUSED int flags, void *uctx)
+{
+	fr_ldap_mux_t		*mux = talloc_get_type_abort(uctx, fr_ldap_mux_t);
+	fr_ldap_connection_t	*c = mux->c;
+	LDAPMessage		*result;
+	struct timeval		tv = { 0, 0 };	/* We're I/O driven, never block */
+	int			ret;
+
+	for (;;) {
+		ret = ldap_result(c->handle, LDAP_RES_ANY, LDAP_MSG_ALL, &tv, &result);
+		switch (ret) {
+		case 0:				/* No more complete results */
+			return;
+
+		case -1:
+			fr_ldap_error_check(NULL, c, NULL, NULL);
+			PERROR("Failed reading results from \"%s\"", c->config->server);
+			fr_ldap_state_error(c);	/* Restart the connection state machine, frees mux */
+			return;
+
+		default:
+			ldap_mux_result(mux, result);
+			break;
+		}
+	}
+}
+
+/** Error reading from the file descriptor
+ *
+ * @param[in] el	the event occurred in.
+ * @param[in] fd	the event occurred on.
+ * @param[in] flags	from kevent.
+ * @param[in] fd_errno	The error that ocurred.
+ * @param[in] uctx	the #fr_ldap_mux_t for the connection.
+ */
+static void _ldap_mux_io_error(UNUSED fr_event_list_t *el, UNUSED int fd,
+			       UNUSED int flags, int fd_errno, void *uctx)
+{
+	fr_ldap_mux_t		*mux = talloc_get_type_abort(uctx, fr_ldap_mux_t);
+	fr_ldap_connection_t	*c = mux->c;
+
+	ERROR("Connection to \"%s\" failed: %s", c->config->server, fr_syserror(fd_errno));
+	fr_ldap_state_error(c);			/* Restart the connection state machine, frees mux */
+}
+
+/** Install the demux (read) handler for a connection which has been bound
+ *
+ * Signals the connection state machine that the connection is open.
+ *
+ * @param[in] c		connection to install the handler on.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+int fr_ldap_mux_async(fr_ldap_connection_t *c)
+{
+	fr_ldap_mux_t	*mux;
+	int		fd = -1;
+
+	rad_assert(!c->mux);
+
+	if ((ldap_get_option(c->handle, LDAP_OPT_DESC, &fd) != LDAP_OPT_SUCCESS) || (fd < 0)) {
+		ERROR("Failed retrieving file descriptor from libldap handle");
+		return -1;
+	}
+
+	MEM(mux = talloc_zero(c, fr_ldap_mux_t));
+	mux->c = c;
+	mux->el = fr_connection_get_el(c->conn);
+	mux->fd = fd;
+	MEM(mux->queries = rbtree_create(mux, ldap_query_cmp, NULL, 0));
+
+	if (fr_event_fd_insert(mux, mux->el, fd,
+			       _ldap_mux_io_read,
+			       NULL,
+			       _ldap_mux_io_error,
+			       mux) < 0) {
+		PERROR("Failed inserting LDAP file descriptor into event loop");
+		talloc_free(mux);
+		return -1;
+	}
+	talloc_set_destructor(mux, _ldap_mux_free);
+	c->mux = mux;
+
+	fr_connection_signal_open(c->conn);
+
+	return 0;
+}
+
+/** Send a search on a connection in the #FR_LDAP_STATE_RUN state
+ *
+ * The caller should yield the request after this function returns.  When the
+ * result arrives (or the connection fails), the request is marked as resumable,
+ * and the result can be found in the returned query.
+ *
+ * Freeing the query before it completes abandons the search.
+ *
+ * @param[in] ctx		to allocate the query in.
+ * @param[in] request		to resume when the result arrives.
+ * @param[in] c			to send the search on.
+ * @param[in] dn		to use as base for the search.
+ * @param[in] scope		to use (LDAP_SCOPE_BASE, LDAP_SCOPE_ONE, LDAP_SCOPE_SUB).
+ * @param[in] filter		to use, should be pre-escaped.
+ * @param[in] attrs		to retrieve.
+ * @param[in] serverctrls	Search controls to pass to the server.  May be NULL.
+ * @param[in] clientctrls	Search controls for ldap_search.  May be NULL.
+ * @return
+ *	- A new query on success.
+ *	- NULL if the connection isn't running, or the search couldn't be sent.
+ */
+fr_ldap_query_t *fr_ldap_search_query(TALLOC_CTX *ctx, REQUEST *request, fr_ldap_connection_t *c,
+				      char const *dn, int scope, char const *filter, char const * const *attrs,
+				      LDAPControl **serverctrls, LDAPControl **clientctrls)
+{
+	fr_ldap_query_t	*query;
+	int		msgid;
+
+	if ((c->state != FR_LDAP_STATE_RUN) || !c->mux) return NULL;
+
+	if (fr_ldap_search_async(&msgid, request, &c, dn, scope, filter, attrs,
+				 serverctrls, clientctrls) != LDAP_PROC_SUCCESS) return NULL;
+
+	MEM(query = talloc_zero(ctx, fr_ldap_query_t));
+	query->request = request;
+	query->msgid = msgid;
+	query->dn = talloc_typed_strdup(query, dn);
+	query->ret = LDAP_PROC_CONTINUE;
+	query->mux = c->mux;
+	talloc_set_destructor(query, _ldap_query_free);
+
+	if (!rbtree_insert(c->mux->queries, query)) {
+		RERROR("Duplicate message ID %i", msgid);
+		query->mux = NULL;
+		ldap_abandon_ext(c->handle, msgid, NULL, NULL);
+		talloc_free(query);
+		return NULL;
+	}
+
+	RDEBUG2("Waiting for search result (message ID %i)...", msgid);
+
+	return query;
+}
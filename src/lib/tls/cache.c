@@ -31,8 +31,12 @@ USES_APPLE_DEPRECATED_API	/* OpenSSL API has been deprecated by Apple */
 #include <freeradius-devel/radiusd.h>
 #include <freeradius-devel/process.h>
 #include <freeradius-devel/modules.h>
+#include <freeradius-devel/heap.h>
 #include <freeradius-devel/rad_assert.h>
 
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+
 /** Add attributes identifying the TLS session to be acted upon, and the action to be performed
  *
  * Adds the following attributes to the request:
@@ -174,6 +178,610 @@ inline static ssize_t tls_cache_id(uint8_t const **out, SSL_SESSION *sess)
 #endif
 }
 
+/** Number of independently locked partitions in the in-memory session cache
+ *
+ * Must be a power of 2.
+ */
+#define TLS_CACHE_STORE_SHARDS	16
+
+/** Number of ticket keys we keep.  The first is used for encryption, the others only for decryption
+ *
+ */
+#define TLS_TICKET_KEYS		3
+
+/** Length of the identifier we add to each session ticket
+ *
+ */
+#define TLS_TICKET_ID_LEN	16
+
+/** How many authorised tickets we remember if the in-memory session cache is disabled
+ *
+ */
+#define TLS_TICKET_AUTHORISED_MAX	65536
+
+/** A session in the in-memory session cache
+ *
+ */
+typedef struct {
+	uint8_t			*id;		//!< Session ID.
+	size_t			id_len;		//!< Length of the session ID.
+	uint8_t			*data;		//!< Serialized session.
+	time_t			expires;	//!< When the session can no longer be resumed.
+	int32_t			heap_id;	//!< Offset used for heap.
+} tls_cache_store_entry_t;
+
+/** One partition of the in-memory session cache
+ *
+ */
+typedef struct {
+	pthread_mutex_t		mutex;		//!< Protect the tree and heap from multiple readers/writers.
+	rbtree_t		*tree;		//!< Sessions keyed by session ID.
+	fr_heap_t		*heap;		//!< Sessions ordered by expiry.
+	uint32_t		max_entries;	//!< Maximum number of sessions in this partition.
+} tls_cache_shard_t;
+
+/** In-memory session cache, shared between all threads
+ *
+ * Sessions are partitioned by a hash of their session ID, so threads
+ * resuming different sessions rarely contend for the same lock.
+ */
+struct tls_cache_store {
+	tls_cache_shard_t	*shards[TLS_CACHE_STORE_SHARDS];
+};
+
+/** A session ticket key
+ *
+ */
+typedef struct {
+	uint8_t			name[16];	//!< Identifies the key used to encrypt a ticket.
+	uint8_t			aes_key[32];	//!< Ticket encryption key.
+	uint8_t			hmac_key[32];	//!< Ticket authentication key.
+	time_t			created;	//!< When the key was generated.  0 if the slot is unused.
+} tls_ticket_key_t;
+
+/** Session ticket keys, shared by all SSL_CTX created from the same configuration
+ *
+ */
+struct tls_ticket_keys {
+	pthread_mutex_t		mutex;		//!< Protect the keys during rotation.
+	uint32_t		lifetime;	//!< How long the current key is used to encrypt new tickets.
+	tls_ticket_key_t	keys[TLS_TICKET_KEYS];	//!< keys[0] is the current key.
+	tls_cache_store_t	*authorised;	//!< IDs of tickets issued to sessions which completed
+						///< authentication, and may be used for resumption.
+};
+
+static int tls_cache_store_entry_cmp(void const *one, void const *two)
+{
+	tls_cache_store_entry_t const *a = one, *b = two;
+	int ret;
+
+	ret = (a->id_len > b->id_len) - (a->id_len < b->id_len);
+	if (ret != 0) return ret;
+
+	return memcmp(a->id, b->id, a->id_len);
+}
+
+static int tls_cache_store_heap_cmp(void const *one, void const *two)
+{
+	tls_cache_store_entry_t const *a = one, *b = two;
+
+	return (a->expires > b->expires) - (a->expires < b->expires);
+}
+
+static int _tls_cache_shard_free(tls_cache_shard_t *shard)
+{
+	pthread_mutex_destroy(&shard->mutex);
+
+	return 0;
+}
+
+/** Allocate an in-memory store
+ *
+ * @param[in] ctx		to allocate the store in.
+ * @param[in] max_entries	Maximum number of entries the store holds.
+ * @return
+ *	- A new store.
+ *	- NULL on failure.
+ */
+static tls_cache_store_t *tls_cache_store_alloc(TALLOC_CTX *ctx, uint32_t max_entries)
+{
+	tls_cache_store_t	*store;
+	size_t			i;
+
+	max_entries /= TLS_CACHE_STORE_SHARDS;
+	if (!max_entries) max_entries = 1;
+
+	MEM(store = talloc_zero(ctx, tls_cache_store_t));
+	for (i = 0; i < TLS_CACHE_STORE_SHARDS; i++) {
+		tls_cache_shard_t *shard;
+
+		/*
+		 *	Each shard is a separate talloc chunk so
+		 *	threads can allocate entries in different
+		 *	shards concurrently.
+		 */
+		MEM(shard = talloc_zero(store, tls_cache_shard_t));
+		shard->max_entries = max_entries;
+
+		shard->tree = rbtree_talloc_create(shard, tls_cache_store_entry_cmp, tls_cache_store_entry_t, NULL, 0);
+		if (!shard->tree) {
+			ERROR("Failed creating session cache");
+		error:
+			talloc_free(store);
+			return NULL;
+		}
+
+		shard->heap = fr_heap_talloc_create(shard, tls_cache_store_heap_cmp, tls_cache_store_entry_t, heap_id);
+		if (!shard->heap) {
+			ERROR("Failed creating heap for the session cache");
+			goto error;
+		}
+
+		if (pthread_mutex_init(&shard->mutex, NULL) < 0) {
+			ERROR("Failed initializing mutex: %s", fr_syserror(errno));
+			goto error;
+		}
+		talloc_set_destructor(shard, _tls_cache_shard_free);
+
+		store->shards[i] = shard;
+	}
+
+	return store;
+}
+
+/** Allocate the in-memory session cache
+ *
+ * Does nothing if the cache is disabled (max_entries = 0).
+ *
+ * @param[in] ctx	to allocate the cache in.
+ * @param[in] conf	to allocate the cache for.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+int tls_cache_store_init(TALLOC_CTX *ctx, fr_tls_conf_t *conf)
+{
+	if (!conf->session_cache_max_entries) return 0;
+
+	conf->session_cache_store = tls_cache_store_alloc(ctx, conf->session_cache_max_entries);
+	if (!conf->session_cache_store) return -1;
+
+	return 0;
+}
+
+static inline tls_cache_shard_t *tls_cache_store_shard(tls_cache_store_t *store, uint8_t const *id, size_t id_len)
+{
+	return store->shards[fr_hash(id, id_len) & (TLS_CACHE_STORE_SHARDS - 1)];
+}
+
+/** Remove a session from a shard
+ *
+ * @note Must be called with the shard mutex held.
+ */
+static void tls_cache_store_entry_free(tls_cache_shard_t *shard, tls_cache_store_entry_t *entry)
+{
+	fr_heap_extract(shard->heap, entry);
+	rbtree_deletebydata(shard->tree, entry);
+	talloc_free(entry);
+}
+
+/** Add a serialized session to the in-memory session cache
+ *
+ * @param[in] store	to add the session to.
+ * @param[in] id	of the session.
+ * @param[in] id_len	Length of the session ID.
+ * @param[in] data	Serialized session.
+ * @param[in] data_len	Length of the serialized session.
+ * @param[in] lifetime	How long the session can be resumed for.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+static int tls_cache_store_insert(tls_cache_store_t *store, uint8_t const *id, size_t id_len,
+				  uint8_t const *data, size_t data_len, uint32_t lifetime)
+{
+	tls_cache_shard_t	*shard = tls_cache_store_shard(store, id, id_len);
+	tls_cache_store_entry_t	*entry, find;
+	time_t			now = time(NULL);
+
+	memcpy(&find.id, &id, sizeof(find.id));
+	find.id_len = id_len;
+
+	pthread_mutex_lock(&shard->mutex);
+
+	entry = rbtree_finddata(shard->tree, &find);
+	if (entry) tls_cache_store_entry_free(shard, entry);
+
+	/*
+	 *	Remove expired sessions, then the sessions
+	 *	closest to expiry until there's space.
+	 */
+	while ((entry = fr_heap_peek(shard->heap)) &&
+	       ((entry->expires <= now) || (rbtree_num_elements(shard->tree) >= shard->max_entries))) {
+		tls_cache_store_entry_free(shard, entry);
+	}
+
+	MEM(entry = talloc_zero(shard, tls_cache_store_entry_t));
+	MEM(entry->id = talloc_memdup(entry, id, id_len));
+	entry->id_len = id_len;
+	MEM(entry->data = talloc_memdup(entry, data, data_len));
+	entry->expires = now + lifetime;
+
+	if (!rbtree_insert(shard->tree, entry)) {
+	error:
+		talloc_free(entry);
+		pthread_mutex_unlock(&shard->mutex);
+		return -1;
+	}
+
+	if (fr_heap_insert(shard->heap, entry) < 0) {
+		rbtree_deletebydata(shard->tree, entry);
+		goto error;
+	}
+
+	pthread_mutex_unlock(&shard->mutex);
+
+	return 0;
+}
+
+/** Retrieve a session from the in-memory session cache
+ *
+ * @param[in] store	to retrieve the session from.
+ * @param[in] id	of the session.
+ * @param[in] id_len	Length of the session ID.
+ * @return
+ *	- Deserialized session.
+ *	- NULL if the session wasn't found, or has expired.
+ */
+static SSL_SESSION *tls_cache_store_find(tls_cache_store_t *store, uint8_t const *id, size_t id_len)
+{
+	tls_cache_shard_t	*shard = tls_cache_store_shard(store, id, id_len);
+	tls_cache_store_entry_t	*entry, find;
+	SSL_SESSION		*sess = NULL;
+
+	memcpy(&find.id, &id, sizeof(find.id));
+	find.id_len = id_len;
+
+	pthread_mutex_lock(&shard->mutex);
+	entry = rbtree_finddata(shard->tree, &find);
+	if (entry) {
+		if (entry->expires <= time(NULL)) {
+			tls_cache_store_entry_free(shard, entry);
+		} else {
+			unsigned char const *p = entry->data;
+
+			sess = d2i_SSL_SESSION(NULL, &p, talloc_array_length(entry->data));
+		}
+	}
+	pthread_mutex_unlock(&shard->mutex);
+
+	return sess;
+}
+
+/** Check whether an entry exists in an in-memory store
+ *
+ * @param[in] store	to search.
+ * @param[in] id	of the entry.
+ * @param[in] id_len	Length of the ID.
+ * @return
+ *	- true if the entry exists and hasn't expired.
+ *	- false otherwise.
+ */
+static bool tls_cache_store_exists(tls_cache_store_t *store, uint8_t const *id, size_t id_len)
+{
+	tls_cache_shard_t	*shard = tls_cache_store_shard(store, id, id_len);
+	tls_cache_store_entry_t	*entry, find;
+	bool			found = false;
+
+	memcpy(&find.id, &id, sizeof(find.id));
+	find.id_len = id_len;
+
+	pthread_mutex_lock(&shard->mutex);
+	entry = rbtree_finddata(shard->tree, &find);
+	if (entry) {
+		if (entry->expires <= time(NULL)) {
+			tls_cache_store_entry_free(shard, entry);
+		} else {
+			found = true;
+		}
+	}
+	pthread_mutex_unlock(&shard->mutex);
+
+	return found;
+}
+
+/** Remove a session from the in-memory session cache
+ *
+ * @param[in] store	to remove the session from.
+ * @param[in] id	of the session.
+ * @param[in] id_len	Length of the session ID.
+ */
+static void tls_cache_store_delete(tls_cache_store_t *store, uint8_t const *id, size_t id_len)
+{
+	tls_cache_shard_t	*shard = tls_cache_store_shard(store, id, id_len);
+	tls_cache_store_entry_t	*entry, find;
+
+	memcpy(&find.id, &id, sizeof(find.id));
+	find.id_len = id_len;
+
+	pthread_mutex_lock(&shard->mutex);
+	entry = rbtree_finddata(shard->tree, &find);
+	if (entry) tls_cache_store_entry_free(shard, entry);
+	pthread_mutex_unlock(&shard->mutex);
+}
+
+/** Fill a ticket key with random data
+ *
+ */
+static int tls_ticket_key_generate(tls_ticket_key_t *key, time_t now)
+{
+	if ((RAND_bytes(key->name, sizeof(key->name)) != 1) ||
+	    (RAND_bytes(key->aes_key, sizeof(key->aes_key)) != 1) ||
+	    (RAND_bytes(key->hmac_key, sizeof(key->hmac_key)) != 1)) return -1;
+
+	key->created = now;
+
+	return 0;
+}
+
+static int _tls_ticket_keys_free(tls_ticket_keys_t *keys)
+{
+	OPENSSL_cleanse(keys->keys, sizeof(keys->keys));
+	pthread_mutex_destroy(&keys->mutex);
+
+	return 0;
+}
+
+/** Allocate the keys used to encrypt session tickets
+ *
+ * Does nothing if session tickets are disabled.
+ *
+ * @param[in] ctx	to allocate the keys in.
+ * @param[in] conf	to allocate the keys for.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+int tls_cache_ticket_keys_init(TALLOC_CTX *ctx, fr_tls_conf_t *conf)
+{
+	tls_ticket_keys_t *keys;
+
+	if (!conf->session_tickets) return 0;
+
+#if OPENSSL_VERSION_NUMBER < 0x10101000L
+	ERROR("Session tickets require OpenSSL >= 1.1.1");
+	return -1;
+#endif
+
+	MEM(keys = talloc_zero(ctx, tls_ticket_keys_t));
+	keys->lifetime = conf->session_ticket_key_lifetime;
+
+	/*
+	 *	Tickets are issued at the end of the handshake,
+	 *	before any inner authentication has completed,
+	 *	so we remember which ones were issued to sessions
+	 *	that were eventually authenticated.
+	 */
+	keys->authorised = tls_cache_store_alloc(keys, conf->session_cache_max_entries ?
+						 conf->session_cache_max_entries : TLS_TICKET_AUTHORISED_MAX);
+	if (!keys->authorised) goto error;
+
+	if (tls_ticket_key_generate(&keys->keys[0], time(NULL)) < 0) {
+		tls_log_error(NULL, "Failed generating session ticket key");
+	error:
+		talloc_free(keys);
+		return -1;
+	}
+
+	if (pthread_mutex_init(&keys->mutex, NULL) < 0) {
+		ERROR("Failed initializing mutex: %s", fr_syserror(errno));
+		goto error;
+	}
+	talloc_set_destructor(keys, _tls_ticket_keys_free);
+
+	conf->session_ticket_keys = keys;
+
+	return 0;
+}
+
+/** Encrypt or decrypt a session ticket
+ *
+ * New tickets are encrypted with the current key.  The current key is
+ * replaced every session_ticket_key_lifetime seconds, and retired keys
+ * are kept for decryption, so tickets issued shortly before a rotation
+ * can still be used.
+ *
+ * @param[in] ssl	The current OpenSSL session.
+ * @param[in,out] key_name	Identifies the key used to encrypt the ticket.
+ * @param[in,out] iv	Initialisation vector for the cipher.
+ * @param[in] ectx	Cipher context to initialise.
+ * @param[in] hctx	HMAC context to initialise.
+ * @param[in] enc	Whether we're encrypting a new ticket, or decrypting an existing one.
+ * @return
+ *	- -1 on error.
+ *	- 0 if the ticket was encrypted with an unknown key (full handshake required).
+ *	- 1 on success.
+ *	- 2 if the ticket was decrypted with a retired key (OpenSSL issues a new ticket).
+ */
+static int tls_cache_ticket_key_cb(SSL *ssl, unsigned char key_name[16], unsigned char *iv,
+				   EVP_CIPHER_CTX *ectx, HMAC_CTX *hctx, int enc)
+{
+	fr_tls_conf_t		*conf;
+	tls_ticket_keys_t	*keys;
+	REQUEST			*request;
+	tls_ticket_key_t	key = { .created = 0 };
+	time_t			now = time(NULL);
+	int			i, ret = 1;
+
+	conf = talloc_get_type_abort(SSL_get_ex_data(ssl, FR_TLS_EX_INDEX_CONF), fr_tls_conf_t);
+	request = SSL_get_ex_data(ssl, FR_TLS_EX_INDEX_REQUEST);
+	keys = conf->session_ticket_keys;
+	if (!keys) return -1;
+
+	pthread_mutex_lock(&keys->mutex);
+	if (enc) {
+		if ((now - keys->keys[0].created) >= keys->lifetime) {
+			tls_ticket_key_t new;
+
+			if (tls_ticket_key_generate(&new, now) == 0) {
+				memmove(&keys->keys[1], &keys->keys[0], sizeof(keys->keys[0]) * (TLS_TICKET_KEYS - 1));
+				keys->keys[0] = new;
+				ROPTIONAL(RDEBUG2, DEBUG2, "Rotated session ticket key");
+			} else {
+				ROPTIONAL(RWDEBUG, WARN, "Failed rotating session ticket key, continuing to use "
+					  "the current one");
+			}
+			OPENSSL_cleanse(&new, sizeof(new));
+		}
+		key = keys->keys[0];
+		i = 0;
+	} else {
+		for (i = 0; i < TLS_TICKET_KEYS; i++) {
+			if (!keys->keys[i].created) continue;
+			if (memcmp(keys->keys[i].name, key_name, sizeof(keys->keys[i].name)) == 0) break;
+		}
+		if (i < TLS_TICKET_KEYS) key = keys->keys[i];
+	}
+	pthread_mutex_unlock(&keys->mutex);
+
+	if (enc) {
+		if (RAND_bytes(iv, EVP_MAX_IV_LENGTH) != 1) {
+			ret = -1;
+			goto finish;
+		}
+		memcpy(key_name, key.name, sizeof(key.name));
+
+		if ((EVP_EncryptInit_ex(ectx, EVP_aes_256_cbc(), NULL, key.aes_key, iv) != 1) ||
+		    (HMAC_Init_ex(hctx, key.hmac_key, sizeof(key.hmac_key), EVP_sha256(), NULL) != 1)) ret = -1;
+		goto finish;
+	}
+
+	/*
+	 *	Keys which haven't been used for encryption
+	 *	recently may still be in the list if no
+	 *	tickets have been issued since.
+	 */
+	if ((i == TLS_TICKET_KEYS) || ((now - key.created) >= ((time_t)keys->lifetime * TLS_TICKET_KEYS))) {
+		ROPTIONAL(RDEBUG2, DEBUG2, "Session ticket was encrypted with an unknown or expired key");
+		ret = 0;
+		goto finish;
+	}
+
+	if ((HMAC_Init_ex(hctx, key.hmac_key, sizeof(key.hmac_key), EVP_sha256(), NULL) != 1) ||
+	    (EVP_DecryptInit_ex(ectx, EVP_aes_256_cbc(), NULL, key.aes_key, iv) != 1)) {
+		ret = -1;
+		goto finish;
+	}
+
+	ret = (i == 0) ? 1 : 2;
+
+finish:
+	OPENSSL_cleanse(&key, sizeof(key));
+
+	return ret;
+}
+
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+/** Add an identifier to a new session ticket
+ *
+ * Tickets are issued at the end of the TLS handshake, before any inner
+ * authentication has completed.  We can't tell yet whether the session
+ * should be resumable, so we add an identifier to the ticket, which
+ * tls_cache_write marks as authorised if all phases succeed.
+ *
+ * All tickets issued for the same tls_session carry the same identifier.
+ *
+ * @param[in] ssl	The current OpenSSL session.
+ * @param[in] arg	unused.
+ * @return
+ *	- 1 on success.
+ *	- 0 on failure (aborts the handshake).
+ */
+static int tls_cache_ticket_gen_cb(SSL *ssl, UNUSED void *arg)
+{
+	tls_session_t		*tls_session;
+	REQUEST			*request;
+
+	tls_session = talloc_get_type_abort(SSL_get_ex_data(ssl, FR_TLS_EX_INDEX_TLS_SESSION), tls_session_t);
+	request = SSL_get_ex_data(ssl, FR_TLS_EX_INDEX_REQUEST);
+
+	if (!tls_session->ticket_id) {
+		MEM(tls_session->ticket_id = talloc_array(tls_session, uint8_t, TLS_TICKET_ID_LEN));
+		if (RAND_bytes(tls_session->ticket_id, TLS_TICKET_ID_LEN) != 1) {
+			tls_log_error(request, "Failed generating session ticket ID");
+			TALLOC_FREE(tls_session->ticket_id);
+			return 0;
+		}
+	}
+
+	if (SSL_SESSION_set1_ticket_appdata(SSL_get_session(ssl),
+					    tls_session->ticket_id, talloc_array_length(tls_session->ticket_id)) != 1) {
+		tls_log_error(request, "Failed adding ID to session ticket");
+		return 0;
+	}
+
+	return 1;
+}
+
+/** Decide whether a decrypted session ticket can be used for resumption
+ *
+ * Tickets are only accepted if they were issued to a session which
+ * completed authentication, and resumption was allowed by policy.
+ * The client certificate is re-validated in the same way as sessions
+ * loaded from the cache by tls_cache_read.
+ *
+ * @param[in] ssl		The current OpenSSL session.
+ * @param[in] sess		decrypted from the ticket.
+ * @param[in] key_name		unused.
+ * @param[in] key_name_len	unused.
+ * @param[in] status		of ticket decryption.
+ * @param[in] arg		unused.
+ * @return what OpenSSL should do with the ticket.
+ */
+static SSL_TICKET_RETURN tls_cache_ticket_dec_cb(SSL *ssl, SSL_SESSION *sess,
+						 UNUSED unsigned char const *key_name, UNUSED size_t key_name_len,
+						 SSL_TICKET_STATUS status, UNUSED void *arg)
+{
+	fr_tls_conf_t		*conf;
+	REQUEST			*request;
+	void			*id;
+	size_t			id_len;
+
+	switch (status) {
+	case SSL_TICKET_SUCCESS:
+	case SSL_TICKET_SUCCESS_RENEW:
+		break;
+
+	case SSL_TICKET_EMPTY:
+	case SSL_TICKET_NO_DECRYPT:
+		return SSL_TICKET_RETURN_IGNORE_RENEW;
+
+	case SSL_TICKET_NONE:
+		return SSL_TICKET_RETURN_IGNORE;
+
+	default:
+		return SSL_TICKET_RETURN_ABORT;
+	}
+
+	conf = talloc_get_type_abort(SSL_get_ex_data(ssl, FR_TLS_EX_INDEX_CONF), fr_tls_conf_t);
+	request = SSL_get_ex_data(ssl, FR_TLS_EX_INDEX_REQUEST);
+
+	if ((SSL_SESSION_get0_ticket_appdata(sess, &id, &id_len) != 1) || (id_len == 0) ||
+	    !tls_cache_store_exists(conf->session_ticket_keys->authorised, id, id_len)) {
+		ROPTIONAL(RDEBUG2, DEBUG2, "Session ticket was not issued to an authenticated session, "
+			  "ignoring it");
+		return SSL_TICKET_RETURN_IGNORE_RENEW;
+	}
+
+	if (request && (tls_validate_session_cert_chain(ssl, sess) != 1)) {
+		RWDEBUG("Validation failed, ignoring session ticket");
+		return SSL_TICKET_RETURN_IGNORE_RENEW;
+	}
+
+	return (status == SSL_TICKET_SUCCESS_RENEW) ? SSL_TICKET_RETURN_USE_RENEW : SSL_TICKET_RETURN_USE;
+}
+#endif
+
 /** Write a newly created session data to the tls_session structure
  *
  * @note If you hit an assert in this function, it was likely called twice, which shouldn't happen
@@ -247,6 +855,12 @@ static int tls_cache_serialize(SSL *ssl, SSL_SESSION *sess)
 	}
 	tls_session->session_blob = data;
 
+	/*
+	 *	So tls_cache_delete can find the blob
+	 *	and session ID if the session is denied.
+	 */
+	SSL_SESSION_set_ex_data(sess, FR_TLS_EX_INDEX_TLS_SESSION, tls_session);
+
 	return 0;
 }
 
@@ -276,11 +890,44 @@ int tls_cache_write(REQUEST *request, tls_session_t *tls_session)
 
 	conf = SSL_get_ex_data(tls_session->ssl, FR_TLS_EX_INDEX_CONF);
 
+	/*
+	 *	Allow tickets issued during this session to be
+	 *	used for resumption, now we know all the phases
+	 *	succeeded, unless policy says otherwise.
+	 */
+	if (tls_session->ticket_id && conf->session_ticket_keys) {
+		vp = fr_pair_find_by_num(request->control, 0, FR_ALLOW_SESSION_RESUMPTION, TAG_ANY);
+		if (!tls_session->allow_session_resumption || (vp && (vp->vp_uint32 == 0))) {
+			RDEBUG2("Session resumption disabled, not authorising session ticket");
+		} else if (tls_cache_store_insert(conf->session_ticket_keys->authorised,
+						  tls_session->ticket_id, talloc_array_length(tls_session->ticket_id),
+						  tls_session->ticket_id, talloc_array_length(tls_session->ticket_id),
+						  conf->session_cache_lifetime) < 0) {
+			RWDEBUG("Failed authorising session ticket");
+		} else {
+			RDEBUG2("Authorised session ticket for resumption");
+		}
+	}
+
 	if (!tls_session->session_blob || !tls_session->session_id) {
 		RDEBUG2("No session data available to cache");
 		return 1;
 	}
 
+	if (conf->session_cache_store) {
+		if (tls_cache_store_insert(conf->session_cache_store,
+					   tls_session->session_id, talloc_array_length(tls_session->session_id),
+					   tls_session->session_blob, talloc_array_length(tls_session->session_blob),
+					   conf->session_cache_lifetime) < 0) {
+			RWDEBUG("Failed storing session data in the in-memory session cache");
+			ret = -1;
+		} else {
+			RDEBUG2("Stored session data in the in-memory session cache");
+		}
+	}
+
+	if (!conf->session_cache_server) return ret;
+
 	if (tls_cache_session_id_to_vp(request, tls_session->session_id,
 				       talloc_array_length(tls_session->session_id)) < 0) {
 		RWDEBUG("Failed adding session key to the request");
@@ -354,13 +1001,30 @@ static SSL_SESSION *tls_cache_read(SSL *ssl,
 	request = SSL_get_ex_data(ssl, FR_TLS_EX_INDEX_REQUEST);
 	conf = SSL_get_ex_data(ssl, FR_TLS_EX_INDEX_CONF);
 
+	*copy = 0;
+
+	/*
+	 *	Check the in-memory cache first, so resumption
+	 *	doesn't need a trip through the virtual server.
+	 */
+	if (conf->session_cache_store) {
+		sess = tls_cache_store_find(conf->session_cache_store, key, key_len);
+		if (sess) {
+			RDEBUG2("Found session in the in-memory session cache");
+			goto found;
+		}
+	}
+
+	if (!conf->session_cache_server) {
+		RWDEBUG("No cached session found");
+		return NULL;
+	}
+
 	if (tls_cache_session_id_to_vp(request, key, key_len) < 0) {
 		RWDEBUG("Failed adding session key to the request");
 		return NULL;
 	}
 
-	*copy = 0;
-
 	/*
 	 *	Call the virtual server to read the session
 	 */
@@ -390,6 +1054,8 @@ static SSL_SESSION *tls_cache_read(SSL *ssl,
 	}
 	RDEBUG3("Read %zu bytes of session data.  Session deserialized successfully", vp->vp_length);
 
+found:
+
 	/*
 	 *	OpenSSL's API is very inconsistent.
 	 *
@@ -440,7 +1106,6 @@ static void tls_cache_delete(SSL_CTX *ctx, SSL_SESSION *sess)
 
 	conf = talloc_get_type_abort(SSL_CTX_get_app_data(ctx), fr_tls_conf_t);
 	tls_session = talloc_get_type_abort(SSL_SESSION_get_ex_data(sess, FR_TLS_EX_INDEX_TLS_SESSION), tls_session_t);
-	request = talloc_get_type_abort(SSL_get_ex_data(tls_session->ssl, FR_TLS_EX_INDEX_REQUEST), REQUEST);
 
 	/*
 	 *	Free any previously stored session blobs or data
@@ -449,6 +1114,14 @@ static void tls_cache_delete(SSL_CTX *ctx, SSL_SESSION *sess)
 	TALLOC_FREE(tls_session->session_blob);
 
 	key_len = tls_cache_id(&key, sess);
+	if (conf->session_cache_store && (key_len > 0)) {
+		tls_cache_store_delete(conf->session_cache_store, key, (size_t)key_len);
+	}
+
+	if (!conf->session_cache_server) return;
+
+	request = talloc_get_type_abort(SSL_get_ex_data(tls_session->ssl, FR_TLS_EX_INDEX_REQUEST), REQUEST);
+
 	if (key_len < 0) {
 		RWDEBUG("Session ID buffer too small");
 	error:
@@ -566,16 +1239,24 @@ int tls_cache_disable_cb(SSL *ssl,
  *
  * @param ctx			to modify.
  * @param enabled		Whether session caching should be enabled.
+ * @param tickets		Whether stateless session tickets should be issued.
  * @param lifetime		The maximum period a cached session remains
  *				valid for.
  */
-void tls_cache_init(SSL_CTX *ctx, bool enabled, uint32_t lifetime)
+void tls_cache_init(SSL_CTX *ctx, bool enabled, bool tickets, uint32_t lifetime)
 {
 	if (!enabled) {
 		SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
 		return;
 	}
 
+	if (tickets) {
+		SSL_CTX_set_tlsext_ticket_key_cb(ctx, tls_cache_ticket_key_cb);
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+		SSL_CTX_set_session_ticket_cb(ctx, tls_cache_ticket_gen_cb, tls_cache_ticket_dec_cb, NULL);
+#endif
+	}
+
 	SSL_CTX_sess_set_new_cb(ctx, tls_cache_serialize);
 	SSL_CTX_sess_set_get_cb(ctx, tls_cache_read);
 	SSL_CTX_sess_set_remove_cb(ctx, tls_cache_delete);
@@ -70,6 +70,9 @@ static CONF_PARSER cache_config[] = {
 			 .dflt = "%{EAP-Type}%{Virtual-Server}", .quote = T_DOUBLE_QUOTED_STRING },
 	{ FR_CONF_OFFSET("lifetime", FR_TYPE_UINT32, fr_tls_conf_t, session_cache_lifetime), .dflt = "86400" },
 	{ FR_CONF_OFFSET("verify", FR_TYPE_BOOL, fr_tls_conf_t, session_cache_verify), .dflt = "no" },
+	{ FR_CONF_OFFSET("max_entries", FR_TYPE_UINT32, fr_tls_conf_t, session_cache_max_entries), .dflt = "0" },
+	{ FR_CONF_OFFSET("tickets", FR_TYPE_BOOL, fr_tls_conf_t, session_tickets), .dflt = "no" },
+	{ FR_CONF_OFFSET("ticket_key_lifetime", FR_TYPE_UINT32, fr_tls_conf_t, session_ticket_key_lifetime), .dflt = "3600" },
 
 #if OPENSSL_VERSION_NUMBER >= 0x10100000L
 	{ FR_CONF_OFFSET("require_extended_master_secret", FR_TYPE_BOOL, fr_tls_conf_t, session_cache_require_extms), .dflt = "yes" },
@@ -77,7 +80,6 @@ static CONF_PARSER cache_config[] = {
 #endif
 
 	{ FR_CONF_DEPRECATED("enable", FR_TYPE_BOOL, fr_tls_conf_t, NULL) },
-	{ FR_CONF_DEPRECATED("max_entries", FR_TYPE_UINT32, fr_tls_conf_t, NULL) },
 	{ FR_CONF_DEPRECATED("persist_dir", FR_TYPE_STRING, fr_tls_conf_t, NULL) },
 
 	CONF_PARSER_TERMINATOR
@@ -90,6 +92,14 @@ static CONF_PARSER verify_config[] = {
 };
 
 #ifdef HAVE_OPENSSL_OCSP_H
+static CONF_PARSER ocsp_response_cache_config[] = {
+	{ FR_CONF_OFFSET("max_entries", FR_TYPE_UINT32, fr_tls_ocsp_conf_t, cache_max_entries), .dflt = "0" },
+	{ FR_CONF_OFFSET("lifetime", FR_TYPE_UINT32, fr_tls_ocsp_conf_t, cache_lifetime), .dflt = "300" },
+	{ FR_CONF_OFFSET("refresh", FR_TYPE_UINT32, fr_tls_ocsp_conf_t, cache_refresh), .dflt = "60" },
+
+	CONF_PARSER_TERMINATOR
+};
+
 static CONF_PARSER ocsp_config[] = {
 	{ FR_CONF_OFFSET("enable", FR_TYPE_BOOL, fr_tls_ocsp_conf_t, enable), .dflt = "no" },
 
@@ -101,6 +111,8 @@ static CONF_PARSER ocsp_config[] = {
 	{ FR_CONF_OFFSET("timeout", FR_TYPE_UINT32, fr_tls_ocsp_conf_t, timeout), .dflt = "yes" },
 	{ FR_CONF_OFFSET("softfail", FR_TYPE_BOOL, fr_tls_ocsp_conf_t, softfail), .dflt = "no" },
 
+	{ FR_CONF_POINTER("response_cache", FR_TYPE_SUBSECTION, NULL), .subcs = (void const *) ocsp_response_cache_config },
+
 	CONF_PARSER_TERMINATOR
 };
 #endif
@@ -441,6 +453,14 @@ fr_tls_conf_t *tls_conf_parse_server(CONF_SECTION *cs)
 	conf->ctx_count = fr_tls_max_threads * 2; /* Reduce contention */
 	if (!conf->ctx_count) conf->ctx_count = 1;
 
+	/*
+	 *	Shared by all the contexts, so a session can
+	 *	be resumed whichever context it lands on.
+	 */
+	if (conf->session_ticket_key_lifetime < 60) conf->session_ticket_key_lifetime = 60;
+	if (tls_cache_store_init(conf, conf) < 0) goto error;
+	if (tls_cache_ticket_keys_init(conf, conf) < 0) goto error;
+
 	/*
 	 *	Initialize TLS
 	 */
@@ -464,11 +484,13 @@ fr_tls_conf_t *tls_conf_parse_server(CONF_SECTION *cs)
 	if (conf->ocsp.enable) {
 		conf->ocsp.store = conf_ocsp_revocation_store(conf);
 		if (conf->ocsp.store == NULL) goto error;
+		if (tls_ocsp_response_cache_init(conf, &conf->ocsp) < 0) goto error;
 	}
 
 	if (conf->staple.enable) {
 		conf->staple.store = conf_ocsp_revocation_store(conf);
 		if (conf->staple.store == NULL) goto error;
+		if (tls_ocsp_response_cache_init(conf, &conf->staple) < 0) goto error;
 	}
 #endif /*HAVE_OPENSSL_OCSP_H*/
 
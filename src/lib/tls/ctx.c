@@ -645,7 +645,7 @@ post_ca:
 #endif
 
 #ifdef SSL_OP_NO_TICKET
-	ctx_options |= SSL_OP_NO_TICKET;
+	if (!conf->session_tickets) ctx_options |= SSL_OP_NO_TICKET;
 #endif
 
 	if (!conf->disable_single_dh_use) {
@@ -805,7 +805,8 @@ post_ca:
 	/*
 	 *	Setup session caching
 	 */
-	tls_cache_init(ctx, conf->session_cache_server ? true : false, conf->session_cache_lifetime);
+	tls_cache_init(ctx, (conf->session_cache_server || conf->session_cache_store || conf->session_tickets),
+		       conf->session_tickets, conf->session_cache_lifetime);
 
 	/*
 	 *	Load dh params
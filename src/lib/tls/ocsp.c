@@ -31,6 +31,7 @@ USES_APPLE_DEPRECATED_API	/* OpenSSL API has been deprecated by Apple */
 
 #include <freeradius-devel/radiusd.h>
 #include <freeradius-devel/modules.h>
+#include <freeradius-devel/heap.h>
 #include <freeradius-devel/rad_assert.h>
 #include <openssl/ocsp.h>
 
@@ -48,6 +49,18 @@ typedef enum {
  */
 #define OCSP_MAX_VALIDITY_PERIOD (5 * 60)
 
+/** How long to wait for a background refresh, if no timeout is configured
+ *
+ */
+#define OCSP_CACHE_WAIT_DEFAULT 10
+
+/** Maximum length of a DER encoded OCSP_CERTID
+ *
+ * Two SHA1 hashes and a serial number (at most 20 octets) need less
+ * than half of this.
+ */
+#define OCSP_CACHE_KEY_MAX 256
+
 /** Extract components of OCSP responser URL from a certificate
  *
  * @param[in] cert to extract URL from.
@@ -162,6 +175,618 @@ static int ocsp_staple_to_pair(VALUE_PAIR **out, REQUEST *request, OCSP_RESPONSE
 	return 0;
 }
 
+/** Result of looking up a certificate in the OCSP response cache
+ */
+typedef enum {
+	OCSP_CACHE_MISS = 0,				//!< No usable response.  The caller must query the responder
+							///< and pass the result to ocsp_cache_update().
+	OCSP_CACHE_HIT,					//!< Cached response returned.
+	OCSP_CACHE_HIT_REFRESH,				//!< Cached response returned.  The caller must refresh it
+							///< and pass the result to ocsp_cache_update().
+	OCSP_CACHE_PENDING,				//!< Another request is querying the responder for the
+							///< certificate.  The caller must query the responder
+							///< itself, without updating the cache.
+	OCSP_CACHE_BYPASS				//!< Cache is full.  Query the responder without updating
+							///< the cache.
+} ocsp_cache_rcode_t;
+
+/** A cached OCSP response
+ *
+ */
+typedef struct {
+	uint8_t const		*key;		//!< DER encoded OCSP_CERTID (issuer name hash, issuer
+						///< key hash, and serial number).
+	size_t			key_len;	//!< Length of key.
+
+	uint8_t			*resp;		//!< DER encoded OCSP response.  NULL until the first
+						///< query for the certificate completes.
+	size_t			resp_len;	//!< Length of resp.
+
+	time_t			expires;	//!< nextUpdate from the response, or now + cache_lifetime.
+	time_t			refresh;	//!< When we start refreshing the response.
+	bool			pending;	//!< A query for this certificate is in progress.
+
+	int32_t			heap_id;	//!< Offset used for heap.
+} tls_ocsp_cache_entry_t;
+
+/** In-memory cache of OCSP responses, shared between all threads
+ *
+ * Entries with a response are in both the tree and the heap.  Entries
+ * without a response only exist whilst a query for the certificate
+ * is in progress, and are only in the tree.
+ */
+struct tls_ocsp_cache {
+	rbtree_t		*tree;		//!< Entries keyed by certificate ID.
+	fr_heap_t		*heap;		//!< Entries with responses, ordered by expiry.
+
+	pthread_mutex_t		mutex;		//!< Protect the tree and heap from multiple readers/writers.
+};
+
+/** Compare two entries by certificate ID
+ *
+ */
+static int ocsp_cache_entry_cmp(void const *one, void const *two)
+{
+	tls_ocsp_cache_entry_t const *a = one, *b = two;
+	int ret;
+
+	ret = (a->key_len > b->key_len) - (a->key_len < b->key_len);
+	if (ret != 0) return ret;
+
+	return memcmp(a->key, b->key, a->key_len);
+}
+
+/** Compare two entries by expiry time
+ *
+ */
+static int ocsp_cache_heap_cmp(void const *one, void const *two)
+{
+	tls_ocsp_cache_entry_t const *a = one, *b = two;
+
+	return (a->expires > b->expires) - (a->expires < b->expires);
+}
+
+static int _ocsp_cache_free(tls_ocsp_cache_t *cache)
+{
+	pthread_mutex_destroy(&cache->mutex);
+
+	return 0;
+}
+
+/** Allocate the in-memory OCSP response cache
+ *
+ * Does nothing if the cache is disabled (max_entries = 0).
+ *
+ * @param[in] ctx	to allocate the cache in.
+ * @param[in] conf	to allocate the cache for.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+int tls_ocsp_response_cache_init(TALLOC_CTX *ctx, fr_tls_ocsp_conf_t *conf)
+{
+	tls_ocsp_cache_t *cache;
+
+	if (!conf->cache_max_entries) return 0;
+
+	MEM(cache = talloc_zero(ctx, tls_ocsp_cache_t));
+
+	cache->tree = rbtree_talloc_create(cache, ocsp_cache_entry_cmp, tls_ocsp_cache_entry_t, NULL, 0);
+	if (!cache->tree) {
+		ERROR("Failed creating OCSP response cache");
+	error:
+		talloc_free(cache);
+		return -1;
+	}
+
+	cache->heap = fr_heap_talloc_create(cache, ocsp_cache_heap_cmp, tls_ocsp_cache_entry_t, heap_id);
+	if (!cache->heap) {
+		ERROR("Failed creating heap for the OCSP response cache");
+		goto error;
+	}
+
+	if (pthread_mutex_init(&cache->mutex, NULL) < 0) {
+		ERROR("Failed initializing mutex: %s", fr_syserror(errno));
+		goto error;
+	}
+
+	talloc_set_destructor(cache, _ocsp_cache_free);
+
+	conf->response_cache = cache;
+
+	return 0;
+}
+
+/** Build the cache key for a certificate
+ *
+ * @param[out] out	Where to write the key.
+ * @param[in] outlen	Length of out.
+ * @param[in] certid	to build the key from.
+ * @return
+ *	- Length of the key on success.
+ *	- -1 on failure.
+ */
+static ssize_t ocsp_cache_key(uint8_t *out, size_t outlen, OCSP_CERTID *certid)
+{
+	uint8_t	*p = out;
+	int	len;
+
+	len = i2d_OCSP_CERTID(certid, NULL);
+	if ((len <= 0) || ((size_t)len > outlen)) return -1;
+
+	return i2d_OCSP_CERTID(certid, &p);
+}
+
+/** Remove the response from a cache entry
+ *
+ * @note Must be called with the cache mutex held.
+ *
+ * The entry itself is freed unless a query for the certificate is in
+ * progress, in which case the querier remains responsible for it.
+ */
+static void ocsp_cache_entry_expire(tls_ocsp_cache_t *cache, tls_ocsp_cache_entry_t *entry)
+{
+	if (entry->resp) {
+		fr_heap_extract(cache->heap, entry);
+		TALLOC_FREE(entry->resp);
+		entry->resp_len = 0;
+	}
+
+	if (entry->pending) return;
+
+	rbtree_deletebydata(cache->tree, entry);
+	talloc_free(entry);
+}
+
+/** Make space for a new entry
+ *
+ * @note Must be called with the cache mutex held.
+ *
+ * @return
+ *	- true if there's space for a new entry.
+ *	- false if every entry is waiting on a query.
+ */
+static bool ocsp_cache_evict(tls_ocsp_cache_t *cache, uint32_t max_entries, time_t now)
+{
+	tls_ocsp_cache_entry_t *entry;
+
+	while ((entry = fr_heap_peek(cache->heap)) && (entry->expires <= now)) ocsp_cache_entry_expire(cache, entry);
+
+	if (rbtree_num_elements(cache->tree) < max_entries) return true;
+
+	/*
+	 *	Still full, evict whichever response
+	 *	would have expired first.
+	 */
+	entry = fr_heap_peek(cache->heap);
+	if (!entry) return false;
+	ocsp_cache_entry_expire(cache, entry);
+
+	return (rbtree_num_elements(cache->tree) < max_entries);
+}
+
+/** Find a cached response for a certificate
+ *
+ * If another request is already querying the responder for the same
+ * certificate, and there's no usable cached response, the caller has
+ * to send its own query.  Responses are checked from OpenSSL's
+ * certificate verification callback, where the request can't be
+ * suspended until the other query completes.
+ *
+ * @param[out] out	Where to write the cached response.
+ * @param[in] request	The current request.
+ * @param[in] conf	OCSP configuration holding the cache.
+ * @param[in] key	Certificate ID, as produced by ocsp_cache_key().
+ * @param[in] key_len	Length of key.
+ * @return one of the #ocsp_cache_rcode_t values.
+ */
+static ocsp_cache_rcode_t ocsp_cache_find(OCSP_RESPONSE **out, REQUEST *request, fr_tls_ocsp_conf_t const *conf,
+					  uint8_t const *key, size_t key_len)
+{
+	tls_ocsp_cache_t	*cache = conf->response_cache;
+	tls_ocsp_cache_entry_t	*entry, find = { .key = key, .key_len = key_len };
+	ocsp_cache_rcode_t	rcode;
+	time_t			now;
+
+	now = time(NULL);
+
+	pthread_mutex_lock(&cache->mutex);
+	for (;;) {
+		entry = rbtree_finddata(cache->tree, &find);
+		if (!entry) {
+			if (!ocsp_cache_evict(cache, conf->cache_max_entries, now)) {
+				RWDEBUG("OCSP response cache is full, querying responder directly");
+				rcode = OCSP_CACHE_BYPASS;
+				break;
+			}
+
+			MEM(entry = talloc_zero(cache, tls_ocsp_cache_entry_t));
+			MEM(entry->key = talloc_memdup(entry, key, key_len));
+			entry->key_len = key_len;
+			entry->pending = true;
+			if (!rbtree_insert(cache->tree, entry)) {
+				talloc_free(entry);
+				rcode = OCSP_CACHE_BYPASS;
+				break;
+			}
+
+			RDEBUG2("No cached OCSP response found");
+			rcode = OCSP_CACHE_MISS;
+			break;
+		}
+
+		if (entry->resp && (now < entry->expires)) {
+			uint8_t const *p = entry->resp;
+
+			*out = d2i_OCSP_RESPONSE(NULL, &p, entry->resp_len);
+			if (!*out) {
+				ocsp_cache_entry_expire(cache, entry);
+				continue;
+			}
+
+			/*
+			 *	Only one request starts the refresh,
+			 *	everyone else keeps using the cached
+			 *	response until it completes.
+			 */
+			if ((now >= entry->refresh) && !entry->pending) {
+				entry->pending = true;
+				rcode = OCSP_CACHE_HIT_REFRESH;
+			} else {
+				rcode = OCSP_CACHE_HIT;
+			}
+			RDEBUG2("Found cached OCSP response, expires in %" PRIu64 " seconds",
+				(uint64_t)(entry->expires - now));
+			break;
+		}
+
+		/*
+		 *	Response has expired, and nobody else is
+		 *	fetching a new one.
+		 */
+		if (!entry->pending) {
+			RDEBUG2("Cached OCSP response has expired");
+			ocsp_cache_entry_expire(cache, entry);	/* Frees entry */
+			continue;
+		}
+
+		/*
+		 *	Another request is querying the responder for
+		 *	this certificate.
+		 */
+		rcode = OCSP_CACHE_PENDING;
+		break;
+	}
+	pthread_mutex_unlock(&cache->mutex);
+
+	return rcode;
+}
+
+/** Store the result of a query
+ *
+ * Must be called exactly once for every #OCSP_CACHE_MISS and
+ * #OCSP_CACHE_HIT_REFRESH returned by ocsp_cache_find().
+ *
+ * @param[in] conf	OCSP configuration holding the cache.
+ * @param[in] key	Certificate ID, as produced by ocsp_cache_key().
+ * @param[in] key_len	Length of key.
+ * @param[in] resp	A verified response.  NULL if the query failed.
+ * @param[in] next	nextUpdate time of the response, or 0 if the
+ *			response didn't include one.
+ */
+static void ocsp_cache_update(fr_tls_ocsp_conf_t const *conf, uint8_t const *key, size_t key_len,
+			      OCSP_RESPONSE *resp, time_t next)
+{
+	tls_ocsp_cache_t	*cache = conf->response_cache;
+	tls_ocsp_cache_entry_t	*entry, find = { .key = key, .key_len = key_len };
+	time_t			now;
+	int			len = 0;
+
+	now = time(NULL);
+	if (resp) {
+		if (!next) next = now + conf->cache_lifetime;
+		len = i2d_OCSP_RESPONSE(resp, NULL);
+		if ((next <= now) || (len <= 0)) resp = NULL;
+	}
+
+	pthread_mutex_lock(&cache->mutex);
+	entry = rbtree_finddata(cache->tree, &find);
+	if (!fr_cond_assert(entry && entry->pending)) goto done;
+
+	entry->pending = false;
+
+	/*
+	 *	Query failed.  Keep using the old response
+	 *	until it expires, if there is one.
+	 */
+	if (!resp) {
+		if (!entry->resp) ocsp_cache_entry_expire(cache, entry);
+		goto done;
+	}
+
+	if (entry->resp) {
+		fr_heap_extract(cache->heap, entry);
+		talloc_free(entry->resp);
+	}
+
+	{
+		uint8_t *p;
+
+		MEM(p = entry->resp = talloc_array(entry, uint8_t, len));
+		entry->resp_len = i2d_OCSP_RESPONSE(resp, &p);
+	}
+	entry->expires = next;
+
+	/*
+	 *	Refresh cache_refresh seconds before the response
+	 *	expires, but not before it's half way through its
+	 *	lifetime, so short lived responses aren't refreshed
+	 *	on every use.
+	 */
+	entry->refresh = next - conf->cache_refresh;
+	if (entry->refresh < (now + ((next - now) / 2))) entry->refresh = now + ((next - now) / 2);
+
+	if (fr_heap_insert(cache->heap, entry) < 0) {
+		TALLOC_FREE(entry->resp);
+		ocsp_cache_entry_expire(cache, entry);
+	}
+
+done:
+	pthread_mutex_unlock(&cache->mutex);
+}
+
+#if OPENSSL_VERSION_NUMBER >= 0x1000003f
+/** State for a background refresh of a cached response
+ *
+ */
+typedef struct {
+	fr_tls_ocsp_conf_t const *conf;		//!< Configuration holding the cache.
+
+	fr_event_list_t		*el;		//!< Event list the refresh is running in.
+	fr_event_timer_t const	*ev;		//!< Timeout for the refresh.
+	int			fd;		//!< Connection to the responder.
+
+	BIO			*conn;		//!< Connection to the responder.
+	OCSP_REQ_CTX		*ctx;		//!< Request state.
+	OCSP_REQUEST		*req;		//!< Request being sent.
+	OCSP_CERTID		*certid;	//!< Certificate being refreshed.  Owned by req.
+
+	uint8_t			key[OCSP_CACHE_KEY_MAX];	//!< Cache key of the certificate.
+	size_t			key_len;	//!< Length of key.
+	bool			updated;	//!< Whether we've updated the cache entry.
+} ocsp_refresh_t;
+
+static void _ocsp_refresh_io(fr_event_list_t *el, int fd, int flags, void *uctx);
+static void _ocsp_refresh_error(fr_event_list_t *el, int fd, int flags, int fd_errno, void *uctx);
+
+static int _ocsp_refresh_free(ocsp_refresh_t *refresh)
+{
+	/*
+	 *	Events must be removed before the
+	 *	fd is closed.
+	 */
+	if (refresh->fd >= 0) (void) fr_event_fd_delete(refresh->el, refresh->fd, FR_EVENT_FILTER_IO);
+	(void) fr_event_timer_delete(refresh->el, &refresh->ev);
+
+	if (!refresh->updated) ocsp_cache_update(refresh->conf, refresh->key, refresh->key_len, NULL, 0);
+
+	if (refresh->ctx) OCSP_REQ_CTX_free(refresh->ctx);
+	if (refresh->req) OCSP_REQUEST_free(refresh->req);
+	if (refresh->conn) BIO_free_all(refresh->conn);
+
+	/*
+	 *	We're not in a TLS session, so nothing
+	 *	else will clear the error queue.
+	 */
+	while (ERR_get_error());
+
+	return 0;
+}
+
+/** Wait for the connection to the responder to become readable or writable
+ *
+ * Which one depends on what the last OCSP_sendreq_nbio() call was
+ * waiting for.
+ */
+static int ocsp_refresh_wait(ocsp_refresh_t *refresh)
+{
+	bool want_read = BIO_should_read(refresh->conn);
+
+	return fr_event_fd_insert(refresh, refresh->el, refresh->fd,
+				  want_read ? _ocsp_refresh_io : NULL,
+				  want_read ? NULL : _ocsp_refresh_io,
+				  _ocsp_refresh_error, refresh);
+}
+
+/** Verify a refreshed response, and store it in the cache
+ *
+ */
+static void ocsp_refresh_complete(ocsp_refresh_t *refresh, OCSP_RESPONSE *resp)
+{
+	fr_tls_ocsp_conf_t const	*conf = refresh->conf;
+	OCSP_BASICRESP			*bresp = NULL;
+	ASN1_GENERALIZEDTIME		*rev, *this_update, *next_update;
+	int				status, reason;
+	time_t				next = 0;
+
+	status = OCSP_response_status(resp);
+	if (status != OCSP_RESPONSE_STATUS_SUCCESSFUL) {
+		ERROR("Refresh failed, response status: %s", OCSP_response_status_str(status));
+		return;
+	}
+
+	bresp = OCSP_response_get1_basic(resp);
+	if (!bresp) {
+		ERROR("Refresh failed, no basic response");
+		return;
+	}
+
+	if (conf->use_nonce && (OCSP_check_nonce(refresh->req, bresp) != 1)) {
+		ERROR("Refresh failed, response has wrong nonce value");
+		goto finish;
+	}
+
+	if (OCSP_basic_verify(bresp, NULL, conf->store, 0) != 1) {
+		ERROR("Refresh failed, couldn't verify OCSP basic response");
+		goto finish;
+	}
+
+	if (!OCSP_resp_find_status(bresp, refresh->certid, &status, &reason, &rev, &this_update, &next_update)) {
+		ERROR("Refresh failed, no status found");
+		goto finish;
+	}
+
+	if (!OCSP_check_validity(this_update, next_update, OCSP_MAX_VALIDITY_PERIOD, -1)) {
+		ERROR("Refresh failed, response is outside its validity period");
+		goto finish;
+	}
+
+	if (next_update && (tls_utils_asn1time_to_epoch(&next, next_update) < 0)) {
+		PERROR("Refresh failed, couldn't parse next_update time");
+		goto finish;
+	}
+
+	DEBUG2("Refreshed cached OCSP response, cert status: %s", OCSP_cert_status_str(status));
+	ocsp_cache_update(conf, refresh->key, refresh->key_len, resp, next);
+	refresh->updated = true;
+
+finish:
+	OCSP_BASICRESP_free(bresp);
+}
+
+/** Send the request to, or read the response from, the responder
+ *
+ */
+static void _ocsp_refresh_io(UNUSED fr_event_list_t *el, UNUSED int fd, UNUSED int flags, void *uctx)
+{
+	ocsp_refresh_t	*refresh = talloc_get_type_abort(uctx, ocsp_refresh_t);
+	OCSP_RESPONSE	*resp = NULL;
+
+	switch (OCSP_sendreq_nbio(&resp, refresh->ctx)) {
+	case 1:
+		ocsp_refresh_complete(refresh, resp);
+		OCSP_RESPONSE_free(resp);
+		break;
+
+	case -1:
+		if (BIO_should_retry(refresh->conn) && (ocsp_refresh_wait(refresh) == 0)) return;
+		/* FALL-THROUGH */
+
+	default:
+		ERROR("Refresh failed, couldn't get OCSP response");
+		break;
+	}
+
+	talloc_free(refresh);
+}
+
+static void _ocsp_refresh_error(UNUSED fr_event_list_t *el, UNUSED int fd, UNUSED int flags, int fd_errno, void *uctx)
+{
+	ocsp_refresh_t *refresh = talloc_get_type_abort(uctx, ocsp_refresh_t);
+
+	ERROR("Refresh failed, connection error: %s", fr_syserror(fd_errno));
+	talloc_free(refresh);
+}
+
+static void _ocsp_refresh_timeout(UNUSED fr_event_list_t *el, UNUSED struct timeval *now, void *uctx)
+{
+	ocsp_refresh_t *refresh = talloc_get_type_abort(uctx, ocsp_refresh_t);
+
+	ERROR("Refresh failed, timed out waiting for OCSP response");
+	talloc_free(refresh);
+}
+
+/** Refresh a cached response in the background
+ *
+ * The query runs in the event loop of the current worker, so the
+ * request that triggered the refresh (and any other requests for the
+ * same certificate) continue with the cached response.
+ *
+ * Takes over responsibility for calling ocsp_cache_update(), even if
+ * the refresh can't be started.
+ *
+ * @param[in] request	that triggered the refresh.
+ * @param[in] conf	OCSP configuration holding the cache.
+ * @param[in] certid	of the certificate to refresh the response for.
+ * @param[in] host	of the responder.
+ * @param[in] port	of the responder.
+ * @param[in] path	of the responder.
+ * @param[in] key	Certificate ID, as produced by ocsp_cache_key().
+ * @param[in] key_len	Length of key.
+ */
+static void ocsp_refresh_start(REQUEST *request, fr_tls_ocsp_conf_t const *conf, OCSP_CERTID *certid,
+			       char const *host, char const *port, char const *path,
+			       uint8_t const *key, size_t key_len)
+{
+	ocsp_refresh_t	*refresh;
+	char		host_header[1024];
+	struct timeval	when;
+
+	if (!request->el) {
+		ocsp_cache_update(conf, key, key_len, NULL, 0);
+		return;
+	}
+
+	MEM(refresh = talloc_zero(NULL, ocsp_refresh_t));	/* Not bound to the request, or the shared cache */
+	refresh->conf = conf;
+	refresh->el = request->el;
+	refresh->fd = -1;
+	memcpy(refresh->key, key, key_len);
+	refresh->key_len = key_len;
+	talloc_set_destructor(refresh, _ocsp_refresh_free);
+
+	snprintf(host_header, sizeof(host_header), "%s:%s", host, port);
+
+	refresh->req = OCSP_REQUEST_new();
+	if (!refresh->req) goto error;
+
+	refresh->certid = OCSP_CERTID_dup(certid);
+	if (!refresh->certid) goto error;
+	if (!OCSP_request_add0_id(refresh->req, refresh->certid)) {
+		OCSP_CERTID_free(refresh->certid);
+		goto error;
+	}
+	if (conf->use_nonce) OCSP_request_add1_nonce(refresh->req, NULL, 8);
+
+	refresh->conn = BIO_new_connect(host);
+	if (!refresh->conn) goto error;
+	BIO_set_conn_port(refresh->conn, port);
+	BIO_set_nbio(refresh->conn, 1);
+
+	if ((BIO_do_connect(refresh->conn) <= 0) && !BIO_should_retry(refresh->conn)) goto error;
+	if (BIO_get_fd(refresh->conn, &refresh->fd) < 0) goto error;
+
+	refresh->ctx = OCSP_sendreq_new(refresh->conn, path, NULL, -1);
+	if (!refresh->ctx) goto error;
+
+	if (!OCSP_REQ_CTX_add1_header(refresh->ctx, "Host", host_header) ||
+	    !OCSP_REQ_CTX_set1_req(refresh->ctx, refresh->req)) goto error;
+
+	gettimeofday(&when, NULL);
+	when.tv_sec += conf->timeout ? conf->timeout : OCSP_CACHE_WAIT_DEFAULT;
+	if (fr_event_timer_insert(refresh, refresh->el, &refresh->ev, &when, _ocsp_refresh_timeout, refresh) < 0) {
+		goto error;
+	}
+
+	if (ocsp_refresh_wait(refresh) < 0) goto error;
+
+	RDEBUG2("Refreshing cached OCSP response in the background");
+
+	return;
+
+error:
+	RWDEBUG("Failed starting background refresh of cached OCSP response");
+	talloc_free(refresh);
+}
+#else
+static void ocsp_refresh_start(UNUSED REQUEST *request, fr_tls_ocsp_conf_t const *conf, UNUSED OCSP_CERTID *certid,
+			       UNUSED char const *host, UNUSED char const *port, UNUSED char const *path,
+			       uint8_t const *key, size_t key_len)
+{
+	ocsp_cache_update(conf, key, key_len, NULL, 0);
+}
+#endif
+
 /** Callback used to get stapling data for the current server cert
  *
  * @param ssl	Current SSL session.
@@ -272,6 +897,11 @@ int tls_ocsp_check(REQUEST *request, SSL *ssl,
 	time_t		next;
 	VALUE_PAIR	*vp;
 
+	uint8_t		cache_key[OCSP_CACHE_KEY_MAX];
+	ssize_t		cache_key_len = -1;
+	bool		from_cache = false;	/* resp came from the in-memory cache */
+	bool		cache_update = false;	/* We must pass our result to ocsp_cache_update() */
+
 	if (conf->cache_server) switch (tls_cache_process(request, conf->cache.load)) {
 	case RLM_MODULE_REJECT:
 		REDEBUG("Told to force OCSP validation failure from cached response");
@@ -402,6 +1032,42 @@ int tls_ocsp_check(REQUEST *request, SSL *ssl,
 	}
 	snprintf(host_header, sizeof(host_header), "%s:%s", host, port);
 
+	/*
+	 *	Check the in-memory response cache before
+	 *	going to the network.
+	 */
+	if (conf->response_cache) {
+		cache_key_len = ocsp_cache_key(cache_key, sizeof(cache_key), certid);
+		if (cache_key_len < 0) {
+			RWDEBUG("Failed building OCSP response cache key, not using cache");
+		} else switch (ocsp_cache_find(&resp, request, conf, cache_key, cache_key_len)) {
+		case OCSP_CACHE_HIT_REFRESH:
+			ocsp_refresh_start(request, conf, certid, host, port, path, cache_key, cache_key_len);
+			/* FALL-THROUGH */
+
+		case OCSP_CACHE_HIT:
+			from_cache = true;
+			goto process_response;
+
+		case OCSP_CACHE_MISS:
+			cache_update = true;
+			break;
+
+		/*
+		 *	We can't wait for the other query, so send
+		 *	our own, and leave updating the cache to
+		 *	whoever started the other one.
+		 */
+		case OCSP_CACHE_PENDING:
+			RDEBUG2("Another request is already querying the OCSP responder for this certificate, "
+				"sending our own query");
+			break;
+
+		case OCSP_CACHE_BYPASS:
+			break;
+		}
+	}
+
 	/* Setup BIO socket to OCSP responder */
 	conn = BIO_new_connect(host);
 	BIO_set_conn_port(conn, port);
@@ -472,6 +1138,7 @@ int tls_ocsp_check(REQUEST *request, SSL *ssl,
 	}
 #endif /* OPENSSL_VERSION_NUMBER < 0x1000003f */
 
+process_response:
 	/* Verify OCSP response status */
 	status = OCSP_response_status(resp);
 	if (status != OCSP_RESPONSE_STATUS_SUCCESSFUL) {
@@ -479,13 +1146,20 @@ int tls_ocsp_check(REQUEST *request, SSL *ssl,
 		goto finish;
 	}
 	bresp = OCSP_response_get1_basic(resp);
-	if (conf->use_nonce && OCSP_check_nonce(req, bresp) != 1) {
-		REDEBUG("Response has wrong nonce value");
-		goto finish;
-	}
-	if (OCSP_basic_verify(bresp, NULL, store, 0) != 1){
-		REDEBUG("Couldn't verify OCSP basic response");
-		goto finish;
+
+	/*
+	 *	Cached responses were verified before they were
+	 *	stored, and were sent in reply to a different nonce.
+	 */
+	if (!from_cache) {
+		if (conf->use_nonce && OCSP_check_nonce(req, bresp) != 1) {
+			REDEBUG("Response has wrong nonce value");
+			goto finish;
+		}
+		if (OCSP_basic_verify(bresp, NULL, store, 0) != 1){
+			REDEBUG("Couldn't verify OCSP basic response");
+			goto finish;
+		}
 	}
 
 	/*	Verify OCSP cert status */
@@ -564,6 +1238,15 @@ int tls_ocsp_check(REQUEST *request, SSL *ssl,
 		RDEBUG2("Update time not provided.  Not adding &TLS-OCSP-Next-Update");
 	}
 
+	/*
+	 *	Share the response with anyone else validating
+	 *	this certificate.
+	 */
+	if (cache_update) {
+		ocsp_cache_update(conf, cache_key, cache_key_len, resp, next_update ? next : 0);
+		cache_update = false;
+	}
+
 	switch (status) {
 	case V_OCSP_CERTSTATUS_GOOD:
 		RDEBUG2("Cert status: good");
@@ -654,6 +1337,12 @@ finish:
 		break;
 	}
 
+	/*
+	 *	Query failed, let the next request
+	 *	try for itself.
+	 */
+	if (cache_update) ocsp_cache_update(conf, cache_key, cache_key_len, NULL, 0);
+
 	/* Free OCSP Stuff */
 	OCSP_REQUEST_free(req);
 	OCSP_BASICRESP_free(bresp);
@@ -1467,16 +1467,19 @@ static void session_init(tls_session_t *session)
  *
  * Configures a new client TLS session, configuring options, setting callbacks etc...
  *
+ * The handshake is not started here.  The socket will usually be non-blocking,
+ * so the caller drives the handshake by calling SSL_connect() until it succeeds.
+ *
  * @param ctx 	to alloc session data in. Should usually be NULL unless the lifetime of the
  *		session is tied to another talloc'd object.
  * @param conf	values for this TLS session.
+ * @param fd	of the connected socket the session will use.
  * @return
  *	- A new session on success.
  *	- NULL on error.
  */
-tls_session_t *tls_session_init_client(TALLOC_CTX *ctx, fr_tls_conf_t *conf)
+tls_session_t *tls_session_init_client(TALLOC_CTX *ctx, fr_tls_conf_t *conf, int fd)
 {
-	int		ret;
 	int		verify_mode;
 	tls_session_t	*session = NULL;
 	REQUEST		*request;
@@ -1517,13 +1520,13 @@ tls_session_t *tls_session_init_client(TALLOC_CTX *ctx, fr_tls_conf_t *conf)
 	SSL_set_ex_data(session->ssl, FR_TLS_EX_INDEX_CONF, (void *)conf);
 	SSL_set_ex_data(session->ssl, FR_TLS_EX_INDEX_TLS_SESSION, (void *)session);
 
-	ret = SSL_connect(session->ssl);
-	if (ret <= 0) {
-		tls_log_io_error(NULL, session, ret, "Failed in SSL_connect");
+	if (SSL_set_fd(session->ssl, fd) != 1) {
+		tls_log_error(NULL, "Failed associating socket with TLS session");
 		talloc_free(session);
 
 		return NULL;
 	}
+	SSL_set_connect_state(session->ssl);
 
 	session->mtu = conf->fragment_size;
 
@@ -1734,7 +1737,9 @@ tls_session_t *tls_session_init_server(TALLOC_CTX *ctx, fr_tls_conf_t *conf, REQ
 		session->mtu = vp->vp_uint32;
 	}
 
-	if (conf->session_cache_server) session->allow_session_resumption = true; /* otherwise it's false */
+	if (conf->session_cache_server || conf->session_cache_store || conf->session_tickets) {
+		session->allow_session_resumption = true; /* otherwise it's false */
+	}
 
 	return session;
 }
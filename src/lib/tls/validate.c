@@ -339,26 +339,24 @@ int tls_validate_cert_cb(int ok, X509_STORE_CTX *x509_ctx)
 	return my_ok;
 }
 
-/** Revalidates the client's certificate chain
+/** Validate a certificate chain
  *
  * Wraps the tls_validate_cert_cb callback, allowing us to use the same
  * validation logic whenever we need to.
  *
- * @note Only use so far is forcing the chain to be re-validated on session
- *	resumption.
- *
+ * @param[in] ssl	The current OpenSSL session.
+ * @param[in] cert	to validate.
+ * @param[in] chain	Untrusted intermediaries presented with the certificate.  May be NULL.
  * @return
  *	- 1 if the chain could be validated.
  *	- 0 if the chain failed validation.
  */
-int tls_validate_client_cert_chain(SSL *ssl)
+static int tls_validate_cert_chain(SSL *ssl, X509 *cert, STACK_OF(X509) *chain)
 {
 	int		err;
 	int		verify;
 	int		ret = 1;
 
-	STACK_OF(X509)	*chain;
-	X509		*cert;
 	X509_STORE	*store;
 	X509_STORE_CTX	*store_ctx;
 
@@ -366,14 +364,7 @@ int tls_validate_client_cert_chain(SSL *ssl)
 
 	request = talloc_get_type_abort(SSL_get_ex_data(ssl, FR_TLS_EX_INDEX_REQUEST), REQUEST);
 
-	/*
-	 *	If there's no client certificate, we just return OK.
-	 */
-	cert = SSL_get_peer_certificate(ssl);			/* Increases ref count */
-	if (!cert) return 1;
-
 	store_ctx = X509_STORE_CTX_new();
-	chain = SSL_get_peer_cert_chain(ssl);			/* Does not increase ref count */
 	store = SSL_CTX_get_cert_store(SSL_get_SSL_CTX(ssl));	/* Does not increase ref count */
 
 	X509_STORE_CTX_init(store_ctx, store, cert, chain);
@@ -390,9 +381,54 @@ int tls_validate_client_cert_chain(SSL *ssl)
 		}
 	}
 
-	X509_free(cert);
 	X509_STORE_CTX_free(store_ctx);
 
 	return ret;
 }
+
+/** Revalidates the client's certificate chain
+ *
+ * @note Only use so far is forcing the chain to be re-validated on session
+ *	resumption.
+ *
+ * @return
+ *	- 1 if the chain could be validated.
+ *	- 0 if the chain failed validation.
+ */
+int tls_validate_client_cert_chain(SSL *ssl)
+{
+	int		ret;
+	X509		*cert;
+
+	/*
+	 *	If there's no client certificate, we just return OK.
+	 */
+	cert = SSL_get_peer_certificate(ssl);			/* Increases ref count */
+	if (!cert) return 1;
+
+	ret = tls_validate_cert_chain(ssl, cert, SSL_get_peer_cert_chain(ssl));
+	X509_free(cert);
+
+	return ret;
+}
+
+/** Revalidates the client certificate stored in a session
+ *
+ * Used when resuming a session from a ticket, where the session isn't
+ * yet associated with the SSL.  Only the client certificate is stored
+ * in the session, so any intermediaries must be available locally.
+ *
+ * @return
+ *	- 1 if the certificate could be validated.
+ *	- 0 if the certificate failed validation.
+ */
+int tls_validate_session_cert_chain(SSL *ssl, SSL_SESSION *sess)
+{
+	X509		*cert;
+
+	cert = SSL_SESSION_get0_peer(sess);			/* Does not increase ref count */
+	if (!cert) return 1;
+
+	return tls_validate_cert_chain(ssl, cert, NULL);
+}
 #endif /* WITH_TLS */
@@ -34,6 +34,9 @@ RCSID("$Id$")
 #  include <sys/stat.h>
 #endif
 
+#include <fcntl.h>
+#include <sys/mman.h>
+
 #define MAX_ARGV (16)
 
 
@@ -57,6 +60,7 @@ fr_dict_t	*fr_dict_radius = NULL;		//!< FIXME - Shouldn't be global.
  */
 typedef struct dict_stat_t {
 	struct dict_stat_t *next;
+	char const *filename;
 	struct stat stat_buf;
 } dict_stat_t;
 
@@ -474,13 +478,14 @@ static int dict_enum_value_cmp(void const *one, void const *two)
 
 /** Add an entry to the list of stat buffers.
  */
-static void dict_stat_add(fr_dict_t *dict, struct stat const *stat_buf)
+static void dict_stat_add(fr_dict_t *dict, char const *filename, struct stat const *stat_buf)
 {
 	dict_stat_t *this;
 
 	this = talloc_zero(dict, dict_stat_t);
 	if (!this) return;
 
+	this->filename = talloc_typed_strdup(this, filename);
 	memcpy(&(this->stat_buf), stat_buf, sizeof(this->stat_buf));
 
 	if (!dict->stat_head) {
@@ -1501,80 +1506,40 @@ static inline int dict_attr_child_add(fr_dict_attr_t *parent, fr_dict_attr_t *ch
 	return 0;
 }
 
-/** Add an attribute to the name table for the dictionary.
+/** Insert copies of a combo IP attribute into the polymorphic attribute table
+ *
+ * This allows an abstract attribute type like combo IP to be resolved
+ * to a concrete one later.
  *
  * @param[in] dict		of protocol context we're operating in.
- *				If NULL the internal dictionary will be used.
- * @param[in] da		to add to the name lookup tables.
+ * @param[in] da		to add variants of.
  * @return
  *	- 0 on success.
  *	- -1 on failure.
  */
-static int dict_attr_add_by_name(fr_dict_t *dict, fr_dict_attr_t *da)
+static int dict_attr_combo_add(fr_dict_t *dict, fr_dict_attr_t const *da)
 {
-	/*
-	 *	Insert the attribute, only if it's not a duplicate.
-	 */
-	if (!fr_hash_table_insert(dict->attributes_by_name, da)) {
-		fr_dict_attr_t *a;
-
-		/*
-		 *	If the attribute has identical number, then
-		 *	error out.  We don't allow duplicate attribute
-		 *	definitions.
-		 */
-		a = fr_hash_table_finddata(dict->attributes_by_name, da);
-		if (a && (strcasecmp(a->name, da->name) == 0)) {
-			if ((a->attr != da->attr) || (a->parent != da->parent)) {
-				fr_strerror_printf("Duplicate attribute name");
-			error:
-				return -1;
-			}
-		}
-
-		/*
-		 *	Otherwise the attribute has been redefined later
-		 *	in the dictionary.
-		 *
-		 *	The original fr_dict_attr_t remains in the
-		 *	dictionary but entry in the name hash table is
-		 *	updated to point to the new definition.
-		 */
-		if (!fr_hash_table_replace(dict->attributes_by_name, da)) {
-			fr_strerror_printf("Internal error storing attribute");
-			goto error;
-		}
-	}
-
-	/*
-	 *	Insert copies of the attribute into the
-	 *	polymorphic attribute table.
-	 *
-	 *	This allows an abstract attribute type
-	 *	like combo IP to be resolved to a
-	 *	concrete one later.
-	 */
 	switch (da->type) {
 	case FR_TYPE_COMBO_IP_ADDR:
 	{
 		fr_dict_attr_t *v4, *v6;
 
 		v4 = dict_attr_acopy(dict->pool, da);
-		if (!v4) goto error;
+		if (!v4) return -1;
 		v4->type = FR_TYPE_IPV4_ADDR;
 
 		v6 = dict_attr_acopy(dict->pool, da);
-		if (!v6) goto error;
+		if (!v6) return -1;
 		v6->type = FR_TYPE_IPV6_ADDR;
 
 		if (!fr_hash_table_replace(dict->attributes_combo, v4)) {
 			fr_strerror_printf("Failed inserting IPv4 version of combo attribute");
-			goto error;
+			return -1;
 		}
 
 		if (!fr_hash_table_replace(dict->attributes_combo, v6)) {
 			fr_strerror_printf("Failed inserting IPv6 version of combo attribute");
-			goto error;
+			return -1;
 		}
 		break;
 	}
@@ -1584,21 +1549,21 @@ static int dict_attr_add_by_name(fr_dict_t *dict, fr_dict_attr_t *da)
 		fr_dict_attr_t *v4, *v6;
 
 		v4 = dict_attr_acopy(dict->pool, da);
-		if (!v4) goto error;
+		if (!v4) return -1;
 		v4->type = FR_TYPE_IPV4_PREFIX;
 
 		v6 = dict_attr_acopy(dict->pool, da);
-		if (!v6) goto error;
+		if (!v6) return -1;
 		v6->type = FR_TYPE_IPV6_PREFIX;
 
 		if (!fr_hash_table_replace(dict->attributes_combo, v4)) {
 			fr_strerror_printf("Failed inserting IPv4 version of combo attribute");
-			goto error;
+			return -1;
 		}
 
 		if (!fr_hash_table_replace(dict->attributes_combo, v6)) {
 			fr_strerror_printf("Failed inserting IPv6 version of combo attribute");
-			goto error;
+			return -1;
 		}
 		break;
 	}
@@ -1610,6 +1575,54 @@ static int dict_attr_add_by_name(fr_dict_t *dict, fr_dict_attr_t *da)
 	return 0;
 }
 
+/** Add an attribute to the name table for the dictionary.
+ *
+ * @param[in] dict		of protocol context we're operating in.
+ *				If NULL the internal dictionary will be used.
+ * @param[in] da		to add to the name lookup tables.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+static int dict_attr_add_by_name(fr_dict_t *dict, fr_dict_attr_t *da)
+{
+	/*
+	 *	Insert the attribute, only if it's not a duplicate.
+	 */
+	if (!fr_hash_table_insert(dict->attributes_by_name, da)) {
+		fr_dict_attr_t *a;
+
+		/*
+		 *	If the attribute has identical number, then
+		 *	error out.  We don't allow duplicate attribute
+		 *	definitions.
+		 */
+		a = fr_hash_table_finddata(dict->attributes_by_name, da);
+		if (a && (strcasecmp(a->name, da->name) == 0)) {
+			if ((a->attr != da->attr) || (a->parent != da->parent)) {
+				fr_strerror_printf("Duplicate attribute name");
+			error:
+				return -1;
+			}
+		}
+
+		/*
+		 *	Otherwise the attribute has been redefined later
+		 *	in the dictionary.
+		 *
+		 *	The original fr_dict_attr_t remains in the
+		 *	dictionary but entry in the name hash table is
+		 *	updated to point to the new definition.
+		 */
+		if (!fr_hash_table_replace(dict->attributes_by_name, da)) {
+			fr_strerror_printf("Internal error storing attribute");
+			goto error;
+		}
+	}
+
+	return dict_attr_combo_add(dict, da);
+}
+
 
 /** Add an reference to the dictionary
  *
@@ -3680,7 +3693,12 @@ static fr_dict_t *dict_alloc(TALLOC_CTX *ctx)
 	dict->values_by_alias = fr_hash_table_create(dict, dict_enum_alias_hash, dict_enum_alias_cmp, hash_pool_free);
 	if (!dict->values_by_alias) goto error;
 
-	dict->values_by_da = fr_hash_table_create(dict, dict_enum_value_hash, dict_enum_value_cmp, hash_pool_free);
+	/*
+	 *	The enums are owned by values_by_alias.  Multiple
+	 *	aliases may have the same value, so entries here
+	 *	are replaced, and must not be freed.
+	 */
+	dict->values_by_da = fr_hash_table_create(dict, dict_enum_value_hash, dict_enum_value_cmp, NULL);
 	if (!dict->values_by_da) goto error;
 
 	return dict;
@@ -4470,7 +4488,7 @@ static int _dict_from_file(dict_from_file_ctx_t *ctx,
 	}
 #endif
 
-	dict_stat_add(ctx->dict, &statbuf);
+	dict_stat_add(ctx->dict, fn, &statbuf);
 
 	/*
 	 *	Seed the random pool with data.
@@ -4873,6 +4891,652 @@ static int dict_from_file(fr_dict_t *dict,
 	return _dict_from_file(&ctx, dir_name, filename, src_file, src_line);
 }
 
+/*
+ *	Binary dictionary cache.
+ *
+ *	Parsing the text dictionaries means opening, tokenising and
+ *	validating hundreds of files.  After the dictionaries have
+ *	been parsed we write out the attributes, vendors and enums
+ *	as flat records, and on the next start (or HUP) we mmap the
+ *	cache and insert the records directly.
+ *
+ *	The cache records the modification time and size of every
+ *	file that was read, and is ignored if any of them change.
+ *	It's also tied to the version of the library which wrote it,
+ *	as the attribute flags are stored as-is.
+ */
+#define DICT_CACHE_MAGIC	0x46524443	//!< "FRDC"
+#define DICT_CACHE_VERSION	1
+#define DICT_CACHE_MAX_RECORDS	(1 << 24)	//!< Sanity check for the record counts.
+
+/** Header of the dictionary cache file
+ *
+ * Followed by the file, vendor, attribute and enum records, then the string table.
+ */
+typedef struct {
+	uint32_t		magic;			//!< Must be #DICT_CACHE_MAGIC.
+	uint32_t		version;		//!< Must be #DICT_CACHE_VERSION.
+	uint64_t		lib_magic;		//!< RADIUSD_MAGIC_NUMBER of the library that wrote it.
+	uint32_t		flags_size;		//!< sizeof(fr_dict_attr_flags_t).
+	uint32_t		num_files;		//!< Number of source files.
+	uint32_t		num_vendors;		//!< Number of vendors.
+	uint32_t		num_attrs;		//!< Number of attributes.
+	uint32_t		num_enums;		//!< Number of enum values.
+	uint32_t		strings_len;		//!< Length of the string table.
+} dict_cache_hdr_t;
+
+/** A dictionary file the cache was built from
+ *
+ */
+typedef struct {
+	uint32_t		filename;		//!< Offset of the file name in the string table.
+	uint32_t		pad;
+	int64_t			mtime;			//!< Modification time of the file.
+	int64_t			size;			//!< Size of the file.
+} dict_cache_file_t;
+
+/** A vendor
+ *
+ */
+typedef struct {
+	uint32_t		pen;			//!< Private enterprise number.
+	uint32_t		name;			//!< Offset of the name in the string table.
+	uint8_t			type;			//!< Length of type data.
+	uint8_t			length;			//!< Length of length data.
+	uint8_t			flags;			//!< Vendor flags.
+	uint8_t			by_num;			//!< Vendor is returned by lookups on its PEN.
+} dict_cache_vendor_t;
+
+/** An attribute
+ *
+ * Attributes are written parents first, and in the order they appear in
+ * their parent's child bins.
+ */
+typedef struct {
+	uint32_t		parent;			//!< Index of the parent attribute + 1, or 0 for the root.
+	uint32_t		attr;			//!< Attribute number.
+	uint32_t		type;			//!< Value type.
+	uint32_t		name;			//!< Offset of the name in the string table.
+	fr_dict_attr_flags_t	flags;			//!< Flags.
+	uint8_t			by_name;		//!< Attribute is returned by lookups on its name.
+} dict_cache_attr_t;
+
+/** An enum value
+ *
+ */
+typedef struct {
+	uint32_t		da;			//!< Index of the attribute + 1.
+	uint32_t		alias;			//!< Offset of the alias in the string table.
+	uint32_t		value;			//!< Offset of the network encoded value in the string table.
+	uint32_t		value_len;		//!< Length of the network encoded value.
+	uint8_t			by_value;		//!< Alias is returned by lookups on its value.
+} dict_cache_enum_t;
+
+/** Maps attributes to their record indexes when writing the cache
+ *
+ */
+typedef struct {
+	fr_dict_attr_t const	*da;
+	uint32_t		index;			//!< Index of the attribute + 1.
+} dict_cache_index_t;
+
+/** State for building the cache
+ *
+ */
+typedef struct {
+	fr_dict_t		*dict;			//!< Dictionary we're writing out.
+	fr_hash_table_t		*index;			//!< Attribute record indexes.
+
+	dict_cache_vendor_t	*vendors;
+	uint32_t		num_vendors;
+	bool			by_num;			//!< Which vendors we're currently writing.
+
+	dict_cache_attr_t	*attrs;
+	uint32_t		num_attrs;
+
+	dict_cache_enum_t	*enums;
+	uint32_t		num_enums;
+
+	uint8_t			*strings;		//!< String table.
+	uint32_t		strings_len;		//!< Amount of the string table used.
+
+	bool			failed;			//!< A walker callback failed.
+} dict_cache_build_t;
+
+static uint32_t dict_cache_index_hash(void const *data)
+{
+	dict_cache_index_t const *idx = data;
+
+	return fr_hash(&idx->da, sizeof(idx->da));
+}
+
+static int dict_cache_index_cmp(void const *one, void const *two)
+{
+	dict_cache_index_t const *a = one;
+	dict_cache_index_t const *b = two;
+
+	return (a->da > b->da) - (a->da < b->da);
+}
+
+/** Append data to the string table
+ *
+ * @return
+ *	- The offset of the data.
+ *	- UINT32_MAX on failure.
+ */
+static uint32_t dict_cache_string_add(dict_cache_build_t *build, void const *data, size_t len)
+{
+	uint32_t	offset = build->strings_len;
+	size_t		need = build->strings_len + len;
+
+	if (need >= UINT32_MAX) {
+		fr_strerror_printf("Dictionary cache string table too large");
+		return UINT32_MAX;
+	}
+
+	if (need > talloc_array_length(build->strings)) {
+		uint8_t *strings;
+
+		strings = talloc_realloc(build, build->strings, uint8_t, need * 2);
+		if (!strings) {
+			fr_strerror_printf("Out of memory");
+			return UINT32_MAX;
+		}
+		build->strings = strings;
+	}
+
+	memcpy(build->strings + offset, data, len);
+	build->strings_len = need;
+
+	return offset;
+}
+
+static inline uint32_t dict_cache_name_add(dict_cache_build_t *build, char const *name)
+{
+	return dict_cache_string_add(build, name, strlen(name) + 1);
+}
+
+/** Whether an attribute is one of the cast attributes added by the library
+ *
+ */
+static inline bool dict_cache_attr_is_cast(fr_dict_t const *dict, fr_dict_attr_t const *da)
+{
+	return (da->parent == dict->root) && da->flags.internal &&
+	       (da->attr > FR_CAST_BASE) && (da->attr <= (FR_CAST_BASE + FR_TYPE_MAX));
+}
+
+/** Write records for the children of an attribute, and all their descendents
+ *
+ */
+static int dict_cache_attrs_add(dict_cache_build_t *build, fr_dict_attr_t const *parent, uint32_t parent_index)
+{
+	unsigned int		i;
+	fr_dict_attr_t const	*da;
+
+	if (!parent->children) return 0;
+
+	for (i = 0; i <= UINT8_MAX; i++) {
+		for (da = parent->children[i]; da; da = da->next) {
+			dict_cache_attr_t	*rec;
+			dict_cache_index_t	*idx;
+
+			if (dict_cache_attr_is_cast(build->dict, da)) continue;
+
+			if (da->flags.is_reference) {
+				fr_strerror_printf("Can't cache dictionaries containing references");
+				return -1;
+			}
+
+			if (build->num_attrs == talloc_array_length(build->attrs)) {
+				dict_cache_attr_t *attrs;
+
+				attrs = talloc_realloc(build, build->attrs, dict_cache_attr_t, build->num_attrs * 2);
+				if (!attrs) {
+					fr_strerror_printf("Out of memory");
+					return -1;
+				}
+				build->attrs = attrs;
+			}
+
+			rec = &build->attrs[build->num_attrs++];
+			memset(rec, 0, sizeof(*rec));
+			rec->parent = parent_index;
+			rec->attr = da->attr;
+			rec->type = da->type;
+			rec->flags = da->flags;
+			rec->by_name = (fr_hash_table_finddata(build->dict->attributes_by_name, da) == da);
+			rec->name = dict_cache_name_add(build, da->name);
+			if (rec->name == UINT32_MAX) return -1;
+
+			idx = talloc_zero(build, dict_cache_index_t);
+			if (!idx) {
+				fr_strerror_printf("Out of memory");
+				return -1;
+			}
+			idx->da = da;
+			idx->index = build->num_attrs;
+			if (!fr_hash_table_insert(build->index, idx)) {
+				fr_strerror_printf("Attribute \"%s\" appears twice in the dictionary", da->name);
+				return -1;
+			}
+
+			if (dict_cache_attrs_add(build, da, idx->index) < 0) return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int _dict_cache_vendor_add(void *ctx, void *data)
+{
+	dict_cache_build_t	*build = ctx;
+	fr_dict_vendor_t const	*dv = data;
+	dict_cache_vendor_t	*rec;
+	bool			by_num;
+
+	if (!dv) return 0;
+
+	/*
+	 *	Vendors which aren't returned by PEN lookups
+	 *	are written first, so the remaining ones replace
+	 *	them in the PEN table when they're read back.
+	 */
+	by_num = (fr_hash_table_finddata(build->dict->vendors_by_num, dv) == dv);
+	if (by_num != build->by_num) return 0;
+
+	rec = &build->vendors[build->num_vendors++];
+	memset(rec, 0, sizeof(*rec));
+	rec->pen = dv->pen;
+	rec->type = dv->type;
+	rec->length = dv->length;
+	rec->flags = dv->flags;
+	rec->by_num = by_num;
+	rec->name = dict_cache_name_add(build, dv->name);
+	if (rec->name == UINT32_MAX) {
+		build->failed = true;
+		return 1;
+	}
+
+	return 0;
+}
+
+static int _dict_cache_enum_add(void *ctx, void *data)
+{
+	dict_cache_build_t	*build = ctx;
+	fr_dict_enum_t const	*enumv = data;
+	dict_cache_enum_t	*rec;
+	dict_cache_index_t	*idx, find = { .da = NULL };
+	uint8_t			buffer[1024];
+	ssize_t			slen;
+	size_t			need = 0;
+
+	if (!enumv) return 0;
+
+	find.da = enumv->da;
+	idx = fr_hash_table_finddata(build->index, &find);
+	if (!idx) {
+		fr_strerror_printf("VALUE \"%s\" references an attribute outside of the dictionary", enumv->alias);
+	error:
+		build->failed = true;
+		return 1;
+	}
+
+	slen = fr_value_box_to_network(&need, buffer, sizeof(buffer), enumv->value);
+	if ((slen < 0) || need) {
+		fr_strerror_printf_push("Can't cache VALUE \"%s\"", enumv->alias);
+		goto error;
+	}
+
+	rec = &build->enums[build->num_enums++];
+	memset(rec, 0, sizeof(*rec));
+	rec->da = idx->index;
+	rec->by_value = (fr_hash_table_finddata(build->dict->values_by_da, enumv) == enumv);
+	rec->alias = dict_cache_name_add(build, enumv->alias);
+	if (rec->alias == UINT32_MAX) goto error;
+	rec->value = dict_cache_string_add(build, buffer, slen);
+	if (rec->value == UINT32_MAX) goto error;
+	rec->value_len = slen;
+
+	return 0;
+}
+
+/** Write a binary cache of a dictionary
+ *
+ * The cache is written to a temporary file, which is then renamed, so
+ * processes reading the cache never see a partially written one.
+ *
+ * @param[in] dict	to write out.
+ * @param[in] filename	of the cache.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+static int dict_cache_save(fr_dict_t *dict, char const *filename)
+{
+	dict_cache_build_t	*build;
+	dict_cache_hdr_t	hdr;
+	dict_cache_file_t	*files;
+	dict_stat_t		*this;
+	uint32_t		num_files = 0, i;
+	char			*tmp;
+	FILE			*fp;
+	int			ret = -1;
+
+	build = talloc_zero(NULL, dict_cache_build_t);
+	if (!build) {
+		fr_strerror_printf("Out of memory");
+		return -1;
+	}
+	build->dict = dict;
+
+	for (this = dict->stat_head; this; this = this->next) num_files++;
+
+	build->index = fr_hash_table_create(build, dict_cache_index_hash, dict_cache_index_cmp, NULL);
+	files = talloc_zero_array(build, dict_cache_file_t, num_files);
+	build->vendors = talloc_array(build, dict_cache_vendor_t, fr_hash_table_num_elements(dict->vendors_by_name));
+	build->attrs = talloc_array(build, dict_cache_attr_t, 1024);
+	build->enums = talloc_array(build, dict_cache_enum_t, fr_hash_table_num_elements(dict->values_by_alias));
+	build->strings = talloc_array(build, uint8_t, 64 * 1024);
+	if (!build->index || !files || !build->vendors || !build->attrs || !build->enums || !build->strings) {
+		fr_strerror_printf("Out of memory");
+		goto finish;
+	}
+
+	for (this = dict->stat_head, i = 0; this; this = this->next, i++) {
+		files[i].filename = dict_cache_name_add(build, this->filename);
+		if (files[i].filename == UINT32_MAX) goto finish;
+		files[i].mtime = this->stat_buf.st_mtime;
+		files[i].size = this->stat_buf.st_size;
+	}
+
+	build->by_num = false;
+	(void) fr_hash_table_walk(dict->vendors_by_name, _dict_cache_vendor_add, build);
+	if (build->failed) goto finish;
+
+	build->by_num = true;
+	(void) fr_hash_table_walk(dict->vendors_by_name, _dict_cache_vendor_add, build);
+	if (build->failed) goto finish;
+
+	if (dict_cache_attrs_add(build, dict->root, 0) < 0) goto finish;
+
+	(void) fr_hash_table_walk(dict->values_by_alias, _dict_cache_enum_add, build);
+	if (build->failed) goto finish;
+
+	/*
+	 *	Enum values may be binary, so terminate the
+	 *	string table explicitly.
+	 */
+	if (dict_cache_string_add(build, "", 1) == UINT32_MAX) goto finish;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = DICT_CACHE_MAGIC;
+	hdr.version = DICT_CACHE_VERSION;
+	hdr.lib_magic = RADIUSD_MAGIC_NUMBER;
+	hdr.flags_size = sizeof(fr_dict_attr_flags_t);
+	hdr.num_files = num_files;
+	hdr.num_vendors = build->num_vendors;
+	hdr.num_attrs = build->num_attrs;
+	hdr.num_enums = build->num_enums;
+	hdr.strings_len = build->strings_len;
+
+	tmp = talloc_asprintf(build, "%s.%u", filename, (unsigned int) getpid());
+	fp = fopen(tmp, "w");
+	if (!fp) {
+		fr_strerror_printf("Failed creating dictionary cache \"%s\": %s", tmp, fr_syserror(errno));
+		goto finish;
+	}
+
+	if ((fwrite(&hdr, sizeof(hdr), 1, fp) != 1) ||
+	    (fwrite(files, sizeof(*files), num_files, fp) != num_files) ||
+	    (fwrite(build->vendors, sizeof(*build->vendors), build->num_vendors, fp) != build->num_vendors) ||
+	    (fwrite(build->attrs, sizeof(*build->attrs), build->num_attrs, fp) != build->num_attrs) ||
+	    (fwrite(build->enums, sizeof(*build->enums), build->num_enums, fp) != build->num_enums) ||
+	    (fwrite(build->strings, 1, build->strings_len, fp) != build->strings_len)) {
+		fr_strerror_printf("Failed writing dictionary cache \"%s\": %s", tmp, fr_syserror(errno));
+		fclose(fp);
+		unlink(tmp);
+		goto finish;
+	}
+
+	if (fclose(fp) != 0) {
+		fr_strerror_printf("Failed writing dictionary cache \"%s\": %s", tmp, fr_syserror(errno));
+		unlink(tmp);
+		goto finish;
+	}
+
+	if (rename(tmp, filename) < 0) {
+		fr_strerror_printf("Failed renaming dictionary cache \"%s\" to \"%s\": %s",
+				   tmp, filename, fr_syserror(errno));
+		unlink(tmp);
+		goto finish;
+	}
+
+	ret = 0;
+
+finish:
+	talloc_free(build);
+	return ret;
+}
+
+/** Append a child to a parent, after any children already in its bin
+ *
+ * Unlike #dict_attr_child_add this doesn't sort the bin, the cache
+ * already contains the attributes in the correct order.
+ */
+static inline int dict_attr_child_append(fr_dict_attr_t *parent, fr_dict_attr_t *child)
+{
+	fr_dict_attr_t const * const *bin;
+	fr_dict_attr_t **this;
+
+	child->parent = parent;
+	child->depth = parent->depth + 1;
+
+	if (!parent->children) parent->children = talloc_zero_array(parent, fr_dict_attr_t const *, UINT8_MAX + 1);
+	if (!parent->children) return -1;
+
+	bin = &parent->children[child->attr & 0xff];
+	while (*bin) bin = &(*bin)->next;
+
+	memcpy(&this, &bin, sizeof(this));
+	*this = child;
+
+	return 0;
+}
+
+/** Check a string table offset points to a string
+ *
+ * The string table is always \0 terminated, so any offset within it
+ * is a valid string.
+ */
+static inline bool dict_cache_string_valid(dict_cache_hdr_t const *hdr, uint32_t offset)
+{
+	return offset < hdr->strings_len;
+}
+
+/** Load a dictionary from a binary cache
+ *
+ * The cache is fully validated before the dictionary is modified, so
+ * on a return value of 1 the caller can go on to parse the text
+ * dictionaries.
+ *
+ * @param[in] dict	to insert attributes into.
+ * @param[in] filename	of the cache.
+ * @return
+ *	- 0 if the dictionary was loaded from the cache.
+ *	- 1 if the cache doesn't exist, or is stale.
+ *	- -1 if inserting the cached definitions failed.
+ */
+static int dict_cache_load(fr_dict_t *dict, char const *filename)
+{
+	int				fd, ret = 1;
+	struct stat			cache_stat;
+	uint8_t				*base;
+	size_t				len;
+	dict_cache_hdr_t const		*hdr;
+	dict_cache_file_t const		*files;
+	dict_cache_vendor_t const	*vendors;
+	dict_cache_attr_t const		*attrs;
+	dict_cache_enum_t const		*enums;
+	char const			*strings;
+	struct stat			*file_stats = NULL;
+	fr_dict_attr_t			**das = NULL;
+	uint32_t			i;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0) return 1;
+
+	if ((fstat(fd, &cache_stat) < 0) || !S_ISREG(cache_stat.st_mode) ||
+	    ((size_t) cache_stat.st_size < sizeof(*hdr))) {
+		close(fd);
+		return 1;
+	}
+
+	/*
+	 *	Same rule as the text dictionaries.
+	 */
+#ifdef S_IWOTH
+	if ((cache_stat.st_mode & S_IWOTH) != 0) {
+		close(fd);
+		return 1;
+	}
+#endif
+
+	len = cache_stat.st_size;
+	base = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED) return 1;
+
+	hdr = (dict_cache_hdr_t const *) base;
+	if ((hdr->magic != DICT_CACHE_MAGIC) || (hdr->version != DICT_CACHE_VERSION) ||
+	    (hdr->lib_magic != RADIUSD_MAGIC_NUMBER) || (hdr->flags_size != sizeof(fr_dict_attr_flags_t)) ||
+	    (hdr->num_files > DICT_CACHE_MAX_RECORDS) || (hdr->num_vendors > DICT_CACHE_MAX_RECORDS) ||
+	    (hdr->num_attrs > DICT_CACHE_MAX_RECORDS) || (hdr->num_enums > DICT_CACHE_MAX_RECORDS) ||
+	    (hdr->strings_len == 0)) goto finish;
+
+	if (len != (sizeof(*hdr) +
+		    (sizeof(*files) * (size_t) hdr->num_files) +
+		    (sizeof(*vendors) * (size_t) hdr->num_vendors) +
+		    (sizeof(*attrs) * (size_t) hdr->num_attrs) +
+		    (sizeof(*enums) * (size_t) hdr->num_enums) +
+		    hdr->strings_len)) goto finish;
+
+	files = (dict_cache_file_t const *) (hdr + 1);
+	vendors = (dict_cache_vendor_t const *) (files + hdr->num_files);
+	attrs = (dict_cache_attr_t const *) (vendors + hdr->num_vendors);
+	enums = (dict_cache_enum_t const *) (attrs + hdr->num_attrs);
+	strings = (char const *) (enums + hdr->num_enums);
+
+	if (strings[hdr->strings_len - 1] != '\0') goto finish;
+
+	/*
+	 *	Check none of the source files have changed.
+	 */
+	file_stats = talloc_array(NULL, struct stat, hdr->num_files);
+	if (!file_stats && hdr->num_files) goto finish;
+
+	for (i = 0; i < hdr->num_files; i++) {
+		if (!dict_cache_string_valid(hdr, files[i].filename)) goto finish;
+		if (stat(strings + files[i].filename, &file_stats[i]) < 0) goto finish;
+		if ((file_stats[i].st_mtime != files[i].mtime) || (file_stats[i].st_size != files[i].size)) goto finish;
+	}
+
+	/*
+	 *	Check the records, so we don't fail half way
+	 *	through modifying the dictionary.
+	 */
+	for (i = 0; i < hdr->num_vendors; i++) {
+		if (!dict_cache_string_valid(hdr, vendors[i].name)) goto finish;
+	}
+
+	for (i = 0; i < hdr->num_attrs; i++) {
+		if (!dict_cache_string_valid(hdr, attrs[i].name) ||
+		    (attrs[i].parent > i) || (attrs[i].type >= FR_TYPE_MAX)) goto finish;
+	}
+
+	for (i = 0; i < hdr->num_enums; i++) {
+		if (!dict_cache_string_valid(hdr, enums[i].alias) ||
+		    (enums[i].da == 0) || (enums[i].da > hdr->num_attrs) ||
+		    (enums[i].value > hdr->strings_len) ||
+		    (enums[i].value_len > (hdr->strings_len - enums[i].value))) goto finish;
+	}
+
+	/*
+	 *	Everything after this point modifies the dictionary.
+	 */
+	ret = -1;
+
+	for (i = 0; i < hdr->num_files; i++) dict_stat_add(dict, strings + files[i].filename, &file_stats[i]);
+
+	for (i = 0; i < hdr->num_vendors; i++) {
+		fr_dict_vendor_t const	*dv;
+		fr_dict_vendor_t	*mutable;
+
+		if (dict_vendor_add(dict, strings + vendors[i].name, vendors[i].pen) < 0) goto finish;
+
+		dv = fr_dict_vendor_by_name(dict, strings + vendors[i].name);
+		if (!dv) {
+			fr_strerror_printf("Failed adding vendor \"%s\"", strings + vendors[i].name);
+			goto finish;
+		}
+
+		memcpy(&mutable, &dv, sizeof(mutable));
+		mutable->type = vendors[i].type;
+		mutable->length = vendors[i].length;
+		mutable->flags = vendors[i].flags;
+	}
+
+	das = talloc_array(NULL, fr_dict_attr_t *, hdr->num_attrs);
+	if (!das && hdr->num_attrs) {
+		fr_strerror_printf("Out of memory");
+		goto finish;
+	}
+
+	for (i = 0; i < hdr->num_attrs; i++) {
+		fr_dict_attr_t *parent, *n;
+
+		parent = attrs[i].parent ? das[attrs[i].parent - 1] : dict->root;
+
+		n = dict_attr_alloc(dict->pool, parent, strings + attrs[i].name,
+				    attrs[i].attr, attrs[i].type, &attrs[i].flags);
+		if (!n) goto finish;
+
+		if (attrs[i].by_name && !fr_hash_table_replace(dict->attributes_by_name, n)) {
+			fr_strerror_printf("Failed inserting attribute \"%s\"", n->name);
+			goto finish;
+		}
+
+		if ((dict_attr_combo_add(dict, n) < 0) || (dict_attr_child_append(parent, n) < 0)) goto finish;
+
+		das[i] = n;
+	}
+
+	for (i = 0; i < hdr->num_enums; i++) {
+		fr_dict_attr_t const	*da = das[enums[i].da - 1];
+		fr_value_box_t		value = { .type = FR_TYPE_INVALID };
+		int			rcode;
+
+		if (fr_value_box_from_network(NULL, &value, da->type, NULL,
+					      (uint8_t const *) strings + enums[i].value, enums[i].value_len,
+					      false) < 0) {
+			fr_strerror_printf_push("Invalid VALUE for ATTRIBUTE \"%s\"", da->name);
+			goto finish;
+		}
+
+		rcode = fr_dict_enum_add_alias(da, strings + enums[i].alias, &value, false, enums[i].by_value);
+		fr_value_box_clear(&value);
+		if (rcode < 0) goto finish;
+	}
+
+	ret = 0;
+
+finish:
+	talloc_free(das);
+	talloc_free(file_stats);
+	munmap(base, len);
+
+	return ret;
+}
+
 /** (re)initialize a protocol dictionary
  *
  * Initialize the directory, then fix the attr member of all attributes.
@@ -4891,9 +5555,39 @@ static int dict_from_file(fr_dict_t *dict,
  *	- -1 on failure.
  */
 int fr_dict_from_file(TALLOC_CTX *ctx, fr_dict_t **out, char const *dir, char const *fn, char const *name)
+{
+	return fr_dict_from_file_cached(ctx, out, dir, fn, name, NULL);
+}
+
+/** (re)initialize a protocol dictionary, using a binary cache if it's up to date
+ *
+ * If the cache doesn't exist, or any of the dictionary files it was built
+ * from have changed, the text dictionaries are parsed and the cache is
+ * (re)written.  Failing to write the cache isn't an error.
+ *
+ * @note Dictionaries containing references, or defining other protocols
+ *	are never cached.
+ *
+ * @param[in] ctx		to allocate the dictionary from.
+ * @param[out] out		Where to write a pointer to the new dictionary.
+ *				Will free existing dictionary if files have
+ *				changed and *out is not NULL.
+ * @param[in] dir		to read dictionary files from.
+ * @param[in] fn		file name to read.
+ * @param[in] name		to use for the root attributes.
+ * @param[in] cache_file	to load the dictionary from, or write it to.
+ *				May be NULL, in which case this behaves
+ *				like #fr_dict_from_file.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+int fr_dict_from_file_cached(TALLOC_CTX *ctx, fr_dict_t **out, char const *dir, char const *fn, char const *name,
+			     char const *cache_file)
 {
 	static bool	defined_cast_types;
 	fr_dict_t	*dict;
+	int		num_protocols;
 
 	dict = dict_alloc(ctx);
 	if (!dict) return -1;
@@ -4956,6 +5650,21 @@ int fr_dict_from_file(TALLOC_CTX *ctx, fr_dict_t **out, char const *dir, char co
 		defined_cast_types = true;
 	}
 
+	if (cache_file) {
+		switch (dict_cache_load(dict, cache_file)) {
+		case 0:
+			goto done;
+
+		case 1:
+			break;
+
+		default:
+			goto error;
+		}
+	}
+
+	num_protocols = protocol_by_num ? fr_hash_table_num_elements(protocol_by_num) : 0;
+
 	if (dict_from_file(dict, dir, fn, NULL, 0) < 0) goto error;
 
 	/*
@@ -4994,6 +5703,15 @@ int fr_dict_from_file(TALLOC_CTX *ctx, fr_dict_t **out, char const *dir, char co
 		}
 	}
 
+	/*
+	 *	Attributes in other protocols defined by the
+	 *	dictionary files wouldn't be in the cache.
+	 */
+	if (cache_file && (!protocol_by_num || (fr_hash_table_num_elements(protocol_by_num) == num_protocols))) {
+		(void) dict_cache_save(dict, cache_file);
+	}
+
+done:
 	/*
 	 *	Walk over all of the hash tables to ensure they're
 	 *	initialized.  We do this because the threads may perform
@@ -5367,6 +6085,157 @@ int fr_dict_parse_str(fr_dict_t *dict, char *buf, fr_dict_attr_t const *parent,
 	return -1;
 }
 
+/** State for comparing two dictionaries
+ *
+ */
+typedef struct {
+	fr_dict_t const		*a;
+	fr_dict_t const		*b;
+	bool			failed;
+} dict_cmp_ctx_t;
+
+/** Find the attribute in another dictionary with the same number, under the same parents
+ *
+ */
+static fr_dict_attr_t const *dict_attr_equivalent(fr_dict_t const *dict, fr_dict_attr_t const *da)
+{
+	fr_dict_attr_t const *parent;
+
+	if (!da->parent) return dict->root;
+
+	parent = dict_attr_equivalent(dict, da->parent);
+	if (!parent) return NULL;
+
+	return fr_dict_attr_child_by_num(parent, da->attr);
+}
+
+/** Compare two attributes, and all their descendents
+ *
+ * The library's cast attributes are skipped, as they're only added to the
+ * first dictionary which is loaded.
+ */
+static int dict_attr_cmp(dict_cmp_ctx_t *cmp, fr_dict_attr_t const *a, fr_dict_attr_t const *b)
+{
+	unsigned int i;
+
+	if ((a->attr != b->attr) || (a->type != b->type) || (strcmp(a->name, b->name) != 0) ||
+	    (memcmp(&a->flags, &b->flags, sizeof(a->flags)) != 0)) {
+		fr_strerror_printf("Attribute \"%s\" differs from \"%s\"", a->name, b->name);
+		return -1;
+	}
+
+	if ((fr_hash_table_finddata(cmp->a->attributes_by_name, a) == a) !=
+	    (fr_hash_table_finddata(cmp->b->attributes_by_name, b) == b)) {
+		fr_strerror_printf("Lookups on the name of attribute \"%s\" differ", a->name);
+		return -1;
+	}
+
+	if (!a->children && !b->children) return 0;
+
+	for (i = 0; i <= UINT8_MAX; i++) {
+		fr_dict_attr_t const *p = a->children ? a->children[i] : NULL;
+		fr_dict_attr_t const *q = b->children ? b->children[i] : NULL;
+
+		for (;;) {
+			while (p && dict_cache_attr_is_cast(cmp->a, p)) p = p->next;
+			while (q && dict_cache_attr_is_cast(cmp->b, q)) q = q->next;
+			if (!p || !q) break;
+
+			if (dict_attr_cmp(cmp, p, q) < 0) return -1;
+
+			p = p->next;
+			q = q->next;
+		}
+
+		if (p || q) {
+			fr_strerror_printf("Children of attribute \"%s\" differ", a->name);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int _dict_vendor_cmp(void *ctx, void *data)
+{
+	dict_cmp_ctx_t		*cmp = ctx;
+	fr_dict_vendor_t const	*a = data, *b;
+
+	if (!a) return 0;
+
+	b = fr_dict_vendor_by_name(cmp->b, a->name);
+	if (!b || (a->pen != b->pen) || (a->type != b->type) || (a->length != b->length) ||
+	    (a->flags != b->flags) ||
+	    ((fr_hash_table_finddata(cmp->a->vendors_by_num, a) == a) !=
+	     (fr_hash_table_finddata(cmp->b->vendors_by_num, b) == b))) {
+		fr_strerror_printf("Vendor \"%s\" differs", a->name);
+		cmp->failed = true;
+		return 1;
+	}
+
+	return 0;
+}
+
+static int _dict_enum_cmp(void *ctx, void *data)
+{
+	dict_cmp_ctx_t		*cmp = ctx;
+	fr_dict_enum_t const	*a = data, *b;
+	fr_dict_enum_t		find = { .da = NULL };
+
+	if (!a) return 0;
+
+	find.da = dict_attr_equivalent(cmp->b, a->da);
+	find.alias = a->alias;
+	b = find.da ? fr_hash_table_finddata(cmp->b->values_by_alias, &find) : NULL;
+	if (!b || (fr_value_box_cmp(a->value, b->value) != 0) ||
+	    ((fr_hash_table_finddata(cmp->a->values_by_da, a) == a) !=
+	     (fr_hash_table_finddata(cmp->b->values_by_da, b) == b))) {
+		fr_strerror_printf("VALUE \"%s\" of attribute \"%s\" differs", a->alias, a->da->name);
+		cmp->failed = true;
+		return 1;
+	}
+
+	return 0;
+}
+
+/** Check two dictionaries contain the same vendors, attributes and enum values
+ *
+ * Used to check a dictionary loaded from a binary cache matches the one
+ * parsed from the text dictionaries.
+ *
+ * @param[in] a		first dictionary.
+ * @param[in] b		second dictionary.
+ * @return
+ *	- 0 if the dictionaries are the same.
+ *	- -1 if they differ.  The first difference is available via fr_strerror().
+ */
+int fr_dict_cmp(fr_dict_t const *a, fr_dict_t const *b)
+{
+	dict_cmp_ctx_t cmp = { .a = a, .b = b };
+
+	if ((fr_hash_table_num_elements(a->vendors_by_name) != fr_hash_table_num_elements(b->vendors_by_name)) ||
+	    (fr_hash_table_num_elements(a->vendors_by_num) != fr_hash_table_num_elements(b->vendors_by_num))) {
+		fr_strerror_printf("Number of vendors differs");
+		return -1;
+	}
+
+	(void) fr_hash_table_walk(a->vendors_by_name, _dict_vendor_cmp, &cmp);
+	if (cmp.failed) return -1;
+
+	if (dict_attr_cmp(&cmp, a->root, b->root) < 0) return -1;
+
+	if ((fr_hash_table_num_elements(a->values_by_alias) != fr_hash_table_num_elements(b->values_by_alias)) ||
+	    (fr_hash_table_num_elements(a->values_by_da) != fr_hash_table_num_elements(b->values_by_da))) {
+		fr_strerror_printf("Number of VALUEs differs");
+		return -1;
+	}
+
+	(void) fr_hash_table_walk(a->values_by_alias, _dict_enum_cmp, &cmp);
+	if (cmp.failed) return -1;
+
+	return 0;
+}
+
 /*
  *	[a-zA-Z0-9_-:.]+
  */
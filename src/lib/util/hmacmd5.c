@@ -105,6 +105,126 @@ void fr_hmac_md5(uint8_t digest[MD5_DIGEST_LENGTH], uint8_t const *text, size_t
 	fr_md5_final(digest, &context);	  /* finish up 2nd pass */
 }
 
+/** Derive the inner and outer HMAC-MD5 contexts for a key
+ *
+ * @param[out] hkey	to initialise.
+ * @param[in] key	Pointer to authentication key.
+ * @param[in] key_len	Length of authentication key.
+ */
+void fr_hmac_md5_key_init(fr_hmac_md5_key_t *hkey, uint8_t const *key, size_t key_len)
+{
+	uint8_t k_ipad[64];
+	uint8_t k_opad[64];
+	uint8_t tk[16];
+	int i;
+
+	/* if key is longer than 64 bytes reset it to key=MD5(key) */
+	if (key_len > 64) {
+		fr_md5_calc(tk, key, key_len);
+
+		key = tk;
+		key_len = 16;
+	}
+
+	memset(k_ipad, 0, sizeof(k_ipad));
+	memcpy(k_ipad, key, key_len);
+	memcpy(k_opad, k_ipad, sizeof(k_opad));
+
+	for (i = 0; i < 64; i++) {
+		k_ipad[i] ^= 0x36;
+		k_opad[i] ^= 0x5c;
+	}
+
+	fr_md5_init(&hkey->ipad);
+	fr_md5_update(&hkey->ipad, k_ipad, sizeof(k_ipad));
+
+	fr_md5_init(&hkey->opad);
+	fr_md5_update(&hkey->opad, k_opad, sizeof(k_opad));
+}
+
+/** Calculate HMAC using MD5, with a key initialised by #fr_hmac_md5_key_init
+ *
+ * @param digest Caller digest to be filled in.
+ * @param text Pointer to data stream.
+ * @param text_len length of data stream.
+ * @param hkey Derived authentication key.
+ */
+void fr_hmac_md5_from_key(uint8_t digest[MD5_DIGEST_LENGTH], uint8_t const *text, size_t text_len,
+			  fr_hmac_md5_key_t const *hkey)
+{
+	FR_MD5_CTX context;
+
+	fr_md5_copy(&context, &hkey->ipad);
+	fr_md5_update(&context, text, text_len);
+	fr_md5_final(digest, &context);
+
+	fr_md5_copy(&context, &hkey->opad);
+	fr_md5_update(&context, digest, MD5_DIGEST_LENGTH);
+	fr_md5_final(digest, &context);
+}
+
+/** Calculate multiple independent HMACs using MD5
+ *
+ * Uses #fr_md5_calc_multi to hash the inner, then the outer, pads of
+ * all the messages in parallel.
+ *
+ * @param[in,out] msgs	to authenticate.  The HMAC for each is written to msgs[i].digest.
+ * @param[in] num	Number of messages.
+ */
+void fr_hmac_md5_multi(fr_hmac_md5_multi_t *msgs, size_t num)
+{
+	fr_md5_multi_t	md5[32];
+	uint8_t		k_ipad[32][64];
+	uint8_t		k_opad[32][64];
+	uint8_t		inner[32][MD5_DIGEST_LENGTH];
+	size_t		i, j, batch;
+
+	while (num > 0) {
+		batch = (num > 32) ? 32 : num;
+
+		for (i = 0; i < batch; i++) {
+			uint8_t const	*key = msgs[i].key;
+			size_t		key_len = msgs[i].key_len;
+			uint8_t		tk[16];
+
+			/* if key is longer than 64 bytes reset it to key=MD5(key) */
+			if (key_len > 64) {
+				fr_md5_calc(tk, key, key_len);
+				key = tk;
+				key_len = 16;
+			}
+
+			memset(k_ipad[i], 0, sizeof(k_ipad[i]));
+			memcpy(k_ipad[i], key, key_len);
+			memcpy(k_opad[i], k_ipad[i], sizeof(k_opad[i]));
+
+			for (j = 0; j < 64; j++) {
+				k_ipad[i][j] ^= 0x36;
+				k_opad[i][j] ^= 0x5c;
+			}
+
+			md5[i].in[0] = k_ipad[i];
+			md5[i].inlen[0] = 64;
+			md5[i].in[1] = msgs[i].text;
+			md5[i].inlen[1] = msgs[i].text_len;
+			md5[i].out = inner[i];
+		}
+		fr_md5_calc_multi(md5, batch);
+
+		for (i = 0; i < batch; i++) {
+			md5[i].in[0] = k_opad[i];
+			md5[i].inlen[0] = 64;
+			md5[i].in[1] = inner[i];
+			md5[i].inlen[1] = MD5_DIGEST_LENGTH;
+			md5[i].out = msgs[i].digest;
+		}
+		fr_md5_calc_multi(md5, batch);
+
+		msgs += batch;
+		num -= batch;
+	}
+}
+
 /*
 Test Vectors (Trailing '\0' of a character string not included in test):
 
@@ -269,6 +269,12 @@ void fr_pair_steal(TALLOC_CTX *ctx, VALUE_PAIR *vp)
 {
 	(void) talloc_steal(ctx, vp);
 
+	/*
+	 *	The new ctx may outlive whatever owns a
+	 *	borrowed buffer, so give the VP its own copy.
+	 */
+	(void) fr_pair_value_unborrow(vp);
+
 	/*
 	 *	The DA may be unknown.  If we're stealing the VPs to a
 	 *	different context, copy the unknown DA.  We use the VP
@@ -2345,6 +2351,28 @@ void fr_pair_value_snprintf(VALUE_PAIR *vp, char const *fmt, ...)
 	VP_VERIFY(vp);
 }
 
+/** Copy a borrowed buffer into the VALUE_PAIR, so the VALUE_PAIR owns its value
+ *
+ * Pairs decoded in "zero copy" mode reference the packet they were decoded
+ * from.  This must be called before modifying the value of such a pair in
+ * place.  The fr_pair_value_* functions which replace the value don't need it.
+ *
+ * @param[in,out] vp	to unborrow.  If vp's value isn't borrowed, this is a no-op.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+int fr_pair_value_unborrow(VALUE_PAIR *vp)
+{
+	if (!vp->data.borrowed) return 0;
+
+	if (fr_value_box_unborrow(vp, &vp->data) < 0) return -1;
+
+	VP_VERIFY(vp);
+
+	return 0;
+}
+
 /** Print the value of an attribute to a string
  *
  * @param[out] out Where to write the string.
@@ -2815,7 +2843,7 @@ inline void fr_pair_verify(char const *file, int line, VALUE_PAIR const *vp)
 
 	fr_dict_verify(file, line, vp->da);
 
-	if (vp->vp_ptr) switch (vp->vp_type) {
+	if (vp->vp_ptr && !vp->data.borrowed) switch (vp->vp_type) {
 	case FR_TYPE_OCTETS:
 	{
 		size_t len;
@@ -33,6 +33,10 @@
   #include <net/if.h>
 #endif
 
+#ifdef __linux__
+  #include <linux/if_packet.h>
+#endif
+
 #include <freeradius-devel/pcap.h>
 #include <freeradius-devel/net.h>
 #include <freeradius-devel/rad_assert.h>
@@ -404,6 +408,53 @@ int fr_pcap_apply_filter(fr_pcap_t *pcap, char const *expression)
 	return 0;
 }
 
+/** Add a live capture handle to a fanout group
+ *
+ * All handles on the same interface with the same group ID share the packets received
+ * on that interface.  Packets are distributed by a hash of their addresses and ports,
+ * which the kernel calculates so that both directions of a flow end up on the same handle.
+ *
+ * IP fragments are reassembled before hashing, so they're delivered with the rest of
+ * the flow.
+ *
+ * @param pcap handle to add to the fanout group.  Must be an opened live capture handle.
+ * @param group ID.  Must be unique to the process and interface.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+int fr_pcap_fanout(fr_pcap_t *pcap, uint16_t group)
+{
+#ifdef PACKET_FANOUT
+	int arg;
+
+	if ((pcap->type != PCAP_INTERFACE_IN) && (pcap->type != PCAP_INTERFACE_IN_OUT)) {
+		fr_strerror_printf("Fanout is only supported for live capture handles");
+		return -1;
+	}
+
+	if (!pcap->handle || (pcap->fd < 0)) {
+		fr_strerror_printf("Handle must be opened before joining a fanout group");
+		return -1;
+	}
+
+	arg = group | ((PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG) << 16);
+	if (setsockopt(pcap->fd, SOL_PACKET, PACKET_FANOUT, &arg, sizeof(arg)) < 0) {
+		fr_strerror_printf("Failed joining fanout group %u on \"%s\": %s",
+				   group, pcap->name, fr_syserror(errno));
+		return -1;
+	}
+
+	return 0;
+#else
+	(void) pcap;
+	(void) group;
+
+	fr_strerror_printf("Fanout groups are not supported on this system");
+	return -1;
+#endif
+}
+
 /** Retrieve list of interface names that will be used for capture.
  * Only used for debugging.
  *
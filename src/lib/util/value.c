@@ -236,7 +236,12 @@ inline void fr_value_box_clear(fr_value_box_t *data)
 	switch (data->type) {
 	case FR_TYPE_OCTETS:
 	case FR_TYPE_STRING:
-		TALLOC_FREE(data->datum.ptr);
+		if (data->borrowed) {
+			data->datum.ptr = NULL;
+			data->borrowed = false;
+		} else {
+			TALLOC_FREE(data->datum.ptr);
+		}
 		data->datum.length = 0;
 		break;
 
@@ -274,6 +279,7 @@ static inline void fr_value_box_copy_meta(fr_value_box_t *dst, fr_value_box_t co
 	dst->enumv = src->enumv;
 	dst->type = src->type;
 	dst->tainted = src->tainted;
+	dst->borrowed = false;
 	dst->next = NULL;	/* copy one */
 }
 
@@ -352,7 +358,7 @@ int fr_value_box_cmp(fr_value_box_t const *a, fr_value_box_t const *b)
 		break;
 
 	case FR_TYPE_UINT32:
-		CHECK(int32);
+		CHECK(uint32);
 		break;
 
 	case FR_TYPE_UINT64:
@@ -1251,6 +1257,7 @@ ssize_t fr_value_box_from_network(TALLOC_CTX *ctx,
 	case FR_TYPE_DATE_MICROSECONDS:
 	case FR_TYPE_DATE_NANOSECONDS:
 		memcpy(((uint8_t *)&dst->datum) + fr_value_box_offsets[type], src, len);
+		dst->type = type;		/* fr_value_box_hton() needs to know the type */
 		fr_value_box_hton(dst, dst);	/* Operate in-place */
 		break;
 
@@ -2644,6 +2651,17 @@ void fr_value_box_copy_shallow(TALLOC_CTX *ctx, fr_value_box_t *dst, fr_value_bo
 
 	case FR_TYPE_STRING:
 	case FR_TYPE_OCTETS:
+		/*
+		 *	Borrowed buffers aren't talloced, so we can't
+		 *	add a reference, and the copy is borrowed too.
+		 */
+		if (src->borrowed) {
+			dst->datum.ptr = src->datum.ptr;
+			fr_value_box_copy_meta(dst, src);
+			dst->borrowed = true;
+			break;
+		}
+
 		dst->datum.ptr = ctx && incr_ref ? talloc_reference(ctx, src->datum.ptr) : src->datum.ptr;
 		fr_value_box_copy_meta(dst, src);
 		break;
@@ -2663,6 +2681,11 @@ int fr_value_box_steal(TALLOC_CTX *ctx, fr_value_box_t *dst, fr_value_box_t cons
 {
 	if (!fr_cond_assert(src->type != FR_TYPE_INVALID)) return -1;
 
+	/*
+	 *	We don't own the buffer, so we can't steal it.
+	 */
+	if (src->borrowed) return fr_value_box_copy(ctx, dst, src);
+
 	switch (src->type) {
 	default:
 		return fr_value_box_copy(ctx, dst, src);
@@ -2780,6 +2803,12 @@ int fr_value_box_append_bstr(fr_value_box_t *dst, char const *src, size_t len, b
 		return -1;
 	}
 
+	if (dst->borrowed) {
+		fr_strerror_printf("%s: Boxed value is borrowed, and must be copied before it's modified",
+				   __FUNCTION__);
+		return -1;
+	}
+
 	memcpy(&ptr, &dst->datum.ptr, sizeof(ptr));	/* defeat const */
 	rad_assert(ptr);
 
@@ -3147,6 +3176,64 @@ int fr_value_box_memdup_buffer_shallow(TALLOC_CTX *ctx, fr_value_box_t *dst, fr_
 	return 0;
 }
 
+/** Assign a buffer owned by something else to a box, without copying it
+ *
+ * Used to reference data in a received packet instead of copying it.  The
+ * buffer must not be modified, and must outlive the box.
+ *
+ * The box is marked as borrowed, so #fr_value_box_clear won't free the
+ * buffer, and #fr_value_box_copy, #fr_value_box_steal and
+ * #fr_value_box_unborrow will copy it.
+ *
+ * @param[in] dst 	to assign buffer to.
+ * @param[in] enumv	Aliases for values.
+ * @param[in] src	a buffer.  Need not be talloced.
+ * @param[in] len	of data in the buffer.
+ * @param[in] tainted	Whether the value came from a trusted source.
+ */
+void fr_value_box_memborrow(fr_value_box_t *dst, fr_dict_attr_t const *enumv,
+			    uint8_t const *src, size_t len, bool tainted)
+{
+	dst->type = FR_TYPE_OCTETS;
+	dst->tainted = tainted;
+	dst->borrowed = true;
+	dst->vb_octets = src;
+	dst->datum.length = len;
+	dst->enumv = enumv;
+	dst->next = NULL;
+}
+
+/** Copy a borrowed buffer, so that the box owns its data
+ *
+ * Should be called before the buffer of a borrowed box is modified in place,
+ * or the box is moved somewhere that may outlive the owner of the buffer.
+ *
+ * @param[in] ctx	to allocate the copy in.
+ * @param[in] vb	to unborrow.  If the box isn't borrowed, this is a no-op.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+int fr_value_box_unborrow(TALLOC_CTX *ctx, fr_value_box_t *vb)
+{
+	uint8_t *bin = NULL;
+
+	if (!vb->borrowed) return 0;
+
+	if (vb->datum.length) {
+		bin = talloc_memdup(ctx, vb->vb_octets, vb->datum.length);
+		if (!bin) {
+			fr_strerror_printf("Failed allocating octets buffer");
+			return -1;
+		}
+		talloc_set_type(bin, uint8_t);
+	}
+	vb->vb_octets = bin;
+	vb->borrowed = false;
+
+	return 0;
+}
+
 /** Increment a boxed value
  *
  * Implements safe integer overflow.
@@ -833,6 +833,12 @@ RADCLIENT *client_afrom_cs(TALLOC_CTX *ctx, CONF_SECTION *cs, CONF_SECTION *serv
 		}
 	}
 
+	/*
+	 *	Derive the MD5 state for the secret once, instead
+	 *	of for every packet.
+	 */
+	fr_radius_secret_init(&c->radius_secret, (uint8_t const *) c->secret, talloc_array_length(c->secret) - 1);
+
 #ifdef WITH_TCP
 	if ((c->proto == IPPROTO_TCP) || (c->proto == IPPROTO_IP)) {
 		if ((c->limit.idle_timeout > 0) && (c->limit.idle_timeout < 5))
@@ -884,6 +890,7 @@ RADCLIENT *client_afrom_query(TALLOC_CTX *ctx, char const *identifier, char cons
 	 *	Other values (secret, shortname, nas_type, virtual_server)
 	 */
 	c->secret = talloc_typed_strdup(c, secret);
+	fr_radius_secret_init(&c->radius_secret, (uint8_t const *) c->secret, talloc_array_length(c->secret) - 1);
 	if (shortname) c->shortname = talloc_typed_strdup(c, shortname);
 	if (type) c->nas_type = talloc_typed_strdup(c, type);
 	if (server) c->server = talloc_typed_strdup(c, server);
@@ -1102,6 +1109,11 @@ RADCLIENT *client_clone(TALLOC_CTX *ctx, RADCLIENT const *parent)
 	COPY_FIELD(tls_required);
 #endif
 
+	if (c->secret) {
+		fr_radius_secret_init(&c->radius_secret, (uint8_t const *) c->secret,
+				      talloc_array_length(c->secret) - 1);
+	}
+
 	return c;
 
 	/*
@@ -758,6 +758,309 @@ int cond_eval(REQUEST *request, int modreturn, int depth, fr_cond_t const *c)
 	}
 	return rcode;
 }
+
+/** Convert the result of a three way comparison to the result of an operator
+ *
+ */
+static inline int cond_cmp_result(FR_TOKEN op, int compare)
+{
+	switch (op) {
+	case T_OP_CMP_EQ:
+		return (compare == 0);
+
+	case T_OP_NE:
+		return (compare != 0);
+
+	case T_OP_LT:
+		return (compare < 0);
+
+	case T_OP_GT:
+		return (compare > 0);
+
+	case T_OP_LE:
+		return (compare <= 0);
+
+	case T_OP_GE:
+		return (compare >= 0);
+
+	default:
+		return -1;
+	}
+}
+
+#define CMP_FUNC(_type, _field) \
+static int cond_cmp_##_type(FR_TOKEN op, fr_value_box_t const *a, fr_value_box_t const *b) \
+{ \
+	return cond_cmp_result(op, (a->_field > b->_field) - (a->_field < b->_field)); \
+}
+
+CMP_FUNC(bool, vb_bool)
+CMP_FUNC(uint8, vb_uint8)
+CMP_FUNC(uint16, vb_uint16)
+CMP_FUNC(uint32, vb_uint32)
+CMP_FUNC(uint64, vb_uint64)
+CMP_FUNC(int8, vb_int8)
+CMP_FUNC(int16, vb_int16)
+CMP_FUNC(int32, vb_int32)
+CMP_FUNC(int64, vb_int64)
+CMP_FUNC(size, vb_size)
+CMP_FUNC(date, vb_date)
+
+/** Compare strings or octets, with the same ordering as fr_value_box_cmp()
+ *
+ */
+static int cond_cmp_variable(FR_TOKEN op, fr_value_box_t const *a, fr_value_box_t const *b)
+{
+	size_t	length;
+	int	compare;
+
+	/*
+	 *	Most comparisons are for equality, and most
+	 *	values differ in length.
+	 */
+	if (((op == T_OP_CMP_EQ) || (op == T_OP_NE)) && (a->datum.length != b->datum.length)) {
+		return (op == T_OP_NE);
+	}
+
+	length = (a->datum.length < b->datum.length) ? a->datum.length : b->datum.length;
+	if (length) {
+		compare = memcmp(a->vb_octets, b->vb_octets, length);
+		if (compare != 0) return cond_cmp_result(op, compare);
+	}
+
+	return cond_cmp_result(op, (a->datum.length > b->datum.length) - (a->datum.length < b->datum.length));
+}
+
+/** Return a comparison function specialised for a data type
+ *
+ * Types without a specialised function use fr_value_box_cmp_op().
+ *
+ * @param[in] type of both operands.
+ * @return the comparison function.
+ */
+fr_cond_cmp_t cond_cmp_func(fr_type_t type)
+{
+	switch (type) {
+	case FR_TYPE_STRING:
+	case FR_TYPE_OCTETS:
+		return cond_cmp_variable;
+
+	case FR_TYPE_BOOL:
+		return cond_cmp_bool;
+
+	case FR_TYPE_UINT8:
+		return cond_cmp_uint8;
+
+	case FR_TYPE_UINT16:
+		return cond_cmp_uint16;
+
+	case FR_TYPE_UINT32:
+		return cond_cmp_uint32;
+
+	case FR_TYPE_UINT64:
+		return cond_cmp_uint64;
+
+	case FR_TYPE_INT8:
+		return cond_cmp_int8;
+
+	case FR_TYPE_INT16:
+		return cond_cmp_int16;
+
+	case FR_TYPE_INT32:
+		return cond_cmp_int32;
+
+	case FR_TYPE_INT64:
+		return cond_cmp_int64;
+
+	case FR_TYPE_SIZE:
+		return cond_cmp_size;
+
+	case FR_TYPE_DATE:
+		return cond_cmp_date;
+
+	default:
+		return fr_value_box_cmp_op;
+	}
+}
+
+/** Compare all instances of an attribute to a pre-cast literal
+ *
+ * @return
+ *	- < 0 on failure, or if the attribute wasn't found.
+ *	- 0 for "no match".
+ *	- 1 for "match".
+ */
+static int cond_eval_cmp(REQUEST *request, fr_cond_inst_t const *inst)
+{
+	int		rcode;
+	VALUE_PAIR	*vp;
+	fr_cursor_t	cursor;
+
+	for (vp = tmpl_cursor_init(&rcode, &cursor, request, inst->lhs);
+	     vp;
+	     vp = fr_cursor_next(&cursor)) {
+		fr_value_box_t	lhs_cast;
+
+		if (!inst->cast) {
+			rcode = inst->cmp(inst->op, &vp->data, &inst->rhs);
+			if (rcode != 0) break;
+			continue;
+		}
+
+		if (fr_value_box_cast(request, &lhs_cast, inst->cast->type, inst->cast, &vp->data) < 0) {
+			RPEDEBUG("Failed casting lhs operand");
+			return -1;
+		}
+		rcode = inst->cmp(inst->op, &lhs_cast, &inst->rhs);
+		fr_value_box_clear(&lhs_cast);
+		if (rcode != 0) break;
+	}
+
+	return rcode;
+}
+
+/** Compare all instances of an attribute to all instances of another attribute
+ *
+ * @return
+ *	- < 0 on failure, or if either attribute wasn't found.
+ *	- 0 for "no match".
+ *	- 1 for "match".
+ */
+static int cond_eval_cmp_attr(REQUEST *request, fr_cond_inst_t const *inst)
+{
+	int		rcode;
+	VALUE_PAIR	*vp, *rhs;
+	fr_cursor_t	cursor, rhs_cursor;
+
+	for (vp = tmpl_cursor_init(&rcode, &cursor, request, inst->lhs);
+	     vp;
+	     vp = fr_cursor_next(&cursor)) {
+		fr_value_box_t const	*lhs = &vp->data;
+		fr_value_box_t		lhs_cast = { .type = FR_TYPE_INVALID };
+
+		if (inst->cast) {
+			if (fr_value_box_cast(request, &lhs_cast, inst->cast->type, inst->cast, &vp->data) < 0) {
+				RPEDEBUG("Failed casting lhs operand");
+				return -1;
+			}
+			lhs = &lhs_cast;
+		}
+
+		for (rhs = tmpl_cursor_init(&rcode, &rhs_cursor, request, inst->rhs_attr);
+		     rhs;
+		     rhs = fr_cursor_next(&rhs_cursor)) {
+			rcode = inst->cmp(inst->op, lhs, &rhs->data);
+			if (rcode != 0) break;
+		}
+		fr_value_box_clear(&lhs_cast);
+		if (rcode != 0) break;
+	}
+
+	return rcode;
+}
+
+#ifdef HAVE_REGEX
+/** Match all instances of a string attribute against a pre-compiled regex
+ *
+ * @return
+ *	- < 0 on failure, or if the attribute wasn't found.
+ *	- 0 for "no match".
+ *	- 1 for "match".
+ */
+static int cond_eval_regex(REQUEST *request, fr_cond_inst_t const *inst)
+{
+	int		rcode;
+	VALUE_PAIR	*vp;
+	fr_cursor_t	cursor;
+
+	for (vp = tmpl_cursor_init(&rcode, &cursor, request, inst->lhs);
+	     vp;
+	     vp = fr_cursor_next(&cursor)) {
+		rcode = cond_do_regex(request, inst->c, &vp->data, NULL);
+		if (rcode != 0) break;
+	}
+
+	return rcode;
+}
+#endif
+
+/** Evaluate a condition which has been compiled to a #fr_cond_prog_t
+ *
+ * Produces the same results as cond_eval() on the condition the
+ * program was compiled from.
+ *
+ * @param[in] request the REQUEST
+ * @param[in] modreturn the previous module return code
+ * @param[in] prog the compiled condition
+ * @return
+ *	- -1 on failure.
+ *	- -2 on attribute not found.
+ *	- 0 for "no match".
+ *	- 1 for "match".
+ */
+int cond_eval_prog(REQUEST *request, int modreturn, fr_cond_prog_t const *prog)
+{
+	int			i = 0;
+	int			rcode;
+	fr_cond_inst_t const	*inst;
+
+	while (i >= 0) {
+		rad_assert(i < prog->num_insts);
+		inst = &prog->inst[i];
+
+		switch (inst->type) {
+		case COND_INST_TRUE:
+			rcode = 1;
+			break;
+
+		case COND_INST_FALSE:
+			rcode = 0;
+			break;
+
+		case COND_INST_RCODE:
+			rcode = (inst->modcode == modreturn);
+			break;
+
+		case COND_INST_EXISTS:
+			rcode = (tmpl_find_vp(NULL, request, inst->vpt) == 0);
+			break;
+
+		case COND_INST_TMPL:
+			rcode = cond_eval_tmpl(request, modreturn, 0, inst->vpt);
+			/* Existence checks are special, because we expect them to fail */
+			if (rcode < 0) rcode = 0;
+			break;
+
+		case COND_INST_CMP:
+			rcode = cond_eval_cmp(request, inst);
+			break;
+
+		case COND_INST_CMP_ATTR:
+			rcode = cond_eval_cmp_attr(request, inst);
+			break;
+
+#ifdef HAVE_REGEX
+		case COND_INST_REGEX:
+			rcode = cond_eval_regex(request, inst);
+			break;
+#endif
+
+		case COND_INST_MAP:
+			rcode = cond_eval_map(request, modreturn, 0, inst->c);
+			break;
+
+		default:
+			EVAL_DEBUG("FAIL %d", __LINE__);
+			return -1;
+		}
+
+		if (rcode < 0) return rcode;
+
+		i = rcode ? inst->on_true : inst->on_false;
+	}
+
+	return (i == COND_JUMP_TRUE);
+}
 #endif
 
 
@@ -684,7 +684,8 @@ int main_config_init(void)
 	 *	the ones in raddb.
 	 */
 	DEBUG2("Including dictionary file \"%s/%s\"", main_config.dictionary_dir, FR_DICTIONARY_FILE);
-	if (fr_dict_from_file(NULL, &main_config.dict, main_config.dictionary_dir, FR_DICTIONARY_FILE, "radius") != 0) {
+	if (fr_dict_from_file_cached(NULL, &main_config.dict, main_config.dictionary_dir, FR_DICTIONARY_FILE, "radius",
+				     main_config.dictionary_cache) != 0) {
 		fr_log_perror(&default_log, L_ERR, "Failed to initialize the dictionaries");
 		return -1;
 	}
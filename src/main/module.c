@@ -34,6 +34,9 @@ RCSID("$Id$")
 #include <freeradius-devel/unlang.h>
 
 static _Thread_local rbtree_t *module_thread_inst_tree;
+static _Thread_local module_thread_instance_t **module_thread_inst_array;
+
+static uint32_t module_instance_num = 0;	//!< Number of module instances bootstrapped so far.
 
 static TALLOC_CTX *instance_ctx = NULL;
 
@@ -381,6 +384,7 @@ int modules_free(void)
 	 *	Free instances first, then dynamic libraries.
 	 */
 	TALLOC_FREE(instance_ctx);
+	module_instance_num = 0;
 
 	return 0;
 }
@@ -458,10 +462,9 @@ module_instance_t *module_find_with_method(rlm_components_t *method, CONF_SECTIO
  */
 module_thread_instance_t *module_thread_instance_find(module_instance_t *mi)
 {
-	rbtree_t			*tree = module_thread_inst_tree;
-	module_thread_instance_t	find = { .mod_inst = mi->dl_inst->data };
+	rad_assert(mi->number < talloc_array_length(module_thread_inst_array));
 
-	return rbtree_finddata(tree, &find);
+	return module_thread_inst_array[mi->number];
 }
 
 /** Retrieve module/thread specific instance data for a module
@@ -516,6 +519,7 @@ static int _module_thread_inst_tree_cmp(void const *a, void const *b)
 
 typedef struct {
 	rbtree_t	*tree;		//!< Containing the thread instances.
+	module_thread_instance_t **array;	//!< Thread instances indexed by module instance number.
 	fr_event_list_t *el;		//!< Event list for this thread.
 } _thread_intantiate_ctx_t;
 
@@ -564,6 +568,7 @@ static int _module_thread_instantiate(void *instance, void *ctx)
 	}
 
 	rbtree_insert(thread_inst_ctx->tree, ti);
+	thread_inst_ctx->array[mi->number] = ti;
 
 	return 0;
 }
@@ -594,11 +599,23 @@ int modules_thread_instantiate(TALLOC_CTX *ctx, CONF_SECTION *root, fr_event_lis
 							    	   _module_thread_instance_free, 0));
 	}
 
+	/*
+	 *	Module instance numbers are dense, so the thread
+	 *	instances can be found with a single array lookup,
+	 *	instead of a tree search on every module call.
+	 */
+	if (!module_thread_inst_array) {
+		MEM(module_thread_inst_array = talloc_zero_array(ctx, module_thread_instance_t *,
+								 module_instance_num));
+	}
+
 	uctx.el = el;
 	uctx.tree = module_thread_inst_tree;
+	uctx.array = module_thread_inst_array;
 
 	if (cf_data_walk(modules, module_instance_t, _module_thread_instantiate, &uctx) < 0) {
 		TALLOC_FREE(module_thread_inst_tree);
+		TALLOC_FREE(module_thread_inst_array);
 		return -1;
 	}
 
@@ -847,6 +864,7 @@ static module_instance_t *module_bootstrap(CONF_SECTION *modules, CONF_SECTION *
 	}
 
 	mi->name = talloc_typed_strdup(mi, inst_name);
+	mi->number = module_instance_num++;
 
 	/*
 	 *	Remember the module for later.
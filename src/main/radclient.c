@@ -91,6 +91,13 @@ static void NEVER_RETURNS usage(void)
 	fprintf(stderr, "                         If a second file is provided, it will be used to verify responses\n");
 	fprintf(stderr, "  -F                     Print the file name, packet number and reply code.\n");
 	fprintf(stderr, "  -h                     Print usage help information.\n");
+	fprintf(stderr, "  -J <file>              With -L, write the results as JSON to file ('-' for stdout).\n");
+	fprintf(stderr, "  -L <schedule>          Generate load, instead of sending each packet once.  <schedule> is one of:\n");
+	fprintf(stderr, "                           constant,<pps>,<seconds>\n");
+	fprintf(stderr, "                           ramp,<start pps>,<end pps>,<seconds>\n");
+	fprintf(stderr, "                           step,<start pps>,<increment pps>,<seconds per step>,<steps>\n");
+	fprintf(stderr, "                         Packets from the input files are sent in rotation.  Latency is\n");
+	fprintf(stderr, "                         measured from when each packet was scheduled to be sent.\n");
 	fprintf(stderr, "  -n <num>               Send N requests/s\n");
 	fprintf(stderr, "  -p <num>               Send 'num' packets from a file in parallel.\n");
 	fprintf(stderr, "  -q                     Do not print anything out.\n");
@@ -98,6 +105,7 @@ static void NEVER_RETURNS usage(void)
 	fprintf(stderr, "  -s                     Print out summary information of auth results.\n");
 	fprintf(stderr, "  -S <file>              read secret from file, not command line.\n");
 	fprintf(stderr, "  -t <timeout>           Wait 'timeout' seconds before retrying (may be a floating point number).\n");
+	fprintf(stderr, "  -T <threads>           With -L, the number of threads sending packets.\n");
 	fprintf(stderr, "  -v                     Show program version information.\n");
 	fprintf(stderr, "  -x                     Debugging mode.\n");
 
@@ -801,6 +809,32 @@ static void deallocate_id(rc_request_t *request)
 	if (request->reply) fr_radius_free(&request->reply);
 }
 
+/*
+ *	Update the password attributes from Cleartext-Password.
+ */
+static void password_update(rc_request_t *request)
+{
+	VALUE_PAIR *vp;
+
+	if (!request->password) return;
+
+	if ((vp = fr_pair_find_by_num(request->packet->vps, 0, FR_USER_PASSWORD, TAG_ANY)) != NULL) {
+		fr_pair_value_strcpy(vp, request->password->vp_strvalue);
+
+	} else if ((vp = fr_pair_find_by_num(request->packet->vps, 0, FR_CHAP_PASSWORD, TAG_ANY)) != NULL) {
+		uint8_t buffer[17];
+
+		fr_radius_encode_chap_password(buffer, request->packet, fr_rand() & 0xff, request->password);
+		fr_pair_value_memcpy(vp, buffer, 17);
+
+	} else if (fr_pair_find_by_num(request->packet->vps, 0, FR_MS_CHAP_PASSWORD, TAG_ANY) != NULL) {
+		mschapv1_encode(request->packet, &request->packet->vps, request->password->vp_strvalue);
+
+	} else {
+		DEBUG("WARNING: No password in the request");
+	}
+}
+
 /*
  *	Send one packet.
  */
@@ -874,25 +908,7 @@ static int send_one_packet(rc_request_t *request)
 		 *	Update the password, so it can be encrypted with the
 		 *	new authentication vector.
 		 */
-		if (request->password) {
-			VALUE_PAIR *vp;
-
-			if ((vp = fr_pair_find_by_num(request->packet->vps, 0, FR_USER_PASSWORD, TAG_ANY)) != NULL) {
-				fr_pair_value_strcpy(vp, request->password->vp_strvalue);
-
-			} else if ((vp = fr_pair_find_by_num(request->packet->vps, 0, FR_CHAP_PASSWORD, TAG_ANY)) != NULL) {
-				uint8_t buffer[17];
-
-				fr_radius_encode_chap_password(buffer, request->packet, fr_rand() & 0xff, request->password);
-				fr_pair_value_memcpy(vp, buffer, 17);
-
-			} else if (fr_pair_find_by_num(request->packet->vps, 0, FR_MS_CHAP_PASSWORD, TAG_ANY) != NULL) {
-				mschapv1_encode(request->packet, &request->packet->vps, request->password->vp_strvalue);
-
-			} else {
-				DEBUG("WARNING: No password in the request");
-			}
-		}
+		password_update(request);
 
 		request->timestamp = time(NULL);
 		request->tries = 1;
@@ -1072,7 +1088,7 @@ static int recv_one_packet(int wait_time)
 	/*
 	 *	If this fails, we're out of memory.
 	 */
-	if (fr_radius_packet_decode(request->reply, request->packet, RADIUS_MAX_ATTRIBUTES, false, secret) != 0) {
+	if (fr_radius_packet_decode(request->reply, request->packet, RADIUS_MAX_ATTRIBUTES, false, false, secret) != 0) {
 		REDEBUG("Reply decode failed");
 		stats.lost++;
 		goto packet_done;
@@ -1142,6 +1158,39 @@ fr_radius_free(&request->reply);
 	return 0;
 }
 
+/*
+ *	Encode each request once, for the load generator.  The ID
+ *	and authenticators are filled in as each copy is sent.
+ */
+static rc_load_template_t *load_templates(TALLOC_CTX *ctx, size_t *num)
+{
+	rc_request_t		*this;
+	rc_load_template_t	*templates;
+	size_t			i = 0;
+
+	for (this = request_head; this != NULL; this = this->next) i++;
+
+	templates = talloc_zero_array(ctx, rc_load_template_t, i);
+	if (!templates) return NULL;
+
+	for (this = request_head, i = 0; this != NULL; this = this->next, i++) {
+		this->packet->id = 0;
+		password_update(this);
+
+		if (fr_radius_packet_encode(this->packet, NULL, secret) < 0) {
+			ERROR("Failed encoding request %" PRIu64 " in file %s", this->num, this->files->packets);
+			talloc_free(templates);
+			return NULL;
+		}
+
+		templates[i].data = this->packet->data;
+		templates[i].data_len = this->packet->data_len;
+	}
+
+	*num = i;
+	return templates;
+}
+
 int main(int argc, char **argv)
 {
 	int		c;
@@ -1155,6 +1204,9 @@ int main(int argc, char **argv)
 	rc_request_t	*this;
 	int		force_af = AF_UNSPEC;
 	fr_dict_t	*dict = NULL;
+	char const	*load_schedule = NULL;
+	char const	*load_json = NULL;
+	uint32_t	load_threads = 1;
 
 	/*
 	 *	It's easier having two sets of flags to set the
@@ -1180,7 +1232,7 @@ int main(int argc, char **argv)
 		exit(1);
 	}
 
-	while ((c = getopt(argc, argv, "46c:d:D:f:Fhn:p:qr:sS:t:vx"
+	while ((c = getopt(argc, argv, "46c:d:D:f:FhJ:L:n:p:qr:sS:t:T:vx"
 #ifdef WITH_TCP
 		"P:"
 #endif
@@ -1232,6 +1284,14 @@ int main(int argc, char **argv)
 			print_filename = true;
 			break;
 
+		case 'J':
+			load_json = optarg;
+			break;
+
+		case 'L':
+			load_schedule = optarg;
+			break;
+
 		case 'n':
 			persec = atoi(optarg);
 			if (persec <= 0) usage();
@@ -1316,6 +1376,12 @@ int main(int argc, char **argv)
 			timeout = atof(optarg);
 			break;
 
+		case 'T':
+			if (!isdigit((int) *optarg)) usage();
+			load_threads = atoi(optarg);
+			if ((load_threads == 0) || (load_threads > 256)) usage();
+			break;
+
 		case 'v':
 			fr_debug_lvl = 1;
 			DEBUG("%s", radclient_version);
@@ -1472,6 +1538,51 @@ int main(int argc, char **argv)
 		}
 	}
 
+	/*
+	 *	Generate load, instead of sending each packet until
+	 *	it's done.
+	 */
+	if (load_schedule) {
+		rc_load_config_t	config;
+		int			rcode;
+
+		memset(&config, 0, sizeof(config));
+
+		if (server_ipaddr.af == AF_UNSPEC) {
+			ERROR("A server address must be given with -L");
+			exit(1);
+		}
+
+		if (rc_load_schedule_parse(&config.schedule, load_schedule) < 0) {
+			ERROR("Invalid -L");
+			usage();
+		}
+
+		config.num_threads = load_threads;
+		config.src_ipaddr = client_ipaddr;
+		config.dst_ipaddr = server_ipaddr;
+		config.dst_port = server_port;
+		config.secret = secret;
+		config.timeout = timeout;
+		config.json_file = load_json;
+		config.do_output = do_output;
+
+		config.templates = load_templates(NULL, &config.num_templates);
+		if (!config.templates) exit(1);
+
+		rcode = rc_load_run(&config);
+		if (rcode < 0) ERROR("Load generation failed");
+
+		talloc_free(config.templates);
+		fr_packet_list_free(packet_list);
+		while (request_head) TALLOC_FREE(request_head);
+		talloc_free(filename_tree);
+		talloc_free(dict);
+		talloc_free(secret);
+
+		exit((rcode == 0) ? 0 : 1);
+	}
+
 	/*
 	 *	Walk over the packets to send, until
 	 *	we're all done.
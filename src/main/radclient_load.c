@@ -0,0 +1,961 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file main/radclient_load.c
+ * @brief Open-loop load generator for radclient.
+ *
+ * Packets are sent according to a schedule, and not in response to
+ * replies.  Every packet has an intended send time, and latency is
+ * measured from that time.  If the sender falls behind (e.g. because
+ * all IDs are in use), the delay is counted against the server, instead
+ * of being hidden by sending fewer packets.
+ *
+ * Each sender thread has its own sockets, and sends the packets
+ * whose number modulo the number of threads is its own.  Packets are
+ * sent and received in batches with sendmmsg() / recvmmsg() where
+ * available, and signed / verified with fr_radius_sign_multi() and
+ * fr_radius_verify_multi().
+ *
+ * @copyright 2018  The FreeRADIUS server project
+ */
+
+RCSID("$Id$")
+
+#include <freeradius-devel/radclient.h>
+#include <freeradius-devel/radius/radius.h>
+
+#ifdef HAVE_PTHREAD_H
+#  include <pthread.h>
+#endif
+
+#include <poll.h>
+#include <sys/uio.h>
+
+#define USEC			(1000000)
+
+#define RC_LOAD_SOCKETS		(8)		//!< Sockets per thread, each with 256 IDs.
+#define RC_LOAD_BATCH		RADIUS_BATCH_MAX
+
+/*
+ *	Latencies are recorded in microseconds, in a log-linear
+ *	histogram.  Values below 2^HIST_SUB_BITS are exact.  Above
+ *	that, each power of two is split into 2^(HIST_SUB_BITS - 1)
+ *	buckets, which gives a resolution of better than 1%.
+ */
+#define HIST_SUB_BITS		(8)
+#define HIST_SUB_COUNT		(1 << HIST_SUB_BITS)
+#define HIST_HALF_COUNT		(1 << (HIST_SUB_BITS - 1))
+#define HIST_MAX_SHIFT		(32)
+#define HIST_NUM_BUCKETS	(HIST_SUB_COUNT + (HIST_MAX_SHIFT * HIST_HALF_COUNT))
+
+typedef struct rc_histogram {
+	uint64_t		count[HIST_NUM_BUCKETS];
+	uint64_t		total;		//!< Number of values recorded.
+	uint64_t		sum;		//!< Sum of the values.
+	uint64_t		min;		//!< Smallest value.
+	uint64_t		max;		//!< Largest value.
+} rc_histogram_t;
+
+typedef struct rc_load_stats {
+	uint64_t		sent;		//!< Packets sent.
+	uint64_t		received;	//!< Valid replies.
+	uint64_t		accepted;	//!< Access-Accept, Accounting-Response, CoA-ACK, Disconnect-ACK.
+	uint64_t		rejected;	//!< Access-Reject, CoA-NAK, Disconnect-NAK, Protocol-Error.
+	uint64_t		challenged;	//!< Access-Challenge.
+	uint64_t		lost;		//!< No reply within the timeout.
+	uint64_t		invalid;	//!< Malformed replies, or replies which failed verification.
+	uint64_t		send_errors;	//!< Packets which could not be sent.
+	uint64_t		late;		//!< Packets sent more than 1ms after their intended time.
+} rc_load_stats_t;
+
+typedef struct rc_load_outstanding {
+	uint64_t		intended;	//!< When the packet should have been sent.
+	uint64_t		sent;		//!< When the packet was sent.
+	uint8_t			vector[AUTH_VECTOR_LEN];	//!< Request authenticator, after signing.
+	uint8_t			code;		//!< Packet code.
+	bool			used;		//!< Whether the ID is in use.
+} rc_load_outstanding_t;
+
+typedef struct rc_load_socket {
+	int			fd;
+	int			num_free;	//!< Number of free IDs.
+	int			next_id;	//!< Where to start looking for a free ID.
+	rc_load_outstanding_t	id[256];
+} rc_load_socket_t;
+
+typedef struct rc_load rc_load_t;
+
+typedef struct rc_load_thread {
+	rc_load_t		*load;
+	uint32_t		num;		//!< Thread number.
+#ifdef HAVE_PTHREAD_H
+	pthread_t		pthread_id;
+#endif
+
+	rc_load_socket_t	sockets[RC_LOAD_SOCKETS];
+	int			cur_socket;	//!< Socket we're currently sending on.
+
+	uint64_t		next;		//!< Number of the next packet to send.
+	uint64_t		outstanding;	//!< Packets waiting for a reply.
+
+	uint8_t			*buffers;	//!< Send and receive buffers, RC_LOAD_BATCH of them.
+
+	rc_load_stats_t		stats;
+	rc_histogram_t		hist;
+} rc_load_thread_t;
+
+struct rc_load {
+	rc_load_config_t const	*config;
+	fr_radius_secret_t	secret;
+
+	uint64_t		start;		//!< When the test started.
+	uint64_t		total;		//!< Total number of packets to send.
+	uint64_t		timeout;	//!< Reply timeout, in microseconds.
+	size_t			buflen;		//!< Size of each send / receive buffer.
+
+	rc_load_thread_t	*threads;
+};
+
+static uint64_t load_now(void)
+{
+	struct timespec ts;
+
+	(void) clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((uint64_t) ts.tv_sec * USEC) + (ts.tv_nsec / 1000);
+}
+
+static void hist_add(rc_histogram_t *hist, uint64_t value)
+{
+	int	msb, shift;
+	size_t	idx;
+
+	if (value < HIST_SUB_COUNT) {
+		idx = value;
+	} else {
+		msb = 63 - __builtin_clzll(value);
+		shift = msb - HIST_SUB_BITS + 1;
+		if (shift > HIST_MAX_SHIFT) {
+			idx = HIST_NUM_BUCKETS - 1;
+		} else {
+			idx = HIST_SUB_COUNT + ((shift - 1) * HIST_HALF_COUNT) + ((value >> shift) - HIST_HALF_COUNT);
+		}
+	}
+
+	hist->count[idx]++;
+	hist->sum += value;
+	if (!hist->total || (value < hist->min)) hist->min = value;
+	if (value > hist->max) hist->max = value;
+	hist->total++;
+}
+
+/** The value in the middle of a histogram bucket
+ *
+ */
+static uint64_t hist_value(size_t idx)
+{
+	int shift;
+
+	if (idx < HIST_SUB_COUNT) return idx;
+
+	idx -= HIST_SUB_COUNT;
+	shift = (idx / HIST_HALF_COUNT) + 1;
+
+	return ((uint64_t) ((idx % HIST_HALF_COUNT) + HIST_HALF_COUNT) << shift) + ((((uint64_t) 1) << shift) >> 1);
+}
+
+static void hist_merge(rc_histogram_t *out, rc_histogram_t const *in)
+{
+	size_t i;
+
+	if (!in->total) return;
+
+	for (i = 0; i < HIST_NUM_BUCKETS; i++) out->count[i] += in->count[i];
+
+	if (!out->total || (in->min < out->min)) out->min = in->min;
+	if (in->max > out->max) out->max = in->max;
+	out->sum += in->sum;
+	out->total += in->total;
+}
+
+static uint64_t hist_percentile(rc_histogram_t const *hist, double percentile)
+{
+	uint64_t	want, seen = 0;
+	size_t		i;
+
+	if (!hist->total) return 0;
+
+	want = (uint64_t) ((percentile / 100.0) * hist->total);
+	if (want < 1) want = 1;
+
+	for (i = 0; i < HIST_NUM_BUCKETS; i++) {
+		seen += hist->count[i];
+		if (seen >= want) break;
+	}
+
+	if (i == HIST_NUM_BUCKETS) return hist->max;
+
+	/*
+	 *	The bucket midpoint may be outside of what we
+	 *	actually saw.
+	 */
+	if (hist_value(i) > hist->max) return hist->max;
+	if (hist_value(i) < hist->min) return hist->min;
+
+	return hist_value(i);
+}
+
+/** Parse a load schedule
+ *
+ * The schedule is one of:
+ *
+ *  - constant,<pps>,<seconds>
+ *  - ramp,<start pps>,<end pps>,<seconds>
+ *  - step,<start pps>,<increment pps>,<seconds per step>,<steps>
+ *
+ * @param[out] out	schedule to fill in.
+ * @param[in] spec	to parse.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+int rc_load_schedule_parse(rc_load_schedule_t *out, char const *spec)
+{
+	char		type[16];
+	double		a = 0, b = 0, c = 0;
+	unsigned int	steps = 0;
+	int		n;
+
+	memset(out, 0, sizeof(*out));
+
+	if (sscanf(spec, "%15[a-z],", type) != 1) {
+		fr_strerror_printf("Invalid load schedule \"%s\"", spec);
+		return -1;
+	}
+
+	if (strcmp(type, "constant") == 0) {
+		n = sscanf(spec, "constant,%lf,%lf", &a, &c);
+		if ((n != 2) || (a <= 0) || (c <= 0)) {
+			fr_strerror_printf("Expected \"constant,<pps>,<seconds>\"");
+			return -1;
+		}
+		out->type = RC_LOAD_CONSTANT;
+
+	} else if (strcmp(type, "ramp") == 0) {
+		n = sscanf(spec, "ramp,%lf,%lf,%lf", &a, &b, &c);
+		if ((n != 3) || (a < 0) || (b < 0) || ((a + b) <= 0) || (c <= 0)) {
+			fr_strerror_printf("Expected \"ramp,<start pps>,<end pps>,<seconds>\"");
+			return -1;
+		}
+		out->type = RC_LOAD_RAMP;
+
+	} else if (strcmp(type, "step") == 0) {
+		n = sscanf(spec, "step,%lf,%lf,%lf,%u", &a, &b, &c, &steps);
+		if ((n != 4) || (a < 0) || (c <= 0) || (steps == 0) ||
+		    ((a + (b * (steps - 1))) < 0) || ((a <= 0) && (b <= 0))) {
+			fr_strerror_printf("Expected \"step,<start pps>,<increment pps>,<seconds per step>,<steps>\"");
+			return -1;
+		}
+		out->type = RC_LOAD_STEP;
+
+	} else {
+		fr_strerror_printf("Unknown load schedule \"%s\"", type);
+		return -1;
+	}
+
+	out->rate = a;
+	out->rate_end = b;
+	out->duration = c;
+	out->steps = steps;
+
+	return 0;
+}
+
+static double schedule_duration(rc_load_schedule_t const *s)
+{
+	if (s->type == RC_LOAD_STEP) return s->duration * s->steps;
+
+	return s->duration;
+}
+
+static uint64_t schedule_total(rc_load_schedule_t const *s)
+{
+	double		total = 0;
+	uint32_t	i;
+
+	switch (s->type) {
+	case RC_LOAD_CONSTANT:
+		total = s->rate * s->duration;
+		break;
+
+	case RC_LOAD_RAMP:
+		total = ((s->rate + s->rate_end) / 2) * s->duration;
+		break;
+
+	case RC_LOAD_STEP:
+		for (i = 0; i < s->steps; i++) total += (s->rate + (s->rate_end * i)) * s->duration;
+		break;
+	}
+
+	return (uint64_t) total;
+}
+
+/** When packet number "k" should be sent, in seconds from the start of the test
+ *
+ */
+static double schedule_time(rc_load_schedule_t const *s, uint64_t k)
+{
+	double		n = k;
+	double		lo, hi, mid, slope;
+	uint32_t	i;
+	int		j;
+
+	switch (s->type) {
+	case RC_LOAD_CONSTANT:
+		return n / s->rate;
+
+	/*
+	 *	The number of packets sent by time t is
+	 *	rate * t + slope * t^2 / 2.  It's monotonic, so we
+	 *	just search for the time.
+	 */
+	case RC_LOAD_RAMP:
+		slope = (s->rate_end - s->rate) / s->duration;
+		lo = 0;
+		hi = s->duration;
+		for (j = 0; j < 48; j++) {
+			mid = (lo + hi) / 2;
+			if (((s->rate * mid) + (slope * mid * mid / 2)) < n) {
+				lo = mid;
+			} else {
+				hi = mid;
+			}
+		}
+		return hi;
+
+	case RC_LOAD_STEP:
+		for (i = 0; i < s->steps; i++) {
+			double rate = s->rate + (s->rate_end * i);
+			double count = rate * s->duration;
+
+			if (rate <= 0) continue;
+
+			if (n < count) return (i * s->duration) + (n / rate);
+			n -= count;
+		}
+		break;
+	}
+
+	return schedule_duration(s);
+}
+
+static char const *schedule_name(rc_load_schedule_t const *s)
+{
+	switch (s->type) {
+	case RC_LOAD_CONSTANT:
+		return "constant";
+
+	case RC_LOAD_RAMP:
+		return "ramp";
+
+	case RC_LOAD_STEP:
+		return "step";
+	}
+
+	return "unknown";
+}
+
+/** Send a batch of packets on one socket
+ *
+ * @return the number of packets sent, or -1 on error.
+ */
+static int load_send_batch(int fd, struct iovec *iov, int num)
+{
+#ifdef MSG_WAITFORONE
+	struct mmsghdr	msgs[RC_LOAD_BATCH];
+	int		i;
+
+	memset(msgs, 0, sizeof(msgs[0]) * num);
+	for (i = 0; i < num; i++) {
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	return sendmmsg(fd, msgs, num, 0);
+#else
+	int i;
+
+	for (i = 0; i < num; i++) {
+		if (write(fd, iov[i].iov_base, iov[i].iov_len) < 0) {
+			if (i == 0) return -1;
+			break;
+		}
+	}
+
+	return i;
+#endif
+}
+
+/** Receive a batch of packets from one socket, without blocking
+ *
+ * @return the number of packets received, or -1 on error.
+ */
+static int load_recv_batch(int fd, struct iovec *iov, size_t *lens, int num)
+{
+#ifdef MSG_WAITFORONE
+	struct mmsghdr	msgs[RC_LOAD_BATCH];
+	int		i, rcode;
+
+	memset(msgs, 0, sizeof(msgs[0]) * num);
+	for (i = 0; i < num; i++) {
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	rcode = recvmmsg(fd, msgs, num, MSG_DONTWAIT, NULL);
+	for (i = 0; i < rcode; i++) lens[i] = msgs[i].msg_len;
+
+	return rcode;
+#else
+	int	i;
+	ssize_t	len;
+
+	for (i = 0; i < num; i++) {
+		len = recv(fd, iov[i].iov_base, iov[i].iov_len, MSG_DONTWAIT);
+		if (len < 0) {
+			if (i == 0) return -1;
+			break;
+		}
+		lens[i] = len;
+	}
+
+	return i;
+#endif
+}
+
+static void load_release(rc_load_thread_t *t, rc_load_socket_t *s, int id)
+{
+	s->id[id].used = false;
+	s->num_free++;
+	t->outstanding--;
+}
+
+/** Send all of the packets which are due
+ *
+ * @return the number of packets sent.
+ */
+static int load_send(rc_load_thread_t *t, uint64_t now)
+{
+	rc_load_t		*load = t->load;
+	rc_load_config_t const	*config = load->config;
+	fr_radius_batch_t	batch[RC_LOAD_BATCH];
+	uint64_t		intended[RC_LOAD_BATCH];
+	struct iovec		iov[RC_LOAD_BATCH];
+	int			ids[RC_LOAD_BATCH];
+	int			i, num, sent, total = 0;
+	rc_load_socket_t	*s;
+
+	while (t->next < load->total) {
+		/*
+		 *	Find a socket with free IDs.  If there aren't
+		 *	any, the packets wait, and the wait is counted
+		 *	in their latency.
+		 */
+		for (i = 0; i < RC_LOAD_SOCKETS; i++) {
+			s = &t->sockets[(t->cur_socket + i) % RC_LOAD_SOCKETS];
+			if (s->num_free > 0) break;
+		}
+		if (i == RC_LOAD_SOCKETS) break;
+		t->cur_socket = (t->cur_socket + i) % RC_LOAD_SOCKETS;
+
+		for (num = 0; (num < RC_LOAD_BATCH) && (num < s->num_free) && (t->next < load->total); num++) {
+			rc_load_template_t const	*tmpl;
+			uint8_t				*packet;
+			int				id;
+
+			intended[num] = load->start +
+				(uint64_t) (schedule_time(&config->schedule, t->next) * USEC);
+			if (intended[num] > now) break;
+
+			tmpl = &config->templates[t->next % config->num_templates];
+			t->next += config->num_threads;
+
+			for (id = s->next_id; s->id[id].used; id = (id + 1) & 0xff);
+			s->next_id = (id + 1) & 0xff;
+			s->id[id].used = true;
+			ids[num] = id;
+
+			packet = t->buffers + (num * load->buflen);
+			memcpy(packet, tmpl->data, tmpl->data_len);
+			packet[1] = id;
+
+			batch[num].packet = packet;
+			batch[num].original = NULL;
+			batch[num].secret = &load->secret;
+
+			iov[num].iov_base = packet;
+			iov[num].iov_len = tmpl->data_len;
+		}
+
+		if (!num) break;
+
+		fr_radius_sign_multi(batch, num);
+
+		sent = load_send_batch(s->fd, iov, num);
+		if (sent < 0) sent = 0;
+
+		for (i = 0; i < num; i++) {
+			rc_load_outstanding_t *o = &s->id[ids[i]];
+
+			if ((i >= sent) || (batch[i].rcode < 0)) {
+				o->used = false;
+				t->stats.send_errors++;
+				continue;
+			}
+
+			o->intended = intended[i];
+			o->sent = now;
+			o->code = batch[i].packet[0];
+			memcpy(o->vector, batch[i].packet + 4, sizeof(o->vector));
+
+			s->num_free--;
+			t->outstanding++;
+			t->stats.sent++;
+			if (now > (intended[i] + 1000)) t->stats.late++;
+		}
+
+		total += num;
+		if (num < RC_LOAD_BATCH) break;
+	}
+
+	return total;
+}
+
+/** Receive and verify all of the replies which are waiting
+ *
+ * @return the number of packets received.
+ */
+static int load_recv(rc_load_thread_t *t, uint64_t now)
+{
+	rc_load_t		*load = t->load;
+	fr_radius_batch_t	batch[RC_LOAD_BATCH];
+	uint8_t			original[RC_LOAD_BATCH][20];
+	struct iovec		iov[RC_LOAD_BATCH];
+	size_t			lens[RC_LOAD_BATCH];
+	int			i, j, num, valid, total = 0;
+
+	for (i = 0; i < RC_LOAD_SOCKETS; i++) {
+		rc_load_socket_t *s = &t->sockets[i];
+
+		do {
+			for (j = 0; j < RC_LOAD_BATCH; j++) {
+				iov[j].iov_base = t->buffers + (j * load->buflen);
+				iov[j].iov_len = load->buflen;
+			}
+
+			num = load_recv_batch(s->fd, iov, lens, RC_LOAD_BATCH);
+			if (num <= 0) break;
+			total += num;
+
+			for (j = 0, valid = 0; j < num; j++) {
+				uint8_t			*packet = iov[j].iov_base;
+				rc_load_outstanding_t	*o;
+				decode_fail_t		reason;
+
+				if (!fr_radius_ok(packet, &lens[j], RADIUS_MAX_ATTRIBUTES, false, &reason)) {
+					t->stats.invalid++;
+					continue;
+				}
+
+				o = &s->id[packet[1]];
+				if (!o->used) {
+					t->stats.invalid++;
+					continue;
+				}
+
+				original[valid][0] = o->code;
+				original[valid][1] = packet[1];
+				original[valid][2] = 0;
+				original[valid][3] = 20;	/* for debugging */
+				memcpy(original[valid] + 4, o->vector, sizeof(o->vector));
+
+				batch[valid].packet = packet;
+				batch[valid].original = original[valid];
+				batch[valid].secret = &load->secret;
+				valid++;
+			}
+
+			fr_radius_verify_multi(batch, valid);
+
+			for (j = 0; j < valid; j++) {
+				uint8_t			*packet = batch[j].packet;
+				rc_load_outstanding_t	*o = &s->id[packet[1]];
+
+				if (batch[j].rcode < 0) {
+					t->stats.invalid++;
+					continue;
+				}
+
+				/*
+				 *	Duplicate reply in the same batch.
+				 */
+				if (!o->used) continue;
+
+				hist_add(&t->hist, (now > o->intended) ? (now - o->intended) : 0);
+				t->stats.received++;
+
+				switch (packet[0]) {
+				case FR_CODE_ACCESS_ACCEPT:
+				case FR_CODE_ACCOUNTING_RESPONSE:
+				case FR_CODE_COA_ACK:
+				case FR_CODE_DISCONNECT_ACK:
+					t->stats.accepted++;
+					break;
+
+				case FR_CODE_ACCESS_CHALLENGE:
+					t->stats.challenged++;
+					break;
+
+				default:
+					t->stats.rejected++;
+					break;
+				}
+
+				load_release(t, s, packet[1]);
+			}
+		} while (num == RC_LOAD_BATCH);
+	}
+
+	return total;
+}
+
+/** Give up on packets which have not had a reply within the timeout
+ *
+ */
+static void load_expire(rc_load_thread_t *t, uint64_t now, bool all)
+{
+	int i, id;
+
+	for (i = 0; i < RC_LOAD_SOCKETS; i++) {
+		rc_load_socket_t *s = &t->sockets[i];
+
+		if (s->num_free == 256) continue;
+
+		for (id = 0; id < 256; id++) {
+			if (!s->id[id].used) continue;
+			if (!all && ((now - s->id[id].sent) < t->load->timeout)) continue;
+
+			t->stats.lost++;
+			load_release(t, s, id);
+		}
+	}
+}
+
+static void *load_thread(void *arg)
+{
+	rc_load_thread_t	*t = arg;
+	rc_load_t		*load = t->load;
+	struct pollfd		fds[RC_LOAD_SOCKETS];
+	uint64_t		now, next_expire = 0, end;
+	int			i, wait, busy;
+
+	for (i = 0; i < RC_LOAD_SOCKETS; i++) {
+		fds[i].fd = t->sockets[i].fd;
+		fds[i].events = POLLIN;
+	}
+
+	end = load->start + (uint64_t) (schedule_duration(&load->config->schedule) * USEC) + load->timeout;
+
+	while (true) {
+		now = load_now();
+
+		busy = load_send(t, now) + load_recv(t, now);
+
+		if (now >= next_expire) {
+			load_expire(t, now, false);
+			next_expire = now + 1000;
+		}
+
+		if (t->next >= load->total) {
+			if (!t->outstanding) break;
+			if (now > end) {
+				load_expire(t, now, true);
+				break;
+			}
+			if (busy) continue;
+			wait = 1;
+
+		} else {
+			uint64_t when;
+
+			if (busy) continue;
+
+			/*
+			 *	Spin if the next packet is due within
+			 *	a millisecond.  poll() can't wait for
+			 *	less than that.
+			 */
+			when = load->start + (uint64_t) (schedule_time(&load->config->schedule, t->next) * USEC);
+			wait = (when > (now + 1000)) ? 1 : 0;
+		}
+
+		(void) poll(fds, RC_LOAD_SOCKETS, wait);
+	}
+
+	return NULL;
+}
+
+static void load_json_stats(FILE *fp, rc_load_stats_t const *stats)
+{
+	fprintf(fp, "\t\"sent\": %" PRIu64 ",\n", stats->sent);
+	fprintf(fp, "\t\"received\": %" PRIu64 ",\n", stats->received);
+	fprintf(fp, "\t\"accepted\": %" PRIu64 ",\n", stats->accepted);
+	fprintf(fp, "\t\"rejected\": %" PRIu64 ",\n", stats->rejected);
+	fprintf(fp, "\t\"challenged\": %" PRIu64 ",\n", stats->challenged);
+	fprintf(fp, "\t\"lost\": %" PRIu64 ",\n", stats->lost);
+	fprintf(fp, "\t\"invalid\": %" PRIu64 ",\n", stats->invalid);
+	fprintf(fp, "\t\"send_errors\": %" PRIu64 ",\n", stats->send_errors);
+	fprintf(fp, "\t\"late\": %" PRIu64 ",\n", stats->late);
+}
+
+static int load_json(rc_load_t const *load, rc_load_stats_t const *stats, rc_histogram_t const *hist,
+		     double elapsed)
+{
+	rc_load_config_t const	*config = load->config;
+	FILE			*fp;
+	size_t			i;
+	bool			first = true;
+
+	if (strcmp(config->json_file, "-") == 0) {
+		fp = stdout;
+	} else {
+		fp = fopen(config->json_file, "w");
+		if (!fp) {
+			fr_strerror_printf("Failed opening %s: %s", config->json_file, fr_syserror(errno));
+			return -1;
+		}
+	}
+
+	fprintf(fp, "{\n");
+	fprintf(fp, "\t\"schedule\": { \"type\": \"%s\", \"rate\": %g, \"rate_end\": %g, \"duration\": %g, \"steps\": %u },\n",
+		schedule_name(&config->schedule), config->schedule.rate, config->schedule.rate_end,
+		config->schedule.duration, config->schedule.steps);
+	fprintf(fp, "\t\"threads\": %u,\n", config->num_threads);
+	fprintf(fp, "\t\"elapsed\": %.6f,\n", elapsed);
+	fprintf(fp, "\t\"throughput\": %.3f,\n", (elapsed > 0) ? (stats->received / elapsed) : 0);
+	load_json_stats(fp, stats);
+	fprintf(fp, "\t\"latency_usec\": { \"min\": %" PRIu64 ", \"mean\": %.3f, "
+		"\"p50\": %" PRIu64 ", \"p90\": %" PRIu64 ", \"p99\": %" PRIu64 ", "
+		"\"p99.9\": %" PRIu64 ", \"p99.99\": %" PRIu64 ", \"max\": %" PRIu64 " },\n",
+		hist->min, hist->total ? ((double) hist->sum / hist->total) : 0,
+		hist_percentile(hist, 50), hist_percentile(hist, 90), hist_percentile(hist, 99),
+		hist_percentile(hist, 99.9), hist_percentile(hist, 99.99), hist->max);
+
+	/*
+	 *	The non-empty buckets, as [ value, count ] pairs.
+	 */
+	fprintf(fp, "\t\"histogram\": [");
+	for (i = 0; i < HIST_NUM_BUCKETS; i++) {
+		if (!hist->count[i]) continue;
+
+		fprintf(fp, "%s\n\t\t[ %" PRIu64 ", %" PRIu64 " ]", first ? "" : ",", hist_value(i), hist->count[i]);
+		first = false;
+	}
+	fprintf(fp, "\n\t]\n}\n");
+
+	if (fp != stdout) fclose(fp);
+
+	return 0;
+}
+
+static int load_socket_open(rc_load_t *load, rc_load_socket_t *s)
+{
+	fr_ipaddr_t	src_ipaddr = load->config->src_ipaddr;
+	uint16_t	src_port = 0;
+
+	memset(s, 0, sizeof(*s));
+	s->num_free = 256;
+
+	s->fd = fr_socket_client_udp(&src_ipaddr, &src_port, &load->config->dst_ipaddr, load->config->dst_port, true);
+	if (s->fd < 0) return -1;
+
+	return 0;
+}
+
+/** Run the load test
+ *
+ * @param[in] config	for the test.
+ * @return
+ *	- 0 if every packet received a valid reply.
+ *	- 1 if some packets were lost, or received invalid replies.
+ *	- -1 on error.
+ */
+int rc_load_run(rc_load_config_t const *config)
+{
+#ifndef HAVE_PTHREAD_H
+	fr_strerror_printf("Load generation requires pthreads");
+	return -1;
+#else
+	rc_load_t		*load;
+	rc_load_stats_t		stats;
+	rc_histogram_t		*hist;
+	uint32_t		i;
+	size_t			j;
+	int			k, rcode = -1;
+	uint64_t		end;
+	double			elapsed;
+
+	if (!config->num_templates) {
+		fr_strerror_printf("No packets to send");
+		return -1;
+	}
+
+	load = talloc_zero(NULL, rc_load_t);
+	if (!load) {
+	oom:
+		fr_strerror_printf("Out of memory");
+		return -1;
+	}
+	load->config = config;
+	load->timeout = (uint64_t) (config->timeout * USEC);
+	load->total = schedule_total(&config->schedule);
+	fr_radius_secret_init(&load->secret, (uint8_t const *) config->secret, strlen(config->secret));
+
+	for (j = 0; j < config->num_templates; j++) {
+		if (config->templates[j].data_len > load->buflen) load->buflen = config->templates[j].data_len;
+	}
+	if (load->buflen < MAX_PACKET_LEN) load->buflen = MAX_PACKET_LEN;
+
+	if (!load->total) {
+		fr_strerror_printf("Load schedule sends no packets");
+		goto done;
+	}
+
+	load->threads = talloc_zero_array(load, rc_load_thread_t, config->num_threads);
+	if (!load->threads) {
+		talloc_free(load);
+		goto oom;
+	}
+	for (i = 0; i < config->num_threads; i++) {
+		rc_load_thread_t *t = &load->threads[i];
+
+		t->load = load;
+		t->num = i;
+		t->next = i;
+		t->buffers = talloc_array(load, uint8_t, load->buflen * RC_LOAD_BATCH);
+		if (!t->buffers) {
+			fr_strerror_printf("Out of memory");
+			goto done;
+		}
+
+		for (k = 0; k < RC_LOAD_SOCKETS; k++) {
+			if (load_socket_open(load, &t->sockets[k]) < 0) {
+				fr_strerror_printf_push("Failed opening socket");
+				goto done;
+			}
+		}
+	}
+
+	load->start = load_now();
+
+	for (i = 0; i < config->num_threads; i++) {
+		rc_load_thread_t *t = &load->threads[i];
+
+		if (pthread_create(&t->pthread_id, NULL, load_thread, t) != 0) {
+			fr_strerror_printf("Failed creating thread: %s", fr_syserror(errno));
+
+			/*
+			 *	The others will still finish their
+			 *	share of the test.
+			 */
+			while (i-- > 0) (void) pthread_join(load->threads[i].pthread_id, NULL);
+			goto done;
+		}
+	}
+
+	for (i = 0; i < config->num_threads; i++) (void) pthread_join(load->threads[i].pthread_id, NULL);
+
+	end = load_now();
+	elapsed = (double) (end - load->start) / USEC;
+
+	/*
+	 *	Merge the results from each thread.
+	 */
+	memset(&stats, 0, sizeof(stats));
+	hist = talloc_zero(load, rc_histogram_t);
+	if (!hist) {
+		fr_strerror_printf("Out of memory");
+		goto done;
+	}
+	for (i = 0; i < config->num_threads; i++) {
+		rc_load_thread_t *t = &load->threads[i];
+
+		stats.sent += t->stats.sent;
+		stats.received += t->stats.received;
+		stats.accepted += t->stats.accepted;
+		stats.rejected += t->stats.rejected;
+		stats.challenged += t->stats.challenged;
+		stats.lost += t->stats.lost;
+		stats.invalid += t->stats.invalid;
+		stats.send_errors += t->stats.send_errors;
+		stats.late += t->stats.late;
+
+		hist_merge(hist, &t->hist);
+	}
+
+	if (config->do_output) {
+		printf("Load summary:\n"
+		       "\tSchedule      : %s\n"
+		       "\tThreads       : %u\n"
+		       "\tElapsed       : %.3f s\n"
+		       "\tSent          : %" PRIu64 "\n"
+		       "\tReceived      : %" PRIu64 " (%.1f/s)\n"
+		       "\tAccepted      : %" PRIu64 "\n"
+		       "\tRejected      : %" PRIu64 "\n"
+		       "\tChallenged    : %" PRIu64 "\n"
+		       "\tLost          : %" PRIu64 "\n"
+		       "\tInvalid       : %" PRIu64 "\n"
+		       "\tSend errors   : %" PRIu64 "\n"
+		       "\tSent late     : %" PRIu64 "\n"
+		       "Latency (usec, from intended send time):\n"
+		       "\tmin %" PRIu64 "  p50 %" PRIu64 "  p90 %" PRIu64 "  p99 %" PRIu64
+		       "  p99.9 %" PRIu64 "  max %" PRIu64 "\n",
+		       schedule_name(&config->schedule), config->num_threads, elapsed,
+		       stats.sent, stats.received, (elapsed > 0) ? (stats.received / elapsed) : 0,
+		       stats.accepted, stats.rejected, stats.challenged,
+		       stats.lost, stats.invalid, stats.send_errors, stats.late,
+		       hist->min, hist_percentile(hist, 50), hist_percentile(hist, 90), hist_percentile(hist, 99),
+		       hist_percentile(hist, 99.9), hist->max);
+	}
+
+	if (config->json_file && (load_json(load, &stats, hist, elapsed) < 0)) goto done;
+
+	rcode = ((stats.lost > 0) || (stats.invalid > 0) || (stats.send_errors > 0)) ? 1 : 0;
+
+done:
+	for (i = 0; load->threads && (i < config->num_threads); i++) {
+		for (k = 0; k < RC_LOAD_SOCKETS; k++) {
+			if (load->threads[i].sockets[k].fd > 0) close(load->threads[i].sockets[k].fd);
+		}
+	}
+	talloc_free(load);
+
+	return rcode;
+#endif
+}
@@ -217,7 +217,7 @@ int main(int argc, char *argv[])
 	}
 
 	/*  Process the options.  */
-	while ((argval = getopt(argc, argv, "Cd:D:fhi:l:L:Mn:p:PstTvxX")) != EOF) {
+	while ((argval = getopt(argc, argv, "Cd:D:fhi:k:l:L:Mn:p:PstTvxX")) != EOF) {
 		switch (argval) {
 		case 'C':
 			check_config = true;
@@ -241,6 +241,10 @@ int main(int argc, char *argv[])
 			usage(0);
 			break;
 
+		case 'k':
+			main_config.dictionary_cache = talloc_typed_strdup(autofree, optarg);
+			break;
+
 		case 'l':
 			if (strcmp(optarg, "stdout") == 0) {
 				goto do_stdout;
@@ -866,6 +870,7 @@ static void NEVER_RETURNS usage(int status)
 	fprintf(stderr, "  -D <dictdir>  Set main dictionary directory (defaults to " DICTDIR ").\n");
 	fprintf(output, "  -f            Run as a foreground process, not a daemon.\n");
 	fprintf(output, "  -h            Print this help message.\n");
+	fprintf(output, "  -k <file>     Load the dictionaries from a binary cache, rebuilding it if they've changed.\n");
 	fprintf(output, "  -l <log_file> Logging output will be written to this file.\n");
 #ifndef NDEBUG
 	fprintf(output, "  -L <size>     When running in memory debug mode, set a hard limit on talloced memory\n");
@@ -41,17 +41,34 @@ RCSID("$Id$")
 #  include <collectd/client.h>
 #endif
 
+#ifdef HAVE_STDATOMIC_H
+#  include <stdatomic.h>
+#else
+#  include <freeradius-devel/stdatomic.h>
+#endif
+
 #define RS_ASSERT(_x) if (!(_x) && !fr_cond_assert(_x)) exit(1)
 
 static rs_t *conf;
 static struct timeval start_pcap = {0, 0};
-static char timestr[50];
 
-static rbtree_t *request_tree = NULL;
-static rbtree_t *link_tree = NULL;
-static fr_event_list_t *events;
+/*
+ *	Each decode thread has its own copy of these, so requests
+ *	are only ever matched, timed out, and freed by the thread
+ *	that received them.
+ */
+static _Thread_local char timestr[50];
+static _Thread_local TALLOC_CTX *request_ctx;
+static _Thread_local rbtree_t *request_tree;
+static _Thread_local rbtree_t *link_tree;
+static _Thread_local fr_event_list_t *events;
 static bool cleanup;
 
+static rs_worker_t *workers;			//!< Decode threads, if conf->workers > 1.
+static pthread_mutex_t output_mutex = PTHREAD_MUTEX_INITIALIZER;	//!< Serialises packet logging
+									//!< and pcap output between threads.
+static _Atomic(uint64_t) captured;		//!< Packets processed, across all threads.
+
 static int self_pipe[2] = {-1, -1};		//!< Signals from sig handlers
 
 typedef int (*rbcmp)(void const *, void const *);
@@ -86,6 +103,7 @@ static const FR_NAME_NUMBER rs_events[] = {
 };
 
 static void NEVER_RETURNS usage(int status);
+static void rs_signal_self(int sig);
 
 /** Fork and kill the parent process, writing out our PID
  *
@@ -479,7 +497,20 @@ static inline void rs_packet_print(rs_request_t *request, uint64_t count, rs_sta
 	if (!conf->logger) return;
 
 	if (request) request->logged = true;
+
+	if (conf->workers > 1) pthread_mutex_lock(&output_mutex);
 	conf->logger(count, status, handle, packet, elapsed, latency, response, body);
+	if (conf->workers > 1) pthread_mutex_unlock(&output_mutex);
+}
+
+/** Write a packet to the pcap output
+ *
+ */
+static inline void rs_pcap_dump(fr_pcap_t *out, struct pcap_pkthdr const *header, uint8_t const *data)
+{
+	if (conf->workers > 1) pthread_mutex_lock(&output_mutex);
+	pcap_dump((void *)out->dumper, header, data);
+	if (conf->workers > 1) pthread_mutex_unlock(&output_mutex);
 }
 
 /** Query libpcap to see if it dropped any packets
@@ -783,6 +814,44 @@ static void rs_stats_print_csv(rs_update_t *this, rs_stats_t *stats, UNUSED stru
 	fprintf(stdout , "%s\n", buffer);
 }
 
+/** Add the stats a decode thread gathered over an interval to the main stats
+ *
+ * The decode thread's interval stats are then cleared, ready for the next interval.
+ */
+static void rs_stats_merge(rs_stats_t *stats, rs_stats_t *from)
+{
+	size_t		i, j;
+	size_t		rs_codes_len = (sizeof(rs_useful_codes) / sizeof(*rs_useful_codes));
+
+	for (i = 0; i < rs_codes_len; i++) {
+		rs_latency_t *dst = &stats->exchange[rs_useful_codes[i]];
+		rs_latency_t *src = &from->exchange[rs_useful_codes[i]];
+
+		dst->interval.received_total += src->interval.received_total;
+		dst->interval.linked_total += src->interval.linked_total;
+		dst->interval.unlinked_total += src->interval.unlinked_total;
+		dst->interval.reused_total += src->interval.reused_total;
+		dst->interval.lost_total += src->interval.lost_total;
+		for (j = 0; j <= RS_RETRANSMIT_MAX; j++) dst->interval.rt_total[j] += src->interval.rt_total[j];
+
+		dst->interval.latency_total += src->interval.latency_total;
+		if (src->interval.latency_high > dst->interval.latency_high) {
+			dst->interval.latency_high = src->interval.latency_high;
+		}
+		if (src->interval.latency_low &&
+		    (!dst->interval.latency_low || (src->interval.latency_low < dst->interval.latency_low))) {
+			dst->interval.latency_low = src->interval.latency_low;
+		}
+
+		memset(&src->interval, 0, sizeof(src->interval));
+	}
+
+	/*
+	 *	Decode threads mute stats if they run out of memory
+	 */
+	if (fr_timeval_cmp(&from->quiet, &stats->quiet) > 0) stats->quiet = from->quiet;
+}
+
 /** Process stats for a single interval
  *
  */
@@ -801,6 +870,33 @@ static void rs_stats_process(fr_event_list_t *el, struct timeval *now, void *ctx
 
 	stats->intervals++;
 
+	/*
+	 *	Gather stats from the decode threads.  They own the
+	 *	live capture handles, so check those for drops too.
+	 */
+	if (workers) {
+		bool	dropped = false;
+		int	j;
+
+		for (j = 0; j < conf->workers; j++) {
+			pthread_mutex_lock(&workers[j].mutex);
+			for (in_p = workers[j].in;
+			     in_p;
+			     in_p = in_p->next) {
+				if (rs_check_pcap_drop(in_p) < 0) dropped = true;
+			}
+			rs_stats_merge(stats, &workers[j].stats);
+			pthread_mutex_unlock(&workers[j].mutex);
+		}
+
+		if (dropped) {
+			ERROR("Muting stats for the next %i milliseconds", conf->stats.timeout);
+
+			rs_tv_add_ms(now, conf->stats.timeout, &stats->quiet);
+			goto clear;
+		}
+	}
+
 	for (in_p = this->in;
 	     in_p;
 	     in_p = in_p->next) {
@@ -1114,8 +1210,7 @@ static inline int rs_response_to_pcap(rs_event_t *event, rs_request_t *request,
 		 *	hit our start point.
 		 */
 		if (request->capture_p->header) do {
-			pcap_dump((void *)event->out->dumper, request->capture_p->header,
-				  request->capture_p->data);
+			rs_pcap_dump(event->out, request->capture_p->header, request->capture_p->data);
 			TALLOC_FREE(request->capture_p->header);
 			TALLOC_FREE(request->capture_p->data);
 
@@ -1131,7 +1226,7 @@ static inline int rs_response_to_pcap(rs_event_t *event, rs_request_t *request,
 	/*
 	 *	Now log the response
 	 */
-	pcap_dump((void *)event->out->dumper, header, data);
+	rs_pcap_dump(event->out, header, data);
 
 	return 0;
 }
@@ -1168,7 +1263,51 @@ static inline int rs_request_to_pcap(rs_event_t *event, rs_request_t *request, s
 		return 0;
 	}
 
-	pcap_dump((void *)event->out->dumper, header, data);
+	rs_pcap_dump(event->out, header, data);
+
+	return 0;
+}
+
+/** Add an attribute to the list of attributes we need to decode
+ *
+ */
+static void rs_decode_da_add(fr_dict_attr_t const *da)
+{
+	int i;
+
+	for (i = 0; i < conf->decode_da_num; i++) if (conf->decode_da[i] == da) return;
+
+	conf->decode_da = talloc_realloc(conf, conf->decode_da, fr_dict_attr_t const *, conf->decode_da_num + 1);
+	RS_ASSERT(conf->decode_da);
+	conf->decode_da[conf->decode_da_num++] = da;
+}
+
+/** Decode the attributes in a packet
+ *
+ * If we're printing the packet contents, every attribute is decoded.  Otherwise
+ * the packet is indexed, and only the attributes we list, link or filter on
+ * are decoded.
+ */
+static int rs_packet_decode(RADIUS_PACKET *packet, RADIUS_PACKET *original)
+{
+	fr_radius_index_t	*idx;
+	int			i;
+
+	if (RDEBUG_ENABLED()) {
+		return fr_radius_packet_decode(packet, original, RADIUS_MAX_ATTRIBUTES, false, false,
+					       conf->radius_secret);
+	}
+
+	idx = fr_radius_packet_index(packet, original, false, conf->radius_secret);
+	if (!idx) return -1;
+
+	for (i = 0; i < conf->decode_da_num; i++) {
+		if (fr_radius_packet_index_decode(packet, idx, conf->decode_da[i]) < 0) {
+			talloc_free(idx);
+			return -1;
+		}
+	}
+	talloc_free(idx);
 
 	return 0;
 }
@@ -1201,7 +1340,6 @@ static void rs_packet_process(uint64_t count, rs_event_t *event, struct pcap_pkt
 	bool			response;		/* Was it a response code */
 
 	decode_fail_t		reason;			/* Why we failed decoding the packet */
-	static uint64_t		captured = 0;
 
 	rs_status_t		status = RS_NORMAL;	/* Any special conditions (RTX, Unlinked, ID-Reused) */
 	RADIUS_PACKET		*current;		/* Current packet were processing */
@@ -1306,7 +1444,7 @@ static void rs_packet_process(uint64_t count, rs_event_t *event, struct pcap_pkt
 	 *	recover once some requests timeout, so make an effort to deal
 	 *	with allocation failures gracefully.
 	 */
-	current = fr_radius_alloc(conf, false);
+	current = fr_radius_alloc(request_ctx, false);
 	if (!current) {
 		REDEBUG("Failed allocating memory to hold decoded packet");
 		rs_tv_add_ms(&header->ts, conf->stats.timeout, &stats->quiet);
@@ -1383,9 +1521,9 @@ static void rs_packet_process(uint64_t count, rs_event_t *event, struct pcap_pkt
 			int ret;
 			FILE *log_fp = fr_log_fp;
 
-			fr_log_fp = NULL;
+			if (conf->workers <= 1) fr_log_fp = NULL;
 			ret = fr_radius_packet_verify(current, original->expect, conf->radius_secret);
-			fr_log_fp = log_fp;
+			if (conf->workers <= 1) fr_log_fp = log_fp;
 			if (ret != 0) {
 				REDEBUG("Failed verifying packet ID %d: %s", current->id, fr_strerror());
 				fr_radius_free(&current);
@@ -1401,10 +1539,9 @@ static void rs_packet_process(uint64_t count, rs_event_t *event, struct pcap_pkt
 			int ret;
 			FILE *log_fp = fr_log_fp;
 
-			fr_log_fp = NULL;
-			ret = fr_radius_packet_decode(current, original ? original->expect : NULL,
-						      RADIUS_MAX_ATTRIBUTES, false, conf->radius_secret);
-			fr_log_fp = log_fp;
+			if (conf->workers <= 1) fr_log_fp = NULL;
+			ret = rs_packet_decode(current, original ? original->expect : NULL);
+			if (conf->workers <= 1) fr_log_fp = log_fp;
 			if (ret != 0) {
 				fr_radius_free(&current);
 				REDEBUG("Failed decoding");
@@ -1510,9 +1647,9 @@ static void rs_packet_process(uint64_t count, rs_event_t *event, struct pcap_pkt
 				int ret;
 				FILE *log_fp = fr_log_fp;
 
-				fr_log_fp = NULL;
+				if (conf->workers <= 1) fr_log_fp = NULL;
 				ret = fr_radius_packet_verify(current, NULL, conf->radius_secret);
-				fr_log_fp = log_fp;
+				if (conf->workers <= 1) fr_log_fp = log_fp;
 				if (ret != 0) {
 					REDEBUG("Failed verifying packet ID %d: %s", current->id, fr_strerror());
 					fr_radius_free(&current);
@@ -1532,10 +1669,9 @@ static void rs_packet_process(uint64_t count, rs_event_t *event, struct pcap_pkt
 			int ret;
 			FILE *log_fp = fr_log_fp;
 
-			fr_log_fp = NULL;
-			ret = fr_radius_packet_decode(current, NULL,
-						      RADIUS_MAX_ATTRIBUTES, false, conf->radius_secret);
-			fr_log_fp = log_fp;
+			if (conf->workers <= 1) fr_log_fp = NULL;
+			ret = rs_packet_decode(current, NULL);
+			if (conf->workers <= 1) fr_log_fp = log_fp;
 
 			if (ret != 0) {
 				fr_radius_free(&current);
@@ -1648,7 +1784,7 @@ static void rs_packet_process(uint64_t count, rs_event_t *event, struct pcap_pkt
 		 *	...nope it's a new request.
 		 */
 		} else {
-			original = talloc_zero(conf, rs_request_t);
+			original = talloc_zero(request_ctx, rs_request_t);
 			talloc_set_destructor(original, _request_free);
 
 			original->id = count;
@@ -1784,25 +1920,167 @@ static void rs_packet_process(uint64_t count, rs_event_t *event, struct pcap_pkt
 		fr_radius_free(&current);
 	}
 
-	captured++;
 	/*
 	 *	We've hit our capture limit, break out of the event loop
+	 *
+	 *	With multiple decode threads, the main thread stops the
+	 *	others, so signal it the same way as SIGTERM would.
 	 */
-	if ((conf->limit > 0) && (captured >= conf->limit)) {
-		INFO("Captured %" PRIu64 " packets, exiting...", captured);
-		fr_event_loop_exit(events, 1);
+	if ((atomic_fetch_add_explicit(&captured, 1, memory_order_relaxed) + 1) == conf->limit) {
+		INFO("Captured %" PRIu64 " packets, exiting...", conf->limit);
+		if (conf->workers > 1) {
+			rs_signal_self(SIGTERM);
+		} else {
+			fr_event_loop_exit(events, 1);
+		}
+	}
+}
+
+/** Calculate a hash which is the same for both directions of a flow
+ *
+ * Packets we can't parse all hash to zero, the decode thread they're sent to
+ * will log the error.
+ */
+static uint32_t rs_flow_hash(fr_pcap_t *in, struct pcap_pkthdr const *header, uint8_t const *data)
+{
+	uint8_t const		*p = data, *end = data + header->caplen;
+	uint8_t const		*src, *dst;
+	size_t			addr_len;
+	ssize_t			len;
+	udp_header_t const	*udp;
+
+	len = fr_link_layer_offset(data, header->caplen, in->link_layer);
+	if ((len < 0) || ((p + len) >= end)) return 0;
+	p += len;
+
+	switch ((p[0] & 0xf0) >> 4) {
+	case 4:
+	{
+		ip_header_t const *ip = (ip_header_t const *)p;
+
+		if ((size_t)(end - p) < sizeof(*ip)) return 0;
+
+		src = (uint8_t const *)&ip->ip_src;
+		dst = (uint8_t const *)&ip->ip_dst;
+		addr_len = sizeof(ip->ip_src);
+		p += (0x0f & ip->ip_vhl) * 4;
+	}
+		break;
+
+	case 6:
+	{
+		ip_header6_t const *ip6 = (ip_header6_t const *)p;
+
+		if ((size_t)(end - p) < sizeof(*ip6)) return 0;
+
+		src = (uint8_t const *)&ip6->ip_src;
+		dst = (uint8_t const *)&ip6->ip_dst;
+		addr_len = sizeof(ip6->ip_src);
+		p += sizeof(*ip6);
 	}
+		break;
+
+	default:
+		return 0;
+	}
+
+	if ((p >= end) || ((size_t)(end - p) < sizeof(*udp))) return 0;
+	udp = (udp_header_t const *)p;
+
+	return fr_hash_update(&udp->src, sizeof(udp->src), fr_hash(src, addr_len)) ^
+	       fr_hash_update(&udp->dst, sizeof(udp->dst), fr_hash(dst, addr_len));
+}
+
+/** Queue a batch of packets for a decode thread
+ *
+ * If the decode thread has fallen too far behind, wait for it to catch up.
+ */
+static void rs_worker_push(rs_worker_t *worker, rs_batch_t *batch)
+{
+	bool wake;
+
+	pthread_mutex_lock(&worker->queue_mutex);
+	while (worker->queue_len >= RS_WORKER_QUEUE_MAX) pthread_cond_wait(&worker->queue_cond, &worker->queue_mutex);
+
+	batch->next = NULL;
+	*worker->queue_tail = batch;
+	worker->queue_tail = &batch->next;
+	wake = (worker->queue_len++ == 0);
+	pthread_mutex_unlock(&worker->queue_mutex);
+
+	/*
+	 *	The thread empties the queue every time it's woken
+	 *	up, so we only need to wake it for the first batch.
+	 */
+	if (wake && (write(worker->pipe[1], "", 1) < 0) && (errno != EAGAIN)) {
+		ERROR("Failed waking decode thread %i: %s", worker->id, fr_syserror(errno));
+	}
+}
+
+/** Copy a packet read from a file into a batch for the decode thread handling its flow
+ *
+ */
+static void rs_worker_dispatch(fr_pcap_t *in, uint64_t count, struct pcap_pkthdr const *header, uint8_t const *data)
+{
+	rs_worker_t	*worker;
+	rs_batch_t	*batch;
+	size_t		len;
+
+	/*
+	 *	Keep the data for each packet aligned, as it's
+	 *	accessed through IP and UDP header structs.
+	 */
+	len = (header->caplen + 7) & ~((size_t) 7);
+	if (len > sizeof(batch->data)) {
+		ERROR("Packet %" PRIu64 " too large (%u bytes), ignoring", count, header->caplen);
+		return;
+	}
+
+	/*
+	 *	Elapsed time is relative to the first packet read,
+	 *	not the first packet a decode thread processes.
+	 */
+	if (!start_pcap.tv_sec) start_pcap = header->ts;
+
+	worker = &workers[rs_flow_hash(in, header, data) % conf->workers];
+	batch = worker->pending;
+	if (batch && ((batch->num == RS_WORKER_BATCH) || ((sizeof(batch->data) - batch->used) < len))) {
+		rs_worker_push(worker, batch);
+		batch = worker->pending = NULL;
+	}
+
+	if (!batch) {
+		batch = malloc(sizeof(*batch));
+		if (!batch) {
+			ERROR("Failed allocating memory to hold packet batch");
+			return;
+		}
+		batch->next = NULL;
+		batch->num = 0;
+		batch->used = 0;
+		worker->pending = batch;
+	}
+
+	batch->pkt[batch->num].count = count;
+	batch->pkt[batch->num].in = in;
+	batch->pkt[batch->num].header = *header;
+	batch->pkt[batch->num].data = batch->data + batch->used;
+	memcpy(batch->pkt[batch->num].data, data, header->caplen);
+
+	batch->num++;
+	batch->used += len;
 }
 
 static void rs_got_packet(fr_event_list_t *el, int fd, UNUSED int flags, void *ctx)
 {
-	static uint64_t	count = 0;	/* Packets seen */
+	static _Atomic(uint64_t) count;	/* Packets seen */
 	rs_event_t	*event = ctx;
 	pcap_t		*handle = event->in->handle;
 
 	int i;
 	int ret;
 	int total = 0;
+	uint64_t id;
 	const uint8_t *data;
 	struct pcap_pkthdr *header;
 
@@ -1847,9 +2125,13 @@ static void rs_got_packet(fr_event_list_t *el, int fd, UNUSED int flags, void *c
 			do {
 				now = header->ts;
 			} while (fr_event_timer_run(el, &now) == 1);
-			count++;
+			id = atomic_fetch_add_explicit(&count, 1, memory_order_relaxed) + 1;
 
-			rs_packet_process(count, event, header, data);
+			if (workers) {
+				rs_worker_dispatch(event->in, id, header, data);
+			} else {
+				rs_packet_process(id, event, header, data);
+			}
 			total++;
 		}
 		return;
@@ -1870,8 +2152,8 @@ static void rs_got_packet(fr_event_list_t *el, int fd, UNUSED int flags, void *c
 			return;
 		}
 
-		count++;
-		rs_packet_process(count, event, header, data);
+		id = atomic_fetch_add_explicit(&count, 1, memory_order_relaxed) + 1;
+		rs_packet_process(id, event, header, data);
 	}
 }
 
@@ -2031,6 +2313,353 @@ static void _unmark_link(void *request)
 	this->in_link_tree = false;
 }
 
+/** Open a capture handle, and apply the capture filter
+ *
+ * @return
+ *	- 0 on success.
+ *	- -1 if the handle couldn't be opened.
+ *	- -2 on any other error.
+ */
+static int rs_pcap_open(fr_pcap_t *in_p)
+{
+	if (fr_pcap_open(in_p) < 0) {
+		ERROR("Failed opening pcap handle (%s): %s", in_p->name, fr_strerror());
+		return -1;
+	}
+
+	if (!fr_link_layer_supported(in_p->link_layer)) {
+		ERROR("Failed opening pcap handle (%s): Datalink type %s not supported",
+		      in_p->name, pcap_datalink_val_to_name(in_p->link_layer));
+		return -2;
+	}
+
+	if (conf->pcap_filter) {
+		/*
+		 *	Not all link layers support VLAN tags
+		 *	and this is the easiest way to discover
+		 *	which do and which don't.
+		 */
+		if ((!conf->pcap_filter_vlan ||
+		     (fr_pcap_apply_filter(in_p, conf->pcap_filter_vlan) < 0)) &&
+		     (fr_pcap_apply_filter(in_p, conf->pcap_filter) < 0)) {
+			ERROR("Failed applying filter: %s", fr_strerror());
+			return -2;
+		}
+	}
+
+	return 0;
+}
+
+/** Open a live capture handle on an interface for each decode thread
+ *
+ * The handles are added to a fanout group, so that each packet is only received
+ * by one thread, and all packets for a flow are received by the same thread.
+ *
+ * @param in_p interface to open handles for.  Only the name and settings are used.
+ * @param group fanout group ID to use for this interface.
+ * @return
+ *	- 0 on success.
+ *	- -1 if the interface couldn't be opened.
+ *	- -2 on any other error.
+ */
+static int rs_workers_pcap_open(fr_pcap_t *in_p, uint16_t group)
+{
+	int i, ret;
+
+	for (i = 0; i < conf->workers; i++) {
+		fr_pcap_t *handle;
+
+		handle = fr_pcap_init(workers[i].ctx, in_p->name, in_p->type);
+		if (!handle) return -2;
+
+		handle->promiscuous = in_p->promiscuous;
+		handle->buffer_pkts = in_p->buffer_pkts;
+
+		ret = rs_pcap_open(handle);
+		if (ret < 0) {
+			talloc_free(handle);
+			return (i == 0) ? ret : -2;
+		}
+
+		if (fr_pcap_fanout(handle, group) < 0) {
+			ERROR("%s", fr_strerror());
+			talloc_free(handle);
+			return -2;
+		}
+
+		in_p->link_layer = handle->link_layer;
+		handle->next = workers[i].in;
+		workers[i].in = handle;
+	}
+
+	return 0;
+}
+
+/** Process packets queued for a decode thread
+ *
+ */
+static void rs_worker_wake(fr_event_list_t *el, int fd, UNUSED int flags, void *ctx)
+{
+	rs_worker_t	*worker = ctx;
+	rs_batch_t	*batch, *next;
+	uint8_t		buff[64];
+	bool		done;
+	int		i;
+
+	while (read(fd, buff, sizeof(buff)) > 0);
+
+	pthread_mutex_lock(&worker->queue_mutex);
+	batch = worker->queue;
+	worker->queue = NULL;
+	worker->queue_tail = &worker->queue;
+	worker->queue_len = 0;
+	done = worker->exit;
+	pthread_cond_signal(&worker->queue_cond);
+	pthread_mutex_unlock(&worker->queue_mutex);
+
+	for (; batch; batch = next) {
+		next = batch->next;
+
+		for (i = 0; i < batch->num; i++) {
+			rs_event_t	event = {
+						.list = el,
+						.in = batch->pkt[i].in,
+						.out = worker->out,
+						.stats = &worker->stats
+					};
+			struct timeval	now;
+
+			/*
+			 *	As with a single thread, timers run
+			 *	using the time from the packet.
+			 */
+			do {
+				now = batch->pkt[i].header.ts;
+			} while (fr_event_timer_run(el, &now) == 1);
+
+			rs_packet_process(batch->pkt[i].count, &event, &batch->pkt[i].header, batch->pkt[i].data);
+		}
+		free(batch);
+	}
+
+	if (done) fr_event_loop_exit(el, 1);
+}
+
+/** Main loop for a decode thread
+ *
+ */
+static void *rs_worker_thread(void *arg)
+{
+	rs_worker_t *worker = arg;
+
+	request_ctx = worker->ctx;
+	request_tree = worker->request_tree;
+	events = worker->el;
+
+	/*
+	 *	The main thread takes the mutex to merge our
+	 *	stats, so only hold it whilst servicing events.
+	 */
+	while (fr_event_corral(worker->el, true) >= 0) {
+		pthread_mutex_lock(&worker->mutex);
+		fr_event_service(worker->el);
+		pthread_mutex_unlock(&worker->mutex);
+	}
+
+	/*
+	 *	Requests remove themselves from this thread's request
+	 *	tree and event list, so must be freed by this thread.
+	 */
+	pthread_mutex_lock(&worker->mutex);
+	talloc_free(worker->ctx);
+	worker->ctx = NULL;
+	worker->in = NULL;
+	pthread_mutex_unlock(&worker->mutex);
+
+	return NULL;
+}
+
+/** Allocate the decode threads
+ *
+ * The threads aren't started until rs_workers_start() is called.
+ */
+static int rs_workers_alloc(TALLOC_CTX *ctx)
+{
+	int i;
+
+	workers = talloc_zero_array(ctx, rs_worker_t, conf->workers);
+	if (!workers) {
+		ERROR("Failed allocating memory for decode threads");
+		return -1;
+	}
+
+	for (i = 0; i < conf->workers; i++) {
+		rs_worker_t *worker = &workers[i];
+
+		worker->id = i;
+		worker->pipe[0] = worker->pipe[1] = -1;
+		worker->queue_tail = &worker->queue;
+		pthread_mutex_init(&worker->mutex, NULL);
+		pthread_mutex_init(&worker->queue_mutex, NULL);
+		pthread_cond_init(&worker->queue_cond, NULL);
+	}
+
+	for (i = 0; i < conf->workers; i++) {
+		rs_worker_t *worker = &workers[i];
+
+		/*
+		 *	Not parented by ctx, the main thread may
+		 *	allocate from that whilst this thread is
+		 *	running.
+		 */
+		worker->ctx = talloc_new(NULL);
+		if (!worker->ctx) {
+			ERROR("Failed allocating memory for decode thread");
+			return -1;
+		}
+
+		worker->el = fr_event_list_alloc(worker->ctx, _rs_event_status, NULL);
+		if (!worker->el) {
+			ERROR("Failed creating event list for decode thread");
+			return -1;
+		}
+
+		worker->request_tree = rbtree_talloc_create(worker->ctx, (rbcmp) rs_packet_cmp, rs_request_t,
+							    _unmark_request, 0);
+		if (!worker->request_tree) {
+			ERROR("Failed creating request tree");
+			return -1;
+		}
+
+		if (pipe(worker->pipe) < 0) {
+			ERROR("Couldn't open decode thread pipe: %s", fr_syserror(errno));
+			return -1;
+		}
+
+		if ((fr_nonblock(worker->pipe[0]) < 0) || (fr_nonblock(worker->pipe[1]) < 0)) {
+			ERROR("Failed setting decode thread pipe to non-blocking: %s", fr_syserror(errno));
+			return -1;
+		}
+
+		if (fr_event_fd_insert(NULL, worker->el, worker->pipe[0],
+				       rs_worker_wake,
+				       NULL,
+				       NULL,
+				       worker) < 0) {
+			ERROR("Failed inserting decode thread pipe descriptor: %s", fr_strerror());
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/** Start the decode threads
+ *
+ * @param out where to write pcap output to.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+static int rs_workers_start(fr_pcap_t *out)
+{
+	int		i;
+	fr_pcap_t	*in_p;
+
+	for (i = 0; i < conf->workers; i++) {
+		rs_worker_t *worker = &workers[i];
+
+		worker->out = out;
+
+		for (in_p = worker->in;
+		     in_p;
+		     in_p = in_p->next) {
+			rs_event_t *event;
+
+			event = talloc_zero(worker->el, rs_event_t);
+			event->list = worker->el;
+			event->in = in_p;
+			event->out = out;
+			event->stats = &worker->stats;
+
+			if (fr_event_fd_insert(NULL, worker->el, in_p->fd,
+					       rs_got_packet,
+					       NULL,
+					       NULL,
+					       event) < 0) {
+				ERROR("Failed inserting file descriptor");
+				return -1;
+			}
+		}
+
+		if (pthread_create(&worker->thread, NULL, rs_worker_thread, worker) != 0) {
+			ERROR("Failed starting decode thread: %s", fr_syserror(errno));
+			return -1;
+		}
+		worker->running = true;
+	}
+
+	DEBUG("Started %i decode threads", conf->workers);
+
+	return 0;
+}
+
+/** Stop the decode threads
+ *
+ * Any packets already read are processed before the threads exit.
+ */
+static void rs_workers_stop(void)
+{
+	int i;
+
+	if (!workers) return;
+
+	for (i = 0; i < conf->workers; i++) {
+		rs_worker_t *worker = &workers[i];
+
+		if (!worker->running) continue;
+
+		if (worker->pending) {
+			rs_worker_push(worker, worker->pending);
+			worker->pending = NULL;
+		}
+
+		pthread_mutex_lock(&worker->queue_mutex);
+		worker->exit = true;
+		pthread_mutex_unlock(&worker->queue_mutex);
+
+		if ((write(worker->pipe[1], "", 1) < 0) && (errno != EAGAIN)) {
+			ERROR("Failed signalling decode thread %i: %s", worker->id, fr_syserror(errno));
+		}
+	}
+
+	for (i = 0; i < conf->workers; i++) {
+		rs_worker_t	*worker = &workers[i];
+		rs_batch_t	*batch, *next;
+
+		if (worker->running) {
+			pthread_join(worker->thread, NULL);
+		} else {
+			talloc_free(worker->ctx);
+		}
+
+		for (batch = worker->queue; batch; batch = next) {
+			next = batch->next;
+			free(batch);
+		}
+		free(worker->pending);
+
+		if (worker->pipe[0] >= 0) close(worker->pipe[0]);
+		if (worker->pipe[1] >= 0) close(worker->pipe[1]);
+
+		pthread_cond_destroy(&worker->queue_cond);
+		pthread_mutex_destroy(&worker->queue_mutex);
+		pthread_mutex_destroy(&worker->mutex);
+	}
+
+	TALLOC_FREE(workers);
+}
+
 #ifdef HAVE_COLLECTDC_H
 /** Re-open the collectd socket
  *
@@ -2153,6 +2782,7 @@ static void NEVER_RETURNS usage(int status)
 	fprintf(output, "  -R <filter>           RADIUS attribute response filter.\n");
 	fprintf(output, "  -s <secret>           RADIUS secret.\n");
 	fprintf(output, "  -S                    Write PCAP data to stdout.\n");
+	fprintf(output, "  -t <threads>          Decode packets using this many threads (max %i).\n", RS_WORKER_MAX);
 	fprintf(output, "  -v                    Show program version information and exit.\n");
 	fprintf(output, "  -w <file>             Write output packets to file.\n");
 	fprintf(output, "  -x                    Print more debugging information.\n");
@@ -2235,7 +2865,7 @@ int main(int argc, char *argv[])
 	/*
 	 *  Get options
 	 */
-	while ((opt = getopt(argc, argv, "ab:c:C:d:D:e:Ef:hi:I:l:L:mp:P:qr:R:s:Svw:xXW:T:P:N:O:")) != EOF) {
+	while ((opt = getopt(argc, argv, "ab:c:C:d:D:e:Ef:hi:I:l:L:mp:P:qr:R:s:St:vw:xXW:T:P:N:O:")) != EOF) {
 		switch (opt) {
 		case 'a':
 		{
@@ -2371,6 +3001,14 @@ int main(int argc, char *argv[])
 			conf->to_stdout = true;
 			break;
 
+		case 't':
+			conf->workers = atoi(optarg);
+			if ((conf->workers <= 0) || (conf->workers > RS_WORKER_MAX)) {
+				ERROR("Number of threads must be between 1 and %i", RS_WORKER_MAX);
+				usage(64);
+			}
+			break;
+
 		case 'v':
 #ifdef HAVE_COLLECTDC_H
 			INFO("%s, %s, collectdclient version %s", radsniff_version, pcap_lib_version(),
@@ -2460,6 +3098,12 @@ int main(int argc, char *argv[])
 		usage(64);
 	}
 
+	/* Requests linked by attribute may arrive on different flows, so must be processed by one thread */
+	if ((conf->workers > 1) && conf->link_attributes) {
+		ERROR("Linking requests by attribute is not supported with multiple threads");
+		usage(64);
+	}
+
 	/* Can't set stats export mode if we're not writing stats */
 	if ((conf->stats.out == RS_STATS_OUT_STDIO_CSV) && !conf->stats.interval) {
 		usage(64);
@@ -2620,18 +3264,41 @@ int main(int argc, char *argv[])
 	 */
 	if (conf->list_da_num || conf->link_da_num || conf->filter_response_vps || conf->filter_request_vps ||
 	    conf->print_packet) {
+		vp_cursor_t	cursor;
+		VALUE_PAIR	*vp;
+		int		i;
+
 		conf->decode_attrs = true;
+
+		/*
+		 *	Unless we're printing the packet contents, we
+		 *	only need to decode the attributes we use.
+		 */
+		for (i = 0; i < conf->list_da_num; i++) rs_decode_da_add(conf->list_da[i]);
+		for (i = 0; i < conf->link_da_num; i++) rs_decode_da_add(conf->link_da[i]);
+		for (vp = fr_pair_cursor_init(&cursor, &conf->filter_request_vps);
+		     vp;
+		     vp = fr_pair_cursor_next(&cursor)) rs_decode_da_add(vp->da);
+		for (vp = fr_pair_cursor_init(&cursor, &conf->filter_response_vps);
+		     vp;
+		     vp = fr_pair_cursor_next(&cursor)) rs_decode_da_add(vp->da);
 	}
 
 	/*
 	 *	Setup the request tree
 	 */
+	request_ctx = conf;
 	request_tree = rbtree_talloc_create(conf, (rbcmp) rs_packet_cmp, rs_request_t, _unmark_request, 0);
 	if (!request_tree) {
 		ERROR("Failed creating request tree");
 		goto finish;
 	}
 
+	/*
+	 *	Each decode thread has its own request tree
+	 */
+	if ((conf->workers > 1) && (rs_workers_alloc(conf) < 0)) goto finish;
+
 	/*
 	 *	Get the default capture device
 	 */
@@ -2749,41 +3416,33 @@ int main(int argc, char *argv[])
 	{
 		fr_pcap_t *tmp;
 		fr_pcap_t **tmp_p = &tmp;
+		uint16_t group = getpid() & 0xffff;
 
 		for (in_p = in;
 		     in_p;
 		     in_p = in_p->next) {
+			int rcode;
+
 			in_p->promiscuous = conf->promiscuous;
 			in_p->buffer_pkts = conf->buffer_pkts;
-			if (fr_pcap_open(in_p) < 0) {
-				ERROR("Failed opening pcap handle (%s): %s", in_p->name, fr_strerror());
-				if (conf->from_auto || (in_p->type == PCAP_FILE_IN)) {
-					continue;
-				}
 
-				goto finish;
+			/*
+			 *	With multiple threads, each thread reads from
+			 *	its own handle on the interface.
+			 */
+			if (workers && (in_p->type == PCAP_INTERFACE_IN)) {
+				rcode = rs_workers_pcap_open(in_p, group++);
+			} else {
+				rcode = rs_pcap_open(in_p);
 			}
+			if (rcode < 0) {
+				if ((rcode == -1) && (conf->from_auto || (in_p->type == PCAP_FILE_IN))) {
+					continue;
+				}
 
-			if (!fr_link_layer_supported(in_p->link_layer)) {
-				ERROR("Failed opening pcap handle (%s): Datalink type %s not supported",
-				      in_p->name, pcap_datalink_val_to_name(in_p->link_layer));
 				goto finish;
 			}
 
-			if (conf->pcap_filter) {
-				/*
-				 *	Not all link layers support VLAN tags
-				 *	and this is the easiest way to discover
-				 *	which do and which don't.
-				 */
-				if ((!conf->pcap_filter_vlan ||
-				     (fr_pcap_apply_filter(in_p, conf->pcap_filter_vlan) < 0)) &&
-				     (fr_pcap_apply_filter(in_p, conf->pcap_filter) < 0)) {
-					ERROR("Failed applying filter: %s", fr_strerror());
-					goto finish;
-				}
-			}
-
 			*tmp_p = in_p;
 			tmp_p = &(in_p->next);
 		}
@@ -2860,9 +3519,11 @@ int main(int argc, char *argv[])
 		}
 
 		/*
-		 *  Now add fd's for each of the pcap sessions we opened
+		 *  Now add fd's for each of the pcap sessions we opened.
+		 *  With multiple threads, live capture handles are
+		 *  read by the threads instead.
 		 */
-		for (in_p = in;
+		for (in_p = (workers && conf->from_dev) ? NULL : in;
 		     in_p;
 		     in_p = in_p->next) {
 			rs_event_t *event;
@@ -2891,7 +3552,7 @@ int main(int argc, char *argv[])
 		 */
 		if (conf->stats.interval && conf->from_dev) {
 			gettimeofday(&now, NULL);
-			rs_install_stats_processor(stats, events, in, &now, false);
+			rs_install_stats_processor(stats, events, workers ? NULL : in, &now, false);
 		}
 	}
 
@@ -2913,6 +3574,14 @@ int main(int argc, char *argv[])
 #ifdef SIGQUIT
 	fr_set_signal(SIGQUIT, rs_signal_self);
 #endif
+	/*
+	 *	Threads don't survive daemonizing, so start them here
+	 */
+	if (workers) {
+		if (conf->from_dev) gettimeofday(&start_pcap, NULL);
+		if (rs_workers_start(out) < 0) goto finish;
+	}
+
 	DEBUG2("Entering event loop");
 
 	fr_event_loop(events);	/* Enter the main event loop */
@@ -2920,6 +3589,12 @@ int main(int argc, char *argv[])
 	DEBUG2("Done sniffing");
 
 finish:
+	/*
+	 *	Waits for the decode threads to finish processing
+	 *	any packets we've already read.
+	 */
+	rs_workers_stop();
+
 	cleanup = true;
 
 	if (conf->daemonize) unlink(conf->pidfile);
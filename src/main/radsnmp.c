@@ -812,7 +812,7 @@ static int radsnmp_send_recv(radsnmp_conf_t *conf, int fd)
 						continue;
 					}
 					if (fr_radius_packet_decode(reply, request,
-								    RADIUS_MAX_ATTRIBUTES, false, conf->secret) < 0) {
+								    RADIUS_MAX_ATTRIBUTES, false, false, conf->secret) < 0) {
 						ERROR("Failed decoding reply: %s", fr_strerror());
 						goto recv_error;
 					}
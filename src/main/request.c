@@ -73,15 +73,11 @@ static int _request_free(REQUEST *request)
 	return 0;
 }
 
-/** Create a new REQUEST data structure
+/** Initialise a new REQUEST data structure
  *
  */
-REQUEST *request_alloc(TALLOC_CTX *ctx)
+static REQUEST *request_init(REQUEST *request)
 {
-	REQUEST *request;
-
-	request = talloc_zero(ctx, REQUEST);
-	if (!request) return NULL;
 	talloc_set_destructor(request, _request_free);
 #ifndef NDEBUG
 	request->magic = REQUEST_MAGIC;
@@ -115,6 +111,54 @@ REQUEST *request_alloc(TALLOC_CTX *ctx)
 	return request;
 }
 
+/** Create a new REQUEST data structure
+ *
+ */
+REQUEST *request_alloc(TALLOC_CTX *ctx)
+{
+	REQUEST *request;
+
+	request = talloc_zero(ctx, REQUEST);
+	if (!request) return NULL;
+
+	return request_init(request);
+}
+
+/** Create a new REQUEST data structure, with a pool for its children
+ *
+ * The packets, VALUE_PAIRs and other data allocated in the request are
+ * carved out of a single, contiguous, chunk of memory, instead of each
+ * being a separate malloc.  The pool is released in one go when the
+ * request is freed.
+ *
+ * Allocations which don't fit in the pool fall back to malloc.
+ *
+ * @param[in] ctx		to allocate the request in.
+ * @param[in] num_children	Expected number of talloc chunks allocated
+ *				in the request.
+ * @param[in] pool_size		Total size of the children.
+ * @return
+ *	- A new request.
+ *	- NULL on error.
+ */
+REQUEST *request_alloc_pooled(TALLOC_CTX *ctx, size_t num_children, size_t pool_size)
+{
+#ifdef HAVE_TALLOC_POOLED_OBJECT
+	REQUEST *request;
+
+	request = talloc_pooled_object(ctx, REQUEST, num_children, pool_size);
+	if (!request) return NULL;
+	memset(request, 0, sizeof(*request));
+
+	return request_init(request);
+#else
+	(void) num_children;
+	(void) pool_size;
+
+	return request_alloc(ctx);
+#endif
+}
+
 static REQUEST *request_init_fake(REQUEST *request, REQUEST *fake)
 {
 	fake->number = request->child_number++;
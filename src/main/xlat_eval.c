@@ -1078,7 +1078,15 @@ static char *xlat_aprint(TALLOC_CTX *ctx, REQUEST *request, xlat_exp_t const * c
 		 */
 	case XLAT_LITERAL:
 		XLAT_DEBUG("%.*sxlat_aprint LITERAL", lvl, xlat_spaces);
-		return talloc_typed_strdup(ctx, node->fmt);
+		if (!node->folded) return talloc_typed_strdup(ctx, node->fmt);
+
+		/*
+		 *	Output of a function call which was folded
+		 *	at compile time.  Escape it as if the
+		 *	function had been called now.
+		 */
+		str = talloc_bstrndup(ctx, node->fmt, node->len);
+		break;
 
 		/*
 		 *	Do a one-character expansion.
@@ -1297,7 +1305,8 @@ static size_t xlat_process(TALLOC_CTX *ctx, char **out, REQUEST *request, xlat_e
 {
 	int i, list;
 	size_t total;
-	char **array, *answer;
+	char *answer;
+	xlat_out_t *array;
 	xlat_exp_t const *node;
 
 	*out = NULL;
@@ -1331,21 +1340,32 @@ static size_t xlat_process(TALLOC_CTX *ctx, char **out, REQUEST *request, xlat_e
 		return strlen(answer);
 	}
 
-	list = 0;		/* FIXME: calculate this once */
+	list = 0;
 	for (node = head; node != NULL; node = node->next) {
 		list++;
 	}
 
-	array = talloc_array(ctx, char *, list);
+	array = talloc_array(ctx, xlat_out_t, list);
 	if (!array) return -1;
 
+	/*
+	 *	Literals from the tree are used in place, so
+	 *	only the dynamic parts need a buffer, and the
+	 *	length of each part is only calculated once.
+	 */
+	total = 0;
 	for (node = head, i = 0; node != NULL; node = node->next, i++) {
-		array[i] = xlat_aprint(array, request, node, escape, escape_ctx, 0); /* may be NULL */
-	}
+		char *str;
 
-	total = 0;
-	for (i = 0; i < list; i++) {
-		if (array[i]) total += strlen(array[i]); /* FIXME: calculate strlen once */
+		if ((node->type == XLAT_LITERAL) && !node->folded) {
+			array[i].out = node->fmt;
+			array[i].len = node->len;
+		} else {
+			str = xlat_aprint(array, request, node, escape, escape_ctx, 0); /* may be NULL */
+			array[i].out = str;
+			array[i].len = str ? strlen(str) : 0;
+		}
+		total += array[i].len;
 	}
 
 	if (!total) {
@@ -1358,13 +1378,10 @@ static size_t xlat_process(TALLOC_CTX *ctx, char **out, REQUEST *request, xlat_e
 
 	total = 0;
 	for (i = 0; i < list; i++) {
-		size_t len;
+		if (!array[i].len) continue;
 
-		if (array[i]) {
-			len = strlen(array[i]);
-			memcpy(answer + total, array[i], len);
-			total += len;
-		}
+		memcpy(answer + total, array[i].out, array[i].len);
+		total += array[i].len;
 	}
 	answer[total] = '\0';
 	talloc_free(array);	/* and child entries */
@@ -1373,6 +1390,86 @@ static size_t xlat_process(TALLOC_CTX *ctx, char **out, REQUEST *request, xlat_e
 	return total;
 }
 
+/** Check whether the arguments to a function are constant
+ *
+ * Escape sequences are handled differently by the sync and async
+ * evaluators, so literals containing them are left for runtime.
+ *
+ * @param[in] head	of the argument list.
+ * @return
+ *	- true if the arguments can be passed to the function at compile time.
+ *	- false if they need to be expanded at runtime.
+ */
+static bool xlat_fold_args(xlat_exp_t const *head)
+{
+	xlat_exp_t const *node;
+
+	for (node = head; node; node = node->next) {
+		if (node->type != XLAT_LITERAL) return false;
+		if (memchr(node->fmt, '\\', node->len)) return false;
+	}
+
+	return true;
+}
+
+/** Replace calls to pure functions with constant arguments by their output
+ *
+ * Works bottom up, so nested calls such as %{toupper:%{tolower:FOO}}
+ * collapse into a single literal.  Calls which fail, or which produce
+ * no output, are left in place and are evaluated at runtime as before.
+ *
+ * Must be called before the tree is bootstrapped, as folded nodes no
+ * longer need instance data.
+ *
+ * @param[in] head	of the xlat list to fold.
+ */
+void xlat_fold(xlat_exp_t *head)
+{
+	xlat_exp_t	*node;
+	char		*str;
+
+	for (node = head; node; node = node->next) {
+		switch (node->type) {
+		case XLAT_ALTERNATE:
+			xlat_fold(node->child);
+			xlat_fold(node->alternate);
+			continue;
+
+		case XLAT_FUNC:
+			break;
+
+		default:
+			continue;
+		}
+
+		xlat_fold(node->child);
+
+		if (!node->xlat->pure || (node->xlat->type != XLAT_FUNC_SYNC) || !xlat_fold_args(node->child)) continue;
+
+		/*
+		 *	Pure functions don't look at the request,
+		 *	so we don't need one.  The output isn't
+		 *	escaped here, as that depends on where the
+		 *	literal ends up.
+		 */
+		str = xlat_aprint(node, NULL, node, NULL, NULL, 0);
+		if (!str) {
+			fr_strerror_printf(NULL);
+			continue;
+		}
+
+		XLAT_DEBUG("FOLD %s --> %s", node->xlat->name, str);
+
+		TALLOC_FREE(node->child);
+		node->type = XLAT_LITERAL;
+		node->xlat = NULL;
+		node->len = strlen(str);
+		MEM(node->fmt = talloc_realloc_bstr(str, node->len));
+		node->folded = true;
+		node->async_safe = true;
+	}
+}
+
 /** Replace %whatever in a string.
  *
  * See 'doc/configuration/variables.rst' for more information.
@@ -686,6 +686,7 @@ int xlat_register(void *mod_inst, char const *name,
 	c->instantiate = instantiate;
 	c->inst_size = inst_size;
 	c->async_safe = async_safe;
+	c->pure = false;
 
 	DEBUG3("%s: %s", __FUNCTION__, c->name);
 
@@ -699,6 +700,41 @@ int xlat_register(void *mod_inst, char const *name,
 	return 0;
 }
 
+/** Mark an xlat function as pure
+ *
+ * Pure functions produce output which depends only on their input string.
+ * They must not use the request (which will be NULL), or anything which
+ * may change between calls.  Calls to pure functions with constant
+ * arguments are evaluated once, when the expansion is compiled.
+ *
+ * Must be called after the function is registered, as re-registering
+ * the function clears the flag.
+ *
+ * @param[in] name	of the xlat function.
+ * @return
+ *	- 0 on success.
+ *	- -1 if no function with that name has been registered.
+ */
+int xlat_set_pure(char const *name)
+{
+	xlat_t *c;
+
+	c = xlat_func_find(name);
+	if (!c) {
+		ERROR("%s: Unknown xlat %s", __FUNCTION__, name);
+		return -1;
+	}
+
+	if (c->type != XLAT_FUNC_SYNC) {
+		ERROR("%s: Async xlat %s cannot be pure", __FUNCTION__, name);
+		return -1;
+	}
+
+	c->pure = true;
+
+	return 0;
+}
+
 /** Register an async xlat
  *
  * All functions registered must be async_safe.
@@ -1211,6 +1247,7 @@ int xlat_init(void)
 
 	XLAT_REGISTER(integer);
 	XLAT_REGISTER(strlen);
+	c->pure = true;
 	XLAT_REGISTER(length);
 	XLAT_REGISTER(hex);
 	XLAT_REGISTER(tag);
@@ -69,6 +69,8 @@ typedef struct xlat_t {
 	size_t			thread_inst_size;		//!< Size of the thread instance data to pre-allocate.
 
 	bool			async_safe;			//!< If true, is async safe
+	bool			pure;				//!< Output depends only on the input string,
+								///< so calls with constant input can be folded.
 	void			*uctx;				//!< uctx to pass to instantiation functions.
 
 	size_t			buf_len;			//!< Length of output buffer to pre-allocate.
@@ -98,6 +100,8 @@ struct xlat_exp {
 	size_t		len;		//!< Length of the format string.
 
 	bool		async_safe;	//!< carried from all of the children
+	bool		folded;		//!< Literal produced by evaluating a pure function at
+					///< compile time.  Escaped like dynamic output.
 
 	xlat_state_t	type;		//!< type of this expansion.
 	xlat_exp_t	*next;		//!< Next in the list.
@@ -162,6 +166,8 @@ xlat_action_t	xlat_frame_eval(TALLOC_CTX *ctx, fr_cursor_t *out, xlat_exp_t cons
 
 int		xlat_eval_walk(xlat_exp_t *exp, xlat_walker_t walker, xlat_state_t type, void *uctx);
 
+void		xlat_fold(xlat_exp_t *head);
+
 void		unlang_xlat_init(void);
 
 #ifdef __cplusplus
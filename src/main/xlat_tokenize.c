@@ -847,6 +847,13 @@ ssize_t xlat_tokenize(TALLOC_CTX *ctx, char *fmt, xlat_exp_t **head, char const
 	ret = xlat_tokenize_literal(ctx, fmt, head, false, error);
 	if (ret < 0) return ret;
 
+	/*
+	 *	Evaluate anything which doesn't depend
+	 *	on the request now, instead of on every
+	 *	expansion.
+	 */
+	xlat_fold(*head);
+
 	/*
 	 *	Add nodes that need to be bootstrapped to
 	 *	the registry.
@@ -139,40 +139,229 @@ static int connection_cmp(void const *one, void const *two)
 }
 
 
-static int track_cmp(void const *one, void const *two)
+/*
+ *	The tracking table is indexed by (src port, ID).  Connected
+ *	sockets have only one src port, so their entries are spread
+ *	over the table by ID alone.
+ *
+ *	Clients which negotiated extended identifiers re-use each ID
+ *	for many packets at the same time.  Their packets are told
+ *	apart by the FreeRADIUS-Extended-Identifier, which is then
+ *	part of the index, too.
+ */
+#define PR_TRACK_TABLE_SIZE	(256)
+
+/*
+ *	Length of the FreeRADIUS-Extended-Identifier VSA.
+ */
+#define PR_EXTENDED_ID_LEN	(12)
+
+/** Find a FreeRADIUS-Extended-Identifier VSA in a packet
+ *
+ *  The attribute is hop-by-hop, so a packet can only contain one.
+ *  If there are more, we can't tell which one the client will be
+ *  looking for in the reply.
+ *
+ *  The packet must have already been checked by fr_radius_ok().
+ *
+ * @return
+ *	- 1 if the attribute was found.
+ *	- 0 if it wasn't.
+ *	- -1 if the packet contains more than one.
+ */
+static int track_extended_id(uint32_t *out, uint8_t const *packet, size_t packet_len)
 {
-	proto_radius_track_t const *a = one;
-	proto_radius_track_t const *b = two;
-	int rcode;
+	uint8_t const *attr, *end;
+	uint32_t vendor = htonl(VENDORPEC_FREERADIUS);
+	int found = 0;
+
+	end = packet + packet_len;
+
+	for (attr = packet + 20; (attr + 2) <= end; attr += attr[1]) {
+		if ((attr[1] < 2) || ((attr + attr[1]) > end)) break;
+
+		if ((attr[0] != FR_VENDOR_SPECIFIC) ||
+		    (attr[1] != PR_EXTENDED_ID_LEN) ||
+		    (attr[6] != FR_FREERADIUS_EXTENDED_IDENTIFIER) ||
+		    (attr[7] != 6) ||
+		    (memcmp(attr + 2, &vendor, 4) != 0)) continue;
+
+		if (found) return -1;
+
+		memcpy(out, attr + 8, 4);
+		*out = ntohl(*out);
+		found = 1;
+	}
+
+	return found;
+}
+
+static inline uint32_t track_hash(proto_radius_address_t const *address, uint8_t const *packet,
+				  bool has_extended_id, uint32_t extended_id)
+{
+	uint32_t hash;
+
+	hash = (((uint32_t) address->src_port) << 8) | packet[1];
+	if (has_extended_id) hash ^= extended_id << 8;
+	hash *= 2654435761U;	/* Knuth's multiplicative hash */
+
+	return hash ^ (hash >> 16);
+}
+
+/*
+ *	Entries with the same src port and ID are only the same
+ *	packet if the code, Extended-Identifier, and addresses match,
+ *	too.
+ */
+static inline bool track_match(proto_radius_client_t const *client, proto_radius_track_t const *track,
+			       proto_radius_address_t const *address, uint8_t const *packet,
+			       bool has_extended_id, uint32_t extended_id)
+{
+	if ((track->packet[1] != packet[1]) || (track->packet[0] != packet[0])) return false;
+
+	if ((track->has_extended_id != has_extended_id) ||
+	    (has_extended_id && (track->extended_id != extended_id))) return false;
 
 	/*
-	 *	The tree is ordered by IDs, which are (hopefully)
-	 *	pseudo-randomly distributed.
+	 *	Connected sockets MUST have all tracking entries use
+	 *	the same client definition.
 	 */
-	rcode = (a->packet[1] < b->packet[1]) - (a->packet[1] > b->packet[1]);
-	if (rcode != 0) return rcode;
+	if (client->connected) {
+		rad_assert(track->client == client);
+		return true;
+	}
 
 	/*
-	 *	Then ordered by ID, which is usally the same.
+	 *	Unconnected sockets must check src/dst ip/port.
 	 */
-	rcode = (a->packet[0] < b->packet[0]) - (a->packet[0] > b->packet[0]);
-	if (rcode != 0) return rcode;
+	return (address_cmp(track->address, address) == 0);
+}
+
+static void track_table_alloc(proto_radius_client_t *client)
+{
+	client->table_size = PR_TRACK_TABLE_SIZE;
+	client->num_tracks = 0;
+	MEM(client->table = talloc_zero_array(client, proto_radius_track_t *, client->table_size));
+}
+
+/*
+ *	Double the size of the table.  This only happens for clients
+ *	which have many packets outstanding from many src ports.
+ */
+static void track_table_grow(proto_radius_client_t *client)
+{
+	uint32_t i, slot, mask, old_size;
+	proto_radius_track_t **old;
+
+	old = client->table;
+	old_size = client->table_size;
+
+	client->table_size *= 2;
+	MEM(client->table = talloc_zero_array(client, proto_radius_track_t *, client->table_size));
+	mask = client->table_size - 1;
+
+	for (i = 0; i < old_size; i++) {
+		if (!old[i]) continue;
+
+		for (slot = old[i]->hash & mask; client->table[slot] != NULL; slot = (slot + 1) & mask) {
+			/* nothing */
+		}
+
+		client->table[slot] = old[i];
+		old[i]->slot = slot;
+	}
+
+	talloc_free(old);
+}
+
+static void track_table_remove(proto_radius_client_t *client, proto_radius_track_t *track)
+{
+	uint32_t hole, slot, home, mask;
 
 	/*
-	 *	Connected sockets MUST have all tracking entries use
-	 *	the same client definition.
+	 *	NAK'd clients don't have a table.
 	 */
-	if (a->client->connected) {
-		rad_assert(a->client == b->client);
-		return 0;
-	}
+	if (!client->table) return;
 
-	rad_assert(!b->client->connected);
+	mask = client->table_size - 1;
+	hole = track->slot;
+
+	rad_assert(client->table[hole] == track);
+	client->table[hole] = NULL;
+	client->num_tracks--;
 
 	/*
-	 *	Unconnected sockets must check src/dst ip/port.
+	 *	Move later entries back into the hole, so that
+	 *	lookups don't stop early.  An entry can't be moved to
+	 *	a slot before the one it hashes to.
 	 */
-	return address_cmp(a->address, b->address);
+	for (slot = (hole + 1) & mask; client->table[slot] != NULL; slot = (slot + 1) & mask) {
+		home = client->table[slot]->hash & mask;
+
+		if (((slot - home) & mask) < ((slot - hole) & mask)) continue;
+
+		client->table[hole] = client->table[slot];
+		client->table[hole]->slot = hole;
+		client->table[slot] = NULL;
+		hole = slot;
+	}
+}
+
+static void track_cleanup_add(proto_radius_client_t *client, proto_radius_track_t *track)
+{
+	rad_assert(!track->in_cleanup);
+
+	track->prev = client->cleanup_tail;
+	track->next = NULL;
+
+	if (client->cleanup_tail) {
+		client->cleanup_tail->next = track;
+	} else {
+		client->cleanup_head = track;
+	}
+	client->cleanup_tail = track;
+	track->in_cleanup = true;
+}
+
+static void track_cleanup_remove(proto_radius_client_t *client, proto_radius_track_t *track)
+{
+	rad_assert(track->in_cleanup);
+
+	if (track->prev) {
+		track->prev->next = track->next;
+	} else {
+		client->cleanup_head = track->next;
+	}
+
+	if (track->next) {
+		track->next->prev = track->prev;
+	} else {
+		client->cleanup_tail = track->prev;
+	}
+
+	track->prev = track->next = NULL;
+	track->in_cleanup = false;
+}
+
+/*
+ *	Tracking entries are put onto a free list instead of being
+ *	freed, so that we don't allocate memory for every packet.
+ */
+static void track_free(proto_radius_track_t *track)
+{
+	proto_radius_client_t *client = track->client;
+
+	rad_assert(!track->in_cleanup);
+
+	track_table_remove(client, track);
+
+	if (track->reply) {
+		talloc_free(track->reply);
+		track->reply = NULL;
+	}
+
+	track->next = client->free_tracks;
+	client->free_tracks = track;
 }
 
 
@@ -259,11 +448,8 @@ static proto_radius_connection_t *proto_radius_connection_alloc(proto_radius_t *
 
 	/*
 	 *	Create the packet tracking table for this client.
-	 *
-	 *	#todo - unify the code with static clients?
 	 */
-	MEM(connection->client->table = rbtree_talloc_create(client, track_cmp, proto_radius_track_t,
-							     NULL, RBTREE_FLAG_NONE));
+	track_table_alloc(connection->client);
 
 	/*
 	 *	Set this radclient to be dynamic, and active.
@@ -381,6 +567,27 @@ static proto_radius_connection_t *proto_radius_connection_alloc(proto_radius_t *
 			talloc_free(dl_inst);
 			return NULL;
 		}
+
+		/*
+		 *	Before it was connected, the new socket may
+		 *	have read packets from other clients.  They
+		 *	belong to the master socket, which processes
+		 *	them before reading any more packets.
+		 */
+		if (connection->strays) {
+			proto_radius_stray_t *stray, **last;
+
+			for (last = &inst->strays; *last != NULL; last = &(*last)->next) {
+				/* nothing */
+			}
+
+			*last = connection->strays;
+			connection->strays = NULL;
+
+			for (stray = *last; stray != NULL; stray = stray->next) {
+				(void) talloc_steal(inst, stray);
+			}
+		}
 	}
 
 	/*
@@ -466,6 +673,7 @@ static RADCLIENT *proto_radius_radclient_alloc(proto_radius_t *inst, proto_radiu
 	client->longname = client->shortname = talloc_strdup(client, src_buf);
 
 	client->secret = client->nas_type = talloc_strdup(client, "");
+	fr_radius_secret_init(&client->radius_secret, (uint8_t const *) client->secret, 0);
 
 	client->ipaddr = address->src_ipaddr;
 
@@ -480,35 +688,73 @@ static RADCLIENT *proto_radius_radclient_alloc(proto_radius_t *inst, proto_radiu
 
 static proto_radius_track_t *proto_radius_track_add(proto_radius_client_t *client,
 						    proto_radius_address_t *address,
-						    uint8_t const *packet, fr_time_t recv_time, bool *is_dup)
+						    uint8_t *packet, size_t packet_len,
+						    fr_time_t recv_time, bool *is_dup)
 {
-	proto_radius_track_t my_track, *track;
+	uint32_t hash, slot, mask, extended_id = 0;
+	bool has_extended_id;
+	proto_radius_track_t *track;
+
+	switch (track_extended_id(&extended_id, packet, packet_len)) {
+	case 1:
+		has_extended_id = true;
+		break;
+
+	case 0:
+		has_extended_id = false;
+		break;
+
+	default:
+		DEBUG2("Packet contains more than one FreeRADIUS-Extended-Identifier");
+		return NULL;
+	}
+
+	/*
+	 *	Keep the table no more than half full, so that
+	 *	lookups only have to probe a few slots.
+	 */
+	if (((client->num_tracks + 1) * 2) > client->table_size) track_table_grow(client);
+
+	hash = track_hash(address, packet, has_extended_id, extended_id);
+	mask = client->table_size - 1;
 
-	my_track.address = address;
-	my_track.client = client;
-	memcpy(my_track.packet, packet, sizeof(my_track.packet));
+	for (slot = hash & mask; (track = client->table[slot]) != NULL; slot = (slot + 1) & mask) {
+		if ((track->hash == hash) &&
+		    track_match(client, track, address, packet, has_extended_id, extended_id)) break;
+	}
 
-	track = rbtree_finddata(client->table, &my_track);
 	if (!track) {
 		*is_dup = false;
 
-		MEM(track = talloc_zero(client, proto_radius_track_t));
-		talloc_get_type_abort(track, proto_radius_track_t);
-
-		MEM(track->address = talloc_zero(track, proto_radius_address_t));
-		memcpy(track->address, address, sizeof(*address));
-		track->address->radclient = client->radclient;
+		track = client->free_tracks;
+		if (track) {
+			client->free_tracks = track->next;
+			memset(track, 0, sizeof(*track));
+		} else {
+			MEM(track = talloc_zero(client, proto_radius_track_t));
+		}
 
 		track->client = client;
 		if (client->connected) {
 			proto_radius_connection_t *connection = talloc_parent(client);
 
 			track->address = connection->address;
+		} else {
+			memcpy(&track->my_address, address, sizeof(*address));
+			track->my_address.radclient = client->radclient;
+			track->address = &track->my_address;
 		}
 
 		memcpy(track->packet, packet, sizeof(track->packet));
 		track->timestamp = recv_time;
 		track->packets = 1;
+
+		track->hash = hash;
+		track->extended_id = extended_id;
+		track->has_extended_id = has_extended_id;
+		track->slot = slot;
+		client->table[slot] = track;
+		client->num_tracks++;
 		return track;
 	}
 
@@ -517,7 +763,7 @@ static proto_radius_track_t *proto_radius_track_add(proto_radius_client_t *clien
 	/*
 	 *	Is it exactly the same packet?
 	 */
-	if (memcmp(track->packet, my_track.packet, sizeof(my_track.packet)) == 0) {
+	if (memcmp(track->packet, packet, sizeof(track->packet)) == 0) {
 		/*
 		 *	Ignore duplicates while the client is
 		 *	still pending.
@@ -533,16 +779,42 @@ static proto_radius_track_t *proto_radius_track_add(proto_radius_client_t *clien
 		return track;
 	}
 
+	/*
+	 *	The new packet is different from the old one, and
+	 *	replaces it below.  Check the authenticator first.
+	 *	Otherwise a forged packet would suppress the reply to
+	 *	a request which is still being processed, or throw
+	 *	away a cached reply, and mod_preprocess() discarding
+	 *	it later can't undo that.
+	 *
+	 *	We can't check packets from pending dynamic clients,
+	 *	as we don't know the secret yet.
+	 */
+	if ((client->state != PR_CLIENT_PENDING) &&
+	    (fr_radius_verify(packet, NULL, &client->radclient->radius_secret) < 0)) {
+		DEBUG("Discarding conflicting %s ID %d from client %s - invalid authenticator (shared secret is incorrect?)",
+		      fr_packet_codes[packet[0]], packet[1], client->radclient->shortname);
+		return NULL;
+	}
+
 	/*
 	 *	The new packet is different from the old one.
 	 */
-	memcpy(track->packet, my_track.packet, sizeof(my_track.packet));
+	memcpy(track->packet, packet, sizeof(track->packet));
 	track->timestamp = recv_time;
 	track->packets++;
 
-	if (track->ev) {
-		(void) talloc_const_free(track->ev);
-		track->ev = NULL;
+	/*
+	 *	The old packet was waiting for cleanup_delay.  It's
+	 *	been replaced, so it's done.
+	 */
+	if (track->in_cleanup) {
+		track_cleanup_remove(client, track);
+
+		rad_assert(track->packets > 1);
+		rad_assert(client->packets > 0);
+		track->packets--;
+		client->packets--;
 	}
 
 	/*
@@ -584,12 +856,7 @@ static int pending_free(proto_radius_pending_packet_t *pending)
 	 *	No more packets using this tracking entry,
 	 *	delete it.
 	 */
-	if (track->packets == 0) {
-		(void) rbtree_deletebydata(track->client->table, track);
-
-		// @todo - put this into a slab allocator
-		talloc_free(track);
-	}
+	if (track->packets == 0) track_free(track);
 
 	return 0;
 }
@@ -632,6 +899,61 @@ static proto_radius_pending_packet_t *proto_radius_pending_alloc(proto_radius_cl
 }
 
 
+#define NSEC (1000000000)
+
+#define CLIENT_STATS_INC(_inst, _x) atomic_fetch_add_explicit(&(_inst)->client_stats._x, 1, memory_order_relaxed)
+#define CLIENT_STATS_GET(_inst, _x) ((uint64_t) atomic_load_explicit(&(_inst)->client_stats._x, memory_order_relaxed))
+
+/** Log the dynamic client counters
+ *
+ *  Called when a dynamic client is defined or denied, which doesn't
+ *  happen often enough to fill the logs.
+ */
+static void client_stats_debug(proto_radius_t *inst)
+{
+	DEBUG("proto_radius - dynamic clients defined %" PRIu64 ", denied %" PRIu64
+	      ".  Packets dropped: negative cache %" PRIu64 ", new_client_rate %" PRIu64 ", max_clients %" PRIu64,
+	      CLIENT_STATS_GET(inst, defined), CLIENT_STATS_GET(inst, denied),
+	      CLIENT_STATS_GET(inst, nak_dropped), CLIENT_STATS_GET(inst, rate_limited),
+	      CLIENT_STATS_GET(inst, too_many));
+}
+
+/** Rate limit the definition of new clients from one network.
+ *
+ *  Each network gets a token bucket, which is tracked as the time
+ *  at which the bucket will be full again.  Networks whose hashes
+ *  collide share a bucket, which only makes the limit stricter.
+ */
+static bool new_client_allowed(proto_radius_t *inst, fr_ipaddr_t const *src_ipaddr)
+{
+	fr_ipaddr_t network = *src_ipaddr;
+	fr_time_t now, interval, *full;
+	uint32_t hash;
+
+	if (network.af == AF_INET) {
+		fr_ipaddr_mask(&network, inst->new_client_prefix_v4);
+		hash = fr_hash(&network.addr.v4, sizeof(network.addr.v4));
+	} else {
+		fr_ipaddr_mask(&network, inst->new_client_prefix_v6);
+		hash = fr_hash(&network.addr.v6, sizeof(network.addr.v6));
+	}
+
+	full = &inst->new_client_buckets[hash & (PR_NEW_CLIENT_BUCKETS - 1)];
+	interval = NSEC / inst->new_client_rate;
+	now = fr_time();
+
+	if (*full < now) *full = now;
+
+	/*
+	 *	The bucket is empty.
+	 */
+	if ((*full - now) > ((inst->new_client_burst - 1) * interval)) return false;
+
+	*full += interval;
+	return true;
+}
+
+
 /** Count the number of connections used by active clients.
  *
  *  Unfortunately, we also count NAK'd connections, too, even if they
@@ -787,11 +1109,43 @@ redo:
 		 *		and run THAT through the dynamic client definition,
 		 *		instead of using RADIUS packets.
 		 */
-		packet_len = inst->app_io->read(app_io_instance, (void **) &local_address, &local_recv_time,
-					  buffer, buffer_len, leftover, priority, is_dup);
-		if (packet_len <= 0) {
-			DEBUG("NO DATA %d", (int) packet_len);
-			return packet_len;
+		if (!connection && inst->strays) {
+			proto_radius_stray_t *stray = inst->strays;
+			size_t stray_len = stray->buffer_len;
+
+			/*
+			 *	A packet which a new connected socket
+			 *	read before it was connected.  Process
+			 *	it as if we had read it ourselves.
+			 */
+			inst->strays = stray->next;
+
+			rad_assert(buffer_len >= stray_len);
+			memcpy(buffer, stray->buffer, stray_len);
+			memcpy(&address, &stray->address, sizeof(address));
+			recv_time = stray->recv_time;
+			*leftover = 0;
+			*is_dup = false;
+			talloc_free(stray);
+
+			/*
+			 *	The transport checked this for packets
+			 *	it returned to us.
+			 */
+			if ((stray_len < 20) || (buffer[0] == 0) || (buffer[0] > FR_MAX_PACKET_CODE) ||
+			    !fr_radius_ok(buffer, &stray_len, 0, false, NULL)) {
+				DEBUG2("proto_radius - ignoring malformed packet read by a connected socket");
+				goto redo;
+			}
+			packet_len = stray_len;
+
+		} else {
+			packet_len = inst->app_io->read(app_io_instance, (void **) &local_address, &local_recv_time,
+							buffer, buffer_len, leftover, priority, is_dup);
+			if (packet_len <= 0) {
+				DEBUG("NO DATA %d", (int) packet_len);
+				return packet_len;
+			}
 		}
 
 		rad_assert(packet_len >= 20);
@@ -831,6 +1185,7 @@ redo:
 	 *	Negative cache entry.  Drop the packet.
 	 */
 	if (client && client->state == PR_CLIENT_NAK) {
+		CLIENT_STATS_INC(inst, nak_dropped);
 		return 0;
 	}
 
@@ -865,12 +1220,26 @@ redo:
 				fr_value_box_snprint(src_buf, sizeof(src_buf), fr_box_ipaddr(address.src_ipaddr), 0);
 				DEBUG("proto_radius - ignoring packet code %d from client IP address %s - too many dynamic clients are defined",
 				      buffer[0], src_buf);
+				CLIENT_STATS_INC(inst, too_many);
 				return 0;
 			}
 
 			network = fr_trie_lookup(inst->networks, &address.src_ipaddr.addr, address.src_ipaddr.prefix);
 			if (!network) goto ignore;
 
+			/*
+			 *	Don't let one network (e.g. a scan)
+			 *	flood the workers with requests to
+			 *	define new clients.
+			 */
+			if (inst->new_client_buckets && !new_client_allowed(inst, &address.src_ipaddr)) {
+				fr_value_box_snprint(src_buf, sizeof(src_buf), fr_box_ipaddr(address.src_ipaddr), 0);
+				DEBUG("proto_radius - ignoring packet code %d from client IP address %s - too many new clients from its network",
+				      buffer[0], src_buf);
+				CLIENT_STATS_INC(inst, rate_limited);
+				return 0;
+			}
+
 			/*
 			 *	Allocate our local radclient as a
 			 *	placeholder for the dynamic client.
@@ -923,8 +1292,7 @@ redo:
 		/*
 		 *	Create the packet tracking table for this client.
 		 */
-		MEM(client->table = rbtree_talloc_create(client, track_cmp, proto_radius_track_t,
-							 NULL, RBTREE_FLAG_NONE));
+		track_table_alloc(client);
 
 		/*
 		 *	Allow connected sockets to be set on a
@@ -974,6 +1342,7 @@ have_client:
 	 *	Track this packet and return it if necessary.
 	 */
 	if (connection || !client->use_connected) {
+	track:
 		/*
 		 *	Add the packet to the tracking table, if it's
 		 *	not already there.  Pending packets will be in
@@ -981,7 +1350,7 @@ have_client:
 		 *	"live" packets.
 		 */
 		if (!track) {
-			track = proto_radius_track_add(client, &address, buffer, recv_time, is_dup);
+			track = proto_radius_track_add(client, &address, buffer, packet_len, recv_time, is_dup);
 			if (!track) {
 				DEBUG("Failed tracking packet from client %s - discarding it.", client->radclient->shortname);
 				return 0;
@@ -1117,23 +1486,39 @@ have_client:
 			 *	We've hit the connection limit.  Walk
 			 *	over all clients with connections, and
 			 *	count the number of connections used.
+			 *
+			 *	The walk locks every client, so we do
+			 *	it at most once per check_interval.
 			 */
 			if (inst->num_connections >= inst->max_connections) {
-				inst->num_connections = 0;
+				fr_time_t now = fr_time();
+				fr_time_t interval = (((fr_time_t) inst->check_interval.tv_sec) * NSEC) +
+						     (inst->check_interval.tv_usec * 1000);
 
-				(void) fr_trie_walk(inst->trie, &inst->num_connections, count_connections);
+				if ((now - inst->connections_counted) >= interval) {
+					inst->connections_counted = now;
+					inst->num_connections = 0;
 
-				if ((inst->num_connections + 1) >= inst->max_connections) {
-					DEBUG("Too many open connections.  Ignoring dynamic client %s.  Discarding packet.", client->radclient->shortname);
-					return 0;
+					(void) fr_trie_walk(inst->trie, &inst->num_connections, count_connections);
+
+					if (inst->num_connections >= inst->max_connections) {
+						DEBUG("Too many open connections.  Processing packets from new sources on the main socket.");
+					}
 				}
+
+				/*
+				 *	The client is still allowed to
+				 *	send packets.  It just doesn't
+				 *	get a socket of its own.
+				 */
+				if (inst->num_connections >= inst->max_connections) goto track;
 			}
 		}
 
 		connection = proto_radius_connection_alloc(inst, client, &address, NULL);
 		if (!connection) {
-			DEBUG("Failed to allocate connection from client %s.  Discarding packet.", client->radclient->shortname);
-			return 0;
+			DEBUG("Failed to allocate connection from client %s.  Processing packet on the main socket.", client->radclient->shortname);
+			goto track;
 		}
 
 		/*
@@ -1164,6 +1549,18 @@ have_client:
 	 */
 	(void) fr_network_listen_inject(connection->nr, connection->listen,
 					buffer, packet_len, recv_time);
+
+	/*
+	 *	A new connected socket may have given us packets
+	 *	for other clients.  Go process them, as the master
+	 *	socket.
+	 */
+	if (inst->strays) {
+		connection = NULL;
+		track = NULL;
+		goto redo;
+	}
+
 	return 0;
 }
 
@@ -1226,7 +1623,7 @@ static int mod_inject(void *instance, uint8_t *buffer, size_t buffer_len, fr_tim
 	/*
 	 *	Track this packet, because that's what mod_read expects.
 	 */
-	track = proto_radius_track_add(connection->client, connection->address, buffer,
+	track = proto_radius_track_add(connection->client, connection->address, buffer, packet_len,
 				       recv_time, &is_dup);
 	if (!track) {
 		DEBUG2("Failed injecting packet to tracking table");
@@ -1538,6 +1935,8 @@ reset_timer:
 }
 
 
+static void cleanup_timer(fr_event_list_t *el, struct timeval *now, void *uctx);
+
 static void packet_expiry_timer(fr_event_list_t *el, struct timeval *now, void *uctx)
 {
 	proto_radius_track_t *track = talloc_get_type_abort(uctx, proto_radius_track_t);
@@ -1550,14 +1949,18 @@ static void packet_expiry_timer(fr_event_list_t *el, struct timeval *now, void *
 	 */
 	if (!now && (track->packet[0] == FR_CODE_ACCESS_REQUEST) &&
 	    ((inst->cleanup_delay.tv_sec | inst->cleanup_delay.tv_usec) != 0)) {
+		gettimeofday(&track->expires, NULL);
+		fr_timeval_add(&track->expires, &track->expires, &inst->cleanup_delay);
 
-		struct timeval when;
-
-		gettimeofday(&when, NULL);
-		fr_timeval_add(&when, &when, &inst->cleanup_delay);
-		
-		if (fr_event_timer_insert(client, el, &track->ev,
-					  &when, packet_expiry_timer, track) == 0) {
+		/*
+		 *	All entries have the same cleanup_delay, so
+		 *	the list is in expiry order, and we only need
+		 *	a timer for the oldest entry.
+		 */
+		if (client->cleanup_ev ||
+		    (fr_event_timer_insert(client, el, &client->cleanup_ev,
+					   &track->expires, cleanup_timer, client) == 0)) {
+			track_cleanup_add(client, track);
 			return;
 		}
 
@@ -1581,8 +1984,7 @@ static void packet_expiry_timer(fr_event_list_t *el, struct timeval *now, void *
 	track->packets--;
 
 	if (track->packets == 0) {
-		(void) rbtree_deletebydata(client->table, track);
-		talloc_free(track);
+		track_free(track);
 
 	} else {
 		if (track->reply) {
@@ -1614,6 +2016,41 @@ static void packet_expiry_timer(fr_event_list_t *el, struct timeval *now, void *
 	}
 }
 
+/*
+ *	Clean up all of the entries whose cleanup_delay has passed.
+ */
+static void cleanup_timer(fr_event_list_t *el, struct timeval *now, void *uctx)
+{
+	proto_radius_client_t *client = uctx;
+	proto_radius_track_t *track;
+	bool expire_all = false;
+
+	while ((track = client->cleanup_head) != NULL) {
+		if (!expire_all && (fr_timeval_cmp(&track->expires, now) > 0)) {
+			if (fr_event_timer_insert(client, el, &client->cleanup_ev,
+						  &track->expires, cleanup_timer, client) == 0) {
+				return;
+			}
+
+			DEBUG("proto_radius - Failed adding cleanup_delay for packets.  Discarding packets immediately");
+			expire_all = true;
+		}
+
+		track_cleanup_remove(client, track);
+
+		/*
+		 *	Cleaning up the last entry may also clean up
+		 *	the client.
+		 */
+		if (!client->cleanup_head) {
+			packet_expiry_timer(el, now, track);
+			return;
+		}
+
+		packet_expiry_timer(el, now, track);
+	}
+}
+
 static ssize_t mod_write(void *instance, void *packet_ctx,
 			 fr_time_t request_time, uint8_t *buffer, size_t buffer_len)
 {
@@ -1718,8 +2155,11 @@ static ssize_t mod_write(void *instance, void *packet_ctx,
 	 *	tracking table.
 	 */
 	if (buffer_len == 1) {
+		CLIENT_STATS_INC(inst, denied);
+		client_stats_debug(inst);
+
 		client->state = PR_CLIENT_NAK;
-		talloc_free(client->table);
+		TALLOC_FREE(client->table);
 		talloc_free(client->pending);
 		rad_assert(client->packets == 0);
 
@@ -1800,6 +2240,8 @@ static ssize_t mod_write(void *instance, void *packet_ctx,
 			ERROR("prot_radius - Cannot define a dynamic client as a network");
 
 		error:
+			CLIENT_STATS_INC(inst, denied);
+			client_stats_debug(inst);
 			talloc_free(radclient);
 
 			/*
@@ -1827,6 +2269,9 @@ static ssize_t mod_write(void *instance, void *packet_ctx,
 		}
 	}
 
+	CLIENT_STATS_INC(inst, defined);
+	client_stats_debug(inst);
+
 	/*
 	 *	The new client is mostly OK.  Copy the various fields
 	 *	over.
@@ -1850,6 +2295,9 @@ static ssize_t mod_write(void *instance, void *packet_ctx,
 	COPY_FIELD(message_authenticator);
 	COPY_FIELD(use_connected);
 
+	fr_radius_secret_init(&client->radclient->radius_secret, (uint8_t const *) client->radclient->secret,
+			      talloc_array_length(client->radclient->secret) - 1);
+
 	// @todo - fill in other fields?
 
 	talloc_free(radclient);
@@ -1966,6 +2414,86 @@ reread:
 	return buffer_len;
 }
 
+/** Undo the tracking done by mod_read(), for a packet which is never sent to a worker.
+ *
+ */
+static void track_discard(proto_radius_t *inst, proto_radius_connection_t *connection, proto_radius_track_t *track)
+{
+	proto_radius_client_t *client = track->client;
+
+	rad_assert(track->packets > 0);
+	rad_assert(client->packets > 0);
+	track->packets--;
+	client->packets--;
+
+	if (track->packets == 0) track_free(track);
+
+	/*
+	 *	No packets left for this client, reset idle timeouts.
+	 */
+	if ((client->packets == 0) && (client->state != PR_CLIENT_STATIC)) {
+		client_expiry_timer(connection ? connection->el : inst->el, NULL, client);
+	}
+}
+
+/** Verify the authenticators of packets in the network thread.
+ *
+ *  Packets with a bad authenticator are discarded before they get to
+ *  a worker.  Duplicates are not checked, as they are the same as a
+ *  packet which has already been checked.  Packets which are defining
+ *  a dynamic client are not checked, as we don't know the secret yet.
+ *
+ *  Packets which conflict with one we're already tracking have been
+ *  checked by proto_radius_track_add(), before it changed the
+ *  tracking entry.  They're checked again here, as that's simpler
+ *  than remembering which ones they were, and they're rare.
+ */
+static void mod_preprocess(void *instance, fr_io_preprocess_t *batch, size_t num)
+{
+	proto_radius_t *inst;
+	proto_radius_connection_t *connection;
+	proto_radius_track_t *track;
+	fr_radius_batch_t verify[RADIUS_BATCH_MAX];
+	fr_io_preprocess_t *pre[RADIUS_BATCH_MAX];
+	size_t i, num_verify;
+
+	get_inst(instance, &inst, &connection, NULL);
+
+	while (num > 0) {
+		num_verify = 0;
+
+		for (i = 0; (i < num) && (num_verify < RADIUS_BATCH_MAX); i++) {
+			if (batch[i].is_dup) continue;
+
+			track = talloc_get_type_abort(batch[i].packet_ctx, proto_radius_track_t);
+			if (track->client->state == PR_CLIENT_PENDING) continue;
+
+			verify[num_verify].packet = batch[i].packet;
+			verify[num_verify].original = NULL;
+			verify[num_verify].secret = &track->client->radclient->radius_secret;
+			pre[num_verify++] = &batch[i];
+		}
+
+		batch += i;
+		num -= i;
+
+		if (!num_verify) continue;
+
+		fr_radius_verify_multi(verify, num_verify);
+
+		for (i = 0; i < num_verify; i++) {
+			if (verify[i].rcode == 0) continue;
+
+			track = pre[i]->packet_ctx;
+			DEBUG("proto_radius - Discarding %s ID %d from client %s - invalid authenticator (shared secret is incorrect?)",
+			      fr_packet_codes[pre[i]->packet[0]], pre[i]->packet[1], track->client->radclient->shortname);
+
+			pre[i]->discard = true;
+			track_discard(inst, connection, track);
+		}
+	}
+}
+
 /** Close the socket.
  *
  * @param[in] instance of the RADIUS I/O path.
@@ -2031,6 +2559,7 @@ fr_app_io_t proto_radius_master_io = {
 	.read			= mod_read,
 	.write			= mod_write,
 	.inject			= mod_inject,
+	.preprocess		= mod_preprocess,
 
 	.close			= mod_close,
 	.fd			= mod_fd,
@@ -45,6 +45,11 @@ static CONF_PARSER const limit_config[] = {
 	{ FR_CONF_OFFSET("max_clients", FR_TYPE_UINT32, proto_radius_t, max_clients), .dflt = "256" } ,
 	{ FR_CONF_OFFSET("max_pending_packets", FR_TYPE_UINT32, proto_radius_t, max_pending_packets), .dflt = "256" } ,
 
+	{ FR_CONF_OFFSET("new_client_rate", FR_TYPE_UINT32, proto_radius_t, new_client_rate), .dflt = "0" } ,
+	{ FR_CONF_OFFSET("new_client_burst", FR_TYPE_UINT32, proto_radius_t, new_client_burst), .dflt = "16" } ,
+	{ FR_CONF_OFFSET("new_client_prefix_v4", FR_TYPE_UINT32, proto_radius_t, new_client_prefix_v4), .dflt = "24" } ,
+	{ FR_CONF_OFFSET("new_client_prefix_v6", FR_TYPE_UINT32, proto_radius_t, new_client_prefix_v6), .dflt = "64" } ,
+
 	/*
 	 *	For performance tweaking.  NOT for normal humans.
 	 */
@@ -69,6 +74,12 @@ static CONF_PARSER const proto_radius_config[] = {
 	 */
 	{ FR_CONF_OFFSET("tunnel_password_zeros", FR_TYPE_BOOL, proto_radius_t, tunnel_password_zeros) } ,
 
+	/*
+	 *	Reference "octets" attributes in the received
+	 *	packet, instead of copying them.
+	 */
+	{ FR_CONF_OFFSET("zero_copy", FR_TYPE_BOOL, proto_radius_t, zero_copy), .dflt = "no" } ,
+
 	{ FR_CONF_POINTER("limit", FR_TYPE_SUBSECTION, NULL), .subcs = (void const *) limit_config },
 
 	CONF_PARSER_TERMINATOR
@@ -280,9 +291,13 @@ static int mod_decode(void const *instance, REQUEST *request, uint8_t *const dat
 	 *	Note that we don't set a limit on max_attributes here.
 	 *	That MUST be set and checked in the underlying
 	 *	transport, via a call to fr_radius_ok().
+	 *
+	 *	packet->data is ours, and lives as long as the
+	 *	request, so the VPs can reference it if
+	 *	zero_copy is set.
 	 */
 	if (fr_radius_packet_decode(request->packet, NULL, 0,
-				    inst->tunnel_password_zeros, client->secret) < 0) {
+				    inst->tunnel_password_zeros, inst->zero_copy, client->secret) < 0) {
 		RPEDEBUG("Failed decoding packet");
 		return -1;
 	}
@@ -370,6 +385,7 @@ static ssize_t mod_encode(void const *instance, REQUEST *request, uint8_t *buffe
 	proto_radius_address_t *address = track->address;
 	ssize_t data_len;
 	RADCLIENT const *client;
+	VALUE_PAIR *vp;
 
 	/*
 	 *	The packet timed out.  Tell the network side that the packet is dead.
@@ -420,6 +436,23 @@ static ssize_t mod_encode(void const *instance, REQUEST *request, uint8_t *buffe
 		return sizeof(new_client);
 	}
 
+	/*
+	 *	The client is using extended identifiers, or is asking
+	 *	to use them in a Status-Server.  Every reply has to
+	 *	echo the Extended-Identifier, so that the client can
+	 *	find the packet it's a reply to.
+	 *
+	 *	The attribute is hop-by-hop.  Whatever ended up in the
+	 *	reply (e.g. copied from a proxied reply, or by policy)
+	 *	is replaced by the one the client sent us.
+	 */
+	fr_pair_delete_by_num(&request->reply->vps, VENDORPEC_FREERADIUS, FR_FREERADIUS_EXTENDED_IDENTIFIER, TAG_ANY);
+	vp = fr_pair_find_by_num(request->packet->vps, VENDORPEC_FREERADIUS, FR_FREERADIUS_EXTENDED_IDENTIFIER, TAG_ANY);
+	if (vp) {
+		MEM(vp = fr_pair_copy(request->reply, vp));
+		fr_pair_add(&request->reply->vps, vp);
+	}
+
 	/*
 	 *	If the app_io encodes the packet, then we don't need
 	 *	to do that.
@@ -449,8 +482,7 @@ static ssize_t mod_encode(void const *instance, REQUEST *request, uint8_t *buffe
 		return -1;
 	}
 
-	if (fr_radius_sign(buffer, request->packet->data,
-			   (uint8_t const *) client->secret, talloc_array_length(client->secret) - 1) < 0) {
+	if (fr_radius_sign(buffer, request->packet->data, &client->radius_secret) < 0) {
 		RPEDEBUG("Failed signing RADIUS reply");
 		return -1;
 	}
@@ -889,6 +921,19 @@ static int mod_bootstrap(void *instance, CONF_SECTION *conf)
 		 */
 
 		// check max_clients?
+
+		/*
+		 *	Rate limit new clients, per source network.
+		 */
+		if (inst->new_client_rate) {
+			FR_INTEGER_BOUND_CHECK("new_client_rate", inst->new_client_rate, <=, 1000000);
+			FR_INTEGER_BOUND_CHECK("new_client_burst", inst->new_client_burst, >=, 1);
+			FR_INTEGER_BOUND_CHECK("new_client_burst", inst->new_client_burst, <=, 65536);
+			FR_INTEGER_BOUND_CHECK("new_client_prefix_v4", inst->new_client_prefix_v4, <=, 32);
+			FR_INTEGER_BOUND_CHECK("new_client_prefix_v6", inst->new_client_prefix_v6, <=, 128);
+
+			MEM(inst->new_client_buckets = talloc_zero_array(inst, fr_time_t, PR_NEW_CLIENT_BUCKETS));
+		}
 	}
 
 	FR_TIMEVAL_BOUND_CHECK("idle_timeout", &inst->idle_timeout, >=, 1, 0);
@@ -27,6 +27,12 @@
 
 #include <freeradius-devel/trie.h>
 
+#ifdef HAVE_STDATOMIC_H
+#  include <stdatomic.h>
+#else
+#  include <freeradius-devel/stdatomic.h>
+#endif
+
 typedef struct {
 	fr_ipaddr_t			src_ipaddr;
 	fr_ipaddr_t			dst_ipaddr;
@@ -39,8 +45,7 @@ typedef struct {
 } proto_radius_address_t;
 
 
-typedef struct {
-	fr_event_timer_t const		*ev;		//!< when we clean up this tracking entry
+typedef struct proto_radius_track_t {
 	fr_time_t			timestamp;	//!< when this packet was received
 	int				packets;     	//!< number of packets using this entry
 	uint8_t				*reply;		//!< reply packet (if any)
@@ -57,6 +62,17 @@ typedef struct {
 	proto_radius_address_t   	*address;	//!< of this packet.. shared between multiple packets
 	struct proto_radius_client_t	*client;	//!< for this packet
 	uint8_t				packet[20];	//!< original RADIUS packet.
+
+	uint32_t			hash;		//!< of src port, ID, and Extended-Identifier
+	uint32_t			extended_id;	//!< FreeRADIUS-Extended-Identifier
+	bool				has_extended_id; //!< whether the packet has an Extended-Identifier
+	uint32_t			slot;		//!< where we are in the client tracking table
+	proto_radius_address_t		my_address;	//!< for unconnected sockets
+
+	struct timeval			expires;	//!< when cleanup_delay ends
+	bool				in_cleanup;	//!< are we in the cleanup list?
+	struct proto_radius_track_t	*prev;		//!< in the cleanup list
+	struct proto_radius_track_t	*next;		//!< in the cleanup list, or the free list
 } proto_radius_track_t;
 
 /** A saved packet
@@ -71,6 +87,20 @@ typedef struct {
 	size_t			buffer_len;
 } proto_radius_pending_packet_t;
 
+/** A packet for the master socket, which was read by a connected socket
+ *
+ *  Connected sockets share the port of the master socket.  Until
+ *  they are connected, the kernel may give them packets from any
+ *  client.
+ */
+typedef struct proto_radius_stray_t {
+	proto_radius_address_t		address;	//!< where the packet came from
+	fr_time_t			recv_time;	//!< when the packet was received
+	uint8_t				*buffer;
+	size_t				buffer_len;
+	struct proto_radius_stray_t	*next;
+} proto_radius_stray_t;
+
 
 /** Client states
  *
@@ -103,7 +133,14 @@ typedef struct proto_radius_client_t {
 
 	struct proto_radius_t		*inst;		//!< parent instance for proto_radius
 	fr_event_timer_t const		*ev;		//!< when we clean up the client
-	rbtree_t			*table;		//!< tracking table for packets
+	proto_radius_track_t		**table;	//!< tracking table for packets
+	uint32_t			table_size;	//!< number of slots, always a power of 2
+	uint32_t			num_tracks;	//!< number of used slots
+	proto_radius_track_t		*free_tracks;	//!< unused tracking entries
+
+	fr_event_timer_t const		*cleanup_ev;	//!< when we clean up the oldest entry
+	proto_radius_track_t		*cleanup_head;	//!< oldest entry waiting for cleanup_delay
+	proto_radius_track_t		*cleanup_tail;	//!< newest entry waiting for cleanup_delay
 
 	fr_heap_t			*pending;	//!< pending packets for this client
 	fr_hash_table_t			*addresses;	//!< list of src/dst addresses used by this client
@@ -141,6 +178,8 @@ typedef struct {
 	void				*app_io_instance; //!< as described
 	fr_event_list_t			*el;		//!< event list for this connection
 	fr_network_t			*nr;		//!< network for this connection
+
+	proto_radius_stray_t		*strays;	//!< packets for the master socket, read before connect()
 } proto_radius_connection_t;
 
 typedef int (*proto_radius_connection_set_t)(void *instance, proto_radius_connection_t *connection);
@@ -153,6 +192,19 @@ typedef struct {
 
 extern fr_app_io_t proto_radius_master_io;
 
+/** Counters for dynamic client definition
+ *
+ *  These are updated by the master socket, and by connected sockets
+ *  in other network threads.
+ */
+typedef struct {
+	atomic_uint_fast64_t		defined;	//!< dynamic clients which were defined
+	atomic_uint_fast64_t		denied;		//!< dynamic clients which were not defined
+	atomic_uint_fast64_t		nak_dropped;	//!< packets dropped by the negative cache
+	atomic_uint_fast64_t		rate_limited;	//!< packets dropped by new_client_rate
+	atomic_uint_fast64_t		too_many;	//!< packets dropped by max_clients
+} proto_radius_client_stats_t;
+
 /** An instance of a proto_radius listen section
  *
  */
@@ -181,17 +233,27 @@ typedef struct proto_radius_t {
 	uint32_t			max_clients;			//!< maximum number of dynamic clients to allow
 	uint32_t			max_pending_packets;		//!< maximum number of pending packets
 
+	uint32_t			new_client_rate;		//!< new dynamic clients per second, per network
+	uint32_t			new_client_burst;		//!< burst of new dynamic clients, per network
+	uint32_t			new_client_prefix_v4;		//!< size of IPv4 networks for new_client_rate
+	uint32_t			new_client_prefix_v6;		//!< size of IPv6 networks for new_client_rate
+	fr_time_t			*new_client_buckets;		//!< when each network may define clients again
+
 	// @todo - count num_nak_clients, and num_nak_connections, too
 	uint32_t			num_connections;		//!< number of dynamic connections
+	fr_time_t			connections_counted;		//!< when num_connections was last recounted
 	uint32_t			num_clients;			//!< number of dynamic clients
 	uint32_t			num_pending_packets;   		//!< number of pending packets
 
+	proto_radius_client_stats_t	client_stats;			//!< for dynamic clients
+
 	struct timeval			cleanup_delay;			//!< for Access-Request packets
 	struct timeval			idle_timeout;			//!< for dynamic clients
 	struct timeval			nak_lifetime;			//!< lifetime of NAKed clients
 	struct timeval			check_interval;			//!< polling for closed sockets
 
 	bool				tunnel_password_zeros;		//!< check for trailing zeroes in Tunnel-Password.
+	bool				zero_copy;			//!< decoded "octets" VPs reference the packet data.
 
 	bool				dynamic_clients;		//!< do we have dynamic clients.
 
@@ -208,10 +270,13 @@ typedef struct proto_radius_t {
 	fr_trie_t			*trie;				//!< trie of clients
 	fr_trie_t const			*networks;     			//!< trie of allowed networks
 	fr_heap_t			*pending_clients;		//!< heap of pending clients
+	proto_radius_stray_t		*strays;			//!< packets from new connected sockets
 
 	uint32_t			priorities[FR_MAX_PACKET_CODE];	//!< priorities for individual packets
 } proto_radius_t;
 
+#define PR_NEW_CLIENT_BUCKETS	(1024)
+
 #define PR_CONNECTION_MAGIC (0x434f4e4e)
 #define PR_MAIN_MAGIC	    (0x4d4149e4)
 
@@ -294,6 +294,68 @@ static void mod_network_get(void *instance, int *ipproto, bool *dynamic_clients,
 }
 
 
+/** Read the packets which a new connected socket got before it was connected
+ *
+ *  They're put into connection->strays, in the order they were
+ *  received.  proto_radius gives them to the master socket.
+ *
+ *  The socket is non-blocking, so this stops when the receive
+ *  queue is empty.
+ *
+ * @param[in] inst	of the connected socket.
+ * @param[in] sockfd	the socket.
+ * @return
+ *	- <0 on error
+ *	- 0 on success
+ */
+static int udp_read_strays(proto_radius_udp_t *inst, int sockfd)
+{
+	proto_radius_stray_t	*stray, **last;
+	ssize_t			data_size;
+	uint8_t			*buffer;
+	int			num = 0;
+
+	MEM(buffer = talloc_array(inst, uint8_t, inst->max_packet_size));
+
+	for (last = &inst->connection->strays; *last != NULL; last = &(*last)->next) {
+		/* nothing */
+	}
+
+	for (;;) {
+		MEM(stray = talloc_zero(inst->connection, proto_radius_stray_t));
+
+		data_size = udp_recv(sockfd, buffer, inst->max_packet_size, 0,
+				     &stray->address.src_ipaddr, &stray->address.src_port,
+				     &stray->address.dst_ipaddr, &stray->address.dst_port,
+				     &stray->address.if_index, NULL);
+		if (data_size <= 0) {
+			talloc_free(stray);
+			if (data_size < 0) break;
+			continue;
+		}
+
+		stray->recv_time = fr_time();
+		MEM(stray->buffer = talloc_memdup(stray, buffer, data_size));
+		stray->buffer_len = data_size;
+
+		*last = stray;
+		last = &stray->next;
+		num++;
+	}
+
+	talloc_free(buffer);
+
+	if ((data_size < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)) {
+		ERROR("Failed reading packets received before connecting to the client: %s",
+		      fr_syserror(errno));
+		return -1;
+	}
+
+	if (num) DEBUG2("Giving %d packet(s) received before connecting to the client to the main socket", num);
+
+	return 0;
+}
+
 /** Open a UDP listener for RADIUS
  *
  * @param[in] instance of the RADIUS UDP I/O path.
@@ -355,6 +417,23 @@ static int mod_open(void *instance)
 			ERROR("Failed in connect: %s", fr_syserror(errno));
 			goto error;
 		}
+
+		/*
+		 *	Between bind() and connect(), the kernel may
+		 *	have given this socket packets from any
+		 *	client, as it's in the same SO_REUSEPORT group
+		 *	as the master socket.  Reads from connected
+		 *	sockets don't check the source address, so
+		 *	those packets would be processed as if they
+		 *	came from this client.
+		 *
+		 *	Read them now, with their source addresses,
+		 *	and hand them back to the master socket.
+		 */
+		if (udp_read_strays(inst, sockfd) < 0) {
+			close(sockfd);
+			goto error;
+		}
 	}
 
 	inst->sockfd = sockfd;
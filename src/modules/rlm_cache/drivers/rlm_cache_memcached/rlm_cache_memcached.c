@@ -174,10 +174,10 @@ static cache_status_t cache_entry_find(rlm_cache_entry_t **out,
 		return CACHE_ERROR;
 	}
 	RDEBUG2("Retrieved %zu bytes from memcached", len);
-	RDEBUG2("%s", from_store);
+	if ((len > 0) && ((uint8_t)from_store[0] != CACHE_SERIALIZE_BINARY_MAGIC)) RDEBUG2("%s", from_store);
 
 	c = talloc_zero(NULL, rlm_cache_entry_t);
-	ret = cache_deserialize(c, from_store, len);
+	ret = cache_deserialize_format(c, (uint8_t *)from_store, len);
 	free(from_store);
 	if (ret < 0) {
 		RPERROR("Invalid entry");
@@ -194,7 +194,7 @@ static cache_status_t cache_entry_find(rlm_cache_entry_t **out,
  *
  * @copydetails cache_entry_insert_t
  */
-static cache_status_t cache_entry_insert(UNUSED rlm_cache_config_t const *config, UNUSED void *instance,
+static cache_status_t cache_entry_insert(rlm_cache_config_t const *config, UNUSED void *instance,
 					 REQUEST *request, void *handle, const rlm_cache_entry_t *c)
 {
 	rlm_cache_memcached_handle_t *mandle = handle;
@@ -202,20 +202,21 @@ static cache_status_t cache_entry_insert(UNUSED rlm_cache_config_t const *config
 	memcached_return_t ret;
 
 	TALLOC_CTX *pool;
-	char *to_store;
+	uint8_t *to_store;
+	ssize_t to_store_len;
 
 	pool = talloc_pool(NULL, 1024);
 	if (!pool) return CACHE_ERROR;
 
-	if (cache_serialize(pool, &to_store, c) < 0) {
+	to_store_len = cache_serialize_format(pool, &to_store, c, config->serialize);
+	if (to_store_len < 0) {
 		talloc_free(pool);
 
 		return CACHE_ERROR;
 	}
 
 	ret = memcached_set(mandle->handle, (char const *)c->key, c->key_len,
-		            to_store ? to_store : "",
-		            to_store ? talloc_array_length(to_store) - 1 : 0, c->expires, 0);
+		            (char const *)to_store, (size_t)to_store_len, c->expires, 0);
 	talloc_free(pool);
 	if (ret != MEMCACHED_SUCCESS) {
 		RERROR("Failed storing entry: %s: %s", memcached_strerror(mandle->handle, ret),
@@ -27,6 +27,7 @@
 #include <freeradius-devel/rad_assert.h>
 
 #include "../../rlm_cache.h"
+#include "../../serialize.h"
 #include "../../../rlm_redis/redis.h"
 #include "../../../rlm_redis/cluster.h"
 
@@ -102,7 +103,7 @@ static void cache_entry_free(rlm_cache_entry_t *c)
  * @copydetails cache_entry_find_t
  */
 static cache_status_t cache_entry_find(rlm_cache_entry_t **out,
-				       UNUSED rlm_cache_config_t const *config, void *instance,
+				       rlm_cache_config_t const *config, void *instance,
 				       REQUEST *request, UNUSED void *handle, uint8_t const *key, size_t key_len)
 {
 	rlm_cache_redis_t		*driver = instance;
@@ -127,6 +128,19 @@ static cache_status_t cache_entry_find(rlm_cache_entry_t **out,
 		 *	Grab all the data for this hash, should return an array
 		 *	of alternating keys/values which we then convert into maps.
 		 */
+		if (config->serialize == CACHE_SERIALIZE_BINARY) {
+			if (RDEBUG_ENABLED3) {
+				char *p;
+
+				p = fr_asprint(NULL, (char const *)key, key_len, '"');
+				RDEBUG3("GET %s", p);
+				talloc_free(p);
+			}
+			reply = redisCommand(conn->handle, "GET %b", key, key_len);
+			status = fr_redis_command_status(conn, reply);
+			continue;
+		}
+
 		if (RDEBUG_ENABLED3) {
 			char *p;
 
@@ -151,6 +165,41 @@ static cache_status_t cache_entry_find(rlm_cache_entry_t **out,
 
 	if (!fr_cond_assert(reply)) goto error;
 
+	/*
+	 *	Entry is a single serialized blob
+	 */
+	if (config->serialize == CACHE_SERIALIZE_BINARY) {
+		switch (reply->type) {
+		case REDIS_REPLY_NIL:
+			fr_redis_reply_free(reply);
+			return CACHE_MISS;
+
+		case REDIS_REPLY_STRING:
+			break;
+
+		default:
+			REDEBUG("Bad result type, expected string, got %s",
+				fr_int2str(redis_reply_types, reply->type, "<UNKNOWN>"));
+			goto error;
+		}
+
+		RDEBUG3("Entry is %zu bytes", (size_t)reply->len);
+
+		c = talloc_zero(NULL, rlm_cache_entry_t);
+		if (cache_deserialize_format(c, (uint8_t *)reply->str, reply->len) < 0) {
+			RPERROR("Invalid entry");
+			talloc_free(c);
+			goto error;
+		}
+		fr_redis_reply_free(reply);
+
+		c->key = talloc_memdup(c, key, key_len);
+		c->key_len = key_len;
+		*out = c;
+
+		return CACHE_OK;
+	}
+
 	if (reply->type != REDIS_REPLY_ARRAY) {
 		REDEBUG("Bad result type, expected array, got %s",
 			fr_int2str(redis_reply_types, reply->type, "<UNKNOWN>"));
@@ -243,7 +292,7 @@ static cache_status_t cache_entry_find(rlm_cache_entry_t **out,
  *
  * @copydetails cache_entry_insert_t
  */
-static cache_status_t cache_entry_insert(UNUSED rlm_cache_config_t const *config, void *instance,
+static cache_status_t cache_entry_insert(rlm_cache_config_t const *config, void *instance,
 					 REQUEST *request, UNUSED void *handle, const rlm_cache_entry_t *c)
 {
 	rlm_cache_redis_t	*driver = instance;
@@ -270,6 +319,9 @@ static cache_status_t cache_entry_insert(UNUSED rlm_cache_config_t const *config
 	char			*p;
 	int			cnt;
 
+	uint8_t			*blob = NULL;
+	ssize_t			blob_len = 0;
+
 	vp_tmpl_t		expires_value;
 	vp_map_t		expires = {
 					.op	= T_OP_SET,
@@ -313,6 +365,22 @@ static cache_status_t cache_entry_insert(UNUSED rlm_cache_config_t const *config
 	pool = talloc_pool(request, 1024);
 	if (!pool) return CACHE_ERROR;
 
+	/*
+	 *	Store the entry as a single serialized blob
+	 *	instead of a list of K/V triplets.
+	 */
+	if (config->serialize == CACHE_SERIALIZE_BINARY) {
+		blob_len = cache_serialize_format(pool, &blob, c, config->serialize);
+		if (blob_len < 0) {
+			RPERROR("Failed serializing entry");
+			talloc_free(pool);
+			return CACHE_ERROR;
+		}
+		argv = NULL;
+		argv_len = NULL;
+		goto send;
+	}
+
 	argv_p = argv = talloc_array(pool, char const *, (cnt * 3) + 2);	/* pair = 3 + cmd + key */
 	argv_len_p = argv_len = talloc_array(pool, size_t, (cnt * 3) + 2);	/* pair = 3 + cmd + key */
 
@@ -335,6 +403,7 @@ static cache_status_t cache_entry_insert(UNUSED rlm_cache_config_t const *config
 		argv_len_p += 3;
 	}
 
+send:
 	RDEBUG3("Pipelining commands");
 
 	for (s_ret = fr_redis_cluster_state_init(&state, &conn, driver->cluster, request, c->key, c->key_len, false);
@@ -365,18 +434,25 @@ static cache_status_t cache_entry_insert(UNUSED rlm_cache_config_t const *config
 		if (redisAppendCommand(conn->handle, "DEL %b", c->key, c->key_len) != REDIS_OK) goto append_error;
 		pipelined++;
 
-		if (RDEBUG_ENABLED3) {
-			RDEBUG3("argv command");
-			RINDENT();
-			for (i = 0; i < talloc_array_length(argv); i++) {
-				p = fr_asprint(request, argv[i], argv_len[i], '\0');
-				RDEBUG3("%s", p);
-				talloc_free(p);
+		if (blob) {
+			RDEBUG3("SET <%zu bytes>", (size_t)blob_len);
+			if (redisAppendCommand(conn->handle, "SET %b %b", c->key, c->key_len,
+					       blob, (size_t)blob_len) != REDIS_OK) goto append_error;
+			pipelined++;
+		} else {
+			if (RDEBUG_ENABLED3) {
+				RDEBUG3("argv command");
+				RINDENT();
+				for (i = 0; i < talloc_array_length(argv); i++) {
+					p = fr_asprint(request, argv[i], argv_len[i], '\0');
+					RDEBUG3("%s", p);
+					talloc_free(p);
+				}
+				REXDENT();
 			}
-			REXDENT();
+			redisAppendCommandArgv(conn->handle, talloc_array_length(argv), argv, argv_len);
+			pipelined++;
 		}
-		redisAppendCommandArgv(conn->handle, talloc_array_length(argv), argv, argv_len);
-		pipelined++;
 
 		/*
 		 *	Set the expiry time and close out the transaction.
@@ -0,0 +1,3 @@
+TARGET		:= rlm_cache_sharded.a
+SOURCES		:= rlm_cache_sharded.c
+TGT_LDLIBS	:= $(LIBS)
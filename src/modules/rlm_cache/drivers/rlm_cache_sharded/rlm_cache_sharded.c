@@ -0,0 +1,603 @@
+/*
+ *   This program is is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or (at
+ *   your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ * @file rlm_cache_sharded.c
+ * @brief Lock striped, in memory cache.
+ *
+ * Entries are partitioned across a power of two number of shards by the hash
+ * of their key.  Each shard has its own mutex, an open addressing (linear probing)
+ * index, and a CLOCK hand which sweeps the index, removing expired entries, and
+ * evicting unreferenced entries when the shard is over its memory allowance.
+ *
+ * Workers operating on different keys will almost always lock different shards,
+ * so unlike rlm_cache_rbtree, throughput increases with the number of workers.
+ *
+ * @copyright 2018 The FreeRADIUS server project
+ */
+#include <freeradius-devel/radiusd.h>
+#include <freeradius-devel/rad_assert.h>
+#include "../../rlm_cache.h"
+
+#define SHARD_MIN_SLOTS_BITS	6		//!< Initial size of each shard's index (64 slots).
+#define SHARD_MAX_SLOTS_BITS	30		//!< Maximum size of each shard's index.
+#define SHARD_MAX		4096		//!< Maximum number of shards.
+
+typedef struct rlm_cache_sharded_entry {
+	rlm_cache_entry_t	fields;		//!< Entry data.  Must be first.
+	uint32_t		hash;		//!< Hash of the entry's key.
+	size_t			size;		//!< Memory used by the entry when it was inserted.
+	bool			referenced;	//!< CLOCK reference bit.  Set on every hit, cleared
+						//!< by the sweep.
+} rlm_cache_sharded_entry_t;
+
+/** A slot in a shard's index
+ *
+ * The hash is duplicated here so that probes only dereference entries
+ * whose hash matches.
+ */
+typedef struct {
+	uint32_t			hash;	//!< Hash of the key.
+	rlm_cache_sharded_entry_t	*entry;	//!< Entry in this slot, NULL if the slot is empty.
+} cache_slot_t;
+
+typedef struct {
+	pthread_mutex_t		mutex;		//!< Protects everything in this shard.
+	TALLOC_CTX		*ctx;		//!< Entries are parented here whilst they're in the shard.
+
+	cache_slot_t		*slots;		//!< Open addressing index.
+	uint32_t		slots_bits;	//!< log2 of the number of slots.
+	uint32_t		num_entries;	//!< Number of occupied slots.
+	uint32_t		hand;		//!< Position of the CLOCK hand.
+
+	size_t			mem_used;	//!< Memory used by entries in this shard.
+
+	uint8_t			pad[64];	//!< Keep hot fields of adjacent shards on separate cache lines.
+} cache_shard_t;
+
+typedef struct rlm_cache_sharded {
+	uint32_t		num_shards;	//!< Number of shards, rounded up to a power of 2.
+	size_t			max_memory;	//!< Memory ceiling for all entries, 0 is unlimited.
+	uint32_t		sweep;		//!< Number of slots the CLOCK hand examines per insert.
+
+	uint32_t		shard_mask;	//!< num_shards - 1.
+	size_t			shard_max_memory; //!< Memory ceiling for each shard.
+	cache_shard_t		*shards;	//!< Array of shards.
+} rlm_cache_sharded_t;
+
+/** Tracks the shard locked on behalf of a request
+ *
+ * The shard remains locked until the handle is released, so that entries
+ * returned by #cache_entry_find remain valid whilst rlm_cache operates on them.
+ */
+typedef struct {
+	rlm_cache_sharded_t	*driver;	//!< Driver instance.
+	cache_shard_t		*shard;		//!< Shard currently locked, or NULL.
+} rlm_cache_sharded_handle_t;
+
+static const CONF_PARSER driver_config[] = {
+	{ FR_CONF_OFFSET("shards", FR_TYPE_UINT32, rlm_cache_sharded_t, num_shards), .dflt = "16" },
+	{ FR_CONF_OFFSET("max_memory", FR_TYPE_SIZE, rlm_cache_sharded_t, max_memory), .dflt = "0" },
+	{ FR_CONF_OFFSET("sweep", FR_TYPE_UINT32, rlm_cache_sharded_t, sweep), .dflt = "8" },
+	CONF_PARSER_TERMINATOR
+};
+
+/** Map a hash to its ideal slot
+ *
+ * The low bits of the hash select the shard, so use multiplicative hashing
+ * to derive the slot from all the bits.
+ */
+static inline uint32_t shard_slot(cache_shard_t const *shard, uint32_t hash)
+{
+	return (hash * 2654435761U) >> (32 - shard->slots_bits);
+}
+
+/** Find the slot holding an entry with the specified key
+ *
+ * @return
+ *	- The slot index.
+ *	- -1 if no entry with the key exists.
+ */
+static int64_t shard_index_find(cache_shard_t const *shard, uint32_t hash, uint8_t const *key, size_t key_len)
+{
+	uint32_t mask = (1U << shard->slots_bits) - 1;
+	uint32_t i;
+
+	for (i = shard_slot(shard, hash); shard->slots[i].entry; i = (i + 1) & mask) {
+		rlm_cache_entry_t const *c = &shard->slots[i].entry->fields;
+
+		if ((shard->slots[i].hash != hash) || (c->key_len != key_len)) continue;
+		if (memcmp(c->key, key, key_len) == 0) return i;
+	}
+
+	return -1;
+}
+
+/** Add an entry to the index without checking for duplicates
+ *
+ */
+static void shard_index_add(cache_shard_t *shard, rlm_cache_sharded_entry_t *entry)
+{
+	uint32_t mask = (1U << shard->slots_bits) - 1;
+	uint32_t i;
+
+	for (i = shard_slot(shard, entry->hash); shard->slots[i].entry; i = (i + 1) & mask);
+
+	shard->slots[i].hash = entry->hash;
+	shard->slots[i].entry = entry;
+	shard->num_entries++;
+}
+
+/** Remove the entry at slot i, shifting subsequent entries in the probe sequence back
+ *
+ * Backward shift deletion means we never need tombstones, so probe lengths
+ * don't degrade as entries churn.
+ */
+static void shard_index_remove(cache_shard_t *shard, uint32_t i)
+{
+	uint32_t mask = (1U << shard->slots_bits) - 1;
+	uint32_t j = i;
+
+	for (;;) {
+		uint32_t ideal;
+
+		j = (j + 1) & mask;
+		if (!shard->slots[j].entry) break;
+
+		/*
+		 *	Only move the entry back if the gap lies
+		 *	between its ideal slot and its current slot.
+		 */
+		ideal = shard_slot(shard, shard->slots[j].hash);
+		if (((j - ideal) & mask) < ((j - i) & mask)) continue;
+
+		shard->slots[i] = shard->slots[j];
+		i = j;
+	}
+
+	shard->slots[i].entry = NULL;
+	shard->slots[i].hash = 0;
+	shard->num_entries--;
+}
+
+/** Double the size of a shard's index
+ *
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+static int shard_index_grow(cache_shard_t *shard)
+{
+	cache_slot_t	*old = shard->slots;
+	uint32_t	old_size = 1U << shard->slots_bits;
+	uint32_t	i;
+
+	if (shard->slots_bits >= SHARD_MAX_SLOTS_BITS) return -1;
+
+	shard->slots = talloc_zero_array(shard->ctx, cache_slot_t, old_size << 1);
+	if (!shard->slots) {
+		shard->slots = old;
+		return -1;
+	}
+	shard->slots_bits++;
+	shard->num_entries = 0;
+	shard->hand = 0;
+
+	for (i = 0; i < old_size; i++) if (old[i].entry) shard_index_add(shard, old[i].entry);
+	talloc_free(old);
+
+	return 0;
+}
+
+/** Remove the entry at slot i from the shard and free it
+ *
+ */
+static void shard_entry_free(cache_shard_t *shard, uint32_t i)
+{
+	rlm_cache_sharded_entry_t *entry = shard->slots[i].entry;
+
+	shard_index_remove(shard, i);
+	shard->mem_used -= entry->size;
+	talloc_free(entry);
+}
+
+/** Advance the CLOCK hand
+ *
+ * Expired entries are always removed.  If the shard needs to free memory
+ * entries which haven't been referenced since the hand last passed are
+ * evicted, and referenced entries get a second chance.
+ *
+ * @param[in] driver	instance.
+ * @param[in] shard	to sweep.
+ * @param[in] now	current time.
+ * @param[in] need	bytes required for a new entry.
+ * @param[in] steps	minimum number of slots to examine.
+ */
+static void shard_sweep(rlm_cache_sharded_t const *driver, cache_shard_t *shard, time_t now, size_t need,
+			uint32_t steps)
+{
+	uint32_t mask = (1U << shard->slots_bits) - 1;
+	uint32_t max_steps = (mask + 1) * 2;		/* Two full revolutions clears every reference bit */
+
+	while (shard->num_entries && max_steps--) {
+		rlm_cache_sharded_entry_t	*entry = shard->slots[shard->hand].entry;
+		bool				full;
+
+		full = driver->shard_max_memory && ((shard->mem_used + need) > driver->shard_max_memory);
+		if (!full && !steps) break;
+		if (steps) steps--;
+
+		if (!entry) goto next;
+
+		/*
+		 *	Removal shifts a later entry into this slot,
+		 *	so examine it again without advancing.
+		 */
+		if (entry->fields.expires < now) {
+			shard_entry_free(shard, shard->hand);
+			continue;
+		}
+
+		if (!full) goto next;
+
+		if (entry->referenced) {
+			entry->referenced = false;
+			goto next;
+		}
+
+		shard_entry_free(shard, shard->hand);
+		continue;
+
+	next:
+		shard->hand = (shard->hand + 1) & mask;
+	}
+}
+
+/** Lock the shard responsible for a hash, releasing any other shard we hold
+ *
+ */
+static inline cache_shard_t *shard_lock(rlm_cache_sharded_handle_t *handle, uint32_t hash)
+{
+	cache_shard_t *shard = &handle->driver->shards[hash & handle->driver->shard_mask];
+
+	if (handle->shard == shard) return shard;
+	if (handle->shard) pthread_mutex_unlock(&handle->shard->mutex);
+
+	pthread_mutex_lock(&shard->mutex);
+	handle->shard = shard;
+
+	return shard;
+}
+
+/** Cleanup a cache_sharded instance
+ *
+ */
+static int mod_detach(void *instance)
+{
+	rlm_cache_sharded_t	*driver = talloc_get_type_abort(instance, rlm_cache_sharded_t);
+	uint32_t		i;
+
+	if (!driver->shards) return 0;
+
+	for (i = 0; i < driver->num_shards; i++) {
+		TALLOC_FREE(driver->shards[i].ctx);	/* Frees the index and all entries */
+		pthread_mutex_destroy(&driver->shards[i].mutex);
+	}
+	TALLOC_FREE(driver->shards);
+
+	return 0;
+}
+
+/** Create a new cache_sharded instance
+ *
+ * @copydetails cache_instantiate_t
+ */
+static int mod_instantiate(UNUSED rlm_cache_config_t const *config, void *instance, UNUSED CONF_SECTION *conf)
+{
+	rlm_cache_sharded_t	*driver = talloc_get_type_abort(instance, rlm_cache_sharded_t);
+	uint32_t		i, num_shards = 1;
+
+	FR_INTEGER_BOUND_CHECK("shards", driver->num_shards, >=, 1);
+	FR_INTEGER_BOUND_CHECK("shards", driver->num_shards, <=, SHARD_MAX);
+
+	/*
+	 *	Round up to a power of 2 so we can select
+	 *	shards with a mask.
+	 */
+	while (num_shards < driver->num_shards) num_shards <<= 1;
+	driver->num_shards = num_shards;
+	driver->shard_mask = num_shards - 1;
+	driver->shard_max_memory = driver->max_memory / num_shards;
+
+	if (driver->max_memory && !driver->shard_max_memory) {
+		ERROR("max_memory must be at least %u bytes with %u shards", num_shards, num_shards);
+		return -1;
+	}
+
+	driver->shards = talloc_zero_array(driver, cache_shard_t, num_shards);
+	if (!driver->shards) {
+		ERROR("Failed allocating shards");
+		return -1;
+	}
+
+	for (i = 0; i < num_shards; i++) {
+		cache_shard_t *shard = &driver->shards[i];
+
+		/*
+		 *	Each shard gets its own talloc ctx, as
+		 *	talloc isn't thread safe, and entries are
+		 *	reparented whilst only the shard's mutex
+		 *	is held.
+		 */
+		shard->ctx = talloc_named_const(driver->shards, 0, "cache_shard_t");
+		if (!shard->ctx) {
+		oom:
+			ERROR("Failed allocating shard %u", i);
+			return -1;
+		}
+
+		shard->slots_bits = SHARD_MIN_SLOTS_BITS;
+		shard->slots = talloc_zero_array(shard->ctx, cache_slot_t, 1U << SHARD_MIN_SLOTS_BITS);
+		if (!shard->slots) goto oom;
+
+		if (pthread_mutex_init(&shard->mutex, NULL) != 0) {
+			ERROR("Failed initializing mutex: %s", fr_syserror(errno));
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/** Custom allocation function for the driver
+ *
+ * Allows allocation of cache entry structures with additional fields.
+ *
+ * @copydetails cache_entry_alloc_t
+ */
+static rlm_cache_entry_t *cache_entry_alloc(UNUSED rlm_cache_config_t const *config, UNUSED void *instance,
+					    REQUEST *request)
+{
+	rlm_cache_sharded_entry_t *c;
+
+	c = talloc_zero(NULL, rlm_cache_sharded_entry_t);
+	if (!c) {
+		RERROR("Failed allocating cache entry");
+		return NULL;
+	}
+
+	return (rlm_cache_entry_t *)c;
+}
+
+/** Locate a cache entry
+ *
+ * Locks the shard responsible for the key.
+ *
+ * @copydetails cache_entry_find_t
+ */
+static cache_status_t cache_entry_find(rlm_cache_entry_t **out,
+				       UNUSED rlm_cache_config_t const *config, UNUSED void *instance,
+				       UNUSED REQUEST *request, void *handle, uint8_t const *key, size_t key_len)
+{
+	rlm_cache_sharded_handle_t	*h = handle;
+	cache_shard_t			*shard;
+	uint32_t			hash = fr_hash(key, key_len);
+	int64_t				i;
+
+	shard = shard_lock(h, hash);
+
+	i = shard_index_find(shard, hash, key, key_len);
+	if (i < 0) {
+		*out = NULL;
+		return CACHE_MISS;
+	}
+
+	shard->slots[i].entry->referenced = true;
+	*out = &shard->slots[i].entry->fields;
+
+	return CACHE_OK;
+}
+
+/** Free an entry and remove it from the data store
+ *
+ * Locks the shard responsible for the key.
+ *
+ * @copydetails cache_entry_expire_t
+ */
+static cache_status_t cache_entry_expire(UNUSED rlm_cache_config_t const *config, UNUSED void *instance,
+					 REQUEST *request, void *handle,
+					 uint8_t const *key, size_t key_len)
+{
+	rlm_cache_sharded_handle_t	*h = handle;
+	cache_shard_t			*shard;
+	uint32_t			hash = fr_hash(key, key_len);
+	int64_t				i;
+
+	if (!request) return CACHE_ERROR;
+
+	shard = shard_lock(h, hash);
+
+	i = shard_index_find(shard, hash, key, key_len);
+	if (i < 0) return CACHE_MISS;
+
+	shard_entry_free(shard, i);
+
+	return CACHE_OK;
+}
+
+/** Insert a new entry into the data store
+ *
+ * Locks the shard responsible for the key, and advances its CLOCK hand to
+ * remove expired entries, or to make room for the new entry.
+ *
+ * @copydetails cache_entry_insert_t
+ */
+static cache_status_t cache_entry_insert(UNUSED rlm_cache_config_t const *config, void *instance,
+					 REQUEST *request, void *handle,
+					 rlm_cache_entry_t const *c)
+{
+	rlm_cache_sharded_t		*driver = talloc_get_type_abort(instance, rlm_cache_sharded_t);
+	rlm_cache_sharded_handle_t	*h = handle;
+	rlm_cache_sharded_entry_t	*entry;
+	cache_shard_t			*shard;
+	int64_t				i;
+
+	if (!request) return CACHE_ERROR;
+
+	memcpy(&entry, &c, sizeof(entry));
+
+	entry->hash = fr_hash(c->key, c->key_len);
+	entry->size = talloc_total_size(entry);
+	entry->referenced = false;
+
+	if (driver->shard_max_memory && (entry->size > driver->shard_max_memory)) {
+		RWARN("Entry size (%zu bytes) exceeds per-shard memory limit (%zu bytes)",
+		      entry->size, driver->shard_max_memory);
+		return CACHE_ERROR;
+	}
+
+	shard = shard_lock(h, entry->hash);
+
+	/*
+	 *	Allow overwriting
+	 */
+	i = shard_index_find(shard, entry->hash, c->key, c->key_len);
+	if (i >= 0) shard_entry_free(shard, i);
+
+	shard_sweep(driver, shard, request->packet->timestamp.tv_sec, entry->size, driver->sweep);
+
+	/*
+	 *	Keep the load factor below 0.75
+	 */
+	if (((shard->num_entries + 1) << 2) > (3U << shard->slots_bits)) {
+		if (shard_index_grow(shard) < 0) {
+			RERROR("Failed growing shard index");
+			return CACHE_ERROR;
+		}
+	}
+
+	shard_index_add(shard, entry);
+	shard->mem_used += entry->size;
+	talloc_steal(shard->ctx, entry);
+
+	return CACHE_OK;
+}
+
+/** Update the TTL of an entry
+ *
+ * The expiry time is only examined by the sweep, so there's nothing to re-index.
+ *
+ * @copydetails cache_entry_set_ttl_t
+ */
+static cache_status_t cache_entry_set_ttl(UNUSED rlm_cache_config_t const *config, UNUSED void *instance,
+					  REQUEST *request, void *handle,
+					  rlm_cache_entry_t *c)
+{
+	rlm_cache_sharded_handle_t	*h = handle;
+	rlm_cache_sharded_entry_t	*entry = (rlm_cache_sharded_entry_t *)c;
+
+#ifdef NDEBUG
+	if (!request) return CACHE_ERROR;
+#endif
+
+	/*
+	 *	The entry must have been retrieved with this handle
+	 */
+	if (!fr_cond_assert(h->shard == &h->driver->shards[entry->hash & h->driver->shard_mask])) {
+		RERROR("Entry's shard not locked");
+		return CACHE_ERROR;
+	}
+
+	entry->referenced = true;
+
+	return CACHE_OK;
+}
+
+/** Return the number of entries in the cache
+ *
+ * Shards other than the one we hold aren't locked, so this is approximate.
+ *
+ * @copydetails cache_entry_count_t
+ */
+static uint32_t cache_entry_count(UNUSED rlm_cache_config_t const *config, void *instance,
+				  REQUEST *request, UNUSED void *handle)
+{
+	rlm_cache_sharded_t	*driver = talloc_get_type_abort(instance, rlm_cache_sharded_t);
+	uint32_t		i, count = 0;
+
+	if (!request) return CACHE_ERROR;
+
+	for (i = 0; i < driver->num_shards; i++) count += driver->shards[i].num_entries;
+
+	return count;
+}
+
+/** Allocate a handle to track the shard we lock
+ *
+ * No locks are acquired until we know the key.
+ *
+ * @copydetails cache_acquire_t
+ */
+static int cache_acquire(void **handle, UNUSED rlm_cache_config_t const *config, void *instance,
+			 REQUEST *request)
+{
+	rlm_cache_sharded_handle_t *h;
+
+	MEM(h = talloc_zero(request, rlm_cache_sharded_handle_t));
+	h->driver = talloc_get_type_abort(instance, rlm_cache_sharded_t);
+
+	*handle = h;
+
+	return 0;
+}
+
+/** Release the handle, unlocking any shard it holds
+ *
+ * @copydetails cache_release_t
+ */
+static void cache_release(UNUSED rlm_cache_config_t const *config, UNUSED void *instance, REQUEST *request,
+			  rlm_cache_handle_t *handle)
+{
+	rlm_cache_sharded_handle_t *h = handle;
+
+	if (h->shard) {
+		pthread_mutex_unlock(&h->shard->mutex);
+		RDEBUG3("Shard %u released", (unsigned int)(h->shard - h->driver->shards));
+	}
+
+	talloc_free(h);
+}
+
+extern cache_driver_t rlm_cache_sharded;
+cache_driver_t rlm_cache_sharded = {
+	.name		= "rlm_cache_sharded",
+	.magic		= RLM_MODULE_INIT,
+	.config		= driver_config,
+	.instantiate	= mod_instantiate,
+	.detach		= mod_detach,
+	.inst_size	= sizeof(rlm_cache_sharded_t),
+	.alloc		= cache_entry_alloc,
+
+	.find		= cache_entry_find,
+	.insert		= cache_entry_insert,
+	.expire		= cache_entry_expire,
+	.set_ttl	= cache_entry_set_ttl,
+	.count		= cache_entry_count,
+
+	.acquire	= cache_acquire,
+	.release	= cache_release,
+};
@@ -45,9 +45,17 @@ static const CONF_PARSER module_config[] = {
 	/* Should be a type which matches time_t, @fixme before 2038 */
 	{ FR_CONF_OFFSET("epoch", FR_TYPE_INT32, rlm_cache_config_t, epoch), .dflt = "0" },
 	{ FR_CONF_OFFSET("add_stats", FR_TYPE_BOOL, rlm_cache_config_t, stats), .dflt = "no" },
+	{ FR_CONF_OFFSET("serialize", FR_TYPE_STRING, rlm_cache_config_t, serialize_name), .dflt = "text" },
 	CONF_PARSER_TERMINATOR
 };
 
+static FR_NAME_NUMBER const cache_serialize_table[] = {
+	{ "text",	CACHE_SERIALIZE_TEXT	},
+	{ "binary",	CACHE_SERIALIZE_BINARY	},
+
+	{  NULL , -1 }
+};
+
 static fr_dict_t const *dict_freeradius;
 
 static fr_dict_attr_t const *attr_cache_merge_new;
@@ -252,7 +260,7 @@ static rlm_rcode_t cache_find(rlm_cache_entry_t **out, rlm_cache_t const *inst,
 			talloc_free(p);
 		}
 
-		inst->driver->expire(&inst->config, inst->driver_inst->data, request, handle, c->key, c->key_len);
+		inst->driver->expire(&inst->config, inst->driver_inst->data, request, *handle, c->key, c->key_len);
 		cache_free(inst, &c);
 		return RLM_MODULE_NOTFOUND;	/* Couldn't find a non-expired entry */
 	}
@@ -320,7 +328,7 @@ static rlm_rcode_t cache_insert(rlm_cache_t const *inst, REQUEST *request, rlm_c
 	TALLOC_CTX		*pool;
 
 	if ((inst->config.max_entries > 0) && inst->driver->count &&
-	    (inst->driver->count(&inst->config, inst->driver_inst->data, request, handle) > inst->config.max_entries)) {
+	    (inst->driver->count(&inst->config, inst->driver_inst->data, request, *handle) > inst->config.max_entries)) {
 		RWDEBUG("Cache is full: %d entries", inst->config.max_entries);
 		return RLM_MODULE_FAIL;
 	}
@@ -851,15 +859,18 @@ static ssize_t cache_xlat(TALLOC_CTX *ctx, char **out, UNUSED size_t freespace,
 		return -1;
 	}
 
-	switch (cache_find(&c, mod_inst, request, handle, key, key_len)) {
+	switch (cache_find(&c, mod_inst, request, &handle, key, key_len)) {
 	case RLM_MODULE_OK:		/* found */
 		break;
 
 	case RLM_MODULE_NOTFOUND:	/* not found */
+		talloc_free(target);
+		cache_release(mod_inst, request, &handle);
 		return 0;
 
 	default:
 		talloc_free(target);
+		cache_release(mod_inst, request, &handle);
 		return -1;
 	}
 
@@ -875,14 +886,14 @@ static ssize_t cache_xlat(TALLOC_CTX *ctx, char **out, UNUSED size_t freespace,
 
 	talloc_free(target);
 
+	cache_free(mod_inst, &c);
+	cache_release(mod_inst, request, &handle);
+
 	/*
 	 *	Check if we found a matching map
 	 */
 	if (!map) return 0;
 
-	cache_free(mod_inst, &c);
-	cache_release(mod_inst, request, &handle);
-
 	return ret;
 }
 
@@ -942,6 +953,12 @@ static int mod_instantiate(void *instance, CONF_SECTION *conf)
 
 	rad_assert(inst->config.key);
 
+	inst->config.serialize = fr_str2int(cache_serialize_table, inst->config.serialize_name, CACHE_SERIALIZE_INVALID);
+	if (inst->config.serialize == CACHE_SERIALIZE_INVALID) {
+		cf_log_err(conf, "Invalid serialization format \"%s\"", inst->config.serialize_name);
+		return -1;
+	}
+
 	/*
 	 *	Sanity check for crazy people.
 	 */
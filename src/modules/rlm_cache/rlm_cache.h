@@ -40,6 +40,15 @@ typedef enum {
 	CACHE_MISS	= 1				//!< Cache entry notfound
 } cache_status_t;
 
+/** How drivers which store entries externally should serialize them
+ *
+ */
+typedef enum {
+	CACHE_SERIALIZE_INVALID = -1,
+	CACHE_SERIALIZE_TEXT = 0,			//!< One humanly readable map per line.
+	CACHE_SERIALIZE_BINARY				//!< Attribute numbers and network encoded values.
+} cache_serialize_format_t;
+
 /** Configuration for the rlm_cache module
  *
  * This is separate from the #rlm_cache_t struct, to limit driver's visibility of
@@ -53,6 +62,9 @@ typedef struct rlm_cache_config_t {
 	uint32_t		max_entries;		//!< Maximum entries allowed.
 	int32_t			epoch;			//!< Time after which entries are considered valid.
 	bool			stats;			//!< Generate statistics.
+
+	char const		*serialize_name;	//!< Serialization format name.
+	cache_serialize_format_t serialize;		//!< Serialization format drivers should use.
 } rlm_cache_config_t;
 
 /*
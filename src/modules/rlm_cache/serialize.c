@@ -22,12 +22,80 @@
  * @author Arran Cudbard-Bell
  * @copyright 2014 Arran Cudbard-Bell <a.cudbardb@freeradius.org>
  * @copyright 2014 The FreeRADIUS server project
+ *
+ * Two formats are supported.  The text format is a list of maps, one per line,
+ * which is easy to inspect, but which must be tokenized and have its attribute
+ * names resolved on every read.
+ *
+ * The binary format is encoded similarly to RADIUS attributes.  A header is
+ * followed by one record per map, where each record identifies the attribute
+ * by protocol and attribute numbers, and carries the value in its network
+ * representation.
+ *
+ @verbatim
+   0                   1                   2                   3
+   0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  |     Magic     |    Version    |      Created (64 bits) ...
+  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  |      Expires (64 bits) ...
+  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  |    Request    |     List      |      Tag      |   Operator    |
+  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  |                         Array index                           |
+  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  |                       Protocol number                         |
+  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  |     Depth     |  Attribute numbers (4 octets * depth) ...
+  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  |  Value type   |                 Value length
+  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  |               |  Value ...
+  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ @endverbatim
+ *
+ * The fields from Request to the end of the value are repeated for each map.
+ * All integers are in network byte order.
  */
 RCSID("$Id$")
 
 #include "rlm_cache.h"
 #include "serialize.h"
 
+#define CACHE_BINARY_HDR_LEN	18		//!< Magic, version, created, expires.
+#define CACHE_BINARY_MAP_LEN	18		//!< Fixed fields of a map, excluding attribute numbers and value.
+#define CACHE_BINARY_FIXED_MAX	32		//!< Larger than any fixed size network encoded value.
+
+#ifdef WITH_PROXY
+#  define CACHE_BINARY_LIST_MAX	PAIR_LIST_PROXY_REPLY	//!< Highest list a binary entry can reference.
+#else
+#  define CACHE_BINARY_LIST_MAX	PAIR_LIST_STATE
+#endif
+
+static void cache_binary_put_uint32(uint8_t *p, uint32_t num)
+{
+	p[0] = (num >> 24) & 0xff;
+	p[1] = (num >> 16) & 0xff;
+	p[2] = (num >> 8) & 0xff;
+	p[3] = num & 0xff;
+}
+
+static uint32_t cache_binary_get_uint32(uint8_t const *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static void cache_binary_put_uint64(uint8_t *p, uint64_t num)
+{
+	cache_binary_put_uint32(p, num >> 32);
+	cache_binary_put_uint32(p + 4, num & 0xffffffff);
+}
+
+static uint64_t cache_binary_get_uint64(uint8_t const *p)
+{
+	return ((uint64_t)cache_binary_get_uint32(p) << 32) | cache_binary_get_uint32(p + 4);
+}
+
 /** Serialize a cache entry as a humanly readable string
  *
  * @param ctx to alloc new string in. Should be a talloc pool a little bigger
@@ -172,3 +240,299 @@ int cache_deserialize(rlm_cache_entry_t *c, char *in, ssize_t inlen)
 
 	return 0;
 }
+
+/** Serialize a cache entry in the compact binary format
+ *
+ * @param ctx to alloc the buffer in.
+ * @param out Where to write pointer to serialized cache entry.
+ * @param c Cache entry to serialize.
+ * @return
+ *	- The length of the serialized data on success.
+ *	- -1 if the entry contains maps that can't be represented in the binary
+ *	  format, such as unknown attributes, or values with no network encoding.
+ */
+ssize_t cache_serialize_binary(TALLOC_CTX *ctx, uint8_t **out, rlm_cache_entry_t const *c)
+{
+	uint8_t		*buff, *p;
+	size_t		len = CACHE_BINARY_HDR_LEN;
+	vp_map_t	*map;
+
+	/*
+	 *	Figure out the maximum length of the serialized
+	 *	data, so we only allocate once.
+	 */
+	for (map = c->maps; map; map = map->next) {
+		fr_value_box_t const *value = &map->rhs->tmpl_value;
+
+		if ((map->lhs->type != TMPL_TYPE_ATTR) || (map->rhs->type != TMPL_TYPE_DATA)) {
+			fr_strerror_printf("Binary format can only represent attribute maps with literal values");
+			return -1;
+		}
+
+		if (map->lhs->tmpl_da->flags.is_unknown) {
+			fr_strerror_printf("Binary format can't represent unknown attribute \"%s\"",
+					   map->lhs->tmpl_da->name);
+			return -1;
+		}
+
+		len += CACHE_BINARY_MAP_LEN + (map->lhs->tmpl_da->depth * 4);
+		switch (value->type) {
+		case FR_TYPE_VARIABLE_SIZE:
+			len += value->vb_length;
+			break;
+
+		default:
+			len += CACHE_BINARY_FIXED_MAX;
+			break;
+		}
+	}
+
+	buff = p = talloc_array(ctx, uint8_t, len);
+	if (!buff) {
+		fr_strerror_printf("Out of memory");
+		return -1;
+	}
+
+	*p++ = CACHE_SERIALIZE_BINARY_MAGIC;
+	*p++ = CACHE_SERIALIZE_BINARY_VERSION;
+	cache_binary_put_uint64(p, (uint64_t)c->created);
+	p += 8;
+	cache_binary_put_uint64(p, (uint64_t)c->expires);
+	p += 8;
+
+	for (map = c->maps; map; map = map->next) {
+		fr_dict_attr_t const	*da = map->lhs->tmpl_da;
+		fr_dict_attr_t const	*da_p;
+		fr_dict_t		*dict;
+		uint8_t			*value_len;
+		ssize_t			slen;
+		unsigned int		i;
+
+		dict = fr_dict_by_da(da);
+		if (!dict) goto error;
+
+		*p++ = map->lhs->tmpl_request;
+		*p++ = map->lhs->tmpl_list;
+		*p++ = (uint8_t)map->lhs->tmpl_tag;
+		*p++ = map->op;
+		cache_binary_put_uint32(p, (uint32_t)map->lhs->tmpl_num);
+		p += 4;
+		cache_binary_put_uint32(p, fr_dict_root(dict)->attr);
+		p += 4;
+
+		/*
+		 *	Write attribute numbers outermost first,
+		 *	so they can be resolved from the root.
+		 */
+		*p++ = da->depth;
+		for (da_p = da, i = da->depth; i > 0; da_p = da_p->parent, i--) {
+			cache_binary_put_uint32(p + ((i - 1) * 4), da_p->attr);
+		}
+		p += da->depth * 4;
+
+		*p++ = map->rhs->tmpl_value_type;
+		value_len = p;
+		p += 4;
+
+		slen = fr_value_box_to_network(NULL, p, (buff + len) - p, &map->rhs->tmpl_value);
+		if (slen < 0) {
+		error:
+			talloc_free(buff);
+			return -1;
+		}
+		cache_binary_put_uint32(value_len, (uint32_t)slen);
+		p += slen;
+	}
+
+	*out = buff;
+
+	return p - buff;
+}
+
+/** Converts an entry serialized in the binary format back into a structure
+ *
+ * @param c Cache entry to populate (should already be allocated)
+ * @param in Binary representation of cache entry.
+ * @param inlen Length of the binary data.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+int cache_deserialize_binary(rlm_cache_entry_t *c, uint8_t const *in, size_t inlen)
+{
+	vp_map_t	**last = &c->maps;
+	uint8_t const	*p = in, *end = in + inlen;
+
+	if ((inlen < CACHE_BINARY_HDR_LEN) || (in[0] != CACHE_SERIALIZE_BINARY_MAGIC)) {
+		fr_strerror_printf("Not a binary cache entry");
+		return -1;
+	}
+
+	if (in[1] != CACHE_SERIALIZE_BINARY_VERSION) {
+		fr_strerror_printf("Unsupported binary cache entry version %u", in[1]);
+		return -1;
+	}
+	p += 2;
+
+	c->created = (time_t)cache_binary_get_uint64(p);
+	p += 8;
+	c->expires = (time_t)cache_binary_get_uint64(p);
+	p += 8;
+
+	while (p < end) {
+		vp_map_t		*map;
+		fr_dict_t		*dict;
+		fr_dict_attr_t const	*da;
+		fr_type_t		type;
+		uint32_t		proto, value_len;
+		unsigned int		depth, i;
+		uint8_t const		*hdr = p;
+
+		if ((end - p) < CACHE_BINARY_MAP_LEN) {
+		truncated:
+			fr_strerror_printf("Binary cache entry truncated");
+			return -1;
+		}
+
+		MEM(map = talloc_zero(c, vp_map_t));
+		MEM(map->lhs = talloc_zero(map, vp_tmpl_t));
+		MEM(map->rhs = tmpl_init(talloc(map, vp_tmpl_t), TMPL_TYPE_DATA, "", 0, T_BARE_WORD));
+
+		map->op = p[3];
+		proto = cache_binary_get_uint32(p + 8);
+		depth = p[12];
+		p += 13;
+
+		/*
+		 *	The entry comes from an external store, so check
+		 *	the enumerated values before using them.
+		 */
+		if ((hdr[0] < REQUEST_OUTER) || (hdr[0] > REQUEST_PROXY)) {
+			fr_strerror_printf("Invalid request reference %u in binary cache entry", hdr[0]);
+			goto error;
+		}
+
+		if ((hdr[1] < PAIR_LIST_REQUEST) || (hdr[1] > CACHE_BINARY_LIST_MAX)) {
+			fr_strerror_printf("Invalid list %u in binary cache entry", hdr[1]);
+			goto error;
+		}
+
+		if (((int8_t)hdr[2] != TAG_ANY) && ((int8_t)hdr[2] != TAG_NONE) && !TAG_VALID((int8_t)hdr[2])) {
+			fr_strerror_printf("Invalid tag %u in binary cache entry", hdr[2]);
+			goto error;
+		}
+
+		switch (map->op) {
+		case T_OP_ADD:
+		case T_OP_SUB:
+		case T_OP_SET:
+		case T_OP_EQ:
+		case T_OP_GE:
+		case T_OP_LE:
+		case T_OP_CMP_FALSE:
+			break;
+
+		default:
+			fr_strerror_printf("Invalid operator %u in binary cache entry", hdr[3]);
+			goto error;
+		}
+
+		dict = fr_dict_by_protocol_num(proto);
+		if (!dict && fr_dict_internal && (fr_dict_root(fr_dict_internal)->attr == proto)) dict = fr_dict_internal;
+		if (!dict) {
+			fr_strerror_printf("No dictionary for protocol %u", proto);
+		error:
+			talloc_free(map);
+			return -1;
+		}
+
+		if ((size_t)(end - p) < ((depth * 4) + 5)) {
+			talloc_free(map);
+			goto truncated;
+		}
+
+		da = fr_dict_root(dict);
+		for (i = 0; i < depth; i++, p += 4) {
+			da = fr_dict_attr_child_by_num(da, cache_binary_get_uint32(p));
+			if (!da) {
+				fr_strerror_printf("Unknown attribute at depth %u in binary cache entry", i + 1);
+				goto error;
+			}
+		}
+		tmpl_init(map->lhs, TMPL_TYPE_ATTR, da->name, strlen(da->name), T_BARE_WORD);
+		map->lhs->tmpl_da = da;
+		map->lhs->tmpl_request = hdr[0];
+		map->lhs->tmpl_list = hdr[1];
+		map->lhs->tmpl_tag = (int8_t)hdr[2];
+		map->lhs->tmpl_num = (int32_t)cache_binary_get_uint32(hdr + 4);
+
+		type = *p++;
+		value_len = cache_binary_get_uint32(p);
+		p += 4;
+		if ((type <= FR_TYPE_INVALID) || (type >= FR_TYPE_MAX)) {
+			fr_strerror_printf("Invalid value type %u in binary cache entry", type);
+			goto error;
+		}
+
+		if ((size_t)(end - p) < value_len) {
+			talloc_free(map);
+			goto truncated;
+		}
+
+		if (fr_value_box_from_network(map->rhs, &map->rhs->tmpl_value, type, da,
+					      p, value_len, true) < 0) goto error;
+		map->rhs->tmpl_value_type = type;
+		p += value_len;
+
+		*last = map;
+		last = &(*last)->next;
+	}
+
+	return 0;
+}
+
+/** Serialize a cache entry in the preferred format
+ *
+ * If the entry can't be represented in the binary format, the text format is used.
+ *
+ * @param ctx to alloc the buffer in.
+ * @param out Where to write pointer to serialized cache entry.
+ * @param c Cache entry to serialize.
+ * @param format preferred serialization format.
+ * @return
+ *	- The length of the serialized data on success.
+ *	- -1 on failure.
+ */
+ssize_t cache_serialize_format(TALLOC_CTX *ctx, uint8_t **out, rlm_cache_entry_t const *c,
+			       cache_serialize_format_t format)
+{
+	char	*to_store;
+	ssize_t	slen;
+
+	if (format == CACHE_SERIALIZE_BINARY) {
+		slen = cache_serialize_binary(ctx, out, c);
+		if (slen >= 0) return slen;
+	}
+
+	if (cache_serialize(ctx, &to_store, c) < 0) return -1;
+
+	*out = (uint8_t *)to_store;
+
+	return talloc_array_length(to_store) - 1;
+}
+
+/** Converts a serialized cache entry of either format back into a structure
+ *
+ * @param c Cache entry to populate (should already be allocated)
+ * @param in Serialized entry.  Text entries will be modified in place.
+ * @param inlen Length of the serialized data.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+int cache_deserialize_format(rlm_cache_entry_t *c, uint8_t *in, size_t inlen)
+{
+	if ((inlen > 0) && (in[0] == CACHE_SERIALIZE_BINARY_MAGIC)) return cache_deserialize_binary(c, in, inlen);
+
+	return cache_deserialize(c, (char *)in, inlen);
+}
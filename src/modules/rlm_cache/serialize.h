@@ -25,5 +25,15 @@
  */
 RCSIDH(serialize_h, "$Id$")
 
-int cache_serialize(TALLOC_CTX *ctx, char **out, rlm_cache_entry_t const *c);
-int cache_deserialize(rlm_cache_entry_t *c, char *in, ssize_t inlen);
+#define CACHE_SERIALIZE_BINARY_MAGIC	0xfc	//!< First octet of binary entries.  Text entries start with '&'.
+#define CACHE_SERIALIZE_BINARY_VERSION	1	//!< Current version of the binary format.
+
+int	cache_serialize(TALLOC_CTX *ctx, char **out, rlm_cache_entry_t const *c);
+int	cache_deserialize(rlm_cache_entry_t *c, char *in, ssize_t inlen);
+
+ssize_t	cache_serialize_binary(TALLOC_CTX *ctx, uint8_t **out, rlm_cache_entry_t const *c);
+int	cache_deserialize_binary(rlm_cache_entry_t *c, uint8_t const *in, size_t inlen);
+
+ssize_t	cache_serialize_format(TALLOC_CTX *ctx, uint8_t **out, rlm_cache_entry_t const *c,
+			       cache_serialize_format_t format);
+int	cache_deserialize_format(rlm_cache_entry_t *c, uint8_t *in, size_t inlen);
@@ -1833,6 +1833,16 @@ static int mod_bootstrap(void *instance, CONF_SECTION *conf)
 	xlat_register(inst, "hmacsha1", hmac_sha1_xlat, NULL, NULL, 0, XLAT_DEFAULT_BUF_LEN, true);
 	xlat_register(inst, "pairs", pairs_xlat, NULL, NULL, 0, XLAT_DEFAULT_BUF_LEN, true);
 
+	/*
+	 *	These only look at their input, so calls with
+	 *	constant arguments can be evaluated at compile time.
+	 */
+	xlat_set_pure("urlquote");
+	xlat_set_pure("escape");
+	xlat_set_pure("unescape");
+	xlat_set_pure("tolower");
+	xlat_set_pure("toupper");
+
 	xlat_register(inst, "base64", base64_xlat, NULL, NULL, 0, XLAT_DEFAULT_BUF_LEN, true);
 	xlat_register(inst, "base64tohex", base64_to_hex_xlat, NULL, NULL, 0, XLAT_DEFAULT_BUF_LEN, true);
 
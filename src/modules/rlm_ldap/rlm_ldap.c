@@ -168,6 +168,12 @@ static CONF_PARSER option_config[] = {
 	/* timeout for search results */
 	{ FR_CONF_OFFSET("res_timeout", FR_TYPE_TIMEVAL, rlm_ldap_t, handle_config.res_timeout), .dflt = "20" },
 
+	/* multiplex user object searches over a per-thread connection */
+	{ FR_CONF_OFFSET("async", FR_TYPE_BOOL, rlm_ldap_t, async), .dflt = "yes" },
+
+	/* how long to wait before re-establishing the per-thread connection */
+	{ FR_CONF_OFFSET("reconnection_delay", FR_TYPE_TIMEVAL, rlm_ldap_t, handle_config.reconnection_delay), .dflt = "10" },
+
 	CONF_PARSER_TERMINATOR
 };
 
@@ -884,74 +890,56 @@ free_result:
 	return rcode;
 }
 
-static rlm_rcode_t mod_authorize(void *instance, UNUSED void *thread, REQUEST *request) CC_HINT(nonnull);
-static rlm_rcode_t mod_authorize(void *instance, UNUSED void *thread, REQUEST *request)
+/** Context for an authorize call waiting on an asynchronous user object search
+ *
+ */
+typedef struct {
+	fr_ldap_map_exp_t	expanded;		//!< Attributes being retrieved, and the maps to apply.
+	fr_ldap_query_t		*query;			//!< Outstanding user object search.
+	bool			timeout_pending;	//!< Whether the search timeout is still armed.
+} ldap_autz_ctx_t;
+
+/** Apply the user object to the request
+ *
+ * Checks access, caches group memberships, retrieves eDirectory passwords, applies
+ * profiles, and finally applies the user map to the user object.
+ *
+ * @param[in] inst rlm_ldap configuration.
+ * @param[in] request Current request.
+ * @param[in,out] pconn to use. May change as this function calls functions which auto re-connect.
+ * @param[in] dn of the user object.
+ * @param[in] result of the user object search.
+ * @param[in] expanded Structure containing a list of xlat expanded attribute names and mapping
+information.
+ * @return One of the RLM_MODULE_* values.
+ */
+static rlm_rcode_t mod_authorize_user(rlm_ldap_t const *inst, REQUEST *request, fr_ldap_connection_t **pconn,
+				      char const *dn, LDAPMessage *result, fr_ldap_map_exp_t const *expanded)
 {
 	rlm_rcode_t		rcode = RLM_MODULE_OK;
 	int			ldap_errno;
 	int			i;
-	rlm_ldap_t const	*inst = instance;
 	struct berval		**values;
-	fr_ldap_connection_t	*conn;
-	LDAPMessage		*result, *entry;
-	char const 		*dn = NULL;
-	fr_ldap_map_exp_t	expanded; /* faster than allocing every time */
+	LDAPMessage		*entry;
 #ifdef WITH_EDIR
 	fr_ldap_rcode_t		status;
 #endif
 
-	/*
-	 *	Don't be tempted to add a check for request->username
-	 *	or request->password here. rlm_ldap.authorize can be used for
-	 *	many things besides searching for users.
-	 */
-
-	if (fr_ldap_map_expand(&expanded, request, inst->user_map) < 0) return RLM_MODULE_FAIL;
-
-	conn = mod_conn_get(inst, request);
-	if (!conn) return RLM_MODULE_FAIL;
-
-	/*
-	 *	Add any additional attributes we need for checking access, memberships, and profiles
-	 */
-	if (inst->userobj_access_attr) {
-		expanded.attrs[expanded.count++] = inst->userobj_access_attr;
-	}
-
-	if (inst->userobj_membership_attr && (inst->cacheable_group_dn || inst->cacheable_group_name)) {
-		expanded.attrs[expanded.count++] = inst->userobj_membership_attr;
-	}
-
-	if (inst->profile_attr) {
-		expanded.attrs[expanded.count++] = inst->profile_attr;
-	}
-
-	if (inst->valuepair_attr) {
-		expanded.attrs[expanded.count++] = inst->valuepair_attr;
-	}
-
-	expanded.attrs[expanded.count] = NULL;
-
-	dn = rlm_ldap_find_user(inst, request, &conn, expanded.attrs, true, &result, &rcode);
-	if (!dn) {
-		goto finish;
-	}
-
-	entry = ldap_first_entry(conn->handle, result);
+	entry = ldap_first_entry((*pconn)->handle, result);
 	if (!entry) {
-		ldap_get_option(conn->handle, LDAP_OPT_RESULT_CODE, &ldap_errno);
+		ldap_get_option((*pconn)->handle, LDAP_OPT_RESULT_CODE, &ldap_errno);
 		REDEBUG("Failed retrieving entry: %s", ldap_err2string(ldap_errno));
 
-		goto finish;
+		return rcode;
 	}
 
 	/*
 	 *	Check for access.
 	 */
 	if (inst->userobj_access_attr) {
-		rcode = rlm_ldap_check_access(inst, request, conn, entry);
+		rcode = rlm_ldap_check_access(inst, request, *pconn, entry);
 		if (rcode != RLM_MODULE_OK) {
-			goto finish;
+			return rcode;
 		}
 	}
 
@@ -960,15 +948,15 @@ static rlm_rcode_t mod_authorize(void *instance, UNUSED void *thread, REQUEST *r
 	 */
 	if (inst->cacheable_group_dn || inst->cacheable_group_name) {
 		if (inst->userobj_membership_attr) {
-			rcode = rlm_ldap_cacheable_userobj(inst, request, &conn, entry, inst->userobj_membership_attr);
+			rcode = rlm_ldap_cacheable_userobj(inst, request, pconn, entry, inst->userobj_membership_attr);
 			if (rcode != RLM_MODULE_OK) {
-				goto finish;
+				return rcode;
 			}
 		}
 
-		rcode = rlm_ldap_cacheable_groupobj(inst, request, &conn);
+		rcode = rlm_ldap_cacheable_groupobj(inst, request, pconn);
 		if (rcode != RLM_MODULE_OK) {
-			goto finish;
+			return rcode;
 		}
 	}
 
@@ -990,12 +978,10 @@ static rlm_rcode_t mod_authorize(void *instance, UNUSED void *thread, REQUEST *r
 		/*
 		 *	Retrive universal password
 		 */
-		res = fr_ldap_edir_get_password(conn->handle, dn, password, &pass_size);
+		res = fr_ldap_edir_get_password((*pconn)->handle, dn, password, &pass_size);
 		if (res != 0) {
 			REDEBUG("Failed to retrieve eDirectory password: (%i) %s", res, fr_ldap_edir_errstr(res));
-			rcode = RLM_MODULE_FAIL;
-
-			goto finish;
+			return RLM_MODULE_FAIL;
 		}
 
 		/*
@@ -1015,8 +1001,8 @@ static rlm_rcode_t mod_authorize(void *instance, UNUSED void *thread, REQUEST *r
 			/*
 			 *	Bind as the user
 			 */
-			conn->rebound = true;
-			status = fr_ldap_bind(request, &conn, dn, vp->vp_strvalue, NULL, NULL, NULL, NULL);
+			(*pconn)->rebound = true;
+			status = fr_ldap_bind(request, pconn, dn, vp->vp_strvalue, NULL, NULL, NULL, NULL);
 			switch (status) {
 			case LDAP_PROC_SUCCESS:
 				rcode = RLM_MODULE_OK;
@@ -1024,24 +1010,19 @@ static rlm_rcode_t mod_authorize(void *instance, UNUSED void *thread, REQUEST *r
 				break;
 
 			case LDAP_PROC_NOT_PERMITTED:
-				rcode = RLM_MODULE_USERLOCK;
-				goto finish;
+				return RLM_MODULE_USERLOCK;
 
 			case LDAP_PROC_REJECT:
-				rcode = RLM_MODULE_REJECT;
-				goto finish;
+				return RLM_MODULE_REJECT;
 
 			case LDAP_PROC_BAD_DN:
-				rcode = RLM_MODULE_INVALID;
-				goto finish;
+				return RLM_MODULE_INVALID;
 
 			case LDAP_PROC_NO_RESULT:
-				rcode = RLM_MODULE_NOTFOUND;
-				goto finish;
+				return RLM_MODULE_NOTFOUND;
 
 			default:
-				rcode = RLM_MODULE_FAIL;
-				goto finish;
+				return RLM_MODULE_FAIL;
 			};
 		}
 	}
@@ -1060,18 +1041,15 @@ skip_edir:
 				request, inst->default_profile, NULL, NULL) < 0) {
 			REDEBUG("Failed creating default profile string");
 
-			rcode = RLM_MODULE_INVALID;
-			goto finish;
+			return RLM_MODULE_INVALID;
 		}
 
-		switch (rlm_ldap_map_profile(inst, request, &conn, profile, &expanded)) {
+		switch (rlm_ldap_map_profile(inst, request, pconn, profile, expanded)) {
 		case RLM_MODULE_INVALID:
-			rcode = RLM_MODULE_INVALID;
-			goto finish;
+			return RLM_MODULE_INVALID;
 
 		case RLM_MODULE_FAIL:
-			rcode = RLM_MODULE_FAIL;
-			goto finish;
+			return RLM_MODULE_FAIL;
 
 		case RLM_MODULE_UPDATED:
 			rcode = RLM_MODULE_UPDATED;
@@ -1085,19 +1063,18 @@ skip_edir:
 	 *	Apply a SET of user profiles.
 	 */
 	if (inst->profile_attr) {
-		values = ldap_get_values_len(conn->handle, entry, inst->profile_attr);
+		values = ldap_get_values_len((*pconn)->handle, entry, inst->profile_attr);
 		if (values != NULL) {
 			for (i = 0; values[i] != NULL; i++) {
 				rlm_rcode_t ret;
 				char *value;
 
 				value = fr_ldap_berval_to_string(request, values[i]);
-				ret = rlm_ldap_map_profile(inst, request, &conn, value, &expanded);
+				ret = rlm_ldap_map_profile(inst, request, pconn, value, expanded);
 				talloc_free(value);
 				if (ret == RLM_MODULE_FAIL) {
 					ldap_value_free_len(values);
-					rcode = ret;
-					goto finish;
+					return ret;
 				}
 
 			}
@@ -1108,12 +1085,205 @@ skip_edir:
 	if (inst->user_map || inst->valuepair_attr) {
 		RDEBUG("Processing user attributes");
 		RINDENT();
-		if (fr_ldap_map_do(request, conn, inst->valuepair_attr,
-				   &expanded, entry) > 0) rcode = RLM_MODULE_UPDATED;
+		if (fr_ldap_map_do(request, *pconn, inst->valuepair_attr,
+				   expanded, entry) > 0) rcode = RLM_MODULE_UPDATED;
 		REXDENT();
-		rlm_ldap_check_reply(inst, request, conn);
+		rlm_ldap_check_reply(inst, request, *pconn);
+	}
+
+
+	return rcode;
+}
+
+/** Process the result of an asynchronous user object search
+ *
+ */
+static rlm_rcode_t mod_authorize_resume(REQUEST *request, void *instance, void *thread, void *ctx)
+{
+	rlm_ldap_t const	*inst = instance;
+	rlm_ldap_thread_t	*t = talloc_get_type_abort(thread, rlm_ldap_thread_t);
+	ldap_autz_ctx_t		*autz_ctx = talloc_get_type_abort(ctx, ldap_autz_ctx_t);
+	fr_ldap_query_t		*query = autz_ctx->query;
+	fr_ldap_connection_t	*conn = t->conn;
+	rlm_rcode_t		rcode = RLM_MODULE_FAIL;
+	char const		*dn;
+
+	if (autz_ctx->timeout_pending) unlang_event_timeout_delete(request, autz_ctx);
+
+	/*
+	 *	Query was abandoned by the timeout callback
+	 */
+	if (!query) {
+		REDEBUG("Timeout waiting for user object search result");
+		goto finish;
+	}
+
+	switch (query->ret) {
+	case LDAP_PROC_SUCCESS:
+		break;
+
+	case LDAP_PROC_BAD_DN:
+	case LDAP_PROC_NO_RESULT:
+		rcode = RLM_MODULE_NOTFOUND;
+		goto finish;
+
+	default:
+		goto finish;
+	}
+
+	/*
+	 *	Connection may have been reset between the
+	 *	result arriving and the request being resumed.
+	 */
+	if (!conn->handle) goto finish;
+
+	dn = rlm_ldap_find_user_result(inst, request, conn, query->result, &rcode);
+	if (!dn) goto finish;
+
+	rcode = mod_authorize_user(inst, request, &conn, dn, query->result, &autz_ctx->expanded);
+
+finish:
+	talloc_free(autz_ctx);
+
+	return rcode;
+}
+
+/** Abandon the user object search, and resume the request
+ *
+ */
+static void mod_authorize_timeout(REQUEST *request, UNUSED void *instance, UNUSED void *thread,
+				  void *ctx, UNUSED struct timeval *fired)
+{
+	ldap_autz_ctx_t		*autz_ctx = talloc_get_type_abort(ctx, ldap_autz_ctx_t);
+
+	autz_ctx->timeout_pending = false;
+
+	/*
+	 *	Result arrived, the request just hasn't been resumed yet.
+	 */
+	if (autz_ctx->query->ret != LDAP_PROC_CONTINUE) return;
+
+	TALLOC_FREE(autz_ctx->query);	/* Abandons the search */
+	unlang_resumable(request);
+}
+
+/** Abandon the user object search if the request is cancelled
+ *
+ */
+static void mod_authorize_signal(REQUEST *request, UNUSED void *instance, UNUSED void *thread,
+				 void *ctx, fr_state_signal_t action)
+{
+	ldap_autz_ctx_t		*autz_ctx = talloc_get_type_abort(ctx, ldap_autz_ctx_t);
+
+	if (action != FR_SIGNAL_CANCEL) return;
+
+	if (autz_ctx->timeout_pending) unlang_event_timeout_delete(request, autz_ctx);
+	talloc_free(autz_ctx);
+}
+
+static rlm_rcode_t mod_authorize(void *instance, void *thread, REQUEST *request) CC_HINT(nonnull);
+static rlm_rcode_t mod_authorize(void *instance, void *thread, REQUEST *request)
+{
+	rlm_rcode_t		rcode = RLM_MODULE_OK;
+	rlm_ldap_t const	*inst = instance;
+	rlm_ldap_thread_t	*t = talloc_get_type_abort(thread, rlm_ldap_thread_t);
+	fr_ldap_connection_t	*conn;
+	LDAPMessage		*result = NULL;
+	char const 		*dn = NULL;
+	fr_ldap_map_exp_t	expanded; /* faster than allocing every time */
+
+	/*
+	 *	Don't be tempted to add a check for request->username
+	 *	or request->password here. rlm_ldap.authorize can be used for
+	 *	many things besides searching for users.
+	 */
+
+	if (fr_ldap_map_expand(&expanded, request, inst->user_map) < 0) return RLM_MODULE_FAIL;
+
+	/*
+	 *	Add any additional attributes we need for checking access, memberships, and profiles
+	 */
+	if (inst->userobj_access_attr) {
+		expanded.attrs[expanded.count++] = inst->userobj_access_attr;
+	}
+
+	if (inst->userobj_membership_attr && (inst->cacheable_group_dn || inst->cacheable_group_name)) {
+		expanded.attrs[expanded.count++] = inst->userobj_membership_attr;
+	}
+
+	if (inst->profile_attr) {
+		expanded.attrs[expanded.count++] = inst->profile_attr;
+	}
+
+	if (inst->valuepair_attr) {
+		expanded.attrs[expanded.count++] = inst->valuepair_attr;
 	}
 
+	expanded.attrs[expanded.count] = NULL;
+
+	/*
+	 *	Send the user object search on the thread's
+	 *	connection, and yield until the result arrives.
+	 *
+	 *	t->conn is only allocated if async searches are
+	 *	enabled, and mod_instantiate disables them if we
+	 *	need anything else (group caching, profiles, eDir)
+	 *	which still requires a synchronous pool connection.
+	 */
+	if (t->conn && (t->conn->state != FR_LDAP_STATE_RUN)) {
+		RDEBUG2("Async connection not established, using connection pool");
+	} else if (t->conn) {
+		ldap_autz_ctx_t	*autz_ctx;
+		struct timeval	when;
+
+		MEM(autz_ctx = talloc_zero(request, ldap_autz_ctx_t));
+		autz_ctx->expanded = expanded;
+		talloc_steal(autz_ctx, expanded.ctx);
+
+		autz_ctx->query = rlm_ldap_find_user_async(autz_ctx, inst, request, t->conn,
+							   autz_ctx->expanded.attrs, &rcode);
+		if (autz_ctx->query) {
+			if (timerisset(&inst->handle_config.res_timeout)) {
+				gettimeofday(&when, NULL);
+				fr_timeval_add(&when, &when, &inst->handle_config.res_timeout);
+
+				if (unlang_event_module_timeout_add(request, mod_authorize_timeout,
+								    autz_ctx, &when) < 0) {
+					talloc_free(autz_ctx);
+					return RLM_MODULE_FAIL;
+				}
+				autz_ctx->timeout_pending = true;
+			}
+
+			return unlang_module_yield(request, mod_authorize_resume, mod_authorize_signal, autz_ctx);
+		}
+
+		if (rcode == RLM_MODULE_INVALID) {
+			talloc_free(autz_ctx);
+			return rcode;
+		}
+
+		/*
+		 *	Failed sending, fall back to using the pool.
+		 */
+		RWDEBUG("Failed sending asynchronous search, falling back to synchronous search");
+		talloc_steal(NULL, expanded.ctx);
+		talloc_free(autz_ctx);
+	}
+
+	conn = mod_conn_get(inst, request);
+	if (!conn) {
+		talloc_free(expanded.ctx);
+		return RLM_MODULE_FAIL;
+	}
+
+	dn = rlm_ldap_find_user(inst, request, &conn, expanded.attrs, true, &result, &rcode);
+	if (!dn) {
+		goto finish;
+	}
+
+	rcode = mod_authorize_user(inst, request, &conn, dn, result, &expanded);
+
 finish:
 	talloc_free(expanded.ctx);
 	if (result) ldap_msgfree(result);
@@ -1392,6 +1562,58 @@ static int mod_detach(void *instance)
 	return 0;
 }
 
+/** Create the connection that async searches are multiplexed over
+ *
+ * The connection is bound, and re-established, asynchronously by the
+ * LDAP connection state machine.  Until it reaches the RUN state,
+ * requests use the connection pool.
+ *
+ * @param[in] conf	section containing the configuration of this module instance.
+ * @param[in] instance	of rlm_ldap_t.
+ * @param[in] el	The event list serviced by this thread.
+ * @param[in] thread	specific data.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+static int mod_thread_instantiate(UNUSED CONF_SECTION const *conf, void *instance,
+				  fr_event_list_t *el, void *thread)
+{
+	rlm_ldap_t		*inst = instance;
+	rlm_ldap_thread_t	*t = thread;
+
+	t->inst = inst;
+	t->el = el;
+
+	if (!inst->async) return 0;
+
+	t->conn = fr_ldap_connection_state_alloc(t, el, &inst->handle_config, inst->name);
+	if (!t->conn) {
+		ERROR("Failed allocating async connection");
+		return -1;
+	}
+	fr_connection_signal_init(t->conn->conn);
+
+	return 0;
+}
+
+/** Close the thread's async connection
+ *
+ * Any searches still outstanding are abandoned.
+ *
+ * @param[in] el	for this thread.
+ * @param[in] thread	specific data to destroy.
+ * @return 0
+ */
+static int mod_thread_detach(UNUSED fr_event_list_t *el, void *thread)
+{
+	rlm_ldap_thread_t	*t = thread;
+
+	TALLOC_FREE(t->conn);
+
+	return 0;
+}
+
 /** Parse an accounting sub section.
  *
  * Allocate a new ldap_acct_section_t and write the config data into it.
@@ -1927,6 +2149,35 @@ static int mod_instantiate(void *instance, CONF_SECTION *conf)
 		return -1;
 	}
 
+	/*
+	 *	Async user object searches are only used when the
+	 *	search is the only operation authorize needs to
+	 *	perform.  Say why they're not, so that admins don't
+	 *	wonder where their per-thread connections went.
+	 */
+	if (inst->async) {
+		char const *reason = NULL;
+
+		if (inst->cacheable_group_name || inst->cacheable_group_dn) {
+			reason = "'group.cacheable_name' or 'group.cacheable_dn' is enabled";
+		} else if (inst->default_profile || inst->profile_attr) {
+			reason = "'profile.default' or 'profile.attribute' is set";
+#ifdef WITH_EDIR
+		} else if (inst->edir) {
+			reason = "'edir' is enabled";
+#endif
+#ifdef LDAP_CONTROL_X_SESSION_TRACKING
+		} else if (inst->session_tracking) {
+			reason = "'session_tracking' is enabled";
+#endif
+		}
+
+		if (reason) {
+			cf_log_info(conf, "Disabling 'options.async', as %s", reason);
+			inst->async = false;
+		}
+	}
+
 	/*
 	 *	Set global options
 	 */
@@ -1962,16 +2213,19 @@ static void mod_unload(void)
 /* globally exported name */
 extern rad_module_t rlm_ldap;
 rad_module_t rlm_ldap = {
-	.magic		= RLM_MODULE_INIT,
-	.name		= "ldap",
-	.type		= 0,
-	.inst_size	= sizeof(rlm_ldap_t),
-	.config		= module_config,
-	.load		= mod_load,
-	.unload		= mod_unload,
-	.bootstrap	= mod_bootstrap,
-	.instantiate	= mod_instantiate,
-	.detach		= mod_detach,
+	.magic			= RLM_MODULE_INIT,
+	.name			= "ldap",
+	.type			= 0,
+	.inst_size		= sizeof(rlm_ldap_t),
+	.thread_inst_size	= sizeof(rlm_ldap_thread_t),
+	.config			= module_config,
+	.load			= mod_load,
+	.unload			= mod_unload,
+	.bootstrap		= mod_bootstrap,
+	.instantiate		= mod_instantiate,
+	.thread_instantiate	= mod_thread_instantiate,
+	.thread_detach		= mod_thread_detach,
+	.detach			= mod_detach,
 	.methods = {
 		[MOD_AUTHENTICATE]	= mod_authenticate,
 		[MOD_AUTHORIZE]		= mod_authorize,
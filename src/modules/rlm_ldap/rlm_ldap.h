@@ -47,6 +47,10 @@ struct ldap_inst_s {
 	/*
 	 *	Options
 	 */
+	bool		async;				//!< Whether user object searches in authorize are
+							//!< multiplexed over a per-thread connection,
+							//!< yielding the request while the search is outstanding.
+
 #ifdef LDAP_CONTROL_X_SESSION_TRACKING
 	bool		session_tracking;		//!< Whether we add session tracking controls, which help
 							//!< identify the autz or acct session the commands were
@@ -148,12 +152,28 @@ struct ldap_inst_s {
 	uint32_t	ldap_debug;			//!< Debug flag for the SDK.
 };
 
+/** Thread specific rlm_ldap instance data
+ *
+ */
+typedef struct {
+	rlm_ldap_t const	*inst;		//!< Instance of rlm_ldap.
+	fr_event_list_t		*el;		//!< This thread's event list.
+	fr_ldap_connection_t	*conn;		//!< Connection async searches are multiplexed over.
+						//!< NULL if async is disabled.
+} rlm_ldap_thread_t;
+
 /*
  *	user.c - User lookup functions
  */
 char const *rlm_ldap_find_user(rlm_ldap_t const *inst, REQUEST *request, fr_ldap_connection_t **pconn,
 			       char const *attrs[], bool force, LDAPMessage **result, rlm_rcode_t *rcode);
 
+char const *rlm_ldap_find_user_result(rlm_ldap_t const *inst, REQUEST *request, fr_ldap_connection_t const *conn,
+				      LDAPMessage *result, rlm_rcode_t *rcode);
+
+fr_ldap_query_t *rlm_ldap_find_user_async(TALLOC_CTX *ctx, rlm_ldap_t const *inst, REQUEST *request,
+					  fr_ldap_connection_t *conn, char const *attrs[], rlm_rcode_t *rcode);
+
 rlm_rcode_t rlm_ldap_check_access(rlm_ldap_t const *inst, REQUEST *request,
 				  fr_ldap_connection_t const *conn, LDAPMessage *entry);
 
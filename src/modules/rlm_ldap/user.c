@@ -32,6 +32,143 @@
 
 #include "rlm_ldap.h"
 
+/** Expand the user object filter and base DN
+ *
+ * If the request already has a control:LDAP-UserDN, the object at that DN is
+ * read instead, with a base scope search and no filter.
+ *
+ * @param[in] inst		rlm_ldap configuration.
+ * @param[in] request		Current request.
+ * @param[out] filter		Expanded filter, or NULL if no filter is configured.
+ * @param[in] filter_buff	Buffer to write the expanded filter to.
+ * @param[out] base_dn		Expanded base DN.
+ * @param[in] base_dn_buff	Buffer to write the expanded base DN to.
+ * @param[out] scope		Scope to search with.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+static int rlm_ldap_user_search_expand(rlm_ldap_t const *inst, REQUEST *request,
+				       char const **filter, char filter_buff[LDAP_MAX_FILTER_STR_LEN],
+				       char const **base_dn, char base_dn_buff[LDAP_MAX_DN_STR_LEN], int *scope)
+{
+	VALUE_PAIR	*vp;
+
+	*filter = NULL;
+
+	vp = fr_pair_find_by_num(request->control, 0, FR_LDAP_USERDN, TAG_ANY);
+	if (vp) {
+		RDEBUG("Reading user object at DN \"%s\" from control:LDAP-UserDN", vp->vp_strvalue);
+		*base_dn = vp->vp_strvalue;
+		*scope = LDAP_SCOPE_BASE;
+		return 0;
+	}
+
+	*scope = inst->userobj_scope;
+
+	if (inst->userobj_filter) {
+		if (tmpl_expand(filter, filter_buff, LDAP_MAX_FILTER_STR_LEN, request, inst->userobj_filter,
+				fr_ldap_escape_func, NULL) < 0) {
+			REDEBUG("Unable to create filter");
+			return -1;
+		}
+	}
+
+	if (tmpl_expand(base_dn, base_dn_buff, LDAP_MAX_DN_STR_LEN, request,
+			inst->userobj_base_dn, fr_ldap_escape_func, NULL) < 0) {
+		REDEBUG("Unable to create base_dn");
+		return -1;
+	}
+
+	return 0;
+}
+
+/** Process the result of a user object search
+ *
+ * Checks the result isn't ambiguous, and adds the DN of the user object to the
+ * control list as LDAP-UserDN.
+ *
+ * @param[in] inst rlm_ldap configuration.
+ * @param[in] request Current request.
+ * @param[in] conn used to parse the result.
+ * @param[in] result of the user object search.  Not freed.
+ * @param[out] rcode The status of the operation, one of the RLM_MODULE_* codes.
+ * @return The user's DN or NULL on error.
+ */
+char const *rlm_ldap_find_user_result(rlm_ldap_t const *inst, REQUEST *request, fr_ldap_connection_t const *conn,
+				      LDAPMessage *result, rlm_rcode_t *rcode)
+{
+	VALUE_PAIR	*vp = NULL;
+	LDAPMessage	*entry = NULL;
+	int		ldap_errno;
+	int		cnt;
+	char		*dn = NULL;
+
+	*rcode = RLM_MODULE_FAIL;
+
+	/*
+	 *	Forbid the use of unsorted search results that
+	 *	contain multiple entries, as it's a potential
+	 *	security issue, and likely non deterministic.
+	 */
+	if (!inst->userobj_sort_ctrl) {
+		cnt = ldap_count_entries(conn->handle, result);
+		if (cnt > 1) {
+			REDEBUG("Ambiguous search result, returned %i unsorted entries (should return 1 or 0).  "
+				"Enable sorting, or specify a more restrictive base_dn, filter or scope", cnt);
+			REDEBUG("The following entries were returned:");
+			RINDENT();
+			for (entry = ldap_first_entry(conn->handle, result);
+			     entry;
+			     entry = ldap_next_entry(conn->handle, entry)) {
+				dn = ldap_get_dn(conn->handle, entry);
+				REDEBUG("%s", dn);
+				ldap_memfree(dn);
+			}
+			REXDENT();
+			*rcode = RLM_MODULE_INVALID;
+			return NULL;
+		}
+	}
+
+	entry = ldap_first_entry(conn->handle, result);
+	if (!entry) {
+		ldap_get_option(conn->handle, LDAP_OPT_RESULT_CODE, &ldap_errno);
+		REDEBUG("Failed retrieving entry: %s",
+			ldap_err2string(ldap_errno));
+
+		return NULL;
+	}
+
+	dn = ldap_get_dn(conn->handle, entry);
+	if (!dn) {
+		ldap_get_option(conn->handle, LDAP_OPT_RESULT_CODE, &ldap_errno);
+		REDEBUG("Retrieving object DN from entry failed: %s", ldap_err2string(ldap_errno));
+
+		return NULL;
+	}
+	fr_ldap_util_normalise_dn(dn, dn);
+
+	/*
+	 *	We can't use fr_pair_make here to copy the value into the
+	 *	attribute, as the dn must be copied into the attribute
+	 *	verbatim (without de-escaping).
+	 *
+	 *	Special chars are pre-escaped by libldap, and because
+	 *	we pass the string back to libldap we must not alter it.
+	 */
+	RDEBUG("User object found at DN \"%s\"", dn);
+	vp = fr_pair_find_by_num(request->control, 0, FR_LDAP_USERDN, TAG_ANY);
+	if (!vp) vp = fr_pair_make(request, &request->control, "LDAP-UserDN", NULL, T_OP_EQ);
+	if (vp) {
+		fr_pair_value_strcpy(vp, dn);
+		*rcode = RLM_MODULE_OK;
+	}
+	ldap_memfree(dn);
+
+	return vp ? vp->vp_strvalue : NULL;
+}
+
 /** Retrieve the DN of a user object
  *
  * Retrieves the DN of a user and adds it to the control list as LDAP-UserDN. Will also retrieve any
@@ -57,14 +194,13 @@ char const *rlm_ldap_find_user(rlm_ldap_t const *inst, REQUEST *request, fr_ldap
 
 	fr_ldap_rcode_t	status;
 	VALUE_PAIR	*vp = NULL;
-	LDAPMessage	*tmp_msg = NULL, *entry = NULL;
-	int		ldap_errno;
-	int		cnt;
-	char		*dn = NULL;
+	LDAPMessage	*tmp_msg = NULL;
+	char const	*dn;
 	char const	*filter = NULL;
 	char	    	filter_buff[LDAP_MAX_FILTER_STR_LEN];
 	char const	*base_dn;
 	char	    	base_dn_buff[LDAP_MAX_DN_STR_LEN];
+	int		scope;
 	LDAPControl	*serverctrls[] = { inst->userobj_sort_ctrl, NULL };
 
 	bool freeit = false;					//!< Whether the message should
@@ -111,26 +247,13 @@ char const *rlm_ldap_find_user(rlm_ldap_t const *inst, REQUEST *request, fr_ldap
 		(*pconn)->rebound = false;
 	}
 
-	if (inst->userobj_filter) {
-		if (tmpl_expand(&filter, filter_buff, sizeof(filter_buff), request, inst->userobj_filter,
-				fr_ldap_escape_func, NULL) < 0) {
-			REDEBUG("Unable to create filter");
-			*rcode = RLM_MODULE_INVALID;
-
-			return NULL;
-		}
-	}
-
-	if (tmpl_expand(&base_dn, base_dn_buff, sizeof(base_dn_buff), request,
-			inst->userobj_base_dn, fr_ldap_escape_func, NULL) < 0) {
-		REDEBUG("Unable to create base_dn");
+	if (rlm_ldap_user_search_expand(inst, request, &filter, filter_buff, &base_dn, base_dn_buff, &scope) < 0) {
 		*rcode = RLM_MODULE_INVALID;
-
 		return NULL;
 	}
 
 	status = fr_ldap_search(result, request, pconn, base_dn,
-				inst->userobj_scope, filter, attrs, serverctrls, NULL);
+				scope, filter, attrs, serverctrls, NULL);
 	switch (status) {
 	case LDAP_PROC_SUCCESS:
 		break;
@@ -147,72 +270,57 @@ char const *rlm_ldap_find_user(rlm_ldap_t const *inst, REQUEST *request, fr_ldap
 
 	rad_assert(*pconn);
 
-	/*
-	 *	Forbid the use of unsorted search results that
-	 *	contain multiple entries, as it's a potential
-	 *	security issue, and likely non deterministic.
-	 */
-	if (!inst->userobj_sort_ctrl) {
-		cnt = ldap_count_entries((*pconn)->handle, *result);
-		if (cnt > 1) {
-			REDEBUG("Ambiguous search result, returned %i unsorted entries (should return 1 or 0).  "
-				"Enable sorting, or specify a more restrictive base_dn, filter or scope", cnt);
-			REDEBUG("The following entries were returned:");
-			RINDENT();
-			for (entry = ldap_first_entry((*pconn)->handle, *result);
-			     entry;
-			     entry = ldap_next_entry((*pconn)->handle, entry)) {
-				dn = ldap_get_dn((*pconn)->handle, entry);
-				REDEBUG("%s", dn);
-				ldap_memfree(dn);
-			}
-			REXDENT();
-			*rcode = RLM_MODULE_INVALID;
-			goto finish;
-		}
-	}
-
-	entry = ldap_first_entry((*pconn)->handle, *result);
-	if (!entry) {
-		ldap_get_option((*pconn)->handle, LDAP_OPT_RESULT_CODE, &ldap_errno);
-		REDEBUG("Failed retrieving entry: %s",
-			ldap_err2string(ldap_errno));
+	dn = rlm_ldap_find_user_result(inst, request, *pconn, *result, rcode);
 
-		goto finish;
+	if ((freeit || (*rcode != RLM_MODULE_OK)) && *result) {
+		ldap_msgfree(*result);
+		*result = NULL;
 	}
 
-	dn = ldap_get_dn((*pconn)->handle, entry);
-	if (!dn) {
-		ldap_get_option((*pconn)->handle, LDAP_OPT_RESULT_CODE, &ldap_errno);
-		REDEBUG("Retrieving object DN from entry failed: %s", ldap_err2string(ldap_errno));
+	return dn;
+}
 
-		goto finish;
-	}
-	fr_ldap_util_normalise_dn(dn, dn);
+/** Send a search for the user object, without waiting for the result
+ *
+ * The search is multiplexed over the thread's connection.  The caller should yield
+ * the request, and process the result with #rlm_ldap_find_user_result once it's
+ * resumed.
+ *
+ * @param[in] ctx to allocate the query in.
+ * @param[in] inst rlm_ldap configuration.
+ * @param[in] request Current request.
+ * @param[in] conn to send the search on.  Must be in the #FR_LDAP_STATE_RUN state.
+ * @param[in] attrs Additional attributes to retrieve, may be NULL.
+ * @param[out] rcode The status of the operation, one of the RLM_MODULE_* codes.
+ * @return
+ *	- The outstanding query.
+ *	- NULL on error.
+ */
+fr_ldap_query_t *rlm_ldap_find_user_async(TALLOC_CTX *ctx, rlm_ldap_t const *inst, REQUEST *request,
+					  fr_ldap_connection_t *conn, char const *attrs[], rlm_rcode_t *rcode)
+{
+	fr_ldap_query_t	*query;
+	char const	*filter = NULL;
+	char	    	filter_buff[LDAP_MAX_FILTER_STR_LEN];
+	char const	*base_dn;
+	char	    	base_dn_buff[LDAP_MAX_DN_STR_LEN];
+	int		scope;
+	LDAPControl	*serverctrls[] = { inst->userobj_sort_ctrl, NULL };
 
-	/*
-	 *	We can't use fr_pair_make here to copy the value into the
-	 *	attribute, as the dn must be copied into the attribute
-	 *	verbatim (without de-escaping).
-	 *
-	 *	Special chars are pre-escaped by libldap, and because
-	 *	we pass the string back to libldap we must not alter it.
-	 */
-	RDEBUG("User object found at DN \"%s\"", dn);
-	vp = fr_pair_make(request, &request->control, "LDAP-UserDN", NULL, T_OP_EQ);
-	if (vp) {
-		fr_pair_value_strcpy(vp, dn);
-		*rcode = RLM_MODULE_OK;
+	if (rlm_ldap_user_search_expand(inst, request, &filter, filter_buff, &base_dn, base_dn_buff, &scope) < 0) {
+		*rcode = RLM_MODULE_INVALID;
+		return NULL;
 	}
-	ldap_memfree(dn);
 
-finish:
-	if ((freeit || (*rcode != RLM_MODULE_OK)) && *result) {
-		ldap_msgfree(*result);
-		*result = NULL;
+	query = fr_ldap_search_query(ctx, request, conn, base_dn, scope, filter, attrs,
+				     serverctrls, NULL);
+	if (!query) {
+		*rcode = RLM_MODULE_FAIL;
+		return NULL;
 	}
 
-	return vp ? vp->vp_strvalue : NULL;
+	*rcode = RLM_MODULE_OK;
+	return query;
 }
 
 /** Check for presence of access attribute in result
@@ -276,7 +384,7 @@ void rlm_ldap_check_reply(rlm_ldap_t const *inst, REQUEST *request, fr_ldap_conn
 	    !fr_pair_find_by_num(request->control, 0, FR_USER_PASSWORD, TAG_ANY) &&
 	    !fr_pair_find_by_num(request->control, 0, FR_PASSWORD_WITH_HEADER, TAG_ANY) &&
 	    !fr_pair_find_by_num(request->control, 0, FR_CRYPT_PASSWORD, TAG_ANY)) {
-		switch (conn->directory->type) {
+		switch (conn->directory ? conn->directory->type : FR_LDAP_DIRECTORY_UNKNOWN) {
 		case FR_LDAP_DIRECTORY_ACTIVE_DIRECTORY:
 			RWDEBUG("!!! Found map between LDAP attribute and a FreeRADIUS password attribute");
 			RWDEBUG("!!! Active Directory does not allow passwords to be read via LDAP");
@@ -40,6 +40,8 @@ static CONF_PARSER const status_checks_config[] = {
 	{ FR_CONF_OFFSET("type", FR_TYPE_VOID, rlm_radius_t, status_check),
 	  .func = status_check_type_parse },
 
+	{ FR_CONF_OFFSET("extended_id", FR_TYPE_BOOL, rlm_radius_t, extended_id), .dflt = "no" },
+
 	CONF_PARSER_TERMINATOR
 };
 
@@ -64,6 +66,9 @@ static CONF_PARSER const connection_config[] = {
 	{ FR_CONF_OFFSET("zombie_period", FR_TYPE_TIMEVAL, rlm_radius_t, zombie_period),
 	  .dflt = STRINGIFY(40) },
 
+	{ FR_CONF_OFFSET("max_outstanding", FR_TYPE_UINT32, rlm_radius_t, max_outstanding),
+	  .dflt = STRINGIFY(4096) },
+
 	CONF_PARSER_TERMINATOR
 };
 
@@ -593,6 +598,9 @@ static int mod_bootstrap(void *instance, CONF_SECTION *conf)
 	FR_TIMEVAL_BOUND_CHECK("connection.zombie_period", &inst->zombie_period, >=, 1, 0);
 	FR_TIMEVAL_BOUND_CHECK("connection.zombie_period", &inst->zombie_period, <=, 120, 0);
 
+	FR_INTEGER_BOUND_CHECK("connection.max_outstanding", inst->max_outstanding, >=, 256);
+	FR_INTEGER_BOUND_CHECK("connection.max_outstanding", inst->max_outstanding, <=, 65536);
+
 	num_types = talloc_array_length(inst->types);
 	rad_assert(num_types > 0);
 
@@ -639,6 +647,14 @@ static int mod_bootstrap(void *instance, CONF_SECTION *conf)
 		inst->status_check = 0;
 	}
 
+	/*
+	 *	Extended identifiers are negotiated via Status-Server.
+	 */
+	if (inst->extended_id && (inst->status_check != FR_CODE_STATUS_SERVER)) {
+		cf_log_warn(conf, "Ignoring 'extended_id = yes', as it requires 'status_checks { type = Status-Server }'");
+		inst->extended_id = false;
+	}
+
 	/*
 	 *	Don't sanity check the async timers if we're doing
 	 *	synchronous proxying.
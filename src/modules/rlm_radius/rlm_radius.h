@@ -105,6 +105,7 @@ struct rlm_radius_t {
 	CONF_SECTION		*io_conf;	//!< Easy access to the IO config section
 
 	uint32_t		max_connections;  //!< maximum number of open connections
+	uint32_t		max_outstanding;  //!< maximum packets outstanding on one connection
 	atomic_uint32_t		num_connections;  //!< actual number of connections
 	uint32_t		max_attributes;   //!< Maximum number of attributes to decode in response.
 
@@ -112,6 +113,7 @@ struct rlm_radius_t {
 	uint32_t		*types;		//!< array of allowed packet types
 	uint32_t		status_check;  	//!< code of status-check type
 	vp_map_t		*status_check_map;	//!< attributes for the status-server checks
+	bool			extended_id;	//!< negotiate FreeRADIUS-Extended-Identifier in status checks
 
 	int			allowed[FR_MAX_PACKET_CODE];
 	rlm_radius_retry_t	retry[FR_MAX_PACKET_CODE];
@@ -0,0 +1,3048 @@
+/*
+ *   This program is is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or (at
+ *   your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ * @file rlm_radius_tcp.c
+ * @brief RADIUS TCP and RADIUS/TLS transport
+ *
+ * Many requests are pipelined over each stream connection.  Unlike
+ * UDP, the transport is reliable, so packets are never retransmitted
+ * on the same connection (RFC 6613 Section 2.6.1).  Instead, packets
+ * are re-sent with a new ID when a connection fails.
+ *
+ * @copyright 2018  Network RADIUS SARL
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/io/application.h>
+#include <freeradius-devel/heap.h>
+#include <freeradius-devel/connection.h>
+#include <freeradius-devel/io/listen.h>
+#include <freeradius-devel/rad_assert.h>
+#include <freeradius-devel/unlang.h>
+
+#include "rlm_radius.h"
+#include "track.h"
+
+/*
+ *	How many maximum sized packets the receive buffer can hold.
+ *	Replies are decoded in place, so the more we can read at
+ *	once, the fewer system calls we make.
+ */
+#define TCP_RECV_PACKETS	(16)
+
+/** Static configuration for the module.
+ *
+ */
+typedef struct rlm_radius_tcp_t {
+	rlm_radius_t		*parent;		//!< rlm_radius instance.
+	CONF_SECTION		*config;
+
+	fr_ipaddr_t		dst_ipaddr;		//!< IP of the home server.
+	fr_ipaddr_t		src_ipaddr;		//!< IP we open our socket on.
+	uint16_t		dst_port;		//!< Port of the home server.
+	char const		*secret;		//!< Shared secret.
+	fr_radius_secret_t	radius_secret;		//!< Shared secret, with the MD5 state derived from it.
+
+	uint32_t		recv_buff;		//!< How big the kernel's receive buffer should be.
+	uint32_t		send_buff;		//!< How big the kernel's send buffer should be.
+
+	uint32_t		max_packet_size;	//!< Maximum packet size.
+
+	fr_dict_attr_t const	*response_length;	//!< Cached Response-Length attribute.
+	fr_dict_attr_t const	*error_cause;		//!< Cache Error-Cause attribute.
+
+#ifdef WITH_TLS
+	fr_tls_conf_t		*tls;			//!< RADIUS/TLS configuration, if any.
+#endif
+
+	bool			recv_buff_is_set;	//!< Whether we were provided with a recv_buf
+	bool			send_buff_is_set;	//!< Whether we were provided with a send_buf
+	bool			replicate;		//!< Copied from parent->replicate
+} rlm_radius_tcp_t;
+
+
+/** Per-thread configuration for the module.
+ *
+ *  This data structure holds the connections, etc. for this IO submodule.
+ */
+typedef struct rlm_radius_tcp_thread_t {
+	rlm_radius_tcp_t	*inst;			//!< IO submodule instance.
+	fr_event_list_t		*el;			//!< Event list.
+
+	fr_heap_t		*queued;		//!< Queued requests for some new connection.
+
+	fr_heap_t		*active;   		//!< Active connections.
+	fr_dlist_t		blocked;      		//!< blocked connections, waiting for writable
+	fr_dlist_t		full;      		//!< Full connections.
+	fr_dlist_t		zombie;      		//!< Zombie connections.
+	fr_dlist_t		opening;      		//!< Opening connections.
+} rlm_radius_tcp_thread_t;
+
+typedef enum rlm_radius_tcp_connection_state_t {
+	CONN_INIT = 0,					//!< Configured but not started.
+	CONN_OPENING,					//!< Trying to connect, or doing the TLS handshake.
+	CONN_ACTIVE,					//!< has free IDs
+	CONN_BLOCKED,					//!< blocked, but can't write to the socket
+	CONN_FULL,					//!< Live, but has no more IDs to use.
+	CONN_ZOMBIE,					//!< Has had a response timeout.
+} rlm_radius_tcp_connection_state_t;
+
+typedef struct rlm_radius_tcp_request_t rlm_radius_tcp_request_t;
+
+/** Represents a connection to an external RADIUS server
+ *
+ */
+typedef struct rlm_radius_tcp_connection_t {
+	rlm_radius_tcp_t const	*inst;			//!< Our module instance.
+	rlm_radius_tcp_thread_t *thread;       		//!< Our thread-specific data.
+	fr_connection_t		*conn;			//!< Connection to our destination.
+	char const     		*name;			//!< From IP PORT to IP PORT.
+
+	fr_dlist_t		entry;			//!< In the linked list of connections.
+	int32_t			heap_id;		//!< For the active heap.
+	rlm_radius_tcp_connection_state_t state;	//!< State of the connection.
+
+	fr_event_timer_t const	*idle_ev;		//!< Idle timeout event.
+	struct timeval		idle_timeout;		//!< When the idle timeout will fire.
+
+	struct timeval		mrs_time;		//!< Most recent sent time which had a reply.
+	struct timeval		last_reply;		//!< When we last received a reply.
+
+	fr_event_timer_t const	*zombie_ev;		//!< Zombie timeout.
+	struct timeval		zombie_start;		//!< When the zombie period started.
+
+	fr_dlist_t		sent;			//!< List of sent packets.
+
+	uint32_t		max_packet_size;	//!< Our max packet size. may be different from the parent.
+	int			fd;			//!< File descriptor.
+
+	fr_ipaddr_t		dst_ipaddr;		//!< IP of the home server. stupid 'const' issues.
+	uint16_t		dst_port;		//!< Port of the home server.
+	fr_ipaddr_t		src_ipaddr;		//!< Our source IP.
+	uint16_t	       	src_port;		//!< Our source port.
+
+	uint8_t			*buffer;		//!< Send buffer, for encoding packets.
+	size_t			buflen;			//!< Send buffer length.
+
+	uint8_t			*recv_buffer;		//!< Receive buffer, holding zero or more replies,
+							///< and possibly the start of the next one.
+	size_t			recv_buflen;		//!< Receive buffer length.
+	size_t			recv_used;		//!< How much of the receive buffer contains data.
+
+	uint8_t			*pending;		//!< Remainder of a packet which was partially written.
+	size_t			pending_len;		//!< How much of the packet is left to write.
+	size_t			pending_offset;		//!< Where we are in writing it.
+
+#ifdef WITH_TLS
+	tls_session_t		*tls;			//!< TLS session, for RADIUS/TLS.
+#endif
+
+	rlm_radius_tcp_request_t *status_u;    		//!< For Status-Server checks.
+
+	rlm_radius_id_t		*id;			//!< RADIUS ID tracking structure.
+} rlm_radius_tcp_connection_t;
+
+
+typedef enum rlm_radius_request_state_t {
+	PACKET_STATE_INIT = 0,
+	PACKET_STATE_THREAD,				//!< in the thread queue
+	PACKET_STATE_SENT,				//!< in the connection "sent" heap
+	PACKET_STATE_RESUMABLE,      			//!< timed out, or received a reply
+	PACKET_STATE_FINISHED,				//!< and done
+} rlm_radius_request_state_t;
+
+
+/** An ongoing RADIUS request
+ *
+ */
+struct rlm_radius_tcp_request_t {
+	rlm_radius_request_state_t state;		//!< state of this request
+
+	fr_dlist_t		entry;			//!< in the connection list of packets.
+	int32_t			heap_id;		//!< for the "to be sent" queue.
+
+	VALUE_PAIR		*extra;			//!< VPs for debugging, like Proxy-State.
+
+	bool			yielded;		//!< whether it yielded
+
+	int			code;			//!< Packet code.
+	rlm_radius_tcp_connection_t	*c;		//!< The connection state machine.
+	rlm_radius_tcp_thread_t *thread;		//!< the thread data for this request
+	rlm_radius_link_t	*link;			//!< More link stuff.
+	rlm_radius_request_t	*rr;			//!< ID tracking, resend count, etc.
+
+	rlm_radius_retransmit_t timer;			//!< response timeout data structures
+
+	uint8_t			*packet;		//!< Packet we write to the network.
+	size_t			packet_len;		//!< Length of the packet.
+};
+
+
+static const CONF_PARSER module_config[] = {
+	{ FR_CONF_OFFSET("ipaddr", FR_TYPE_COMBO_IP_ADDR, rlm_radius_tcp_t, dst_ipaddr), },
+	{ FR_CONF_OFFSET("ipv4addr", FR_TYPE_IPV4_ADDR, rlm_radius_tcp_t, dst_ipaddr) },
+	{ FR_CONF_OFFSET("ipv6addr", FR_TYPE_IPV6_ADDR, rlm_radius_tcp_t, dst_ipaddr) },
+
+	{ FR_CONF_OFFSET("port", FR_TYPE_UINT16, rlm_radius_tcp_t, dst_port) },
+
+	{ FR_CONF_OFFSET("secret", FR_TYPE_STRING | FR_TYPE_REQUIRED, rlm_radius_tcp_t, secret) },
+
+	{ FR_CONF_IS_SET_OFFSET("recv_buff", FR_TYPE_UINT32, rlm_radius_tcp_t, recv_buff) },
+	{ FR_CONF_IS_SET_OFFSET("send_buff", FR_TYPE_UINT32, rlm_radius_tcp_t, send_buff) },
+
+	{ FR_CONF_OFFSET("max_packet_size", FR_TYPE_UINT32, rlm_radius_tcp_t, max_packet_size),
+	  .dflt = "4096" },
+
+	{ FR_CONF_OFFSET("src_ipaddr", FR_TYPE_COMBO_IP_ADDR, rlm_radius_tcp_t, src_ipaddr) },
+	{ FR_CONF_OFFSET("src_ipv4addr", FR_TYPE_IPV4_ADDR, rlm_radius_tcp_t, src_ipaddr) },
+	{ FR_CONF_OFFSET("src_ipv6addr", FR_TYPE_IPV6_ADDR, rlm_radius_tcp_t, src_ipaddr) },
+
+	CONF_PARSER_TERMINATOR
+};
+
+static void conn_error(UNUSED fr_event_list_t *el, UNUSED int fd, UNUSED int flags, int fd_errno, void *uctx);
+static void conn_read(UNUSED fr_event_list_t *el, int fd, UNUSED int flags, void *uctx);
+static void conn_writable(UNUSED fr_event_list_t *el, int fd, UNUSED int flags, void *uctx);
+static int conn_write(rlm_radius_tcp_connection_t *c, rlm_radius_tcp_request_t *u);
+static fr_connection_state_t conn_ready(rlm_radius_tcp_connection_t *c);
+
+static int conn_cmp(void const *one, void const *two)
+{
+	rlm_radius_tcp_connection_t const *a = talloc_get_type_abort_const(one, rlm_radius_tcp_connection_t);
+	rlm_radius_tcp_connection_t const *b = talloc_get_type_abort_const(two, rlm_radius_tcp_connection_t);
+
+	if (timercmp(&a->mrs_time, &b->mrs_time, <)) return -1;
+	if (timercmp(&a->mrs_time, &b->mrs_time, >)) return +1;
+
+	if (a->id->num_free < b->id->num_free) return -1;
+	if (a->id->num_free > b->id->num_free) return +1;
+
+	return 0;
+}
+
+
+/** Compare two packets in the "to be sent" queue.
+ *
+ *  Status-Server packets are always sorted before other packets, by
+ *  virtue of request->async->recv_time always being zero.
+ */
+static int queue_cmp(void const *one, void const *two)
+{
+	rlm_radius_tcp_request_t const *a = one;
+	rlm_radius_tcp_request_t const *b = two;
+
+	if (a->link->request->async->recv_time < b->link->request->async->recv_time) return -1;
+	if (a->link->request->async->recv_time > b->link->request->async->recv_time) return +1;
+
+	return 0;
+}
+
+
+/** Read data from the connection, decrypting it if necessary
+ *
+ * @return
+ *	- >0 the amount of data read.
+ *	- 0 the other end closed the connection.
+ *	- <0 on error, with errno set.  EWOULDBLOCK means there's no more data.
+ */
+static ssize_t conn_recv(rlm_radius_tcp_connection_t *c, uint8_t *buffer, size_t buflen)
+{
+#ifdef WITH_TLS
+	if (c->tls) {
+		int ret;
+
+		ret = SSL_read(c->tls->ssl, buffer, buflen);
+		if (ret > 0) return ret;
+
+		switch (SSL_get_error(c->tls->ssl, ret)) {
+		case SSL_ERROR_WANT_READ:
+		case SSL_ERROR_WANT_WRITE:
+			errno = EWOULDBLOCK;
+			return -1;
+
+		case SSL_ERROR_ZERO_RETURN:
+			return 0;
+
+		default:
+			tls_log_io_error(NULL, c->tls, ret, "Failed reading from connection %s", c->name);
+			errno = ECONNRESET;
+			return -1;
+		}
+	}
+#endif
+
+	return read(c->fd, buffer, buflen);
+}
+
+
+/** Write data to the connection, encrypting it if necessary
+ *
+ * @return
+ *	- >0 the amount of data written.
+ *	- <0 on error, with errno set.  EWOULDBLOCK means the socket is full.
+ */
+static ssize_t conn_send(rlm_radius_tcp_connection_t *c, uint8_t const *buffer, size_t buflen)
+{
+#ifdef WITH_TLS
+	if (c->tls) {
+		int ret;
+
+		ret = SSL_write(c->tls->ssl, buffer, buflen);
+		if (ret > 0) return ret;
+
+		switch (SSL_get_error(c->tls->ssl, ret)) {
+		case SSL_ERROR_WANT_READ:
+		case SSL_ERROR_WANT_WRITE:
+			errno = EWOULDBLOCK;
+			return -1;
+
+		default:
+			tls_log_io_error(NULL, c->tls, ret, "Failed writing to connection %s", c->name);
+			errno = ECONNRESET;
+			return -1;
+		}
+	}
+#endif
+
+	return write(c->fd, buffer, buflen);
+}
+
+
+/** Write a packet to the stream
+ *
+ *  Partial writes are allowed.  The rest of the packet is saved in
+ *  the connection, and is flushed before anything else is written.
+ *  That way the packet can be freed, and the stream stays in sync.
+ *
+ * @return
+ *	- <0 on error
+ *	- 0 nothing was written, and the socket is blocked.
+ *	- 1 the packet was written, or queued in the connection.
+ */
+static int packet_send(rlm_radius_tcp_connection_t *c, uint8_t const *packet, size_t packet_len)
+{
+	ssize_t rcode;
+
+	rad_assert(c->pending_len == 0);
+
+	rcode = conn_send(c, packet, packet_len);
+	if (rcode < 0) {
+		if ((errno == EWOULDBLOCK) || (errno == EAGAIN)) return 0;
+
+		return -1;
+	}
+
+	if ((size_t) rcode == packet_len) return 1;
+
+	DEBUG3("%s - Partial write of %zd/%zu bytes on connection %s",
+	       c->inst->parent->name, rcode, packet_len, c->name);
+
+	c->pending_len = packet_len - rcode;
+	c->pending_offset = 0;
+	memcpy(c->pending, packet + rcode, c->pending_len);
+
+	return 1;
+}
+
+
+/** Flush the remainder of a partially written packet
+ *
+ * @return
+ *	- <0 on error
+ *	- 0 the socket blocked before we could finish.
+ *	- 1 there's no more pending data.
+ */
+static int pending_flush(rlm_radius_tcp_connection_t *c)
+{
+	ssize_t rcode;
+
+	while (c->pending_len > 0) {
+		rcode = conn_send(c, c->pending + c->pending_offset, c->pending_len);
+		if (rcode < 0) {
+			if ((errno == EWOULDBLOCK) || (errno == EAGAIN)) return 0;
+
+			return -1;
+		}
+
+		c->pending_offset += rcode;
+		c->pending_len -= rcode;
+	}
+
+	c->pending_offset = 0;
+	return 1;
+}
+
+
+/** Close a socket due to idle timeout
+ *
+ */
+static void conn_idle_timeout(UNUSED fr_event_list_t *el, UNUSED struct timeval *now, void *uctx)
+{
+	rlm_radius_tcp_connection_t *c = talloc_get_type_abort(uctx, rlm_radius_tcp_connection_t);
+
+	DEBUG("%s - Idle timeout for connection %s", c->inst->parent->name, c->name);
+
+	talloc_free(c);
+}
+
+
+/** Check if the connection is idle.
+ *
+ *  A connection is idle if it hasn't sent or recieved a packet in a
+ *  while.  Note that "no response to packet" does NOT set the idle
+ *  timeout.
+ */
+static void conn_check_idle(rlm_radius_tcp_connection_t *c)
+{
+	struct timeval when;
+
+	/*
+	 *	We set idle (or not) depending on the conneciton
+	 *	state.
+	 */
+	switch (c->state) {
+	case CONN_INIT:
+	case CONN_OPENING:
+		rad_assert(0 == 1);
+		return;
+
+		/*
+		 *	Active means "alive", and not "has packets".
+		 */
+	case CONN_ACTIVE:
+		/*
+		 *	No outstanding packets, we're idle.
+		 */
+		if (FR_DLIST_FIRST(c->sent) == NULL) {
+			break;
+		}
+
+		/*
+		 *	Has outstanding packets, we're not idle.
+		 */
+		/* FALL-THROUGH */
+
+		/*
+		 *	If a connection is blocked, full, or zombie,
+		 *	it's not idle.
+		 */
+	case CONN_BLOCKED:
+	case CONN_FULL:
+	case CONN_ZOMBIE:
+		if (c->idle_ev) (void) fr_event_timer_delete(c->thread->el, &c->idle_ev);
+		return;
+	}
+
+	/*
+	 *	We've already set an idle timeout.  Don't do it again.
+	 */
+	if (c->idle_ev) return;
+
+	gettimeofday(&when, NULL);
+	when.tv_usec += c->inst->parent->idle_timeout.tv_usec;
+	when.tv_sec += when.tv_usec / USEC;
+	when.tv_usec %= USEC;
+
+	when.tv_sec += c->inst->parent->idle_timeout.tv_sec;
+	when.tv_sec += 1;
+
+	if (timercmp(&when, &c->idle_timeout, >)) {
+		when.tv_sec--;
+		c->idle_timeout = when;
+
+		DEBUG("%s - Setting idle timeout to +%pV for connection %s",
+		      c->inst->parent->name, fr_box_timeval(c->inst->parent->idle_timeout), c->name);
+		if (fr_event_timer_insert(c, c->thread->el, &c->idle_ev, &c->idle_timeout, conn_idle_timeout, c) < 0) {
+			ERROR("%s - Failed inserting idle timeout for connection %s",
+			      c->inst->parent->name, c->name);
+		}
+	}
+}
+
+
+/** Set the socket to "nothing to write"
+ *
+ *  But keep the read event open, so that we can read replies.
+ *
+ * @param[in] c		Connection data structure
+ */
+static void fd_idle(rlm_radius_tcp_connection_t *c)
+{
+	DEBUG3("Marking socket %s as idle", c->name);
+	if (fr_event_fd_insert(c->conn, c->thread->el, c->fd,
+			       conn_read,
+			       NULL,
+			       conn_error,
+			       c) < 0) {
+		PERROR("Failed inserting FD event");
+		fr_connection_signal_reconnect(c->conn);
+	}
+}
+
+/** Set the socket to active
+ *
+ * We have messages we want to send, so need to know when the socket is writable.
+ *
+ * @param[in] c		Connection data structure
+ */
+static void fd_active(rlm_radius_tcp_connection_t *c)
+{
+	DEBUG3("%s - Activating connection %s", c->inst->parent->name, c->name);
+
+	/*
+	 *	If we're writing to the connection, it's not idle.
+	 */
+	if (c->idle_ev) (void) fr_event_timer_delete(c->thread->el, &c->idle_ev);
+
+	if (fr_event_fd_insert(c->conn, c->thread->el, c->fd,
+			       conn_read,
+			       conn_writable,
+			       conn_error,
+			       c) < 0) {
+		PERROR("Failed inserting FD event");
+
+		/*
+		 *	May free the connection!
+		 */
+		fr_connection_signal_reconnect(c->conn);
+	}
+}
+
+
+/** Mark a connection "zombie" due to zombie timeout.
+ *
+ */
+static void conn_zombie_timeout(UNUSED fr_event_list_t *el, UNUSED struct timeval *now, void *uctx)
+{
+	rlm_radius_tcp_connection_t *c = talloc_get_type_abort(uctx, rlm_radius_tcp_connection_t);
+
+	ERROR("%s - Zombie timeout for connection %s", c->inst->parent->name, c->name);
+
+	/*
+	 *	If we have Status-Server packets, start sending those now.
+	 */
+	if (c->status_u) {
+		int rcode;
+		rlm_radius_tcp_request_t *u = c->status_u;
+
+		/*
+		 *	Re-initialize the timers.
+		 */
+		u->timer.count = 0;
+
+		rcode = conn_write(c, u);
+		if (rcode < 0) {
+			DEBUG2("%s - Failed writing status check, closing connection %s",
+			       c->inst->parent->name, c->name);
+			talloc_free(c);
+			return;
+		}
+
+		/*
+		 *	It returned EWOULDBLOCK.  The zombie period
+		 *	ends without a status check, and the
+		 *	connection is closed.
+		 */
+		if (rcode == 0) {
+			DEBUG2("%s - EWOULDBLOCK for status check, closing connection %s",
+			       c->inst->parent->name, c->name);
+			talloc_free(c);
+			return;
+		}
+
+		/*
+		 *	Note that the status check packets not in any
+		 *	"sent" list
+		 */
+		if (rcode == 1) {
+			u->state = PACKET_STATE_SENT;
+			u->c = c;
+			if (c->pending_len) fd_active(c);
+			return;
+		}
+
+		/*
+		 *	Status check packets are never replicated.
+		 */
+		rad_assert(0 == 1);
+		return;
+	}
+
+	DEBUG2("%s - No status_check response, closing connection %s", c->inst->parent->name, c->name);
+
+	talloc_free(c);
+}
+
+
+/** Connection errored
+ *
+ */
+static void conn_error(UNUSED fr_event_list_t *el, UNUSED int fd, UNUSED int flags, int fd_errno, void *uctx)
+{
+	rlm_radius_tcp_connection_t *c = talloc_get_type_abort(uctx, rlm_radius_tcp_connection_t);
+
+	ERROR("%s - Connection failed: %s - %s", c->inst->parent->name, fr_syserror(fd_errno), c->name);
+
+	/*
+	 *	Something bad happened... Fix it...
+	 */
+	fr_connection_signal_reconnect(c->conn);
+}
+
+
+static void state_transition(rlm_radius_tcp_request_t *u, rlm_radius_request_state_t state)
+{
+	if (u->state == state) return;
+
+	rad_assert(!u->c || (u != u->c->status_u));
+
+	switch (u->state) {
+	case PACKET_STATE_INIT:
+		rad_assert(state == PACKET_STATE_THREAD);
+		break;
+
+	case PACKET_STATE_THREAD:
+		rad_assert(u->heap_id >= 0);
+		(void) fr_heap_extract(u->thread->queued, u);
+		break;
+
+	case PACKET_STATE_SENT:
+		rad_assert(u->rr != NULL);
+		rad_assert(u->c != NULL);
+		(void) rr_track_delete(u->c->id, u->rr);
+		fr_dlist_remove(&u->entry);
+		u->rr = NULL;
+		u->c = NULL;
+		break;
+
+	case PACKET_STATE_RESUMABLE:
+		rad_assert(state == PACKET_STATE_FINISHED);
+		break;
+
+	default:
+		rad_assert(0 == 1);
+		break;
+	}
+
+	u->state = state;
+	switch (u->state) {
+	case PACKET_STATE_THREAD:
+		rad_assert(u->rr == NULL);
+		rad_assert(u->c == NULL);
+		rad_assert(u->heap_id < 0);
+		fr_heap_insert(u->thread->queued, u);
+		break;
+
+	case PACKET_STATE_SENT:
+		rad_assert(u->rr != NULL);
+		rad_assert(u->c != NULL);
+		fr_dlist_insert_tail(&u->c->sent, &u->entry);
+		break;
+
+	case PACKET_STATE_RESUMABLE:
+		rad_assert(u->rr == NULL);
+		rad_assert(u->c == NULL);
+		if (u->timer.ev) (void) fr_event_timer_delete(u->thread->el, &u->timer.ev);
+		if (u->yielded) unlang_resumable(u->link->request);
+		break;
+
+	case PACKET_STATE_FINISHED:
+		rad_assert(u->rr == NULL);
+		rad_assert(u->c == NULL);
+		if (u->timer.ev) (void) fr_event_timer_delete(u->thread->el, &u->timer.ev);
+		break;
+
+	default:
+		rad_assert(0 == 1);
+		break;
+	}
+}
+
+static void mod_finished_request(rlm_radius_tcp_connection_t *c, rlm_radius_tcp_request_t *u)
+{
+	rad_assert(u->state != PACKET_STATE_FINISHED);
+
+	/*
+	 *	Delete the tracking table entry, and remove the
+	 *	request from the "sent" list for this connection.
+	 */
+	if (c) {
+		/*
+		 *	Status check packets are never removed from
+		 *	the connection, and their IDs are never
+		 *	deallocated.
+		 */
+		if (u == c->status_u) {
+			u->state = PACKET_STATE_INIT;
+			return;
+		}
+
+		rad_assert(u->state == PACKET_STATE_SENT);
+		state_transition(u, PACKET_STATE_RESUMABLE);
+
+		conn_check_idle(c);
+
+	} else {
+		rad_assert(u->state == PACKET_STATE_THREAD);
+		state_transition(u, PACKET_STATE_RESUMABLE);
+	}
+}
+
+/** Turn a reply code into a module rcode;
+ *
+ */
+static rlm_rcode_t code2rcode[FR_MAX_PACKET_CODE] = {
+	[FR_CODE_ACCESS_ACCEPT]		= RLM_MODULE_OK,
+	[FR_CODE_ACCESS_CHALLENGE]	= RLM_MODULE_UPDATED,
+	[FR_CODE_ACCESS_REJECT]		= RLM_MODULE_REJECT,
+
+	[FR_CODE_ACCOUNTING_RESPONSE]	= RLM_MODULE_OK,
+
+	[FR_CODE_COA_ACK]		= RLM_MODULE_OK,
+	[FR_CODE_COA_NAK]		= RLM_MODULE_REJECT,
+
+	[FR_CODE_DISCONNECT_ACK]	= RLM_MODULE_OK,
+	[FR_CODE_DISCONNECT_NAK]	= RLM_MODULE_REJECT,
+
+	[FR_CODE_PROTOCOL_ERROR]	= RLM_MODULE_FAIL,
+};
+
+
+/** If we get a reply, the request must come from one of a small
+ * number of packet types.
+ */
+static FR_CODE allowed_replies[FR_MAX_PACKET_CODE] = {
+	[FR_CODE_ACCESS_ACCEPT]		= FR_CODE_ACCESS_REQUEST,
+	[FR_CODE_ACCESS_CHALLENGE]	= FR_CODE_ACCESS_REQUEST,
+	[FR_CODE_ACCESS_REJECT]		= FR_CODE_ACCESS_REQUEST,
+
+	[FR_CODE_ACCOUNTING_RESPONSE]	= FR_CODE_ACCOUNTING_REQUEST,
+
+	[FR_CODE_COA_ACK]		= FR_CODE_COA_REQUEST,
+	[FR_CODE_COA_NAK]		= FR_CODE_COA_REQUEST,
+
+	[FR_CODE_DISCONNECT_ACK]	= FR_CODE_DISCONNECT_REQUEST,
+	[FR_CODE_DISCONNECT_NAK]	= FR_CODE_DISCONNECT_REQUEST,
+};
+
+
+/** Allow the home server to send us larger packets
+ *
+ *  The receive buffer may have unprocessed data in it, so we don't
+ *  grow it here.  conn_read() does that before the next read.
+ */
+static void response_length_update(rlm_radius_tcp_connection_t *c, REQUEST *request, VALUE_PAIR *vp)
+{
+	if (vp->vp_uint32 <= c->max_packet_size) return;
+
+	request->module = c->inst->parent->name;
+	RDEBUG("Increasing maximum packet size to %u for connection %s", vp->vp_uint32, c->name);
+
+	c->max_packet_size = vp->vp_uint32;
+}
+
+/** Deal with Protocol-Error replies, and possible negotiation
+ *
+ */
+static void protocol_error_reply(rlm_radius_tcp_connection_t *c, REQUEST *request)
+{
+	VALUE_PAIR *vp, *error_cause;
+
+	error_cause = fr_pair_find_by_da(request->reply->vps, c->inst->error_cause, TAG_ANY);
+	if (!error_cause) return;
+
+	if ((error_cause->vp_uint32 == 601) &&
+	    c->inst->response_length &&
+	    ((vp = fr_pair_find_by_da(request->reply->vps, c->inst->response_length, TAG_ANY)) != NULL)) {
+		response_length_update(c, request, vp);
+	}
+}
+
+/** Deal with Status-Server replies, and possible negotiation
+ *
+ */
+static void status_check_reply(rlm_radius_tcp_connection_t *c, rlm_radius_tcp_request_t *u, REQUEST *request)
+{
+	VALUE_PAIR *vp;
+
+	/*
+	 *	Remove all timers associated with the packet.
+	 */
+	if (u->timer.ev) (void) fr_event_timer_delete(u->thread->el, &u->timer.ev);
+
+	rad_assert(u->state == PACKET_STATE_SENT);
+	u->state = PACKET_STATE_INIT;
+
+	if (u->code != FR_CODE_STATUS_SERVER) return;
+
+	/*
+	 *	Allow Response-Length in replies to Status-Server
+	 *	packets.
+	 */
+	if (c->inst->response_length &&
+	    ((vp = fr_pair_find_by_da(request->reply->vps, c->inst->response_length, TAG_ANY)) != NULL)) {
+		response_length_update(c, request, vp);
+	}
+
+	/*
+	 *	The home server copied FreeRADIUS-Extended-Identifier
+	 *	to the reply, so it supports extended identifiers.
+	 *	The number of free IDs changes, so the connection has
+	 *	to be re-sorted in the active heap.
+	 */
+	if (c->inst->parent->extended_id && !c->id->use_extended_id &&
+	    fr_pair_find_by_num(request->reply->vps, VENDORPEC_FREERADIUS, FR_FREERADIUS_EXTENDED_IDENTIFIER, TAG_ANY)) {
+		bool active = (c->state == CONN_ACTIVE);
+
+		if (active) (void) fr_heap_extract(c->thread->active, c);
+
+		request->module = c->inst->parent->name;
+		if (rr_track_use_extended_id(c->id, true, c->inst->parent->max_outstanding) < 0) {
+			RWDEBUG("Failed allocating extended identifiers for connection %s", c->name);
+		} else {
+			RDEBUG("Using extended identifiers for connection %s", c->name);
+		}
+
+		if (active) (void) fr_heap_insert(c->thread->active, c);
+	}
+
+	/*
+	 *	Delete the reply VPs, but leave the request VPs in
+	 *	place.
+	 */
+#ifdef __clang_analyzer__
+	if (request->reply)
+#endif
+		fr_pair_list_free(&request->reply->vps);
+
+}
+
+static void conn_transition(rlm_radius_tcp_connection_t *c, rlm_radius_tcp_connection_state_t state)
+{
+	struct timeval when;
+
+	if (c->state == state) return;
+
+	/*
+	 *	Get it out of the old state.
+	 */
+	switch (c->state) {
+	case CONN_INIT:
+		break;
+
+	case CONN_OPENING:
+	case CONN_FULL:
+	case CONN_BLOCKED:
+		fr_dlist_remove(&c->entry);
+		break;
+
+	case CONN_ACTIVE:
+		rad_assert(c->heap_id >= 0);
+		(void) fr_heap_extract(c->thread->active, c);
+		if (c->idle_ev) (void) fr_event_timer_delete(c->thread->el, &c->idle_ev);
+		break;
+
+	case CONN_ZOMBIE:
+		/*
+		 *	Don't transition from zombie to blocked when
+		 *	we're trying to write status check packets to
+		 *	the connection.
+		 */
+		if (state == CONN_BLOCKED) return;
+
+		fr_dlist_remove(&c->entry);
+		if (c->zombie_ev) (void) fr_event_timer_delete(c->thread->el, &c->zombie_ev);
+		break;
+	}
+
+	/*
+	 *	And move it to the new state.
+	 */
+	c->state = state;
+	switch (c->state) {
+	case CONN_INIT:
+		break;
+
+	case CONN_OPENING:
+		fr_dlist_insert_head(&c->thread->opening, &c->entry);
+		break;
+
+	case CONN_ACTIVE:
+		rad_assert(c->heap_id < 0);
+		(void) fr_heap_insert(c->thread->active, c);
+		conn_check_idle(c);
+		break;
+
+	case CONN_BLOCKED:
+		if (c->idle_ev) (void) fr_event_timer_delete(c->thread->el, &c->idle_ev);
+
+		fr_dlist_insert_head(&c->thread->blocked, &c->entry);
+		break;
+
+	case CONN_FULL:
+		if (c->idle_ev) (void) fr_event_timer_delete(c->thread->el, &c->idle_ev);
+
+		fr_dlist_insert_head(&c->thread->full, &c->entry);
+		break;
+
+	case CONN_ZOMBIE:
+		if (c->idle_ev) (void) fr_event_timer_delete(c->thread->el, &c->idle_ev);
+
+		fr_dlist_insert_head(&c->thread->zombie, &c->entry);
+
+		gettimeofday(&when, NULL);
+		c->zombie_start = when;
+
+		fr_timeval_add(&when, &when, &c->inst->parent->zombie_period);
+		WARN("%s - Entering Zombie state - connection %s", c->inst->parent->name, c->name);
+
+		if (fr_event_timer_insert(c, c->thread->el, &c->zombie_ev, &when, conn_zombie_timeout, c) < 0) {
+			ERROR("%s - Failed inserting zombie timeout for connection %s",
+			      c->inst->parent->name, c->name);
+		}
+		break;
+	}
+}
+
+
+/** Process one reply packet
+ *
+ *  The packet is decoded in place, from the receive buffer.
+ *
+ * @return
+ *	- true if the connection should be activated.
+ *	- false otherwise.
+ */
+static bool conn_process_reply(rlm_radius_tcp_connection_t *c, uint8_t *packet, size_t packet_len, bool *reinserted)
+{
+	rlm_radius_request_t		*rr;
+	rlm_radius_link_t		*link;
+	rlm_radius_tcp_request_t	*u;
+	int				code;
+	decode_fail_t			reason;
+	REQUEST				*request = NULL;
+	uint8_t				original[20];
+	bool				activate = false;
+
+	if (!fr_radius_ok(packet, &packet_len, c->inst->parent->max_attributes, false, &reason)) {
+		WARN("%s - Ignoring malformed packet", c->inst->parent->name);
+		return false;
+	}
+
+	if (DEBUG_ENABLED3) {
+		DEBUG3("%s - Read packet", c->inst->parent->name);
+		fr_radius_print_hex(fr_log_fp, packet, packet_len);
+	}
+
+	rr = rr_track_find_reply(c->id, packet, packet_len);
+	if (!rr) {
+		WARN("%s - Ignoring reply which arrived too late", c->inst->parent->name);
+		return false;
+	}
+
+	link = rr->link;
+	u = link->request_io_ctx;
+	request = link->request;
+	rad_assert(request != NULL);
+
+	original[0] = rr->code;
+	original[1] = 0;	/* not looked at by fr_radius_verify() */
+	original[2] = 0;
+	original[3] = 20;	/* for debugging */
+	memcpy(original + 4, rr->vector, sizeof(rr->vector));
+
+	if (fr_radius_verify(packet, original, &c->inst->radius_secret) < 0) {
+		RPWDEBUG("Ignoring response with invalid signature");
+		return false;
+	}
+
+	/*
+	 *	We can only get a reply to a sent packet.
+	 */
+	rad_assert(u->state == PACKET_STATE_SENT);
+	rad_assert(u->c == c);
+
+	/*
+	 *	Remember when we last saw a reply.
+	 */
+	gettimeofday(&c->last_reply, NULL);
+
+	/*
+	 *	Track the Most Recently Started with reply.  If we're
+	 *	writable or have IDs available, just re-order the list
+	 *	instead of doing the transition.  This ensures that
+	 *	packets we're going to send will use the best
+	 *	connection.
+	 */
+	switch (c->state) {
+	case CONN_ACTIVE:
+		if (*reinserted) break;
+
+		if (timercmp(&u->timer.start, &c->mrs_time, >)) {
+			(void) fr_heap_extract(c->thread->active, c);
+			c->mrs_time = u->timer.start;
+			(void) fr_heap_insert(c->thread->active, c);
+			*reinserted = true;
+		}
+		break;
+
+		/*
+		 *	We're still flushing a partially written
+		 *	packet, so we can't take any more.
+		 */
+	case CONN_BLOCKED:
+		if (timercmp(&u->timer.start, &c->mrs_time, >)) {
+			c->mrs_time = u->timer.start;
+		}
+		if (c->pending_len) break;
+		/* FALL-THROUGH */
+
+	default:
+		if (timercmp(&u->timer.start, &c->mrs_time, >)) {
+			c->mrs_time = u->timer.start;
+		}
+
+		/*
+		 *	Transition to active on any one packet.  RFC
+		 *	3539 says to wait for N status check
+		 *	responses, but we're happy to do it faster.
+		 *
+		 *	If the connection was FULL, then
+		 *	mod_finished_request() will ensure that this
+		 *	packet has been removed from the connection,
+		 *	before any subsequent writes go to it.
+		 */
+		conn_transition(c, CONN_ACTIVE);
+
+		/*
+		 *	Note that we don't call fd_active() here, as
+		 *	it can fail, and close the connection.  In
+		 *	which case subsequent uses of 'c' would cause
+		 *	the server to crash.
+		 *
+		 *	Instead, we activate the connection only when
+		 *	we're exiting.
+		 */
+		activate = true;
+		break;
+	}
+
+	code = packet[0];
+
+	/*
+	 *	Set request return code based on the packet type.
+	 *	Note that we don't care what the sent packet is, we
+	 *	presume that the reply is correct for the request,
+	 *	because it has been successfully verified.  The reply
+	 *	packet code only affects the module return code,
+	 *	nothing else.
+	 *
+	 *	Protocol-Error is special.  It goes through it's own
+	 *	set of checks.
+	 */
+	if (code == FR_CODE_PROTOCOL_ERROR) {
+		uint8_t const *attr, *end;
+
+		end = packet + packet_len;
+		link->rcode = RLM_MODULE_INVALID;
+
+		for (attr = packet + 20;
+		     attr < end;
+		     attr += attr[1]) {
+			/*
+			 *	Must be an extended attribute.
+			 */
+			if (attr[0] != FR_EXTENDED_ATTRIBUTE_1) continue;
+
+			/*
+			 *	ATTR + LEN + EXT-Attr + uint32
+			 */
+			if (attr[1] != 7) continue;
+
+			/*
+			 *	See if there's an original packet code.
+			 */
+			if (attr[2] != FR_ORIGINAL_PACKET_CODE) continue;
+
+			/*
+			 *	Has to be an 8-bit number.
+			 */
+			if ((attr[3] != 0) ||
+			    (attr[4] != 0) ||
+			    (attr[5] != 0)) {
+				REDEBUG("Original-Packet-Code has invalid value > 255");
+				break;
+			}
+
+			/*
+			 *	This has to match.  We don't currently
+			 *	multiplex different codes with the
+			 *	same IDs on connections.  So this
+			 *	check is just for RFC compliance, and
+			 *	for sanity.
+			 */
+			if (attr[6] != u->code) {
+				REDEBUG("Original-Packet-Code %d does not match original code %d",
+				        attr[6], u->code);
+				break;
+			}
+
+			/*
+			 *	Allow the Protocol-Error response,
+			 *	which returns "fail".
+			 */
+			link->rcode = RLM_MODULE_FAIL;
+			break;
+		}
+
+		/*
+		 *	Decode and print the reply, so that the caller
+		 *	can do something with it.
+		 */
+		goto decode_reply;
+
+	} else if (!code || (code >= FR_MAX_PACKET_CODE)) {
+		REDEBUG("Unknown reply code %d", code);
+		link->rcode = RLM_MODULE_INVALID;
+
+		/*
+		 *	Different debug message.  The packet is within
+		 *	the known bounds, but is one we don't handle.
+		 */
+	} else if (!allowed_replies[code]) {
+		REDEBUG("%s packet received invalid reply code %s", fr_packet_codes[u->code], fr_packet_codes[code]);
+		link->rcode = RLM_MODULE_INVALID;
+
+
+		/*
+		 *	Status-Server packets can accept all possible replies.
+		 */
+	} else if (u->code == FR_CODE_STATUS_SERVER) {
+		link->rcode = code2rcode[code];
+
+		/*
+		 *	The reply is a known code, but isn't
+		 *	appropriate for the request packet type.
+		 */
+	} else if (allowed_replies[code] != (FR_CODE) u->code) {
+		rad_assert(request != NULL);
+
+		REDEBUG("Invalid reply code %s to request packet %s",
+		        fr_packet_codes[code], fr_packet_codes[u->code]);
+		link->rcode = RLM_MODULE_INVALID;
+
+		/*
+		 *	<whew>, it's OK.  Choose the correct module
+		 *	rcode based on the reply code.  This is either
+		 *	OK for an ACK, or FAIL for a NAK.
+		 */
+	} else {
+		VALUE_PAIR *vp;
+
+		link->rcode = code2rcode[code];
+
+	decode_reply:
+		vp = NULL;
+
+		/*
+		 *	Decode the attributes, in the context of the reply.
+		 */
+		if (fr_radius_decode(request->reply, packet, packet_len, original,
+				     c->inst->secret, 0, &vp) < 0) {
+			REDEBUG("Failed decoding attributes for packet");
+			fr_pair_list_free(&vp);
+			link->rcode = RLM_MODULE_INVALID;
+			goto done;
+		}
+
+		RDEBUG("Received %s ID %d length %ld reply packet on connection %s",
+		       fr_packet_codes[code], packet[1], packet_len, c->name);
+		rdebug_pair_list(L_DBG_LVL_2, request, vp, NULL);
+
+		/*
+		 *	FreeRADIUS-Extended-Identifier is hop-by-hop.
+		 *	The one in the reply is ours, and mustn't be
+		 *	copied to the reply we send to our client.
+		 *	Status checks look for it, to see whether the
+		 *	home server supports extended identifiers.
+		 */
+		if (u != c->status_u) {
+			fr_pair_delete_by_num(&vp, VENDORPEC_FREERADIUS, FR_FREERADIUS_EXTENDED_IDENTIFIER, TAG_ANY);
+		}
+
+		request->reply->code = code;
+		fr_pair_add(&request->reply->vps, vp);
+
+		/*
+		 *	Run hard-coded policies on Protocol-Error
+		 */
+		if (code == FR_CODE_PROTOCOL_ERROR) protocol_error_reply(c, request);
+	}
+
+done:
+	rad_assert(request != NULL);
+	rad_assert(request->reply != NULL);
+
+	/*
+	 *	We received the response to a Status-Server
+	 *	check.
+	 */
+	if (u == c->status_u) {
+		status_check_reply(c, u, request);
+
+	} else {
+		rad_assert(u->c == c);
+		rad_assert(u->rr != NULL);
+		rad_assert(u->state == PACKET_STATE_SENT);
+
+		/*
+		 *	It's a normal request.  Mark it as finished.
+		 */
+		mod_finished_request(c, u);
+	}
+
+	return activate;
+}
+
+
+/** Read reply packets.
+ *
+ *  Data is read into the connection's receive buffer, and each
+ *  complete packet is processed where it lies.  Any trailing partial
+ *  packet is moved to the start of the buffer, for the next read.
+ */
+static void conn_read(fr_event_list_t *el, int fd, UNUSED int flags, void *uctx)
+{
+	rlm_radius_tcp_connection_t	*c = talloc_get_type_abort(uctx, rlm_radius_tcp_connection_t);
+	ssize_t				data_len;
+	size_t				packet_len;
+	uint8_t				*p, *end;
+	bool				reinserted = false;
+	bool				activate = false;
+
+	DEBUG3("%s - Reading data for connection %s", c->inst->parent->name, c->name);
+
+redo:
+	/*
+	 *	A Response-Length negotiation may have raised the
+	 *	maximum packet size.  Grow the receive buffer so
+	 *	that it can hold at least one complete packet.
+	 */
+	if (c->recv_buflen < c->max_packet_size) {
+		uint8_t *buffer;
+
+		MEM(buffer = talloc_array(c, uint8_t, c->max_packet_size));
+		memcpy(buffer, c->recv_buffer, c->recv_used);
+		talloc_free(c->recv_buffer);
+		c->recv_buffer = buffer;
+		c->recv_buflen = c->max_packet_size;
+	}
+
+	/*
+	 *	Drain the socket of all data.  If we're busy, this
+	 *	saves a round through the event loop.  If we're not
+	 *	busy, a few extra system calls don't matter.
+	 */
+	data_len = conn_recv(c, c->recv_buffer + c->recv_used, c->recv_buflen - c->recv_used);
+	if (data_len == 0) {
+		DEBUG("%s - Connection closed by home server - %s", c->inst->parent->name, c->name);
+		fr_connection_signal_reconnect(c->conn);
+		return;
+	}
+
+	if (data_len < 0) {
+		if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+			if (activate && (fr_heap_num_elements(c->thread->queued) > 0)) {
+				fd_active(c);
+			}
+			return;
+		}
+
+		conn_error(el, fd, 0, errno, c);
+		return;
+	}
+
+	c->recv_used += data_len;
+
+	/*
+	 *	Replicating?  Drain the socket, but ignore all responses.
+	 */
+	if (c->inst->replicate) {
+		c->recv_used = 0;
+		goto redo;
+	}
+
+	p = c->recv_buffer;
+	end = c->recv_buffer + c->recv_used;
+
+	/*
+	 *	Process all of the complete packets in the buffer.
+	 */
+	while ((end - p) >= 4) {
+		packet_len = (p[2] << 8) | p[3];
+
+		/*
+		 *	We can't resynchronise a stream once the
+		 *	framing is lost.  Close it.
+		 */
+		if ((packet_len < 20) || (packet_len > c->max_packet_size)) {
+			ERROR("%s - Invalid packet length %zu from home server, closing connection %s",
+			      c->inst->parent->name, packet_len, c->name);
+			c->recv_used = 0;
+			fr_connection_signal_reconnect(c->conn);
+			return;
+		}
+
+		if ((size_t) (end - p) < packet_len) break;
+
+		if (conn_process_reply(c, p, packet_len, &reinserted)) activate = true;
+
+		p += packet_len;
+	}
+
+	/*
+	 *	Move any partial packet to the start of the buffer.
+	 */
+	c->recv_used = end - p;
+	if (c->recv_used && (p != c->recv_buffer)) memmove(c->recv_buffer, p, c->recv_used);
+
+	goto redo;
+}
+
+
+/** Deal with per-request timeouts
+ *
+ *  TCP is reliable, so we don't retransmit packets on the same
+ *  connection.  The retransmission timers are only used to decide
+ *  when to give up on a reply, or to send a queued packet when there
+ *  wasn't a connection for it.
+ */
+static void response_timeout(fr_event_list_t *el, struct timeval *now, void *uctx)
+{
+	int				rcode;
+	rlm_radius_tcp_request_t	*u = uctx;
+	rlm_radius_tcp_connection_t	*c = u->c;
+	REQUEST				*request;
+
+	rad_assert(u->timer.ev == NULL);
+
+	request = u->link->request;
+
+	RDEBUG("TIMER - response timeout reached for try (%d/%d)",
+	       u->timer.count, u->timer.retry->mrc);
+
+	/*
+	 *	Can we wait for longer?  If not, then maybe the
+	 *	connection is zombie.  If we don't have a connection,
+	 *	just give up on the request.
+	 */
+	rcode = rr_track_retry(&u->timer, now);
+	if (rcode == 0) {
+		if (c) {
+			if (u == c->status_u) {
+				/*
+				 *	Negotiation failed, but the
+				 *	connection is still usable.
+				 */
+				if (c->state != CONN_ZOMBIE) {
+					RDEBUG("No response to extended identifier negotiation on connection %s",
+					       c->name);
+					u->state = PACKET_STATE_INIT;
+					return;
+				}
+
+				REDEBUG("No response to status checks, closing connection %s", c->name);
+				talloc_free(c);
+				return;
+			}
+
+			REDEBUG("No response to proxied request ID %d on connection %s",
+				u->rr->id, c->name);
+			conn_transition(c, CONN_ZOMBIE);
+
+		} else {
+			REDEBUG("No response to proxied request");
+		}
+
+		mod_finished_request(c, u);
+		return;
+	}
+
+	/*
+	 *	Insert the next timer.
+	 */
+	if (fr_event_timer_insert(u, el, &u->timer.ev, &u->timer.next, response_timeout, u) < 0) {
+		RDEBUG("Failed inserting response timer");
+		mod_finished_request(c, u);
+		return;
+	}
+
+	/*
+	 *	The packet has been written to the stream, and the
+	 *	stream will get it there.  Keep waiting.
+	 */
+	if (c) {
+		RDEBUG("Waiting %d.%06ds for response to ID %d on connection %s",
+		       u->timer.rt / USEC, u->timer.rt % USEC, u->rr->id, c->name);
+		return;
+	}
+
+	/*
+	 *	The timer hit, but there was no connection for the
+	 *	packet.  Try to grab an active connection.
+	 */
+get_new_connection:
+	rad_assert(u->state == PACKET_STATE_THREAD);
+	c = fr_heap_peek(u->thread->active);
+	if (!c) {
+		RDEBUG("No available connections.  Waiting %d.%06ds for retry",
+		       u->timer.rt / USEC, u->timer.rt % USEC);
+		return;
+	}
+
+	/*
+	 *	We just grabbed a new connection, go allocate
+	 *	an ID for it.
+	 */
+	u->rr = rr_track_alloc(c->id, u->link->request, u->code, u->link, &u->timer);
+	if (!u->rr) {
+		conn_transition(c, CONN_FULL);
+		goto get_new_connection;
+	}
+
+	/*
+	 *	We have a connection, transition to "sent".
+	 */
+	u->c = c;
+	state_transition(u, PACKET_STATE_SENT);
+
+	rcode = conn_write(c, u);
+	if (rcode < 0) {
+		RDEBUG("Failed writing packet for connection %s", c->name);
+		state_transition(u, PACKET_STATE_THREAD);
+		talloc_free(c);
+		goto get_new_connection;
+	}
+
+	/*
+	 *	EWOULDBLOCK, move the connection to blocked, and move
+	 *	the packet back to the thread queue, and try to send
+	 *	the packet on yet another connection.
+	 */
+	if (rcode == 0) {
+		RDEBUG("Blocked writing for connection %s", c->name);
+		state_transition(u, PACKET_STATE_THREAD);
+		conn_transition(c, CONN_BLOCKED);
+		fd_active(c);
+		goto get_new_connection;
+	}
+
+	/*
+	 *	The packet was replicated, we don't care about
+	 *	the reply.
+	 */
+	if (rcode == 2) {
+		state_transition(u, PACKET_STATE_RESUMABLE);
+		return;
+	}
+
+	/*
+	 *	Some of the packet is still waiting to be written.
+	 */
+	if (c->pending_len) {
+		conn_transition(c, CONN_BLOCKED);
+		fd_active(c);
+	}
+}
+
+
+/** Write a packet to a connection
+ *
+ * @param c the conneciton
+ * @param u the tcp_request_t connecting everything
+ * @return
+ *	- <0 on error
+ *	- 0 should retry the write later
+ *	- 1 the packet was successfully written to the socket, and we wait for a reply.
+ *	  Some of it may still be pending in the connection.
+ *	- 2 the packet was replicated to the socket, and should be resumed immediately.
+ */
+static int conn_write(rlm_radius_tcp_connection_t *c, rlm_radius_tcp_request_t *u)
+{
+	int			rcode;
+	size_t			buflen;
+	ssize_t			packet_len;
+	uint8_t			*msg = NULL;
+	bool			require_ma = false;
+	int			proxy_state = 6;
+	int			extended_len = 0;
+	uint32_t		extended_id = 0;
+	VALUE_PAIR		*hop_by_hop;
+	REQUEST			*request;
+	char const		*module_name;
+
+	rad_assert(c->inst->parent->allowed[u->code] || (u == c->status_u));
+	if (c->idle_ev) (void) fr_event_timer_delete(c->thread->el, &c->idle_ev);
+
+	/*
+	 *	We can't interleave packets, so we have to wait
+	 *	until the last one has been written.
+	 */
+	if (c->pending_len) return 0;
+
+	request = u->link->request;
+
+	/*
+	 *	Make sure that we print out the actual encoded value
+	 *	of the Message-Authenticator attribute.  If the caller
+	 *	asked for one, delete theirs (which has a bad value),
+	 *	and remember to add one manually when we encode the
+	 *	packet.  This is the only editing we do on the input
+	 *	request.
+	 */
+	if (fr_pair_find_by_num(request->packet->vps, 0, FR_MESSAGE_AUTHENTICATOR, TAG_ANY)) {
+		require_ma = true;
+		fr_pair_delete_by_num(&request->packet->vps, 0, FR_MESSAGE_AUTHENTICATOR, TAG_ANY);
+	}
+
+	/*
+	 *	All proxied Access-Request packets MUST have a
+	 *	Message-Authenticator, otherwise they're insecure.
+	 *	Same goes for Status-Server.
+	 *
+	 *	And we set the authentication vector to a random
+	 *	number...
+	 */
+	if ((u->code == FR_CODE_ACCESS_REQUEST) ||
+	    (u->code == FR_CODE_STATUS_SERVER)) {
+		size_t i;
+		uint32_t hash, base;
+
+		require_ma = true;
+
+		base = fr_rand();
+		for (i = 0; i < AUTH_VECTOR_LEN; i += sizeof(uint32_t)) {
+			hash = fr_rand() ^ base;
+			memcpy(c->buffer + 4 + i, &hash, sizeof(hash));
+		}
+	}
+
+	/*
+	 *	Every status check packet has an Event-Timestamp.  The
+	 *	timestamp changes every time we send a packet.  Status
+	 *	check packets never have Proxy-State, because we
+	 *	generate them, and they're not proxied.
+	 */
+	if (u == c->status_u) {
+		VALUE_PAIR *vp;
+
+		proxy_state = 0;
+		vp = fr_pair_find_by_num(request->packet->vps, 0, FR_EVENT_TIMESTAMP, TAG_ANY);
+		if (vp) vp->vp_uint32 = time(NULL);
+	}
+
+	/*
+	 *	Add FreeRADIUS-Extended-Identifier if we're using it,
+	 *	or if we're asking the home server to use it.
+	 */
+	if (u->rr->extended) {
+		extended_len = RR_TRACK_EXTENDED_LEN;
+		extended_id = u->rr->extended_id;
+
+	} else if ((u == c->status_u) && c->inst->parent->extended_id && !c->id->use_extended_id) {
+		extended_len = RR_TRACK_EXTENDED_LEN;
+	}
+
+	/*
+	 *	Leave room for the Message-Authenticator.
+	 */
+	if (require_ma) {
+		buflen = c->buflen - 18;
+	} else {
+		buflen = c->buflen;
+	}
+
+	/*
+	 *	FreeRADIUS-Extended-Identifier is hop-by-hop.  Don't
+	 *	forward any the client sent us.
+	 */
+	hop_by_hop = rr_track_extended_id_unlink(&request->packet->vps);
+
+	/*
+	 *	Encode it, leaving room for Proxy-State, too.
+	 */
+	packet_len = fr_radius_encode(c->buffer, buflen - proxy_state - extended_len, NULL,
+				      c->inst->secret, 0, u->code, u->rr->id,
+				      request->packet->vps);
+	if (packet_len <= 0) {
+		fr_pair_add(&request->packet->vps, hop_by_hop);
+		return -1;
+	}
+
+	/*
+	 *	This hack cleans up the debug output a bit.
+	 */
+	module_name = request->module;
+	request->module = NULL;
+
+	RDEBUG("Sending %s ID %d length %ld over connection %s",
+	       fr_packet_codes[u->code], u->rr->id, packet_len, c->name);
+	rdebug_pair_list(L_DBG_LVL_2, request, request->packet->vps, NULL);
+	fr_pair_add(&request->packet->vps, hop_by_hop);
+
+	/*
+	 *	Might have been sent on a connection which then
+	 *	failed... free the raw data so we can re-encode it.
+	 */
+	if (u->packet) {
+		TALLOC_FREE(u->packet);
+		fr_pair_list_free(&u->extra);
+	}
+
+	/*
+	 *	Add Proxy-State to the tail end of the packet.
+	 *	We need to add it here, and NOT in
+	 *	request->packet->vps, because multiple modules
+	 *	may be sending the packets at the same time.
+	 *
+	 *	Note that the length check will always pass, due to
+	 *	the buflen manipulation done above.
+	 */
+	if (proxy_state) {
+		uint8_t		*attr = c->buffer + packet_len;
+		int		hdr_len;
+		VALUE_PAIR	*vp;
+
+		rad_assert((size_t) (packet_len + 6) <= c->buflen);
+
+		attr[0] = FR_PROXY_STATE;
+		attr[1] = 6;
+		memcpy(attr + 2, &c->inst->parent->proxy_state, 4);
+
+		hdr_len = (c->buffer[2] << 8) | (c->buffer[3]);
+		hdr_len += 6;
+		c->buffer[2] = (hdr_len >> 8) & 0xff;
+		c->buffer[3] = hdr_len & 0xff;
+
+		vp = fr_pair_afrom_num(u, 0, FR_PROXY_STATE);
+		fr_pair_value_memcpy(vp, attr + 2, 4);
+		fr_pair_add(&u->extra, vp);
+
+		RINDENT();
+		rdebug_pair(L_DBG_LVL_2, request, vp, NULL);
+		REXDENT();
+
+		packet_len += 6;
+	}
+
+	/*
+	 *	Add FreeRADIUS-Extended-Identifier manually.  The home
+	 *	server copies it to the reply, which lets us find the
+	 *	request when many share the same 8-bit ID.
+	 */
+	if (extended_len) {
+		int		hdr_len;
+		VALUE_PAIR	*vp;
+
+		rad_assert((size_t) (packet_len + extended_len) <= c->buflen);
+
+		rr_track_extended_id_encode(c->buffer + packet_len, extended_id);
+
+		hdr_len = (c->buffer[2] << 8) | (c->buffer[3]);
+		hdr_len += extended_len;
+		c->buffer[2] = (hdr_len >> 8) & 0xff;
+		c->buffer[3] = hdr_len & 0xff;
+
+		vp = fr_pair_afrom_num(u, VENDORPEC_FREERADIUS, FR_FREERADIUS_EXTENDED_IDENTIFIER);
+		if (vp) {
+			vp->vp_uint32 = extended_id;
+			fr_pair_add(&u->extra, vp);
+
+			RINDENT();
+			rdebug_pair(L_DBG_LVL_2, request, vp, NULL);
+			REXDENT();
+		}
+
+		packet_len += extended_len;
+	}
+
+	/*
+	 *	Add Message-Authenticator manually.
+	 *
+	 *	Note that the length check will always pass, due to
+	 *	the buflen manipulation done above.
+	 */
+	if (require_ma &&
+	    ((size_t) (packet_len + 18) <= c->buflen)) {
+		int hdr_len;
+
+		msg = c->buffer + packet_len;
+
+		msg[0] = FR_MESSAGE_AUTHENTICATOR;
+		msg[1] = 18;
+		memset(msg + 2, 0, 16);
+
+		hdr_len = (c->buffer[2] << 8) | (c->buffer[3]);
+		hdr_len += 18;
+		c->buffer[2] = (hdr_len >> 8) & 0xff;
+		c->buffer[3] = hdr_len & 0xff;
+
+		packet_len += 18;
+	}
+
+	if (fr_radius_sign(c->buffer, NULL, &c->inst->radius_secret) < 0) {
+		request->module = module_name;
+		RERROR("Failed signing packet");
+		conn_error(c->thread->el, c->fd, 0, errno, c);
+		return -1;
+	}
+
+	memcpy(u->rr->vector, c->buffer + 4, AUTH_VECTOR_LEN);
+
+	/*
+	 *	Print out the actual value of the Message-Authenticator attribute
+	 */
+	if (msg) {
+		VALUE_PAIR *vp;
+
+		vp = fr_pair_afrom_num(u, 0, FR_MESSAGE_AUTHENTICATOR);
+		fr_pair_value_memcpy(vp, msg + 2, 16);
+		fr_pair_add(&u->extra, vp);
+
+		RINDENT();
+		rdebug_pair(L_DBG_LVL_2, request, vp, NULL);
+		REXDENT();
+	}
+
+	RHEXDUMP(L_DBG_LVL_3, c->buffer, packet_len, "Encoded packet");
+
+	request->module = module_name;
+
+	/*
+	 *	Write the packet to the socket.  If it blocks,
+	 *	stop dequeueing packets.
+	 */
+	rcode = packet_send(c, c->buffer, packet_len);
+	if (rcode == 0) return 0;
+
+	if (rcode < 0) {
+		/*
+		 *	We have to re-encode the packet, so
+		 *	don't bother copying it to 'u'.
+		 */
+		conn_error(c->thread->el, c->fd, 0, errno, c);
+		return 0;
+	}
+
+	/*
+	 *	We're replicating, so we don't care about the
+	 *	responses.  Don't do any response timers, etc.
+	 *
+	 *	Instead, just set the return code to OK, and return.
+	 */
+	if (c->inst->replicate && (u != c->status_u)) {
+		u->link->rcode = RLM_MODULE_OK;
+		return 2;
+	}
+
+	/*
+	 *	Copy the packet for debugging, and to remember that
+	 *	it's been encoded.
+	 */
+	MEM(u->packet = talloc_memdup(u, c->buffer, packet_len));
+	u->packet_len = packet_len;
+
+	/*
+	 *	Print out helpful debugging messages for non-status
+	 *	checks.
+	 */
+	if (u != c->status_u) {
+		if (!c->inst->parent->synchronous) {
+			RDEBUG("Proxying request.  Expecting response within %d.%06ds",
+			       u->timer.rt / USEC, u->timer.rt % USEC);
+
+		} else {
+			RDEBUG("Proxying request.  Relying on NAS to perform retransmissions");
+		}
+
+		return 1;
+	}
+
+	/*
+	 *	Status-Server only checks.
+	 */
+	if (u->timer.count == 0) {
+		u->link->time_sent = fr_time();
+		fr_time_to_timeval(&u->timer.start, u->link->time_sent);
+
+		if (rr_track_start(&u->timer) < 0) {
+			RDEBUG("%s - Failed starting response tracking for connection %s",
+			       c->inst->parent->name, c->name);
+			return -1;
+		}
+
+		if (fr_event_timer_insert(u, c->thread->el, &u->timer.ev, &u->timer.next,
+					  response_timeout, u) < 0) {
+			RDEBUG("%s - Failed starting response tracking for connection %s",
+			       c->inst->parent->name, c->name);
+			return -1;
+		}
+	}
+
+	RDEBUG("Sending %s status check.  Expecting response within %d.%06ds for connection %s",
+	       fr_packet_codes[u->code],
+	       u->timer.rt / USEC, u->timer.rt % USEC,
+	       c->name);
+
+	return 1;
+}
+
+/** There's space available to write data, so do that...
+ *
+ */
+static void conn_writable(fr_event_list_t *el, UNUSED int fd, UNUSED int flags, void *uctx)
+{
+	rlm_radius_tcp_connection_t	*c = talloc_get_type_abort(uctx, rlm_radius_tcp_connection_t);
+	rlm_radius_tcp_request_t	*u;
+	bool				pending = false;
+	rlm_radius_tcp_connection_t	*next;
+
+	DEBUG3("%s - Writing packets for connection %s", c->inst->parent->name, c->name);
+
+	/*
+	 *	Finish writing any partial packet, so that the stream
+	 *	stays in sync.
+	 */
+	if (c->pending_len) {
+		int rcode;
+
+		rcode = pending_flush(c);
+		if (rcode < 0) {
+			conn_error(el, c->fd, 0, errno, c);
+			return;
+		}
+
+		/*
+		 *	Still blocked.  Wait to be called again.
+		 */
+		if (rcode == 0) {
+			if (c->state != CONN_ZOMBIE) conn_transition(c, CONN_BLOCKED);
+			fd_active(c);
+			return;
+		}
+
+		/*
+		 *	We're writable again.
+		 */
+		if (c->state == CONN_BLOCKED) conn_transition(c, CONN_ACTIVE);
+	}
+
+	/*
+	 *	Zombie connections only send status checks, which
+	 *	are written from the zombie timer.
+	 */
+	if (c->state == CONN_ZOMBIE) {
+		fd_idle(c);
+		return;
+	}
+
+	/*
+	 *	Empty the global queue of packets to send.
+	 */
+	while ((u = fr_heap_peek(c->thread->queued)) != NULL) {
+		int rcode;
+
+		u->rr = rr_track_alloc(c->id, u->link->request, u->code, u->link, &u->timer);
+
+		/*
+		 *	Can't allocate any more IDs, re-insert the
+		 *	packet back onto the main thread queue, and
+		 *	stop writing packets.
+		 */
+		if (!u->rr) {
+			pending = true;
+			conn_transition(c, CONN_FULL);
+			break;
+		}
+
+		rad_assert(u->state == PACKET_STATE_THREAD);
+
+		u->c = c;
+		state_transition(u, PACKET_STATE_SENT);
+
+		/*
+		 *	Encode the packet, and do various magical
+		 *	transformations.
+		 *
+		 *	Packets which were moved back to the queue
+		 *	because their connection failed are re-sent
+		 *	immediately, with a new ID.
+		 */
+		rcode = conn_write(c, u);
+
+		/*
+		 *	The packet was sent, and we should wait for
+		 *	the reply.  If only part of it was written,
+		 *	we stop here, and finish it when the socket is
+		 *	writable again.
+		 */
+		if (rcode == 1) {
+			if (!c->pending_len) continue;
+
+			pending = true;
+			conn_transition(c, CONN_BLOCKED);
+			break;
+		}
+
+		/*
+		 *	The write returned EWOULDBLOCK.  We re-insert
+		 *	the packet back onto the main thread queue,
+		 *	and stop writing packets to this connection.
+		 */
+		if (rcode == 0) {
+			pending = true;
+			state_transition(u, PACKET_STATE_THREAD);
+			conn_transition(c, CONN_BLOCKED);
+			break;
+		}
+
+		/*
+		 *	Can't write a packet to this connection, so we
+		 *	close it.
+		 *
+		 *	We still wake up the "next" connection, as we
+		 *	hope that it may be writable.  If it isn't, it
+		 *	will shut itself down again.  If it is
+		 *	writable (and it usually is), then we've saved
+		 *	another round trip through the event loop.
+		 */
+		if (rcode < 0) {
+			rlm_radius_tcp_thread_t *t = c->thread;
+
+			talloc_free(c);
+
+			next = fr_heap_peek(t->active);
+			if (!next) return;
+
+			conn_writable(el, next->fd, 0, next);
+			return;
+		}
+
+		/*
+		 *	The packet was replicated, we don't care about
+		 *	the reply.  Just mark the request as finished.
+		 */
+		else {
+			rad_assert(rcode == 2);
+			state_transition(u, PACKET_STATE_RESUMABLE);
+		}
+	}
+
+	/*
+	 *	There are no more packets to write.  Set ourselves to
+	 *	idle.
+	 */
+	if (!pending) {
+		fd_idle(c);
+		return;
+	}
+
+	next = fr_heap_peek(c->thread->active);
+
+	/*
+	 *	There are more packets to write.  Update our status,
+	 *	and grab another socket to use.
+	 */
+	switch (c->state) {
+	case CONN_INIT:
+	case CONN_OPENING:
+	case CONN_ACTIVE:	/* all packets should have been sent! */
+	case CONN_ZOMBIE:
+		rad_assert(0 == 1);
+		break;
+
+	case CONN_BLOCKED:	/* wait until we're writable */
+		fd_active(c);
+		break;
+
+	case CONN_FULL:		/* we're no longer writable */
+		fd_idle(c);
+		break;
+	}
+
+	/*
+	 *	Wake up the next connection, and see if it can drain
+	 *	the input queue.
+	 */
+	if (!next) return;
+
+	conn_writable(el, next->fd, 0, next);
+}
+
+/** Shutdown/close a file descriptor
+ *
+ */
+static void _conn_close(int fd, void *uctx)
+{
+	rlm_radius_tcp_connection_t *c = talloc_get_type_abort(uctx, rlm_radius_tcp_connection_t);
+
+	if (c->idle_ev) fr_event_timer_delete(c->thread->el, &c->idle_ev);
+
+#ifdef WITH_TLS
+	if (c->tls) {
+		(void) SSL_shutdown(c->tls->ssl);
+		TALLOC_FREE(c->tls);
+	}
+#endif
+
+	if (shutdown(fd, SHUT_RDWR) < 0) {
+		DEBUG3("%s - Failed shutting down connection %s: %s",
+		       c->inst->parent->name, c->name, fr_syserror(errno));
+	}
+
+	if (close(fd) < 0) {
+		DEBUG3("%s - Failed closing connection %s: %s",
+		       c->inst->parent->name, c->name, fr_syserror(errno));
+	}
+
+	c->fd = -1;
+
+	/*
+	 *	Any partial data is for the old stream.
+	 */
+	c->recv_used = 0;
+	c->pending_len = 0;
+	c->pending_offset = 0;
+
+	/*
+	 *	Reset our state back to init
+	 */
+	conn_transition(c, CONN_INIT);
+
+	DEBUG("%s - Connection closed - %s", c->inst->parent->name, c->name);
+}
+
+/** Free an rlm_radius_tcp_request_t
+ *
+ *  Unlink the packet from the connection, and remove any tracking
+ *  entries.
+ */
+static int tcp_request_free(rlm_radius_tcp_request_t *u)
+{
+	struct timeval when, now;
+
+	state_transition(u, PACKET_STATE_FINISHED);
+
+	/*
+	 *	We don't have a connection, so we can't update any of
+	 *	the connection timers or states.
+	 */
+	if (!u->c) return 0;
+
+	/*
+	 *	The module is doing async proxying, we don't need to
+	 *	do more.
+	 */
+	if (!u->c->inst->parent->synchronous) return 0;
+
+	switch (u->c->state) {
+		/*
+		 *	If it's unused, why is there a request for it?
+		 */
+	case CONN_INIT:
+	case CONN_OPENING:
+		rad_assert(0 == 1);
+		return 0;
+
+		/*
+		 *	The connection is already marked "zombie", or
+		 *	is doing status checks.  Don't do it again.
+		 */
+	case CONN_ZOMBIE:
+		return 0;
+
+		/*
+		 *	It was alive, but likely no longer..
+		 */
+	case CONN_ACTIVE:
+	case CONN_FULL:
+	case CONN_BLOCKED:
+		break;
+	}
+
+	/*
+	 *	Check if we can mark the connection as "dead".
+	 */
+	gettimeofday(&now, NULL);
+	when = u->c->last_reply;
+
+	/*
+	 *	Use the zombie_period for the timeout.
+	 *
+	 *	Note that we do this check on every packet, which is a
+	 *	bit annoying, but oh well.
+	 */
+	fr_timeval_add(&when, &when, &u->c->inst->parent->zombie_period);
+	if (timercmp(&when, &now, > )) return 0;
+
+	/*
+	 *	The home server hasn't responded in a long time.  Mark
+	 *	the connection as "zombie".
+	 */
+	conn_transition(u->c, CONN_ZOMBIE);
+
+	return 0;
+}
+
+/** Free the status-check rlm_radius_tcp_request_t
+ *
+ *  Unlink the packet from the connection, and remove any tracking
+ *  entries.
+ */
+static int status_tcp_request_free(rlm_radius_tcp_request_t *u)
+{
+	rlm_radius_tcp_connection_t	*c = u->c;
+
+	DEBUG3("%s - Freeing status check ID %d on connection %s", c->inst->parent->name, u->rr->id, c->name);
+	c->status_u = NULL;
+
+	/*
+	 *	Status check packets are not in any list, but they do
+	 *	have an ID allocated.
+	 */
+	if (u->timer.ev) (void) fr_event_timer_delete(u->thread->el, &u->timer.ev);
+
+	if (u->rr) (void) rr_track_delete(u->c->id, u->rr);
+	u->rr = NULL;
+
+	return 0;
+}
+
+/** Connection failed
+ *
+ * @param[in] fd	of connection that failed.
+ * @param[in] state	the connection was in when it failed.
+ * @param[in] uctx	the connection.
+ */
+static fr_connection_state_t _conn_failed(UNUSED int fd, fr_connection_state_t state, void *uctx)
+{
+	rlm_radius_tcp_connection_t	*c = talloc_get_type_abort(uctx, rlm_radius_tcp_connection_t);
+
+	/*
+	 *	If the connection was connected when it failed,
+	 *	we need to handle any outstanding packers and
+	 *	timer events before reconnecting.
+	 */
+	if (state == FR_CONNECTION_STATE_CONNECTED) {
+		fr_dlist_t *entry;
+
+		/*
+		 *	Reset the Status-Server checks.
+		 */
+		if (c->status_u) {
+			rlm_radius_tcp_request_t *u = c->status_u;
+
+			if (u->timer.ev) (void) fr_event_timer_delete(c->thread->el, &u->timer.ev);
+
+			memset(&u->timer, 0, sizeof(u->timer));
+			u->timer.retry = &c->inst->parent->retry[u->code];
+
+			rad_assert(u->c == c);
+
+			if (u->packet) TALLOC_FREE(u->packet);
+			u->packet_len = 0;
+		}
+
+		/*
+		 *	Delete all timers associated with the connection.
+		 */
+		if (c->idle_ev) (void) fr_event_timer_delete(c->thread->el, &c->idle_ev);
+		if (c->zombie_ev) (void) fr_event_timer_delete(c->thread->el, &c->zombie_ev);
+
+		/*
+		 *	Move "sent" packets back to the thread queue.
+		 *	The stream is gone, so they will be sent again
+		 *	on another connection.
+		 */
+		while ((entry = FR_DLIST_FIRST(c->sent)) != NULL) {
+			rlm_radius_tcp_request_t *u;
+
+			u = fr_ptr_to_type(rlm_radius_tcp_request_t, entry, entry);
+			state_transition(u, PACKET_STATE_THREAD);
+		}
+
+		/*
+		 *	The next connection has to negotiate extended
+		 *	identifiers again.
+		 */
+		(void) rr_track_use_extended_id(c->id, false, 0);
+	}
+
+	conn_transition(c, CONN_OPENING);
+
+	return FR_CONNECTION_STATE_INIT;
+}
+
+#ifdef WITH_TLS
+/** Continue the TLS handshake
+ *
+ *  Called when the socket is readable or writable, depending on
+ *  what OpenSSL wants.
+ */
+static void conn_tls_handshake(UNUSED fr_event_list_t *el, UNUSED int fd, UNUSED int flags, void *uctx)
+{
+	rlm_radius_tcp_connection_t	*c = talloc_get_type_abort(uctx, rlm_radius_tcp_connection_t);
+	int				ret;
+
+	ret = SSL_connect(c->tls->ssl);
+	if (ret == 1) {
+		DEBUG("%s - TLS handshake complete for connection %s", c->inst->parent->name, c->name);
+
+		if (fr_event_fd_delete(c->thread->el, c->fd, FR_EVENT_FILTER_IO) < 0) {
+			PERROR("Failed removing FD event");
+		}
+
+		(void) conn_ready(c);
+		return;
+	}
+
+	switch (SSL_get_error(c->tls->ssl, ret)) {
+	case SSL_ERROR_WANT_READ:
+		if (fr_event_fd_insert(c->conn, c->thread->el, c->fd,
+				       conn_tls_handshake,
+				       NULL,
+				       conn_error,
+				       c) < 0) break;
+		return;
+
+	case SSL_ERROR_WANT_WRITE:
+		if (fr_event_fd_insert(c->conn, c->thread->el, c->fd,
+				       NULL,
+				       conn_tls_handshake,
+				       conn_error,
+				       c) < 0) break;
+		return;
+
+	default:
+		tls_log_io_error(NULL, c->tls, ret, "TLS handshake failed for connection %s", c->name);
+		break;
+	}
+
+	fr_connection_signal_reconnect(c->conn);
+}
+#endif
+
+/** The connection is open, and ready for packets
+ *
+ */
+static fr_connection_state_t conn_ready(rlm_radius_tcp_connection_t *c)
+{
+	rlm_radius_tcp_thread_t		*t = c->thread;
+
+	/*
+	 *	Connection is "active" now.  i.e. we prefer the newly
+	 *	opened connection for sending packets.
+	 *
+	 *	Any negotiation (e.g. extended identifiers) is done
+	 *	with the Status-Server checks created below.
+	 */
+	gettimeofday(&c->mrs_time, NULL);
+	c->last_reply = c->mrs_time;
+
+	/*
+	 *	If the connection is open, it must be writable.
+	 */
+	rad_assert(c->state == CONN_OPENING);
+	conn_transition(c, CONN_ACTIVE);
+
+	rad_assert(c->zombie_ev == NULL);
+	memset(&c->zombie_start, 0, sizeof(c->zombie_start));
+	FR_DLIST_INIT(c->sent);
+
+	/*
+	 *	Status-Server checks.  Manually build the packet, and
+	 *	all of it's associated glue.
+	 */
+	if (c->inst->parent->status_check && !c->status_u) {
+		rlm_radius_link_t *link;
+		rlm_radius_tcp_request_t *u;
+		REQUEST *request;
+
+		link = talloc_zero(c, rlm_radius_link_t);
+		u = talloc_zero(c, rlm_radius_tcp_request_t);
+
+		request = request_alloc(link);
+		request->async = talloc_zero(request, fr_async_t);
+		talloc_const_free(request->name);
+		request->name = talloc_strdup(request, c->inst->parent->name);
+
+		request->el = c->thread->el;
+		request->packet = fr_radius_alloc(request, false);
+		request->reply = fr_radius_alloc(request, false);
+
+		/*
+		 *	Create the packet contents.
+		 */
+		if (c->inst->parent->status_check == FR_CODE_STATUS_SERVER) {
+			pair_make_request("NAS-Identifier", "status check - are you alive?", T_OP_EQ);
+			pair_make_request("Event-Timestamp", "0", T_OP_EQ);
+		} else {
+			vp_map_t *map;
+
+			/*
+			 *	Create the VPs, and ignore any errors
+			 *	creating them.
+			 */
+			for (map = c->inst->parent->status_check_map; map != NULL; map = map->next) {
+				(void) map_to_request(request, map, map_to_vp, NULL);
+			}
+
+			/*
+			 *	Always add an Event-Timestamp, which
+			 *	will be the time at which the packet
+			 *	is sent.
+			 */
+			if (!fr_pair_find_by_num(request->packet->vps, 0, FR_EVENT_TIMESTAMP, TAG_ANY)) {
+				pair_make_request("Event-Timestamp", "0", T_OP_EQ);
+			}
+		}
+
+		DEBUG3("Status check packet will be %s", fr_packet_codes[u->code]);
+		rdebug_pair_list(L_DBG_LVL_3, request, request->packet->vps, NULL);
+
+		/*
+		 *	Initialize the link.  Note that we don't set
+		 *	destructors.
+		 */
+		FR_DLIST_INIT(link->entry);
+		link->request = request;
+		link->request_io_ctx = u;
+
+		/*
+		 *	Unitialize the TCP link.
+		 */
+		FR_DLIST_INIT(u->entry);
+		u->code = c->inst->parent->status_check;
+		request->packet->code = u->code;
+		u->c = c;
+		u->link = link;
+		u->thread = t;
+
+		/*
+		 *	Reserve a permanent ID for the packet.  This
+		 *	is because we need to be able to send an ID on
+		 *	demand.  If the proxied packets use all of the
+		 *	IDs, then we can't send a Status-Server check.
+		 */
+		u->rr = rr_track_alloc(c->id, request, u->code, link, &u->timer);
+		if (!u->rr) {
+			ERROR("%s - Failed allocating status_check ID for connection %s",
+			      c->inst->parent->name, c->name);
+			talloc_free(u);
+			talloc_free(link);
+
+		} else {
+			DEBUG2("%s - Allocated %s ID %u for status checks on connection %s",
+			       c->inst->parent->name, fr_packet_codes[u->code], u->rr->id, c->name);
+			talloc_set_destructor(u, status_tcp_request_free);
+			c->status_u = u;
+		}
+	}
+
+	/*
+	 *	Reset the timer, retransmission counters, etc.
+	 */
+	if (c->status_u) {
+		rlm_radius_tcp_request_t *u = c->status_u;
+
+		memset(&u->timer, 0, sizeof(u->timer));
+		u->timer.retry = &c->inst->parent->retry[u->code];
+	}
+
+	/*
+	 *	Ask the home server to use extended identifiers.  We
+	 *	don't wait for the reply, and keep using 8-bit IDs
+	 *	until it arrives.
+	 */
+	if (c->status_u && c->inst->parent->extended_id) {
+		rlm_radius_tcp_request_t *u = c->status_u;
+
+		if (conn_write(c, u) == 1) {
+			u->state = PACKET_STATE_SENT;
+		} else {
+			DEBUG2("%s - Failed sending extended identifier negotiation on connection %s",
+			       c->inst->parent->name, c->name);
+		}
+	}
+
+	/*
+	 *	Replies can arrive at any time, so we always want
+	 *	read events.  Now that we're open, assume that the
+	 *	connection is writable.
+	 */
+	if (fr_heap_num_elements(t->queued) > 0) {
+		conn_writable(c->thread->el, c->fd, 0, c);
+	} else {
+		fd_idle(c);
+	}
+
+	return FR_CONNECTION_STATE_CONNECTED;
+}
+
+/** Process notification that fd is open
+ *
+ */
+static fr_connection_state_t _conn_open(UNUSED fr_event_list_t *el, int fd, void *uctx)
+{
+	rlm_radius_tcp_connection_t	*c = talloc_get_type_abort(uctx, rlm_radius_tcp_connection_t);
+	int				sock_error = 0;
+	socklen_t			socklen = sizeof(sock_error);
+	struct sockaddr_storage		salocal;
+	socklen_t			salen = sizeof(salocal);
+
+	/*
+	 *	The socket is writable, but that doesn't mean that
+	 *	the connect() succeeded.
+	 */
+	if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &sock_error, &socklen) < 0) sock_error = errno;
+	if (sock_error) {
+		fr_strerror_printf("Failed connecting to %pV port %u: %s",
+				   fr_box_ipaddr(c->dst_ipaddr), c->dst_port, fr_syserror(sock_error));
+		return FR_CONNECTION_STATE_FAILED;
+	}
+
+	/*
+	 *	Find out which source port we were given.
+	 */
+	if ((getsockname(fd, (struct sockaddr *) &salocal, &salen) == 0)) {
+		(void) fr_ipaddr_from_sockaddr(&salocal, salen, &c->src_ipaddr, &c->src_port);
+	}
+
+	talloc_const_free(c->name);
+	c->name = fr_asprintf(c, "proto %s local %pV port %u remote %pV port %u",
+#ifdef WITH_TLS
+			      c->inst->tls ? "tls" :
+#endif
+			      "tcp",
+			      fr_box_ipaddr(c->src_ipaddr), c->src_port,
+			      fr_box_ipaddr(c->dst_ipaddr), c->dst_port);
+
+	DEBUG("%s - Connection open - %s", c->inst->parent->name, c->name);
+
+#ifdef WITH_TLS
+	/*
+	 *	RADIUS/TLS.  The connection isn't usable until the
+	 *	handshake finishes, so stay in the "opening" state
+	 *	until then.
+	 */
+	if (c->inst->tls) {
+		c->tls = tls_session_init_client(c, c->inst->tls, fd);
+		if (!c->tls) {
+			fr_strerror_printf("Failed creating TLS session");
+			return FR_CONNECTION_STATE_FAILED;
+		}
+
+		SSL_set_mode(c->tls->ssl, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+
+		/*
+		 *	The socket is writable, so the ClientHello
+		 *	goes out on the next pass through the event
+		 *	loop.
+		 */
+		if (fr_event_fd_insert(c->conn, c->thread->el, fd,
+				       NULL,
+				       conn_tls_handshake,
+				       conn_error,
+				       c) < 0) {
+			fr_strerror_printf("Failed inserting FD event");
+			return FR_CONNECTION_STATE_FAILED;
+		}
+		return FR_CONNECTION_STATE_CONNECTED;
+	}
+#endif
+
+	return conn_ready(c);
+}
+
+
+/** Initialise a new outbound connection
+ *
+ * @param[out] fd_out	Where to write the new file descriptor.
+ * @param[in] uctx	A #rlm_radius_thread_t.
+ */
+static fr_connection_state_t _conn_init(int *fd_out, void *uctx)
+{
+	int				fd;
+	rlm_radius_tcp_connection_t	*c = talloc_get_type_abort(uctx, rlm_radius_tcp_connection_t);
+
+	/*
+	 *	Open the outgoing socket.
+	 */
+	fd = fr_socket_client_tcp(&c->src_ipaddr, &c->dst_ipaddr, c->dst_port, true);
+	if (fd < 0) {
+		PERROR("%s - Failed opening socket", c->inst->parent->name);
+		return FR_CONNECTION_STATE_FAILED;
+	}
+
+	/*
+	 *	Set the connection name.
+	 */
+	talloc_const_free(c->name);
+	c->name = fr_asprintf(c, "connecting proto tcp from %pV to %pV port %u",
+			      fr_box_ipaddr(c->src_ipaddr),
+			      fr_box_ipaddr(c->dst_ipaddr), c->dst_port);
+
+#ifdef SO_RCVBUF
+	if (c->inst->recv_buff_is_set) {
+		int opt;
+
+		opt = c->inst->recv_buff;
+		if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &opt, sizeof(int)) < 0) {
+			WARN("Failed setting 'recv_buf': %s", fr_syserror(errno));
+		}
+	}
+#endif
+
+#ifdef SO_SNDBUF
+	if (c->inst->send_buff_is_set) {
+		int opt;
+
+		opt = c->inst->send_buff;
+		if (setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &opt, sizeof(int)) < 0) {
+			WARN("Failed setting 'send_buf': %s", fr_syserror(errno));
+		}
+	}
+#endif
+
+#ifdef TCP_NODELAY
+	/*
+	 *	We write whole packets, and don't want them to be
+	 *	held back waiting for ACKs.
+	 */
+	{
+		int opt = 1;
+
+		if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt)) < 0) {
+			WARN("Failed setting TCP_NODELAY: %s", fr_syserror(errno));
+		}
+	}
+#endif
+
+	/*
+	 *	Insert the connection into the opening list
+	 */
+	conn_transition(c, CONN_OPENING);
+	c->fd = fd;
+	c->recv_used = 0;
+	c->pending_len = 0;
+	c->max_packet_size = c->inst->max_packet_size;
+
+	*fd_out = fd;
+
+	return FR_CONNECTION_STATE_CONNECTING;
+}
+
+/** Free the connection, and return requests to the thread queue
+ *
+ */
+static int _conn_free(rlm_radius_tcp_connection_t *c)
+{
+	fr_dlist_t			*entry;
+	rlm_radius_tcp_request_t	*u;
+	rlm_radius_tcp_thread_t		*t = talloc_get_type_abort(c->thread, rlm_radius_tcp_thread_t);
+
+	/*
+	 *	We're no longer using this connection.
+	 */
+	while (true) {
+		uint32_t num_connections;
+
+		num_connections = load(c->inst->parent->num_connections);
+		rad_assert(num_connections > 0);
+
+		if (cas_decr(c->inst->parent->num_connections, num_connections)) break;
+	}
+
+	/*
+	 *	Explicit free not technically required,
+	 *	but may prevent future ordering issues.
+	 */
+	talloc_free(c->conn);
+	c->conn = NULL;
+
+	/*
+	 *	Move "sent" packets back to the main thread queue
+	 */
+	while ((entry = FR_DLIST_FIRST(c->sent)) != NULL) {
+		u = fr_ptr_to_type(rlm_radius_tcp_request_t, entry, entry);
+
+		rad_assert(u->state == PACKET_STATE_SENT);
+		rad_assert(u->c == c);
+
+		state_transition(u, PACKET_STATE_THREAD);
+	}
+
+	if (c->status_u) talloc_free(c->status_u);
+
+	if (c->zombie_ev) (void) fr_event_timer_delete(c->thread->el, &c->zombie_ev);
+	if (c->idle_ev) (void) fr_event_timer_delete(c->thread->el, &c->idle_ev);
+
+	talloc_free_children(c); /* clears out FD events, timers, etc. */
+
+	switch (c->state) {
+	default:
+		rad_assert(0 == 1);
+		break;
+
+	case CONN_INIT:
+		break;
+
+	case CONN_OPENING:
+	case CONN_FULL:
+	case CONN_BLOCKED:
+	case CONN_ZOMBIE:
+		fr_dlist_remove(&c->entry);
+		break;
+
+	case CONN_ACTIVE:
+		rad_assert(c->heap_id >= 0);
+		(void) fr_heap_extract(t->active, c);
+		break;
+	}
+
+	return 0;
+}
+
+
+/** Allocate a new connection and set it up.
+ *
+ */
+static void conn_alloc(rlm_radius_tcp_t *inst, rlm_radius_tcp_thread_t *t)
+{
+	rlm_radius_tcp_connection_t	*c;
+
+	c = talloc_zero(t, rlm_radius_tcp_connection_t);
+	c->heap_id = -1;
+	c->inst = inst;
+	c->thread = t;
+	c->dst_ipaddr = inst->dst_ipaddr;
+	c->dst_port = inst->dst_port;
+	c->src_ipaddr = inst->src_ipaddr;
+	c->src_port = 0;
+	c->max_packet_size = inst->max_packet_size;
+
+	/*
+	 *	One buffer to encode packets into, one for the rest
+	 *	of a partially written packet, and one large enough
+	 *	to read many replies at once.
+	 */
+	c->buffer = talloc_array(c, uint8_t, c->max_packet_size);
+	c->pending = talloc_array(c, uint8_t, c->max_packet_size);
+	c->recv_buffer = talloc_array(c, uint8_t, c->max_packet_size * TCP_RECV_PACKETS);
+	if (!c->buffer || !c->pending || !c->recv_buffer) {
+		cf_log_err(inst->config, "%s failed allocating memory for new connection",
+			   inst->parent->name);
+		talloc_free(c);
+		return;
+	}
+	c->buflen = c->max_packet_size;
+	c->recv_buflen = c->max_packet_size * TCP_RECV_PACKETS;
+
+	/*
+	 *	Each connection can have AT MOST 256 packets
+	 *	outstanding, as the RADIUS header only has an 8-bit
+	 *	ID.  But they're all on one stream, instead of 256
+	 *	sockets.
+	 */
+	c->id = rr_track_create(c);
+	if (!c->id) {
+		cf_log_err(inst->config, "%s - Failed allocating ID tracking for new connection",
+			   inst->parent->name);
+		talloc_free(c);
+		return;
+	}
+	FR_DLIST_INIT(c->sent);
+
+	c->conn = fr_connection_alloc(c, t->el, &inst->parent->connection_timeout, &inst->parent->reconnection_delay,
+				      _conn_init,
+				      _conn_open,
+				      _conn_close,
+				      inst->parent->name, c);
+	if (!c->conn) {
+		talloc_free(c);
+		cf_log_err(inst->config, "%s - Failed allocating state handler for new connection",
+			   inst->parent->name);
+		return;
+	}
+	fr_connection_failed_func(c->conn, _conn_failed);
+
+	/*
+	 *	Enforce max_connections via atomic variables.
+	 *
+	 *	Note that we're counting connections which are in the
+	 *	CONN_OPENING and CONN_ZOMBIE states, too.
+	 */
+	while (true) {
+		uint32_t num_connections;
+
+		num_connections = load(inst->parent->num_connections);
+
+		if (num_connections >= inst->parent->max_connections) {
+			TALLOC_FREE(c->conn); /* ordering */
+			talloc_free(c);
+			return;
+		}
+		if (cas_incr(inst->parent->num_connections, num_connections)) break;
+	}
+
+	fr_connection_signal_init(c->conn);
+
+	talloc_set_destructor(c, _conn_free);
+
+	return;
+}
+
+static rlm_rcode_t mod_push(void *instance, REQUEST *request, rlm_radius_link_t *link, void *thread)
+{
+	rlm_rcode_t    			rcode = RLM_MODULE_FAIL;
+	rlm_radius_tcp_t		*inst = talloc_get_type_abort(instance, rlm_radius_tcp_t);
+	rlm_radius_tcp_thread_t		*t = talloc_get_type_abort(thread, rlm_radius_tcp_thread_t);
+	rlm_radius_tcp_request_t	*u = link->request_io_ctx;
+	rlm_radius_tcp_connection_t	*c;
+
+	rad_assert(request->packet->code > 0);
+	rad_assert(request->packet->code < FR_MAX_PACKET_CODE);
+
+	/*
+	 *	If configured, and we don't have any active
+	 *	connections, fail the request.  This lets "parallel"
+	 *	sections finish much more quickly than otherwise.
+	 */
+	if (inst->parent->no_connection_fail && !fr_heap_num_elements(t->active)) {
+		REDEBUG("Failing request due to 'no_connection_fail = true', and there are no active connections");
+		return RLM_MODULE_FAIL;
+	}
+
+	u->state = PACKET_STATE_INIT;
+	u->rr = NULL;
+	u->c = NULL;
+	u->link = link;
+	u->code = request->packet->code;
+	u->thread = t;
+	u->heap_id = -1;
+	u->timer.retry = &inst->parent->retry[u->code];
+	FR_DLIST_INIT(u->entry);
+
+	talloc_set_destructor(u, tcp_request_free);
+
+	/*
+	 *	Insert the new packet into the thread queue.
+	 */
+	state_transition(u, PACKET_STATE_THREAD);
+
+	/*
+	 *	Start the response timers.
+	 */
+	u->link->time_sent = fr_time();
+	fr_time_to_timeval(&u->timer.start, u->link->time_sent);
+
+	if (rr_track_start(&u->timer) < 0) {
+		RDEBUG("%s - Failed starting response tracking", inst->parent->name);
+		talloc_free(u);
+		return RLM_MODULE_FAIL;
+	}
+
+	if (fr_event_timer_insert(u, t->el, &u->timer.ev, &u->timer.next,
+				  response_timeout, u) < 0) {
+		RDEBUG("%s - Failed starting response tracking",
+		       inst->parent->name);
+		talloc_free(u);
+		return RLM_MODULE_FAIL;
+	}
+
+	/*
+	 *	There are OTHER pending writes, wait for the event
+	 *	callbacks to wake up a connection and send the packet.
+	 */
+	if (fr_heap_num_elements(t->queued) > 1) {
+		u->yielded = true;
+		DEBUG3("Thread has pending packets.  Waiting for socket to be ready");
+		return RLM_MODULE_YIELD;
+	}
+
+	/*
+	 *	There are no pending writes.  Get a waiting
+	 *	connection.  If they're all full, try to open a new
+	 *	one.
+	 */
+	c = fr_heap_peek(t->active);
+	if (!c) {
+		fr_dlist_t *entry;
+
+		/*
+		 *	Only open one new connection at a time.
+		 */
+		entry = FR_DLIST_FIRST(t->opening);
+		if (!entry) conn_alloc(inst, t);
+
+		/*
+		 *	Add the request to the backlog.  It will be
+		 *	sent either when the new connection is open,
+		 *	or when an existing connection has
+		 *	availability.
+		 */
+		u->yielded = true;
+		return RLM_MODULE_YIELD;
+	}
+
+	/*
+	 *	The connection is active, so try to write to it.
+	 */
+	conn_writable(t->el, c->fd, 0, c);
+
+	switch (u->state) {
+	case PACKET_STATE_INIT:
+		rad_assert(0 == 1);
+		break;
+
+	case PACKET_STATE_THREAD:
+	case PACKET_STATE_SENT:
+		rcode = RLM_MODULE_YIELD;
+		u->yielded = true;
+		break;
+
+	case PACKET_STATE_RESUMABLE: /* was replicated */
+		state_transition(u, PACKET_STATE_FINISHED);
+		/* FALL-THROUGH */
+
+	case PACKET_STATE_FINISHED:
+		rcode = RLM_MODULE_OK;
+		break;
+	}
+
+	return rcode;
+}
+
+
+static void mod_signal(REQUEST *request, UNUSED void *instance, UNUSED void *thread, UNUSED rlm_radius_link_t *link, fr_state_signal_t action)
+{
+	if (action != FR_SIGNAL_DUP) return;
+
+	/*
+	 *	RFC 6613 Section 2.6.1.  The stream is reliable, so
+	 *	we don't retransmit on it.  If the connection fails,
+	 *	the packet will be sent on a new one.
+	 */
+	RDEBUG("Not retransmitting proxied request over reliable transport");
+}
+
+
+/** Bootstrap the module
+ *
+ * Bootstrap I/O and type submodules.
+ *
+ * @param[in] instance	Ctx data for this module
+ * @param[in] conf    our configuration section parsed to give us instance.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+static int mod_bootstrap(void *instance, CONF_SECTION *conf)
+{
+	rlm_radius_tcp_t *inst = talloc_get_type_abort(instance, rlm_radius_tcp_t);
+
+	(void) talloc_set_type(inst, rlm_radius_tcp_t);
+	inst->config = conf;
+
+	inst->response_length = fr_dict_attr_by_name(NULL, "Response-Length");
+	inst->error_cause = fr_dict_attr_by_name(NULL, "Error-Cause");
+
+	fr_radius_secret_init(&inst->radius_secret, (uint8_t const *) inst->secret, strlen(inst->secret));
+
+	return 0;
+}
+
+
+/** Instantiate the module
+ *
+ * Instantiate I/O and type submodules.
+ *
+ * @param[in] parent    rlm_radius_t
+ * @param[in] instance	Ctx data for this module
+ * @param[in] conf	our configuration section parsed to give us instance.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+static int mod_instantiate(rlm_radius_t *parent, void *instance, CONF_SECTION *conf)
+{
+	rlm_radius_tcp_t	*inst = talloc_get_type_abort(instance, rlm_radius_tcp_t);
+	CONF_SECTION		*tls_cs;
+
+	inst->parent = parent;
+	inst->replicate = parent->replicate;
+
+	/*
+	 *	Ensure that we have a destination address.
+	 */
+	if (inst->dst_ipaddr.af == AF_UNSPEC) {
+		cf_log_err(conf, "A value must be given for 'ipaddr'");
+		return -1;
+	}
+
+	/*
+	 *	If src_ipaddr isn't set, make sure it's INADDR_ANY, of
+	 *	the same address family as dst_ipaddr.
+	 */
+	if (inst->src_ipaddr.af == AF_UNSPEC) {
+		memset(&inst->src_ipaddr, 0, sizeof(inst->src_ipaddr));
+
+		inst->src_ipaddr.af = inst->dst_ipaddr.af;
+
+		if (inst->src_ipaddr.af == AF_INET) {
+			inst->src_ipaddr.prefix = 32;
+		} else {
+			inst->src_ipaddr.prefix = 128;
+		}
+	}
+
+	else if (inst->src_ipaddr.af != inst->dst_ipaddr.af) {
+		cf_log_err(conf, "The 'ipaddr' and 'src_ipaddr' configuration items must "
+			   "be both of the same address family");
+		return -1;
+	}
+
+	if (!inst->dst_port) {
+		cf_log_err(conf, "A value must be given for 'port'");
+		return -1;
+	}
+
+	if (inst->recv_buff_is_set) {
+		FR_INTEGER_BOUND_CHECK("recv_buff", inst->recv_buff, >=, inst->max_packet_size);
+		FR_INTEGER_BOUND_CHECK("recv_buff", inst->recv_buff, <=, (1 << 30));
+	}
+
+	if (inst->send_buff_is_set) {
+		FR_INTEGER_BOUND_CHECK("send_buff", inst->send_buff, >=, inst->max_packet_size);
+		FR_INTEGER_BOUND_CHECK("send_buff", inst->send_buff, <=, (1 << 30));
+	}
+
+	FR_INTEGER_BOUND_CHECK("max_packet_size", inst->max_packet_size, >=, 64);
+	FR_INTEGER_BOUND_CHECK("max_packet_size", inst->max_packet_size, <=, 65535);
+
+	/*
+	 *	A "tls" subsection means RADIUS/TLS (RFC 6614).
+	 */
+	tls_cs = cf_section_find(conf, "tls", NULL);
+	if (tls_cs) {
+#ifdef WITH_TLS
+		inst->tls = tls_conf_parse_client(tls_cs);
+		if (!inst->tls) {
+			cf_log_err(tls_cs, "Failed parsing TLS configuration");
+			return -1;
+		}
+#else
+		cf_log_err(tls_cs, "Server was built without TLS support");
+		return -1;
+#endif
+	}
+
+	return 0;
+}
+
+
+/** Instantiate thread data for the submodule.
+ *
+ */
+static int mod_thread_instantiate(UNUSED CONF_SECTION const *cs, void *instance, fr_event_list_t *el, void *thread)
+{
+	rlm_radius_tcp_thread_t *t = thread;
+
+	(void) talloc_set_type(t, rlm_radius_tcp_thread_t);
+	t->inst = instance;
+	t->el = el;
+
+	t->queued = fr_heap_talloc_create(t, queue_cmp, rlm_radius_tcp_request_t, heap_id);
+	FR_DLIST_INIT(t->blocked);
+	FR_DLIST_INIT(t->full);
+	FR_DLIST_INIT(t->zombie);
+	FR_DLIST_INIT(t->opening);
+
+	t->active = fr_heap_talloc_create(t, conn_cmp, rlm_radius_tcp_connection_t, heap_id);
+
+	conn_alloc(t->inst, t);
+
+	return 0;
+}
+
+/** Destroy thread data for the IO submodule.
+ *
+ */
+static int mod_thread_detach(UNUSED fr_event_list_t *el, void *thread)
+{
+	rlm_radius_tcp_thread_t *t = talloc_get_type_abort(thread, rlm_radius_tcp_thread_t);
+	fr_dlist_t *entry;
+
+	if (fr_heap_num_elements(t->queued) != 0) {
+		ERROR("There are still queued requests");
+		return -1;
+	}
+
+	/*
+	 *	Free all of the heaps, lists, and sockets.
+	 */
+	talloc_free_children(t);
+
+	entry = FR_DLIST_FIRST(t->opening);
+	if (entry != NULL) {
+		ERROR("There are still partially open sockets");
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ *	The module name should be the only globally exported symbol.
+ *	That is, everything else should be 'static'.
+ *
+ *	If the module needs to temporarily modify it's instantiation
+ *	data, the type should be changed to RLM_TYPE_THREAD_UNSAFE.
+ *	The server will then take care of ensuring that the module
+ *	is single-threaded.
+ */
+extern fr_radius_client_io_t rlm_radius_tcp;
+fr_radius_client_io_t rlm_radius_tcp = {
+	.magic			= RLM_MODULE_INIT,
+	.name			= "radius_tcp",
+	.inst_size		= sizeof(rlm_radius_tcp_t),
+
+	.request_inst_size 	= sizeof(rlm_radius_tcp_request_t),
+	.request_inst_type	= "rlm_radius_tcp_request_t",
+
+	.thread_inst_size	= sizeof(rlm_radius_tcp_thread_t),
+
+	.config			= module_config,
+	.bootstrap		= mod_bootstrap,
+	.instantiate		= mod_instantiate,
+	.thread_instantiate 	= mod_thread_instantiate,
+	.thread_detach		= mod_thread_detach,
+
+	.push			= mod_push,
+	.signal			= mod_signal,
+};
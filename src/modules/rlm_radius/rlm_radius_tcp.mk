@@ -0,0 +1,9 @@
+TARGET		:= rlm_radius_tcp.a
+
+SOURCES		:= rlm_radius_tcp.c track.c
+
+TGT_PREREQS	:= libfreeradius-radius.a libfreeradius-util.a
+
+ifneq ($(OPENSSL_LIBS),)
+TGT_PREREQS	+= libfreeradius-tls.a
+endif
@@ -45,6 +45,7 @@ typedef struct rlm_radius_udp_t {
 	fr_ipaddr_t		src_ipaddr;		//!< IP we open our socket on.
 	uint16_t		dst_port;		//!< Port of the home server.
 	char const		*secret;		//!< Shared secret.
+	fr_radius_secret_t	radius_secret;		//!< Shared secret, with the MD5 state derived from it.
 
 	char const		*interface;		//!< Interface to bind to.
 
@@ -56,12 +57,37 @@ typedef struct rlm_radius_udp_t {
 	fr_dict_attr_t const	*response_length;	//!< Cached Response-Length attribute.
 	fr_dict_attr_t const	*error_cause;		//!< Cache Error-Cause attribute.
 
+	fr_ipaddr_t		*home_servers;		//!< Other home servers to balance packets across.
+
+	uint32_t		eject_factor;		//!< Eject a home server whose RTT is this many
+							///< times that of the best one.
+	uint32_t		eject_timeouts;		//!< Eject a home server after this many timeouts in a row.
+	struct timeval		eject_period;		//!< How long an ejected home server is skipped for.
+
 	bool			recv_buff_is_set;	//!< Whether we were provided with a recv_buf
 	bool			send_buff_is_set;	//!< Whether we were provided with a send_buf
 	bool			replicate;		//!< Copied from parent->replicate
 } rlm_radius_udp_t;
 
 
+/** Per-thread state for one home server
+ *
+ *  Used to balance packets across home servers, by their observed
+ *  round trip time and number of outstanding packets.
+ */
+typedef struct rlm_radius_udp_home_t {
+	fr_ipaddr_t		ipaddr;			//!< IP of the home server.
+
+	fr_heap_t		*active;   		//!< Active connections to this home server.
+	uint32_t		num_opening;		//!< Connections being opened to this home server.
+
+	uint32_t		outstanding;		//!< Packets sent, and waiting for a reply.
+	uint32_t		rtt;			//!< EWMA of the round trip time, in microseconds.
+	uint32_t		timeouts;		//!< Response timeouts in a row.
+	struct timeval		ejected_until;		//!< Don't send packets here until then.
+} rlm_radius_udp_home_t;
+
+
 /** Per-thread configuration for the module.
  *
  *  This data structure holds the connections, etc. for this IO submodule.
@@ -72,7 +98,9 @@ typedef struct rlm_radius_udp_thread_t {
 
 	fr_heap_t		*queued;		//!< Queued requests for some new connection.
 
-	fr_heap_t		*active;   		//!< Active connections.
+	rlm_radius_udp_home_t	*homes;			//!< Home servers, each with their active connections.
+	uint32_t		num_homes;		//!< How many home servers there are.
+
 	fr_dlist_t		blocked;      		//!< blocked connections, waiting for writable
 	fr_dlist_t		full;      		//!< Full connections.
 	fr_dlist_t		zombie;      		//!< Zombie connections.
@@ -96,6 +124,7 @@ typedef struct rlm_radius_udp_request_t rlm_radius_udp_request_t;
 typedef struct rlm_radius_udp_connection_t {
 	rlm_radius_udp_t const	*inst;			//!< Our module instance.
 	rlm_radius_udp_thread_t *thread;       		//!< Our thread-specific data.
+	rlm_radius_udp_home_t	*home;			//!< The home server we're connected to.
 	fr_connection_t		*conn;			//!< Connection to our destination.
 	char const     		*name;			//!< From IP PORT to IP PORT.
 
@@ -169,6 +198,14 @@ struct rlm_radius_udp_request_t {
 };
 
 
+static const CONF_PARSER balance_config[] = {
+	{ FR_CONF_OFFSET("eject_factor", FR_TYPE_UINT32, rlm_radius_udp_t, eject_factor), .dflt = "4" },
+	{ FR_CONF_OFFSET("eject_timeouts", FR_TYPE_UINT32, rlm_radius_udp_t, eject_timeouts), .dflt = "3" },
+	{ FR_CONF_OFFSET("eject_period", FR_TYPE_TIMEVAL, rlm_radius_udp_t, eject_period), .dflt = "30" },
+
+	CONF_PARSER_TERMINATOR
+};
+
 static const CONF_PARSER module_config[] = {
 	{ FR_CONF_OFFSET("ipaddr", FR_TYPE_COMBO_IP_ADDR, rlm_radius_udp_t, dst_ipaddr), },
 	{ FR_CONF_OFFSET("ipv4addr", FR_TYPE_IPV4_ADDR, rlm_radius_udp_t, dst_ipaddr) },
@@ -176,6 +213,10 @@ static const CONF_PARSER module_config[] = {
 
 	{ FR_CONF_OFFSET("port", FR_TYPE_UINT16, rlm_radius_udp_t, dst_port) },
 
+	{ FR_CONF_OFFSET("home_server", FR_TYPE_COMBO_IP_ADDR | FR_TYPE_MULTI, rlm_radius_udp_t, home_servers) },
+
+	{ FR_CONF_POINTER("balance", FR_TYPE_SUBSECTION, NULL), .subcs = (void const *) balance_config },
+
 	{ FR_CONF_OFFSET("secret", FR_TYPE_STRING | FR_TYPE_REQUIRED, rlm_radius_udp_t, secret) },
 
 	{ FR_CONF_OFFSET("interface", FR_TYPE_STRING, rlm_radius_udp_t, interface) },
@@ -213,6 +254,175 @@ static int conn_cmp(void const *one, void const *two)
 }
 
 
+/*
+ *	The RTT average gives each new sample a weight of 1/8.
+ */
+#define HOME_RTT_SHIFT		(3)
+
+/*
+ *	Don't eject home servers for RTTs below this (microseconds).
+ *	When everything is fast, small differences don't matter.
+ */
+#define HOME_EJECT_MIN_RTT	(10000)
+
+static inline bool home_ejected(rlm_radius_udp_home_t const *home, struct timeval const *now)
+{
+	return timercmp(now, &home->ejected_until, <);
+}
+
+/** The cost of sending one more packet to a home server
+ *
+ *  Home servers with no RTT yet have a low cost, so that they are
+ *  probed quickly.
+ */
+static inline uint64_t home_cost(rlm_radius_udp_home_t const *home)
+{
+	return ((uint64_t) home->rtt + 1) * ((uint64_t) home->outstanding + 1);
+}
+
+/** Stop sending packets to a home server for a while
+ *
+ */
+static void home_eject(rlm_radius_udp_thread_t *t, rlm_radius_udp_home_t *home, struct timeval const *now,
+		       char const *why)
+{
+	WARN("%s - Ejecting home server %pV port %u for %pV: %s", t->inst->parent->name,
+	     fr_box_ipaddr(home->ipaddr), t->inst->dst_port, fr_box_timeval(t->inst->eject_period), why);
+
+	fr_timeval_add(&home->ejected_until, now, &t->inst->eject_period);
+
+	/*
+	 *	Forget what we knew.  When the ejection period ends,
+	 *	the home server is probed again.
+	 */
+	home->rtt = 0;
+	home->timeouts = 0;
+}
+
+/** Update a home server from a reply
+ *
+ *  Updates the RTT average, and ejects the home server if it's an
+ *  outlier compared to the others.
+ *
+ *  @param t		the thread.
+ *  @param home		which sent the reply.
+ *  @param start	when the packet was sent.  NULL if the packet was
+ *			retransmitted, as we can't tell which
+ *			transmission the reply is for (Karn's rule).
+ */
+static void home_reply(rlm_radius_udp_thread_t *t, rlm_radius_udp_home_t *home, struct timeval const *start)
+{
+	struct timeval	now, diff;
+	uint64_t	sample;
+	uint32_t	i, best = 0;
+
+	home->timeouts = 0;
+
+	if (!start) return;
+
+	gettimeofday(&now, NULL);
+	fr_timeval_subtract(&diff, &now, start);
+
+	sample = ((uint64_t) diff.tv_sec * USEC) + diff.tv_usec;
+	if (sample > UINT32_MAX) sample = UINT32_MAX;
+
+	if (!home->rtt) {
+		home->rtt = sample;
+	} else {
+		home->rtt = home->rtt - (home->rtt >> HOME_RTT_SHIFT) + (sample >> HOME_RTT_SHIFT);
+	}
+
+	if ((t->num_homes == 1) || !t->inst->eject_factor) return;
+	if (home_ejected(home, &now) || (home->rtt < HOME_EJECT_MIN_RTT)) return;
+
+	/*
+	 *	Find the best RTT of the other usable home servers.
+	 */
+	for (i = 0; i < t->num_homes; i++) {
+		rlm_radius_udp_home_t *other = &t->homes[i];
+
+		if ((other == home) || !other->rtt || home_ejected(other, &now) ||
+		    !fr_heap_num_elements(other->active)) continue;
+
+		if (!best || (other->rtt < best)) best = other->rtt;
+	}
+
+	if (!best || ((uint64_t) home->rtt <= ((uint64_t) best * t->inst->eject_factor))) return;
+
+	home_eject(t, home, &now, "RTT is much higher than other home servers");
+}
+
+/** Update a home server when a packet it was sent hits its response timeout
+ *
+ */
+static void home_timeout(rlm_radius_udp_thread_t *t, rlm_radius_udp_home_t *home)
+{
+	struct timeval now;
+
+	home->timeouts++;
+
+	if ((t->num_homes == 1) || !t->inst->eject_timeouts) return;
+	if (home->timeouts < t->inst->eject_timeouts) return;
+
+	gettimeofday(&now, NULL);
+	if (home_ejected(home, &now)) return;
+
+	home_eject(t, home, &now, "Too many packets had no reply");
+}
+
+/** Pick a connection to send a packet on
+ *
+ *  With one home server, this is just the best connection.  With
+ *  more, we use "power of two choices".  Two usable home servers are
+ *  picked at random, and the one with the lower cost wins.  If every
+ *  home server is ejected, we ignore ejection, rather than failing.
+ */
+static rlm_radius_udp_connection_t *conn_select(rlm_radius_udp_thread_t *t)
+{
+	uint32_t		i, start;
+	struct timeval		now;
+	rlm_radius_udp_home_t	*a = NULL, *b = NULL;
+
+	if (t->num_homes == 1) return fr_heap_peek(t->homes[0].active);
+
+	gettimeofday(&now, NULL);
+
+	start = fr_rand() % t->num_homes;
+	for (i = 0; i < t->num_homes; i++) {
+		rlm_radius_udp_home_t *home = &t->homes[(start + i) % t->num_homes];
+
+		if (!fr_heap_num_elements(home->active) || home_ejected(home, &now)) continue;
+
+		a = home;
+		break;
+	}
+
+	if (!a) {
+		for (i = 0; i < t->num_homes; i++) {
+			rlm_radius_udp_home_t *home = &t->homes[(start + i) % t->num_homes];
+
+			if (fr_heap_num_elements(home->active)) return fr_heap_peek(home->active);
+		}
+
+		return NULL;
+	}
+
+	start = fr_rand() % t->num_homes;
+	for (i = 0; i < t->num_homes; i++) {
+		rlm_radius_udp_home_t *home = &t->homes[(start + i) % t->num_homes];
+
+		if ((home == a) || !fr_heap_num_elements(home->active) || home_ejected(home, &now)) continue;
+
+		b = home;
+		break;
+	}
+
+	if (b && (home_cost(b) < home_cost(a))) a = b;
+
+	return fr_heap_peek(a->active);
+}
+
+
 /** Compare two packets in the "to be sent" queue.
  *
  *  Status-Server packets are always sorted before other packets, by
@@ -466,6 +676,8 @@ static void state_transition(rlm_radius_udp_request_t *u, rlm_radius_request_sta
 		rad_assert(u->c != NULL);
 		(void) rr_track_delete(u->c->id, u->rr);
 		fr_dlist_remove(&u->entry);
+		rad_assert(u->c->home->outstanding > 0);
+		u->c->home->outstanding--;
 		u->rr = NULL;
 		u->c = NULL;
 		break;
@@ -492,6 +704,7 @@ static void state_transition(rlm_radius_udp_request_t *u, rlm_radius_request_sta
 		rad_assert(u->rr != NULL);
 		rad_assert(u->c != NULL);
 		fr_dlist_insert_tail(&u->c->sent, &u->entry);
+		u->c->home->outstanding++;
 		break;
 
 	case PACKET_STATE_RESUMABLE:
@@ -639,6 +852,28 @@ static void status_check_reply(rlm_radius_udp_connection_t *c, rlm_radius_udp_re
 		}
 	}
 
+	/*
+	 *	The home server copied FreeRADIUS-Extended-Identifier
+	 *	to the reply, so it supports extended identifiers.
+	 *	The number of free IDs changes, so the connection has
+	 *	to be re-sorted in the active heap.
+	 */
+	if (c->inst->parent->extended_id && !c->id->use_extended_id &&
+	    fr_pair_find_by_num(request->reply->vps, VENDORPEC_FREERADIUS, FR_FREERADIUS_EXTENDED_IDENTIFIER, TAG_ANY)) {
+		bool active = (c->state == CONN_ACTIVE);
+
+		if (active) (void) fr_heap_extract(c->home->active, c);
+
+		request->module = c->inst->parent->name;
+		if (rr_track_use_extended_id(c->id, true, c->inst->parent->max_outstanding) < 0) {
+			RWDEBUG("Failed allocating extended identifiers for connection %s", c->name);
+		} else {
+			RDEBUG("Using extended identifiers for connection %s", c->name);
+		}
+
+		if (active) (void) fr_heap_insert(c->home->active, c);
+	}
+
 	/*
 	 *	Delete the reply VPs, but leave the request VPs in
 	 *	place.
@@ -664,6 +899,11 @@ static void conn_transition(rlm_radius_udp_connection_t *c, rlm_radius_udp_conne
 		break;
 
 	case CONN_OPENING:
+		rad_assert(c->home->num_opening > 0);
+		c->home->num_opening--;
+		fr_dlist_remove(&c->entry);
+		break;
+
 	case CONN_FULL:
 	case CONN_BLOCKED:
 		fr_dlist_remove(&c->entry);
@@ -671,7 +911,7 @@ static void conn_transition(rlm_radius_udp_connection_t *c, rlm_radius_udp_conne
 
 	case CONN_ACTIVE:
 		rad_assert(c->heap_id >= 0);
-		(void) fr_heap_extract(c->thread->active, c);
+		(void) fr_heap_extract(c->home->active, c);
 		if (c->idle_ev) (void) fr_event_timer_delete(c->thread->el, &c->idle_ev);
 		break;
 
@@ -697,12 +937,13 @@ static void conn_transition(rlm_radius_udp_connection_t *c, rlm_radius_udp_conne
 		break;
 
 	case CONN_OPENING:
+		c->home->num_opening++;
 		fr_dlist_insert_head(&c->thread->opening, &c->entry);
 		break;
 
 	case CONN_ACTIVE:
 		rad_assert(c->heap_id < 0);
-		(void) fr_heap_insert(c->thread->active, c);
+		(void) fr_heap_insert(c->home->active, c);
 		conn_check_idle(c);
 		break;
 
@@ -796,7 +1037,7 @@ check_active:
 		fr_radius_print_hex(fr_log_fp, c->buffer, packet_len);
 	}
 
-	rr = rr_track_find(c->id, c->buffer[1], NULL);
+	rr = rr_track_find_reply(c->id, c->buffer, packet_len);
 	if (!rr) {
 		WARN("%s - Ignoring reply which arrived too late", c->inst->parent->name);
 		goto redo;
@@ -813,8 +1054,7 @@ check_active:
 	original[3] = 20;	/* for debugging */
 	memcpy(original + 4, rr->vector, sizeof(rr->vector));
 
-	if (fr_radius_verify(c->buffer, original,
-			     (uint8_t const *) c->inst->secret, strlen(c->inst->secret)) < 0) {
+	if (fr_radius_verify(c->buffer, original, &c->inst->radius_secret) < 0) {
 		RPWDEBUG("Ignoring response with invalid signature");
 		goto redo;
 	}
@@ -830,6 +1070,8 @@ check_active:
 	 */
 	gettimeofday(&c->last_reply, NULL);
 
+	home_reply(c->thread, c->home, (u->timer.count > 1) ? NULL : &u->timer.start);
+
 	/*
 	 *	Track the Most Recently Started with reply.  If we're
 	 *	writable or have IDs available, just re-order the list
@@ -842,9 +1084,9 @@ check_active:
 		if (reinserted) break;
 
 		if (timercmp(&u->timer.start, &c->mrs_time, >)) {
-			(void) fr_heap_extract(c->thread->active, c);
+			(void) fr_heap_extract(c->home->active, c);
 			c->mrs_time = u->timer.start;
-			(void) fr_heap_insert(c->thread->active, c);
+			(void) fr_heap_insert(c->home->active, c);
 			reinserted = true;
 		}
 		break;
@@ -1015,6 +1257,17 @@ check_active:
 		       fr_packet_codes[code], code, packet_len, c->name);
 		rdebug_pair_list(L_DBG_LVL_2, request, vp, NULL);
 
+		/*
+		 *	FreeRADIUS-Extended-Identifier is hop-by-hop.
+		 *	The one in the reply is ours, and mustn't be
+		 *	copied to the reply we send to our client.
+		 *	Status checks look for it, to see whether the
+		 *	home server supports extended identifiers.
+		 */
+		if (u != c->status_u) {
+			fr_pair_delete_by_num(&vp, VENDORPEC_FREERADIUS, FR_FREERADIUS_EXTENDED_IDENTIFIER, TAG_ANY);
+		}
+
 		/*
 		 *	@todo - make this programmatic?  i.e. run a
 		 *	separate policy which updates the reply.
@@ -1158,8 +1411,7 @@ static int retransmit_packet(rlm_radius_udp_request_t *u, struct timeval *now)
 	 *	Recalculate the packet signature again.
 	 */
 	if (resign) {
-		if (fr_radius_sign(u->packet, NULL, (uint8_t const *) c->inst->secret,
-				   strlen(c->inst->secret)) < 0) {
+		if (fr_radius_sign(u->packet, NULL, &c->inst->radius_secret) < 0) {
 			REDEBUG("Failed re-signing packet");
 			return -1;
 		}
@@ -1224,6 +1476,14 @@ static void response_timeout(fr_event_list_t *el, struct timeval *now, void *uct
 	RDEBUG("TIMER - response timeout reached for try (%d/%d)",
 	       u->timer.count, u->timer.retry->mrc);
 
+	/*
+	 *	Every timeout counts against the home server, not
+	 *	just the last one.  Otherwise a dead home server
+	 *	isn't ejected until packets have been retransmitted
+	 *	for their whole retransmission duration.
+	 */
+	if (c && (u != c->status_u)) home_timeout(c->thread, c->home);
+
 	/*
 	 *	Can we retry this packet?  If not, then maybe the
 	 *	connection is zombie.  If we don't have a connection,
@@ -1233,6 +1493,17 @@ static void response_timeout(fr_event_list_t *el, struct timeval *now, void *uct
 	if (rcode == 0) {
 		if (c) {
 			if (u == c->status_u) {
+				/*
+				 *	Negotiation failed, but the
+				 *	connection is still usable.
+				 */
+				if (c->state != CONN_ZOMBIE) {
+					RDEBUG("No response to extended identifier negotiation on connection %s",
+					       c->name);
+					u->state = PACKET_STATE_INIT;
+					return;
+				}
+
 				REDEBUG("No response to status checks, closing connection %s", c->name);
 				talloc_free(c);
 				return;
@@ -1267,7 +1538,7 @@ static void response_timeout(fr_event_list_t *el, struct timeval *now, void *uct
 	if (!c) {
 	get_new_connection:
 		rad_assert(u->state == PACKET_STATE_THREAD);
-		c = fr_heap_peek(u->thread->active);
+		c = conn_select(u->thread);
 		if (!c) {
 			RDEBUG("No available connections for retransmission.  Waiting %d.%06ds for retry",
 			       u->timer.rt / USEC, u->timer.rt % USEC);
@@ -1341,6 +1612,9 @@ static int conn_write(rlm_radius_udp_connection_t *c, rlm_radius_udp_request_t *
 	uint8_t			*msg = NULL;
 	bool			require_ma = false;
 	int			proxy_state = 6;
+	int			extended_len = 0;
+	uint32_t		extended_id = 0;
+	VALUE_PAIR		*hop_by_hop;
 	REQUEST			*request;
 	char const		*module_name;
 
@@ -1398,6 +1672,18 @@ static int conn_write(rlm_radius_udp_connection_t *c, rlm_radius_udp_request_t *
 		if (vp) vp->vp_uint32 = time(NULL);
 	}
 
+	/*
+	 *	Add FreeRADIUS-Extended-Identifier if we're using it,
+	 *	or if we're asking the home server to use it.
+	 */
+	if (u->rr->extended) {
+		extended_len = RR_TRACK_EXTENDED_LEN;
+		extended_id = u->rr->extended_id;
+
+	} else if ((u == c->status_u) && c->inst->parent->extended_id && !c->id->use_extended_id) {
+		extended_len = RR_TRACK_EXTENDED_LEN;
+	}
+
 	/*
 	 *	Leave room for the Message-Authenticator.
 	 */
@@ -1407,13 +1693,22 @@ static int conn_write(rlm_radius_udp_connection_t *c, rlm_radius_udp_request_t *
 		buflen = c->buflen;
 	}
 
+	/*
+	 *	FreeRADIUS-Extended-Identifier is hop-by-hop.  Don't
+	 *	forward any the client sent us.
+	 */
+	hop_by_hop = rr_track_extended_id_unlink(&request->packet->vps);
+
 	/*
 	 *	Encode it, leaving room for Proxy-State, too.
 	 */
-	packet_len = fr_radius_encode(c->buffer, buflen - proxy_state, NULL,
+	packet_len = fr_radius_encode(c->buffer, buflen - proxy_state - extended_len, NULL,
 				      c->inst->secret, 0, u->code, u->rr->id,
 				      request->packet->vps);
-	if (packet_len <= 0) return -1;
+	if (packet_len <= 0) {
+		fr_pair_add(&request->packet->vps, hop_by_hop);
+		return -1;
+	}
 
 	/*
 	 *	This hack cleans up the debug output a bit.
@@ -1424,6 +1719,7 @@ static int conn_write(rlm_radius_udp_connection_t *c, rlm_radius_udp_request_t *
 	RDEBUG("Sending %s ID %d length %ld over connection %s",
 	       fr_packet_codes[u->code], u->rr->id, packet_len, c->name);
 	rdebug_pair_list(L_DBG_LVL_2, request, request->packet->vps, NULL);
+	fr_pair_add(&request->packet->vps, hop_by_hop);
 
 	/*
 	 *	Might have been sent and then given up on... free the
@@ -1470,6 +1766,37 @@ static int conn_write(rlm_radius_udp_connection_t *c, rlm_radius_udp_request_t *
 		packet_len += 6;
 	}
 
+	/*
+	 *	Add FreeRADIUS-Extended-Identifier manually.  The home
+	 *	server copies it to the reply, which lets us find the
+	 *	request when many share the same 8-bit ID.
+	 */
+	if (extended_len) {
+		int		hdr_len;
+		VALUE_PAIR	*vp;
+
+		rad_assert((size_t) (packet_len + extended_len) <= c->buflen);
+
+		rr_track_extended_id_encode(c->buffer + packet_len, extended_id);
+
+		hdr_len = (c->buffer[2] << 8) | (c->buffer[3]);
+		hdr_len += extended_len;
+		c->buffer[2] = (hdr_len >> 8) & 0xff;
+		c->buffer[3] = hdr_len & 0xff;
+
+		vp = fr_pair_afrom_num(u, VENDORPEC_FREERADIUS, FR_FREERADIUS_EXTENDED_IDENTIFIER);
+		if (vp) {
+			vp->vp_uint32 = extended_id;
+			fr_pair_add(&u->extra, vp);
+
+			RINDENT();
+			rdebug_pair(L_DBG_LVL_2, request, vp, NULL);
+			REXDENT();
+		}
+
+		packet_len += extended_len;
+	}
+
 	/*
 	 *	Add Message-Authenticator manually.
 	 *
@@ -1530,8 +1857,7 @@ static int conn_write(rlm_radius_udp_connection_t *c, rlm_radius_udp_request_t *
 		u->manual_delay_time = false;
 	}
 
-	if (fr_radius_sign(c->buffer, NULL, (uint8_t const *) c->inst->secret,
-			   strlen(c->inst->secret)) < 0) {
+	if (fr_radius_sign(c->buffer, NULL, &c->inst->radius_secret) < 0) {
 		request->module = module_name;
 		RERROR("Failed signing packet");
 		conn_error(c->thread->el, c->fd, 0, errno, c);
@@ -1671,6 +1997,26 @@ static void conn_writable(fr_event_list_t *el, UNUSED int fd, UNUSED int flags,
 
 	DEBUG3("%s - Writing packets for connection %s", c->inst->parent->name, c->name);
 
+	/*
+	 *	Our home server has been ejected.  If there's a
+	 *	connection to a better one, let it drain the queue
+	 *	instead.  It won't hand the queue back, as its home
+	 *	server isn't ejected.
+	 */
+	if ((c->thread->num_homes > 1) && (c->state == CONN_ACTIVE)) {
+		struct timeval now;
+
+		gettimeofday(&now, NULL);
+		if (home_ejected(c->home, &now)) {
+			next = conn_select(c->thread);
+			if (next && (next->home != c->home)) {
+				fd_idle(c);
+				conn_writable(el, next->fd, 0, next);
+				return;
+			}
+		}
+	}
+
 	/*
 	 *	Empty the global queue of packets to send.
 	 */
@@ -1744,7 +2090,7 @@ static void conn_writable(fr_event_list_t *el, UNUSED int fd, UNUSED int flags,
 
 			talloc_free(c);
 
-			next = fr_heap_peek(t->active);
+			next = conn_select(t);
 			if (!next) return;
 
 			conn_writable(el, next->fd, 0, next);
@@ -1770,7 +2116,7 @@ static void conn_writable(fr_event_list_t *el, UNUSED int fd, UNUSED int flags,
 		return;
 	}
 
-	next = fr_heap_peek(c->thread->active);
+	next = conn_select(c->thread);
 
 	/*
 	 *	There are more packets to write.  Update our status,
@@ -1979,6 +2325,12 @@ static fr_connection_state_t _conn_failed(UNUSED int fd, fr_connection_state_t s
 			u = fr_ptr_to_type(rlm_radius_udp_request_t, entry, entry);
 			state_transition(u, PACKET_STATE_THREAD);
 		}
+
+		/*
+		 *	The next connection has to negotiate extended
+		 *	identifiers again.
+		 */
+		(void) rr_track_use_extended_id(c->id, false, 0);
 	}
 
 	conn_transition(c, CONN_OPENING);
@@ -2005,7 +2357,8 @@ static fr_connection_state_t _conn_open(UNUSED fr_event_list_t *el, UNUSED int f
 	 *	Connection is "active" now.  i.e. we prefer the newly
 	 *	opened connection for sending packets.
 	 *
-	 *	@todo - connection negotiation via Status-Server
+	 *	Any negotiation (e.g. extended identifiers) is done
+	 *	with the Status-Server checks created below.
 	 */
 	gettimeofday(&c->mrs_time, NULL);
 	c->last_reply = c->mrs_time;
@@ -2120,6 +2473,23 @@ static fr_connection_state_t _conn_open(UNUSED fr_event_list_t *el, UNUSED int f
 		u->timer.retry = &c->inst->parent->retry[u->code];
 	}
 
+	/*
+	 *	Ask the home server to use extended identifiers.  We
+	 *	don't wait for the reply, and keep using 8-bit IDs
+	 *	until it arrives.
+	 */
+	if (c->status_u && c->inst->parent->extended_id) {
+		rlm_radius_udp_request_t *u = c->status_u;
+
+		if (conn_write(c, u) == 1) {
+			u->state = PACKET_STATE_SENT;
+			if (fr_heap_num_elements(t->queued) == 0) fd_idle(c);
+		} else {
+			DEBUG2("%s - Failed sending extended identifier negotiation on connection %s",
+			       c->inst->parent->name, c->name);
+		}
+	}
+
 	/*
 	 *	Now that we're open, assume that the connection is
 	 *	writable.
@@ -2201,7 +2571,8 @@ static int _conn_free(rlm_radius_udp_connection_t *c)
 {
 	fr_dlist_t			*entry;
 	rlm_radius_udp_request_t	*u;
-	rlm_radius_udp_thread_t		*t = talloc_get_type_abort(c->thread, rlm_radius_udp_thread_t);
+
+	(void) talloc_get_type_abort(c->thread, rlm_radius_udp_thread_t);
 
 	/*
 	 *	We're no longer using this connection.
@@ -2250,6 +2621,11 @@ static int _conn_free(rlm_radius_udp_connection_t *c)
 		break;
 
 	case CONN_OPENING:
+		rad_assert(c->home->num_opening > 0);
+		c->home->num_opening--;
+		fr_dlist_remove(&c->entry);
+		break;
+
 	case CONN_FULL:
 	case CONN_ZOMBIE:
 		fr_dlist_remove(&c->entry);
@@ -2257,7 +2633,7 @@ static int _conn_free(rlm_radius_udp_connection_t *c)
 
 	case CONN_ACTIVE:
 		rad_assert(c->heap_id < 0);
-		(void) fr_heap_extract(t->active, c);
+		(void) fr_heap_extract(c->home->active, c);
 		break;
 	}
 
@@ -2268,7 +2644,7 @@ static int _conn_free(rlm_radius_udp_connection_t *c)
 /** Allocate a new connection and set it up.
  *
  */
-static void conn_alloc(rlm_radius_udp_t *inst, rlm_radius_udp_thread_t *t)
+static void conn_alloc(rlm_radius_udp_t *inst, rlm_radius_udp_thread_t *t, rlm_radius_udp_home_t *home)
 {
 	rlm_radius_udp_connection_t	*c;
 
@@ -2276,7 +2652,8 @@ static void conn_alloc(rlm_radius_udp_t *inst, rlm_radius_udp_thread_t *t)
 	c->heap_id = -1;
 	c->inst = inst;
 	c->thread = t;
-	c->dst_ipaddr = inst->dst_ipaddr;
+	c->home = home;
+	c->dst_ipaddr = home->ipaddr;
 	c->dst_port = inst->dst_port;
 	c->src_ipaddr = inst->src_ipaddr;
 	c->src_port = 0;
@@ -2367,7 +2744,7 @@ static rlm_rcode_t mod_push(void *instance, REQUEST *request, rlm_radius_link_t
 	 *	connections, fail the request.  This lets "parallel"
 	 *	sections finish much more quickly than otherwise.
 	 */
-	if (inst->parent->no_connection_fail && !fr_heap_num_elements(t->active)) {
+	if (inst->parent->no_connection_fail && !conn_select(t)) {
 		REDEBUG("Failing request due to 'no_connection_fail = true', and there are no active connections");
 		return RLM_MODULE_FAIL;
 	}
@@ -2424,15 +2801,17 @@ static rlm_rcode_t mod_push(void *instance, REQUEST *request, rlm_radius_link_t
 	 *	connection.  If they're all full, try to open a new
 	 *	one.
 	 */
-	c = fr_heap_peek(t->active);
+	c = conn_select(t);
 	if (!c) {
-		fr_dlist_t *entry;
+		uint32_t i;
 
 		/*
-		 *	Only open one new connection at a time.
+		 *	Only open one new connection at a time to
+		 *	each home server.
 		 */
-		entry = FR_DLIST_FIRST(t->opening);
-		if (!entry) conn_alloc(inst, t);
+		for (i = 0; i < t->num_homes; i++) {
+			if (!t->homes[i].num_opening) conn_alloc(inst, t, &t->homes[i]);
+		}
 
 		/*
 		 *	Add the request to the backlog.  It will be
@@ -2512,6 +2891,8 @@ static int mod_bootstrap(void *instance, CONF_SECTION *conf)
 	inst->response_length = fr_dict_attr_by_name(NULL, "Response-Length");
 	inst->error_cause = fr_dict_attr_by_name(NULL, "Error-Cause");
 
+	fr_radius_secret_init(&inst->radius_secret, (uint8_t const *) inst->secret, strlen(inst->secret));
+
 	return 0;
 }
 
@@ -2582,6 +2963,26 @@ static int mod_instantiate(rlm_radius_t *parent, void *instance, CONF_SECTION *c
 	FR_INTEGER_BOUND_CHECK("max_packet_size", inst->max_packet_size, >=, 64);
 	FR_INTEGER_BOUND_CHECK("max_packet_size", inst->max_packet_size, <=, 65535);
 
+	/*
+	 *	The other home servers use the same port, secret, and
+	 *	source address.
+	 */
+	if (inst->home_servers) {
+		size_t i;
+
+		for (i = 0; i < talloc_array_length(inst->home_servers); i++) {
+			if (inst->home_servers[i].af != inst->src_ipaddr.af) {
+				cf_log_err(conf, "The 'home_server' and 'src_ipaddr' configuration items must "
+					   "be both of the same address family");
+				return -1;
+			}
+		}
+
+		if (inst->eject_factor) FR_INTEGER_BOUND_CHECK("balance.eject_factor", inst->eject_factor, >=, 2);
+		FR_TIMEVAL_BOUND_CHECK("balance.eject_period", &inst->eject_period, >=, 1, 0);
+		FR_TIMEVAL_BOUND_CHECK("balance.eject_period", &inst->eject_period, <=, 600, 0);
+	}
+
 	return 0;
 }
 
@@ -2592,6 +2993,7 @@ static int mod_instantiate(rlm_radius_t *parent, void *instance, CONF_SECTION *c
 static int mod_thread_instantiate(UNUSED CONF_SECTION const *cs, void *instance, fr_event_list_t *el, void *thread)
 {
 	rlm_radius_udp_thread_t *t = thread;
+	uint32_t		i;
 
 	(void) talloc_set_type(t, rlm_radius_udp_thread_t);
 	t->inst = instance;
@@ -2603,9 +3005,25 @@ static int mod_thread_instantiate(UNUSED CONF_SECTION const *cs, void *instance,
 	FR_DLIST_INIT(t->zombie);
 	FR_DLIST_INIT(t->opening);
 
-	t->active = fr_heap_talloc_create(t, conn_cmp, rlm_radius_udp_connection_t, heap_id);
+	/*
+	 *	The first home server is "ipaddr", and the rest are
+	 *	from "home_server".
+	 */
+	t->num_homes = 1;
+	if (t->inst->home_servers) t->num_homes += talloc_array_length(t->inst->home_servers);
+
+	t->homes = talloc_zero_array(t, rlm_radius_udp_home_t, t->num_homes);
+	if (!t->homes) return -1;
+
+	for (i = 0; i < t->num_homes; i++) {
+		rlm_radius_udp_home_t *home = &t->homes[i];
+
+		home->ipaddr = (i == 0) ? t->inst->dst_ipaddr : t->inst->home_servers[i - 1];
+		home->active = fr_heap_talloc_create(t->homes, conn_cmp, rlm_radius_udp_connection_t, heap_id);
+		if (!home->active) return -1;
+	}
 
-	conn_alloc(t->inst, t);
+	for (i = 0; i < t->num_homes; i++) conn_alloc(t->inst, t, &t->homes[i]);
 
 	return 0;
 }
@@ -0,0 +1,1824 @@
+/*
+ *   This program is is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or (at
+ *   your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ * @file rlm_radius_udp_shared.c
+ * @brief RADIUS UDP transport, with sockets shared across worker threads
+ *
+ *  The "udp" transport opens sockets in every worker thread.  With many
+ *  workers, that means many sockets to the same home server, each of
+ *  which is lightly used.
+ *
+ *  This transport instead starts one or more proxy threads, which own
+ *  all of the sockets to the home server.  The workers encode packets,
+ *  and send them to a proxy thread over an #fr_channel_t.  The proxy
+ *  thread allocates IDs, sends the packets, does retransmissions, and
+ *  sends the replies back to the worker over the same channel.  All of
+ *  the workers therefore share the same 256 IDs per socket.
+ *
+ * @copyright 2018  The FreeRADIUS server project
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/io/application.h>
+#include <freeradius-devel/io/channel.h>
+#include <freeradius-devel/io/control.h>
+#include <freeradius-devel/io/message.h>
+#include <freeradius-devel/udp.h>
+#include <freeradius-devel/rad_assert.h>
+#include <freeradius-devel/unlang.h>
+
+#include <pthread.h>
+
+#include "rlm_radius.h"
+#include "track.h"
+
+typedef struct rlm_radius_udp_shared_io_t rlm_radius_udp_shared_io_t;
+
+/** Static configuration for the module.
+ *
+ */
+typedef struct rlm_radius_udp_shared_t {
+	rlm_radius_t		*parent;		//!< rlm_radius instance.
+	CONF_SECTION		*config;
+
+	fr_ipaddr_t		dst_ipaddr;		//!< IP of the home server.
+	fr_ipaddr_t		src_ipaddr;		//!< IP we open our socket on.
+	uint16_t		dst_port;		//!< Port of the home server.
+	char const		*secret;		//!< Shared secret.
+	fr_radius_secret_t	radius_secret;		//!< Shared secret, with the MD5 state derived from it.
+
+	char const		*interface;		//!< Interface to bind to.
+
+	uint32_t		recv_buff;		//!< How big the kernel's receive buffer should be.
+	uint32_t		send_buff;		//!< How big the kernel's send buffer should be.
+
+	uint32_t		max_packet_size;	//!< Maximum packet size.
+
+	uint8_t			*status_packet;		//!< Encoded status check packet, or NULL for none.
+	size_t			status_packet_len;	//!< Length of the status check packet.
+
+	uint32_t		num_threads;		//!< Number of proxy threads.
+	uint32_t		num_sockets;		//!< Number of sockets in each proxy thread.
+
+	rlm_radius_udp_shared_io_t **io;		//!< The proxy threads.
+	atomic_uint32_t		next_io;		//!< Which proxy thread the next worker uses.
+
+	bool			recv_buff_is_set;	//!< Whether we were provided with a recv_buf
+	bool			send_buff_is_set;	//!< Whether we were provided with a send_buf
+	bool			replicate;		//!< Copied from parent->replicate
+} rlm_radius_udp_shared_t;
+
+
+/** One socket, owned by a proxy thread
+ *
+ */
+typedef struct rlm_radius_udp_shared_socket_t {
+	rlm_radius_udp_shared_io_t *io;			//!< The proxy thread which owns this socket.
+
+	int			fd;			//!< File descriptor.
+	fr_ipaddr_t		src_ipaddr;		//!< Our source IP.
+	uint16_t	       	src_port;		//!< Our source port.
+
+	int			num_free;		//!< How many IDs are free.
+	int			next_id;		//!< Where we start looking for a free ID.
+	struct rlm_radius_udp_shared_packet_t *id[256];	//!< Packets, by ID.
+} rlm_radius_udp_shared_socket_t;
+
+
+/** What a proxy thread thinks of the home server
+ *
+ */
+typedef enum {
+	HOME_ALIVE = 0,					//!< Replying to packets.
+	HOME_ZOMBIE,					//!< No replies for zombie_period.  Being checked.
+	HOME_DEAD					//!< Failed status checks.  Packets fail immediately.
+} rlm_radius_udp_shared_home_state_t;
+
+
+/** A proxy thread
+ *
+ */
+struct rlm_radius_udp_shared_io_t {
+	rlm_radius_udp_shared_t	*inst;			//!< Instance of the module.
+	int			num;			//!< Which proxy thread this is.
+	pthread_t		pthread_id;		//!< Thread ID.
+	bool			running;		//!< Whether the thread was started.
+
+	fr_event_list_t		*el;			//!< Event list for this thread.
+
+	fr_atomic_queue_t	*aq_control;		//!< Control messages sent to this thread.
+	uintptr_t		aq_ident;		//!< Identifier for aq_control.
+	fr_control_t		*control;		//!< The control plane, which the workers send to.
+
+	rlm_radius_udp_shared_socket_t *sockets;	//!< Sockets to the home server.
+	uint32_t		next_socket;		//!< Where we start looking for a free ID.
+
+	fr_dlist_t		queued;			//!< Packets waiting for a free ID.
+	fr_dlist_t		deferred;		//!< Replies waiting for room in the message set.
+	fr_event_timer_t const	*deferred_ev;		//!< Retries the deferred replies.
+
+	rlm_radius_udp_shared_home_state_t state;	//!< State of the home server.
+	struct timeval		last_reply;		//!< When we last got a reply from the home server,
+							//!< or started sending to it after it was idle.
+	uint32_t		num_outstanding;	//!< Packets waiting for a reply.
+	struct rlm_radius_udp_shared_packet_t *status;	//!< Status check packet, or NULL for none.
+	fr_event_timer_t const	*revive_ev;		//!< When a dead home server is checked again.
+
+	uint8_t			*buffer;		//!< Receive buffer.
+	size_t			buflen;			//!< Receive buffer length.
+};
+
+
+/** One channel to a worker, as seen by a proxy thread
+ *
+ */
+typedef struct rlm_radius_udp_shared_channel_t {
+	rlm_radius_udp_shared_io_t *io;			//!< The proxy thread.
+	fr_channel_t		*ch;			//!< The channel to the worker.
+	fr_message_set_t	*ms;			//!< For replies sent to the worker.
+	fr_dlist_t		packets;		//!< Packets from this worker which are waiting for replies.
+} rlm_radius_udp_shared_channel_t;
+
+
+/** A packet being proxied, as seen by a proxy thread
+ *
+ */
+typedef struct rlm_radius_udp_shared_packet_t {
+	rlm_radius_udp_shared_io_t *io;			//!< The proxy thread.
+	rlm_radius_udp_shared_channel_t *chan;		//!< Channel the packet came from, or NULL
+							//!< for status checks.
+	void			*packet_ctx;		//!< Worker context, returned with the reply.
+
+	fr_dlist_t		entry;			//!< In the channel list of packets.
+	fr_dlist_t		queue;			//!< In the list of packets waiting for an ID,
+							//!< or for their reply to be sent.
+
+	rlm_radius_udp_shared_socket_t *s;		//!< Socket the packet was sent on.
+	int			id;			//!< ID allocated on that socket.
+
+	int			code;			//!< Packet code.
+	uint8_t			vector[AUTH_VECTOR_LEN];	//!< Request authenticator, after signing.
+
+	rlm_radius_retransmit_t timer;			//!< Retransmission data structures.
+
+	uint8_t			*packet;		//!< Packet we write to the network.
+	size_t			packet_len;		//!< Length of the packet.
+
+	bool			deferred;		//!< The reply is waiting to be sent to the worker.
+	uint8_t			*reply;			//!< Deferred reply, or NULL for "no reply".
+	size_t			reply_len;		//!< Length of the deferred reply.
+} rlm_radius_udp_shared_packet_t;
+
+
+/** Per-worker data
+ *
+ */
+typedef struct rlm_radius_udp_shared_thread_t {
+	rlm_radius_udp_shared_t	*inst;			//!< Instance of the module.
+	fr_event_list_t		*el;			//!< This thread's event list.
+
+	fr_atomic_queue_t	*aq_control;		//!< Control messages sent to this worker.
+	uintptr_t		aq_ident;		//!< Identifier for aq_control.
+	fr_control_t		*control;		//!< The control plane, which the proxy thread sends to.
+
+	fr_channel_t		*ch;			//!< The channel to our proxy thread.
+	fr_message_set_t	*ms;			//!< For packets sent to the proxy thread.
+
+	atomic_uint32_t		closed;			//!< Set by the proxy thread when it's done with the channel.
+} rlm_radius_udp_shared_thread_t;
+
+
+typedef struct rlm_radius_udp_shared_request_t rlm_radius_udp_shared_request_t;
+
+/** Links a packet in a proxy thread back to the worker request
+ *
+ *  The proxy thread always replies to every packet, even if the
+ *  worker has given up on the request.  So this structure is owned by
+ *  the worker thread, and lives until the reply arrives.
+ */
+typedef struct rlm_radius_udp_shared_pending_t {
+	rlm_radius_udp_shared_request_t *u;		//!< The request, or NULL if it was cancelled.
+} rlm_radius_udp_shared_pending_t;
+
+
+/** An ongoing RADIUS request, as seen by a worker
+ *
+ */
+struct rlm_radius_udp_shared_request_t {
+	rlm_radius_udp_shared_thread_t *thread;		//!< The thread data for this request.
+	rlm_radius_link_t	*link;			//!< More link stuff.
+	rlm_radius_udp_shared_pending_t *pending;	//!< Link to the proxy thread.
+
+	int			code;			//!< Packet code.
+	bool			yielded;		//!< Whether it yielded.
+};
+
+
+static const CONF_PARSER module_config[] = {
+	{ FR_CONF_OFFSET("ipaddr", FR_TYPE_COMBO_IP_ADDR, rlm_radius_udp_shared_t, dst_ipaddr), },
+	{ FR_CONF_OFFSET("ipv4addr", FR_TYPE_IPV4_ADDR, rlm_radius_udp_shared_t, dst_ipaddr) },
+	{ FR_CONF_OFFSET("ipv6addr", FR_TYPE_IPV6_ADDR, rlm_radius_udp_shared_t, dst_ipaddr) },
+
+	{ FR_CONF_OFFSET("port", FR_TYPE_UINT16, rlm_radius_udp_shared_t, dst_port) },
+
+	{ FR_CONF_OFFSET("secret", FR_TYPE_STRING | FR_TYPE_REQUIRED, rlm_radius_udp_shared_t, secret) },
+
+	{ FR_CONF_OFFSET("interface", FR_TYPE_STRING, rlm_radius_udp_shared_t, interface) },
+
+	{ FR_CONF_IS_SET_OFFSET("recv_buff", FR_TYPE_UINT32, rlm_radius_udp_shared_t, recv_buff) },
+	{ FR_CONF_IS_SET_OFFSET("send_buff", FR_TYPE_UINT32, rlm_radius_udp_shared_t, send_buff) },
+
+	{ FR_CONF_OFFSET("max_packet_size", FR_TYPE_UINT32, rlm_radius_udp_shared_t, max_packet_size),
+	  .dflt = "4096" },
+
+	{ FR_CONF_OFFSET("src_ipaddr", FR_TYPE_COMBO_IP_ADDR, rlm_radius_udp_shared_t, src_ipaddr) },
+	{ FR_CONF_OFFSET("src_ipv4addr", FR_TYPE_IPV4_ADDR, rlm_radius_udp_shared_t, src_ipaddr) },
+	{ FR_CONF_OFFSET("src_ipv6addr", FR_TYPE_IPV6_ADDR, rlm_radius_udp_shared_t, src_ipaddr) },
+
+	{ FR_CONF_OFFSET("threads", FR_TYPE_UINT32, rlm_radius_udp_shared_t, num_threads), .dflt = "1" },
+	{ FR_CONF_OFFSET("sockets", FR_TYPE_UINT32, rlm_radius_udp_shared_t, num_sockets), .dflt = "4" },
+
+	CONF_PARSER_TERMINATOR
+};
+
+/*
+ *	Messages in either direction are a packet, plus the request
+ *	authenticator for replies.  The ring buffers have to be able
+ *	to hold a few of them.
+ */
+#define SHARED_RING_BUFFER_SIZE	(1 << 18)
+#define SHARED_NUM_MESSAGES	(1024)
+
+/*
+ *	How long to wait before retrying replies which didn't fit
+ *	into the message set.
+ */
+#define SHARED_DEFERRED_USEC	(10000)
+
+/** Turn a reply code into a module rcode;
+ *
+ */
+static rlm_rcode_t code2rcode[FR_MAX_PACKET_CODE] = {
+	[FR_CODE_ACCESS_ACCEPT]		= RLM_MODULE_OK,
+	[FR_CODE_ACCESS_CHALLENGE]	= RLM_MODULE_UPDATED,
+	[FR_CODE_ACCESS_REJECT]		= RLM_MODULE_REJECT,
+
+	[FR_CODE_ACCOUNTING_RESPONSE]	= RLM_MODULE_OK,
+
+	[FR_CODE_COA_ACK]		= RLM_MODULE_OK,
+	[FR_CODE_COA_NAK]		= RLM_MODULE_REJECT,
+
+	[FR_CODE_DISCONNECT_ACK]	= RLM_MODULE_OK,
+	[FR_CODE_DISCONNECT_NAK]	= RLM_MODULE_REJECT,
+
+	[FR_CODE_PROTOCOL_ERROR]	= RLM_MODULE_FAIL,
+};
+
+
+/** If we get a reply, the request must come from one of a small
+ * number of packet types.
+ */
+static FR_CODE allowed_replies[FR_MAX_PACKET_CODE] = {
+	[FR_CODE_ACCESS_ACCEPT]		= FR_CODE_ACCESS_REQUEST,
+	[FR_CODE_ACCESS_CHALLENGE]	= FR_CODE_ACCESS_REQUEST,
+	[FR_CODE_ACCESS_REJECT]		= FR_CODE_ACCESS_REQUEST,
+
+	[FR_CODE_ACCOUNTING_RESPONSE]	= FR_CODE_ACCOUNTING_REQUEST,
+
+	[FR_CODE_COA_ACK]		= FR_CODE_COA_REQUEST,
+	[FR_CODE_COA_NAK]		= FR_CODE_COA_REQUEST,
+
+	[FR_CODE_DISCONNECT_ACK]	= FR_CODE_DISCONNECT_REQUEST,
+	[FR_CODE_DISCONNECT_NAK]	= FR_CODE_DISCONNECT_REQUEST,
+};
+
+
+/*
+ *	Proxy thread functions.
+ *
+ *	Everything here runs in the proxy thread, and only touches
+ *	data owned by that thread.  The workers are reached only
+ *	through the channels.
+ */
+static void io_send(rlm_radius_udp_shared_io_t *io, rlm_radius_udp_shared_packet_t *p);
+
+/** Release the ID and timers for a packet
+ *
+ */
+static void packet_release(rlm_radius_udp_shared_packet_t *p)
+{
+	if (p->s) {
+		rad_assert(p->s->id[p->id] == p);
+		p->s->id[p->id] = NULL;
+		p->s->num_free++;
+		p->s = NULL;
+		p->io->num_outstanding--;
+	}
+
+	if (p->timer.ev) (void) fr_event_timer_delete(p->io->el, &p->timer.ev);
+}
+
+static int _packet_free(rlm_radius_udp_shared_packet_t *p)
+{
+	packet_release(p);
+
+	fr_dlist_remove(&p->entry);
+	fr_dlist_remove(&p->queue);
+
+	return 0;
+}
+
+/** Process the incoming requests from a worker
+ *
+ */
+static void io_recv_requests(rlm_radius_udp_shared_io_t *io, fr_channel_t *ch, fr_channel_data_t *cd)
+{
+	rlm_radius_udp_shared_channel_t *chan = fr_channel_worker_ctx_get(ch);
+
+	rad_assert(chan != NULL);
+
+	if (!cd) cd = fr_channel_recv_request(ch);
+
+	while (cd) {
+		rlm_radius_udp_shared_packet_t *p;
+
+		MEM(p = talloc_zero(chan, rlm_radius_udp_shared_packet_t));
+		p->io = io;
+		p->chan = chan;
+		p->packet_ctx = cd->packet_ctx;
+		p->id = -1;
+		FR_DLIST_INIT(p->entry);
+		FR_DLIST_INIT(p->queue);
+
+		/*
+		 *	Copy the packet, and tell the worker that it
+		 *	can re-use the message.
+		 */
+		MEM(p->packet = talloc_memdup(p, cd->m.data, cd->m.data_size));
+		p->packet_len = cd->m.data_size;
+		p->code = p->packet[0];
+		p->timer.retry = &io->inst->parent->retry[p->code];
+		fr_message_done(&cd->m);
+
+		fr_dlist_insert_tail(&chan->packets, &p->entry);
+		talloc_set_destructor(p, _packet_free);
+
+		io_send(io, p);
+
+		cd = fr_channel_recv_request(ch);
+	}
+}
+
+static void io_deferred_timer(fr_event_list_t *el, struct timeval *now, void *uctx);
+
+/** Keep a reply which couldn't be sent to the worker, and try again later
+ *
+ *  The worker waits for exactly one reply to each packet, so the
+ *  reply can't just be discarded.  The ID is released, as we're done
+ *  with the home server.
+ */
+static void io_defer(rlm_radius_udp_shared_io_t *io, rlm_radius_udp_shared_packet_t *p,
+		     uint8_t const *reply, size_t reply_len)
+{
+	struct timeval when;
+
+	packet_release(p);
+
+	/*
+	 *	If this was a retry of a deferred reply, it stays at
+	 *	the head of the list.
+	 */
+	if (!p->deferred) {
+		if (reply) {
+			MEM(p->reply = talloc_memdup(p, reply, reply_len));
+			p->reply_len = reply_len;
+		}
+		p->deferred = true;
+
+		fr_dlist_remove(&p->queue);
+		fr_dlist_insert_tail(&io->deferred, &p->queue);
+	}
+
+	if (io->deferred_ev) return;
+
+	gettimeofday(&when, NULL);
+	when.tv_usec += SHARED_DEFERRED_USEC;
+	if (when.tv_usec >= USEC) {
+		when.tv_sec++;
+		when.tv_usec -= USEC;
+	}
+
+	if (fr_event_timer_insert(io, io->el, &io->deferred_ev, &when, io_deferred_timer, io) < 0) {
+		ERROR("%s - Failed inserting timer for deferred replies", io->inst->parent->name);
+	}
+}
+
+/** Send a reply (or a notice that there was no reply) to the worker
+ *
+ *  Frees the packet, unless the reply has to be deferred.
+ *
+ * @return
+ *	- 0 on success.
+ *	- -1 if the reply was deferred.
+ */
+static int io_reply(rlm_radius_udp_shared_io_t *io, rlm_radius_udp_shared_packet_t *p,
+		    uint8_t const *reply, size_t reply_len)
+{
+	rlm_radius_udp_shared_channel_t *chan = p->chan;
+	fr_channel_data_t		*cd, *request = NULL;
+	size_t				size = 0;
+
+	if (reply) size = AUTH_VECTOR_LEN + reply_len;
+
+	/*
+	 *	The worker hasn't yet freed enough of the replies
+	 *	we've sent it.
+	 */
+	cd = (fr_channel_data_t *) fr_message_reserve(chan->ms, size);
+	if (!cd) {
+		DEBUG3("%s - No room for reply message to worker, deferring it", io->inst->parent->name);
+		io_defer(io, p, reply, reply_len);
+		return -1;
+	}
+
+	if (reply) {
+		memcpy(cd->m.data, p->vector, AUTH_VECTOR_LEN);
+		memcpy(cd->m.data + AUTH_VECTOR_LEN, reply, reply_len);
+		(void) fr_message_alloc(chan->ms, &cd->m, size);
+	}
+
+	cd->m.when = fr_time();
+	cd->reply.cpu_time = 0;
+	cd->reply.processing_time = 0;
+	cd->reply.request_time = 0;
+	cd->priority = PRIORITY_NORMAL;
+	cd->packet_ctx = p->packet_ctx;
+	cd->listen = NULL;
+
+	talloc_free(p);
+
+	if (fr_channel_send_reply(chan->ch, cd, &request) < 0) {
+		ERROR("%s - Failed sending reply to worker", io->inst->parent->name);
+		fr_message_done(&cd->m);
+	}
+
+	/*
+	 *	Sending the reply also polls for new requests.
+	 */
+	if (request) io_recv_requests(io, chan->ch, request);
+
+	return 0;
+}
+
+/** Retry the replies which didn't fit into the message set
+ *
+ */
+static void io_deferred_timer(UNUSED fr_event_list_t *el, UNUSED struct timeval *now, void *uctx)
+{
+	rlm_radius_udp_shared_io_t	*io = uctx;
+	fr_dlist_t			*entry;
+
+	io->deferred_ev = NULL;
+
+	while ((entry = FR_DLIST_FIRST(io->deferred)) != NULL) {
+		rlm_radius_udp_shared_packet_t *p;
+
+		p = fr_ptr_to_type(rlm_radius_udp_shared_packet_t, queue, entry);
+
+		/*
+		 *	Still no room.  The packet stays on the list,
+		 *	and the timer has been started again.
+		 */
+		if (io_reply(io, p, p->reply, p->reply_len) < 0) break;
+	}
+}
+
+/** Send queued packets, now that IDs are free
+ *
+ */
+static void io_drain_queue(rlm_radius_udp_shared_io_t *io)
+{
+	fr_dlist_t *entry;
+
+	while ((entry = FR_DLIST_FIRST(io->queued)) != NULL) {
+		rlm_radius_udp_shared_packet_t *p;
+		uint32_t i;
+
+		for (i = 0; i < io->inst->num_sockets; i++) {
+			if (io->sockets[i].num_free > 0) break;
+		}
+		if (i == io->inst->num_sockets) return;
+
+		p = fr_ptr_to_type(rlm_radius_udp_shared_packet_t, queue, entry);
+		fr_dlist_remove(&p->queue);
+
+		io_send(io, p);
+	}
+}
+
+static void io_status_send(rlm_radius_udp_shared_io_t *io, struct timeval *now);
+
+/** The home server replied to something
+ *
+ */
+static void home_alive(rlm_radius_udp_shared_io_t *io, struct timeval *now)
+{
+	io->last_reply = *now;
+
+	if (io->state == HOME_ALIVE) return;
+
+	INFO("%s - Proxy thread %d marking home server %pV port %u alive", io->inst->parent->name, io->num,
+	     fr_box_ipaddr(io->inst->dst_ipaddr), io->inst->dst_port);
+	io->state = HOME_ALIVE;
+
+	if (io->revive_ev) (void) fr_event_timer_delete(io->el, &io->revive_ev);
+	if (io->status && io->status->timer.ev) (void) fr_event_timer_delete(io->el, &io->status->timer.ev);
+}
+
+/** Check a dead home server again
+ *
+ */
+static void io_revive(UNUSED fr_event_list_t *el, struct timeval *now, void *uctx)
+{
+	rlm_radius_udp_shared_io_t *io = uctx;
+
+	io->revive_ev = NULL;
+
+	/*
+	 *	Without status checks, all we can do is to send it
+	 *	packets again, and see if it replies.
+	 */
+	if (!io->status) {
+		INFO("%s - Proxy thread %d trying home server %pV port %u again", io->inst->parent->name, io->num,
+		     fr_box_ipaddr(io->inst->dst_ipaddr), io->inst->dst_port);
+		io->state = HOME_ALIVE;
+		io->last_reply = *now;
+		return;
+	}
+
+	io_status_send(io, now);
+}
+
+/** The home server failed its status checks, or it didn't reply for zombie_period
+ *
+ *  Packets to a dead home server fail immediately, until it's
+ *  checked again after reconnect_delay.
+ */
+static void home_dead(rlm_radius_udp_shared_io_t *io, struct timeval *now)
+{
+	struct timeval	when;
+	fr_dlist_t	*entry;
+
+	ERROR("%s - Proxy thread %d marking home server %pV port %u dead", io->inst->parent->name, io->num,
+	      fr_box_ipaddr(io->inst->dst_ipaddr), io->inst->dst_port);
+	io->state = HOME_DEAD;
+
+	/*
+	 *	Packets which are waiting for an ID will never get
+	 *	one.
+	 */
+	while ((entry = FR_DLIST_FIRST(io->queued)) != NULL) {
+		rlm_radius_udp_shared_packet_t *p;
+
+		p = fr_ptr_to_type(rlm_radius_udp_shared_packet_t, queue, entry);
+		fr_dlist_remove(&p->queue);
+
+		io_reply(io, p, NULL, 0);
+	}
+
+	fr_timeval_add(&when, now, &io->inst->parent->reconnection_delay);
+
+	if (fr_event_timer_insert(io, io->el, &io->revive_ev, &when, io_revive, io) < 0) {
+		ERROR("%s - Failed inserting revive timer", io->inst->parent->name);
+		io->state = HOME_ALIVE;
+	}
+}
+
+/** The home server hasn't replied to anything for zombie_period
+ *
+ *  If we have status checks, start sending them.  Otherwise, the
+ *  home server is dead.
+ */
+static void home_zombie(rlm_radius_udp_shared_io_t *io, struct timeval *now)
+{
+	WARN("%s - Proxy thread %d marking home server %pV port %u zombie", io->inst->parent->name, io->num,
+	     fr_box_ipaddr(io->inst->dst_ipaddr), io->inst->dst_port);
+
+	if (!io->status) {
+		home_dead(io, now);
+		return;
+	}
+
+	io->state = HOME_ZOMBIE;
+	io_status_send(io, now);
+}
+
+/** Write a status check packet
+ *
+ *  The Event-Timestamp is the time at which the packet is sent, so
+ *  the packet is signed every time.
+ */
+static void io_status_write(rlm_radius_udp_shared_io_t *io, struct timeval *now)
+{
+	rlm_radius_udp_shared_packet_t	*p = io->status;
+	uint8_t				*attr, *end;
+	uint32_t			event_time;
+	ssize_t				rcode;
+
+	end = p->packet + p->packet_len;
+	for (attr = p->packet + 20; attr < end; attr += attr[1]) {
+		if (attr[0] != FR_EVENT_TIMESTAMP) continue;
+
+		rad_assert(attr[1] == 6);
+		event_time = htonl(now->tv_sec);
+		memcpy(attr + 2, &event_time, 4);
+		break;
+	}
+
+	p->packet[1] = p->id;
+	if (fr_radius_sign(p->packet, NULL, &io->inst->radius_secret) < 0) {
+		ERROR("%s - Failed signing status check", io->inst->parent->name);
+		return;
+	}
+	memcpy(p->vector, p->packet + 4, AUTH_VECTOR_LEN);
+
+	DEBUG3("%s - Sending status check %s ID %d on socket port %u",
+	       io->inst->parent->name, fr_packet_codes[p->code], p->id, p->s->src_port);
+
+	rcode = write(p->s->fd, p->packet, p->packet_len);
+	if ((rcode < 0) && (errno != EWOULDBLOCK)) {
+		ERROR("%s - Failed sending status check: %s", io->inst->parent->name, fr_syserror(errno));
+	}
+}
+
+/** The home server didn't reply to a status check in time
+ *
+ */
+static void io_status_timeout(fr_event_list_t *el, struct timeval *now, void *uctx)
+{
+	rlm_radius_udp_shared_io_t	*io = uctx;
+	rlm_radius_udp_shared_packet_t	*p = io->status;
+
+	if (!rr_track_retry(&p->timer, now)) {
+		DEBUG("%s - No response to status check", io->inst->parent->name);
+		home_dead(io, now);
+		return;
+	}
+
+	if (fr_event_timer_insert(p, el, &p->timer.ev, &p->timer.next, io_status_timeout, io) < 0) {
+		ERROR("%s - Failed inserting retransmission timer for status check", io->inst->parent->name);
+		home_dead(io, now);
+		return;
+	}
+
+	io_status_write(io, now);
+}
+
+/** Start a round of status checks
+ *
+ */
+static void io_status_send(rlm_radius_udp_shared_io_t *io, struct timeval *now)
+{
+	rlm_radius_udp_shared_packet_t *p = io->status;
+
+	if (p->timer.ev) (void) fr_event_timer_delete(io->el, &p->timer.ev);
+
+	p->timer.start = *now;
+	(void) rr_track_start(&p->timer);
+
+	if (fr_event_timer_insert(p, io->el, &p->timer.ev, &p->timer.next, io_status_timeout, io) < 0) {
+		ERROR("%s - Failed inserting retransmission timer for status check", io->inst->parent->name);
+		home_dead(io, now);
+		return;
+	}
+
+	io_status_write(io, now);
+}
+
+/** The home server didn't reply in time
+ *
+ */
+static void io_response_timeout(fr_event_list_t *el, struct timeval *now, void *uctx)
+{
+	rlm_radius_udp_shared_packet_t	*p = talloc_get_type_abort(uctx, rlm_radius_udp_shared_packet_t);
+	rlm_radius_udp_shared_io_t	*io = p->io;
+	ssize_t				rcode;
+
+	rad_assert(p->s != NULL);
+
+	if (!rr_track_retry(&p->timer, now)) {
+		struct timeval when;
+
+		DEBUG("%s - No response to proxied %s ID %d from socket port %u",
+		      io->inst->parent->name, fr_packet_codes[p->code], p->id, p->s->src_port);
+		io_reply(io, p, NULL, 0);
+
+		/*
+		 *	The home server hasn't replied to anything
+		 *	for a while, so it's probably down.
+		 */
+		fr_timeval_add(&when, &io->last_reply, &io->inst->parent->zombie_period);
+		if ((io->state == HOME_ALIVE) && (fr_timeval_cmp(now, &when) >= 0)) home_zombie(io, now);
+
+		io_drain_queue(io);
+		return;
+	}
+
+	if (fr_event_timer_insert(p, el, &p->timer.ev, &p->timer.next, io_response_timeout, p) < 0) {
+		ERROR("%s - Failed inserting retransmission timer", io->inst->parent->name);
+		io_reply(io, p, NULL, 0);
+		io_drain_queue(io);
+		return;
+	}
+
+	/*
+	 *	The ID and authenticator don't change, so the packet
+	 *	doesn't need to be signed again.
+	 */
+	DEBUG3("%s - Retransmitting %s ID %d on socket port %u",
+	       io->inst->parent->name, fr_packet_codes[p->code], p->id, p->s->src_port);
+
+	rcode = write(p->s->fd, p->packet, p->packet_len);
+	if ((rcode < 0) && (errno != EWOULDBLOCK)) {
+		ERROR("%s - Failed retransmitting packet: %s", io->inst->parent->name, fr_syserror(errno));
+	}
+}
+
+/** Allocate an ID, and send a packet to the home server
+ *
+ *  If there are no free IDs, the packet is queued until one of the
+ *  outstanding packets is done.
+ */
+static void io_send(rlm_radius_udp_shared_io_t *io, rlm_radius_udp_shared_packet_t *p)
+{
+	uint32_t			i;
+	int				id;
+	ssize_t				rcode;
+	rlm_radius_udp_shared_socket_t	*s = NULL;
+
+	rad_assert(p->s == NULL);
+
+	if (io->state == HOME_DEAD) {
+		DEBUG3("%s - Home server is dead, failing %s", io->inst->parent->name, fr_packet_codes[p->code]);
+		io_reply(io, p, NULL, 0);
+		return;
+	}
+
+	for (i = 0; i < io->inst->num_sockets; i++) {
+		s = &io->sockets[(io->next_socket + i) % io->inst->num_sockets];
+		if (s->num_free > 0) break;
+	}
+
+	if (i == io->inst->num_sockets) {
+		DEBUG3("%s - No free IDs, queueing %s", io->inst->parent->name, fr_packet_codes[p->code]);
+		fr_dlist_insert_tail(&io->queued, &p->queue);
+		return;
+	}
+	io->next_socket = (io->next_socket + i + 1) % io->inst->num_sockets;
+
+	/*
+	 *	Find a free ID.  There is one, so this loop always
+	 *	terminates.
+	 */
+	for (id = s->next_id; s->id[id] != NULL; id = (id + 1) & 0xff);
+	s->next_id = (id + 1) & 0xff;
+
+	s->id[id] = p;
+	s->num_free--;
+	p->s = s;
+	p->id = id;
+
+	/*
+	 *	The home server had nothing to reply to, so it can't
+	 *	be blamed for the time since its last reply.
+	 */
+	if (!io->num_outstanding) gettimeofday(&io->last_reply, NULL);
+	io->num_outstanding++;
+
+	/*
+	 *	The worker encoded the packet with a placeholder ID.
+	 *	Put ours in, and sign the packet.
+	 */
+	p->packet[1] = id;
+	if (fr_radius_sign(p->packet, NULL, &io->inst->radius_secret) < 0) {
+		ERROR("%s - Failed signing packet", io->inst->parent->name);
+		io_reply(io, p, NULL, 0);
+		return;
+	}
+	memcpy(p->vector, p->packet + 4, AUTH_VECTOR_LEN);
+
+	DEBUG3("%s - Sending %s ID %d length %zu on socket port %u",
+	       io->inst->parent->name, fr_packet_codes[p->code], id, p->packet_len, s->src_port);
+
+	/*
+	 *	If the write blocks, the retransmission timer will
+	 *	take care of it.
+	 */
+	rcode = write(s->fd, p->packet, p->packet_len);
+	if ((rcode < 0) && (errno != EWOULDBLOCK)) {
+		ERROR("%s - Failed sending packet: %s", io->inst->parent->name, fr_syserror(errno));
+	}
+
+	/*
+	 *	We're replicating, so we don't care about the
+	 *	responses.  The worker doesn't wait for the reply, but
+	 *	the channel still needs one.
+	 */
+	if (io->inst->replicate) {
+		io_reply(io, p, NULL, 0);
+		return;
+	}
+
+	gettimeofday(&p->timer.start, NULL);
+	(void) rr_track_start(&p->timer);
+
+	if (fr_event_timer_insert(p, io->el, &p->timer.ev, &p->timer.next, io_response_timeout, p) < 0) {
+		ERROR("%s - Failed inserting retransmission timer", io->inst->parent->name);
+		io_reply(io, p, NULL, 0);
+	}
+}
+
+/** Read replies from the home server
+ *
+ */
+static void io_read(UNUSED fr_event_list_t *el, int fd, UNUSED int flags, void *uctx)
+{
+	rlm_radius_udp_shared_socket_t	*s = uctx;
+	rlm_radius_udp_shared_io_t	*io = s->io;
+	rlm_radius_udp_shared_packet_t	*p;
+	ssize_t				data_len;
+	size_t				packet_len;
+	decode_fail_t			reason;
+	uint8_t				original[20];
+	bool				done = false;
+	struct timeval			now;
+
+	/*
+	 *	Drain the socket of all packets.
+	 */
+	while (true) {
+		data_len = read(fd, io->buffer, io->buflen);
+		if (data_len == 0) break;
+
+		if (data_len < 0) {
+			if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) break;
+
+			ERROR("%s - Failed reading from socket port %u: %s",
+			      io->inst->parent->name, s->src_port, fr_syserror(errno));
+			break;
+		}
+
+		/*
+		 *	Replicating?  Drain the socket, but ignore all responses.
+		 */
+		if (io->inst->replicate) continue;
+
+		packet_len = data_len;
+		if (!fr_radius_ok(io->buffer, &packet_len, io->inst->parent->max_attributes, false, &reason)) {
+			WARN("%s - Ignoring malformed packet", io->inst->parent->name);
+			continue;
+		}
+
+		p = s->id[io->buffer[1]];
+		if (!p) {
+			WARN("%s - Ignoring reply which arrived too late", io->inst->parent->name);
+			continue;
+		}
+
+		original[0] = p->code;
+		original[1] = 0;	/* not looked at by fr_radius_verify() */
+		original[2] = 0;
+		original[3] = 20;	/* for debugging */
+		memcpy(original + 4, p->vector, sizeof(p->vector));
+
+		if (fr_radius_verify(io->buffer, original, &io->inst->radius_secret) < 0) {
+			WARN("%s - Ignoring response with invalid signature", io->inst->parent->name);
+			continue;
+		}
+
+		gettimeofday(&now, NULL);
+		home_alive(io, &now);
+
+		/*
+		 *	Status checks are never sent to a worker.  The
+		 *	ID stays reserved for the next one.
+		 */
+		if (p == io->status) {
+			DEBUG("%s - Received response to status check", io->inst->parent->name);
+			if (p->timer.ev) (void) fr_event_timer_delete(io->el, &p->timer.ev);
+			continue;
+		}
+
+		io_reply(io, p, io->buffer, packet_len);
+		done = true;
+	}
+
+	if (done) io_drain_queue(io);
+}
+
+static void io_error(UNUSED fr_event_list_t *el, UNUSED int fd, UNUSED int flags, int fd_errno, void *uctx)
+{
+	rlm_radius_udp_shared_socket_t *s = uctx;
+
+	ERROR("%s - Failed on socket port %u: %s", s->io->inst->parent->name, s->src_port, fr_syserror(fd_errno));
+}
+
+/** Handle a control message for a channel to a worker
+ *
+ */
+static void io_channel_callback(void *ctx, void const *data, size_t data_size, fr_time_t now)
+{
+	rlm_radius_udp_shared_io_t	*io = ctx;
+	rlm_radius_udp_shared_channel_t *chan;
+	rlm_radius_udp_shared_thread_t	*t;
+	fr_channel_t			*ch;
+	fr_dlist_t			*entry;
+	uint32_t			closed = 1;
+
+	switch (fr_channel_service_message(now, &ch, data, data_size)) {
+	case FR_CHANNEL_DATA_READY_WORKER:
+		rad_assert(ch != NULL);
+		io_recv_requests(io, ch, NULL);
+		break;
+
+	case FR_CHANNEL_OPEN:
+		rad_assert(ch != NULL);
+
+		MEM(chan = talloc_zero(io, rlm_radius_udp_shared_channel_t));
+		chan->io = io;
+		chan->ch = ch;
+		FR_DLIST_INIT(chan->packets);
+
+		chan->ms = fr_message_set_create(chan, SHARED_NUM_MESSAGES, sizeof(fr_channel_data_t),
+						 SHARED_RING_BUFFER_SIZE);
+		rad_assert(chan->ms != NULL);
+
+		fr_channel_worker_ctx_add(ch, chan);
+		break;
+
+	/*
+	 *	The worker is exiting.  Forget about its packets, and
+	 *	tell it that we're done with the channel.  We don't
+	 *	ACK the close via the channel, as the worker is
+	 *	about to free its control plane.
+	 */
+	case FR_CHANNEL_CLOSE:
+		rad_assert(ch != NULL);
+
+		chan = fr_channel_worker_ctx_get(ch);
+		rad_assert(chan != NULL);
+
+		while ((entry = FR_DLIST_FIRST(chan->packets)) != NULL) {
+			talloc_free(fr_ptr_to_type(rlm_radius_udp_shared_packet_t, entry, entry));
+		}
+
+		fr_message_set_gc(chan->ms);
+		talloc_free(chan);
+
+		t = fr_channel_master_ctx_get(ch);
+		store(t->closed, closed);
+
+		io_drain_queue(io);
+		break;
+
+	default:
+		break;
+	}
+}
+
+/** Service the control plane of a proxy thread
+ *
+ */
+static void io_evfilt_user(UNUSED int kq, UNUSED struct kevent const *kev, void *ctx)
+{
+	rlm_radius_udp_shared_io_t	*io = ctx;
+	char				data[256];
+
+	fr_control_service(io->control, data, sizeof(data), fr_time());
+}
+
+/** The main loop of a proxy thread
+ *
+ */
+static void *io_thread(void *arg)
+{
+	rlm_radius_udp_shared_io_t *io = arg;
+
+	DEBUG2("%s - Proxy thread %d starting", io->inst->parent->name, io->num);
+
+	(void) fr_event_loop(io->el);
+
+	DEBUG2("%s - Proxy thread %d exiting", io->inst->parent->name, io->num);
+
+	return NULL;
+}
+
+/** Close the sockets of a proxy thread
+ *
+ */
+static int _io_free(rlm_radius_udp_shared_io_t *io)
+{
+	uint32_t i;
+
+	if (!io->sockets) return 0;
+
+	for (i = 0; i < io->inst->num_sockets; i++) {
+		if (io->sockets[i].fd < 0) continue;
+
+		(void) fr_event_fd_delete(io->el, io->sockets[i].fd, FR_EVENT_FILTER_IO);
+		close(io->sockets[i].fd);
+		io->sockets[i].fd = -1;
+	}
+
+	return 0;
+}
+
+/** Set up a proxy thread, and open its sockets
+ *
+ *  This runs in the main thread, before the proxy thread is started.
+ */
+static rlm_radius_udp_shared_io_t *io_alloc(rlm_radius_udp_shared_t *inst, int num)
+{
+	rlm_radius_udp_shared_io_t	*io;
+	uint32_t			i;
+
+	MEM(io = talloc_zero(inst, rlm_radius_udp_shared_io_t));
+	io->inst = inst;
+	io->num = num;
+	FR_DLIST_INIT(io->queued);
+	FR_DLIST_INIT(io->deferred);
+
+	io->buflen = inst->max_packet_size;
+	MEM(io->buffer = talloc_array(io, uint8_t, io->buflen));
+
+	io->el = fr_event_list_alloc(io, NULL, NULL);
+	if (!io->el) {
+		PERROR("%s - Failed creating event list for proxy thread", inst->parent->name);
+	fail:
+		talloc_free(io);
+		return NULL;
+	}
+
+	io->aq_control = fr_atomic_queue_create(io, 1024);
+	if (!io->aq_control) {
+		ERROR("%s - Failed creating atomic queue for proxy thread", inst->parent->name);
+		goto fail;
+	}
+
+	io->aq_ident = fr_event_user_insert(io->el, io_evfilt_user, io);
+	if (!io->aq_ident) {
+		PERROR("%s - Failed updating event list for proxy thread", inst->parent->name);
+		goto fail;
+	}
+
+	io->control = fr_control_create(io, fr_event_list_kq(io->el), io->aq_control, io->aq_ident);
+	if (!io->control) {
+		PERROR("%s - Failed creating control plane for proxy thread", inst->parent->name);
+		goto fail;
+	}
+
+	if (fr_control_callback_add(io->control, FR_CONTROL_ID_CHANNEL, io, io_channel_callback) < 0) {
+		PERROR("%s - Failed adding channel callback for proxy thread", inst->parent->name);
+		goto fail;
+	}
+
+	MEM(io->sockets = talloc_zero_array(io, rlm_radius_udp_shared_socket_t, inst->num_sockets));
+	for (i = 0; i < inst->num_sockets; i++) {
+		rlm_radius_udp_shared_socket_t *s = &io->sockets[i];
+
+		s->io = io;
+		s->fd = -1;
+		s->num_free = 256;
+		s->src_ipaddr = inst->src_ipaddr;
+	}
+
+	/*
+	 *	The status check packet gets a permanent ID, so that
+	 *	it can always be sent, even if proxied packets are
+	 *	using all of the other IDs.
+	 */
+	if (inst->status_packet) {
+		rlm_radius_udp_shared_packet_t *p;
+
+		MEM(p = talloc_zero(io, rlm_radius_udp_shared_packet_t));
+		p->io = io;
+		FR_DLIST_INIT(p->entry);
+		FR_DLIST_INIT(p->queue);
+
+		MEM(p->packet = talloc_memdup(p, inst->status_packet, inst->status_packet_len));
+		p->packet_len = inst->status_packet_len;
+		p->code = p->packet[0];
+		p->timer.retry = &inst->parent->retry[p->code];
+
+		p->s = &io->sockets[0];
+		p->id = 0;
+		p->s->id[0] = p;
+		p->s->num_free--;
+		p->s->next_id = 1;
+
+		io->status = p;
+	}
+	talloc_set_destructor(io, _io_free);
+
+	for (i = 0; i < inst->num_sockets; i++) {
+		rlm_radius_udp_shared_socket_t *s = &io->sockets[i];
+
+		s->fd = fr_socket_client_udp(&s->src_ipaddr, &s->src_port, &inst->dst_ipaddr, inst->dst_port, true);
+		if (s->fd < 0) {
+			PERROR("%s - Failed opening socket", inst->parent->name);
+			goto fail;
+		}
+
+#ifdef SO_RCVBUF
+		if (inst->recv_buff_is_set) {
+			int opt;
+
+			opt = inst->recv_buff;
+			if (setsockopt(s->fd, SOL_SOCKET, SO_RCVBUF, &opt, sizeof(int)) < 0) {
+				WARN("Failed setting 'recv_buf': %s", fr_syserror(errno));
+			}
+		}
+#endif
+
+#ifdef SO_SNDBUF
+		if (inst->send_buff_is_set) {
+			int opt;
+
+			opt = inst->send_buff;
+			if (setsockopt(s->fd, SOL_SOCKET, SO_SNDBUF, &opt, sizeof(int)) < 0) {
+				WARN("Failed setting 'send_buf': %s", fr_syserror(errno));
+			}
+		}
+#endif
+
+		if (fr_event_fd_insert(io, io->el, s->fd, io_read, NULL, io_error, s) < 0) {
+			PERROR("%s - Failed inserting socket into event list", inst->parent->name);
+			goto fail;
+		}
+
+		DEBUG2("%s - Proxy thread %d opened socket from %pV port %u to %pV port %u", inst->parent->name, num,
+		       fr_box_ipaddr(s->src_ipaddr), s->src_port, fr_box_ipaddr(inst->dst_ipaddr), inst->dst_port);
+	}
+
+	return io;
+}
+
+/** Stop a proxy thread, and close its sockets
+ *
+ */
+static void io_free(rlm_radius_udp_shared_io_t *io)
+{
+	if (io->running) {
+		fr_event_loop_exit(io->el, 1);
+		(void) pthread_join(io->pthread_id, NULL);
+		io->running = false;
+	}
+
+	talloc_free(io);
+}
+
+
+/*
+ *	Worker thread functions.
+ */
+
+/** Encode a packet for the proxy thread
+ *
+ *  The ID is a placeholder, and the packet isn't signed.  The proxy
+ *  thread does both when it allocates an ID.
+ */
+static ssize_t shared_encode(rlm_radius_udp_shared_t const *inst, rlm_radius_udp_shared_request_t *u,
+			     REQUEST *request, uint8_t *buffer, size_t buflen)
+{
+	ssize_t			packet_len;
+	bool			require_ma = false;
+	int			hdr_len;
+	uint8_t			*attr;
+	VALUE_PAIR		*hop_by_hop;
+
+	/*
+	 *	Same as the "udp" transport.  Delete any existing
+	 *	Message-Authenticator, and add one when we encode the
+	 *	packet.  Access-Request and Status-Server packets
+	 *	always get one, and a random authentication vector.
+	 */
+	if (fr_pair_find_by_num(request->packet->vps, 0, FR_MESSAGE_AUTHENTICATOR, TAG_ANY)) {
+		require_ma = true;
+		fr_pair_delete_by_num(&request->packet->vps, 0, FR_MESSAGE_AUTHENTICATOR, TAG_ANY);
+	}
+
+	if ((u->code == FR_CODE_ACCESS_REQUEST) || (u->code == FR_CODE_STATUS_SERVER)) {
+		size_t i;
+		uint32_t hash, base;
+
+		require_ma = true;
+
+		base = fr_rand();
+		for (i = 0; i < AUTH_VECTOR_LEN; i += sizeof(uint32_t)) {
+			hash = fr_rand() ^ base;
+			memcpy(buffer + 4 + i, &hash, sizeof(hash));
+		}
+	}
+
+	/*
+	 *	FreeRADIUS-Extended-Identifier is hop-by-hop.  Don't
+	 *	forward any the client sent us.
+	 */
+	hop_by_hop = rr_track_extended_id_unlink(&request->packet->vps);
+
+	/*
+	 *	Leave room for Proxy-State, and Message-Authenticator.
+	 */
+	packet_len = fr_radius_encode(buffer, buflen - 6 - (require_ma ? 18 : 0), NULL,
+				      inst->secret, 0, u->code, 0, request->packet->vps);
+	if (packet_len <= 0) {
+		fr_pair_add(&request->packet->vps, hop_by_hop);
+		return -1;
+	}
+
+	RDEBUG("Sending %s length %ld via proxy thread", fr_packet_codes[u->code], packet_len);
+	rdebug_pair_list(L_DBG_LVL_2, request, request->packet->vps, NULL);
+	fr_pair_add(&request->packet->vps, hop_by_hop);
+
+	attr = buffer + packet_len;
+	attr[0] = FR_PROXY_STATE;
+	attr[1] = 6;
+	memcpy(attr + 2, &inst->parent->proxy_state, 4);
+	packet_len += 6;
+
+	if (require_ma) {
+		attr = buffer + packet_len;
+		attr[0] = FR_MESSAGE_AUTHENTICATOR;
+		attr[1] = 18;
+		memset(attr + 2, 0, 16);
+		packet_len += 18;
+	}
+
+	hdr_len = packet_len;
+	buffer[2] = (hdr_len >> 8) & 0xff;
+	buffer[3] = hdr_len & 0xff;
+
+	return packet_len;
+}
+
+/** Encode the status check packet
+ *
+ *  The proxy threads don't have requests, so the packet is built
+ *  once, here.  Each proxy thread sends its own copy.
+ */
+static int status_packet_init(rlm_radius_udp_shared_t *inst)
+{
+	rlm_radius_udp_shared_request_t	u;
+	REQUEST				*request;
+	ssize_t				packet_len;
+
+	request = request_alloc(inst);
+	talloc_const_free(request->name);
+	request->name = talloc_strdup(request, inst->parent->name);
+
+	request->packet = fr_radius_alloc(request, false);
+	request->reply = fr_radius_alloc(request, false);
+
+	/*
+	 *	Create the packet contents.  This is the same as for
+	 *	the "udp" transport.
+	 */
+	if (inst->parent->status_check == FR_CODE_STATUS_SERVER) {
+		pair_make_request("NAS-Identifier", "status check - are you alive?", T_OP_EQ);
+		pair_make_request("Event-Timestamp", "0", T_OP_EQ);
+	} else {
+		vp_map_t *map;
+
+		for (map = inst->parent->status_check_map; map != NULL; map = map->next) {
+			(void) map_to_request(request, map, map_to_vp, NULL);
+		}
+
+		if (!fr_pair_find_by_num(request->packet->vps, 0, FR_EVENT_TIMESTAMP, TAG_ANY)) {
+			pair_make_request("Event-Timestamp", "0", T_OP_EQ);
+		}
+	}
+
+	memset(&u, 0, sizeof(u));
+	u.code = inst->parent->status_check;
+
+	MEM(inst->status_packet = talloc_zero_array(inst, uint8_t, inst->max_packet_size));
+	packet_len = shared_encode(inst, &u, request, inst->status_packet, inst->max_packet_size);
+	talloc_free(request);
+
+	if (packet_len <= 0) {
+		ERROR("%s - Failed encoding status check packet", inst->parent->name);
+		TALLOC_FREE(inst->status_packet);
+		return -1;
+	}
+	inst->status_packet_len = packet_len;
+
+	return 0;
+}
+
+/** Decode a reply from the proxy thread
+ *
+ */
+static void shared_reply(rlm_radius_udp_shared_thread_t *t, fr_channel_data_t *cd)
+{
+	rlm_radius_udp_shared_pending_t	*pending = cd->packet_ctx;
+	rlm_radius_udp_shared_request_t	*u = pending->u;
+	rlm_radius_link_t		*link;
+	REQUEST				*request;
+	uint8_t				original[20];
+	uint8_t				*packet;
+	size_t				packet_len;
+	int				code;
+	VALUE_PAIR			*vp = NULL;
+
+	talloc_free(pending);
+
+	/*
+	 *	The request was cancelled, or we didn't wait for the
+	 *	reply.
+	 */
+	if (!u) {
+		fr_message_done(&cd->m);
+		return;
+	}
+	u->pending = NULL;
+
+	link = u->link;
+	request = link->request;
+
+	if (!cd->m.data_size) {
+		REDEBUG("No response to proxied request");
+		link->rcode = RLM_MODULE_FAIL;
+		goto done;
+	}
+
+	if (cd->m.data_size < (AUTH_VECTOR_LEN + 20)) {
+		REDEBUG("Reply from proxy thread is too short (%zu bytes)", cd->m.data_size);
+		link->rcode = RLM_MODULE_INVALID;
+		goto done;
+	}
+
+	original[0] = u->code;
+	original[1] = 0;
+	original[2] = 0;
+	original[3] = 20;
+	memcpy(original + 4, cd->m.data, AUTH_VECTOR_LEN);
+
+	packet = cd->m.data + AUTH_VECTOR_LEN;
+	packet_len = cd->m.data_size - AUTH_VECTOR_LEN;
+	code = packet[0];
+
+	if (!code || (code >= FR_MAX_PACKET_CODE)) {
+		REDEBUG("Unknown reply code %d", code);
+		link->rcode = RLM_MODULE_INVALID;
+		goto done;
+	}
+
+	if ((code != FR_CODE_PROTOCOL_ERROR) && (allowed_replies[code] != (FR_CODE) u->code)) {
+		REDEBUG("Invalid reply code %s to request packet %s",
+			fr_packet_codes[code], fr_packet_codes[u->code]);
+		link->rcode = RLM_MODULE_INVALID;
+		goto done;
+	}
+
+	if (fr_radius_decode(request->reply, packet, packet_len, original,
+			     t->inst->secret, 0, &vp) < 0) {
+		REDEBUG("Failed decoding attributes for packet");
+		fr_pair_list_free(&vp);
+		link->rcode = RLM_MODULE_INVALID;
+		goto done;
+	}
+
+	RDEBUG("Received %s ID %d length %ld reply packet via proxy thread",
+	       fr_packet_codes[code], packet[1], packet_len);
+	rdebug_pair_list(L_DBG_LVL_2, request, vp, NULL);
+
+	/*
+	 *	FreeRADIUS-Extended-Identifier is hop-by-hop, and
+	 *	mustn't be copied to the reply we send to our client.
+	 */
+	fr_pair_delete_by_num(&vp, VENDORPEC_FREERADIUS, FR_FREERADIUS_EXTENDED_IDENTIFIER, TAG_ANY);
+
+	link->rcode = code2rcode[code];
+	request->reply->code = code;
+	fr_pair_add(&request->reply->vps, vp);
+
+done:
+	fr_message_done(&cd->m);
+
+	if (u->yielded) unlang_resumable(request);
+}
+
+/** Handle a control message for the channel to our proxy thread
+ *
+ */
+static void shared_channel_callback(void *ctx, void const *data, size_t data_size, fr_time_t now)
+{
+	rlm_radius_udp_shared_thread_t	*t = ctx;
+	fr_channel_t			*ch;
+	fr_channel_data_t		*cd;
+
+	if (fr_channel_service_message(now, &ch, data, data_size) != FR_CHANNEL_DATA_READY_NETWORK) return;
+
+	rad_assert(ch == t->ch);
+
+	while ((cd = fr_channel_recv_reply(ch)) != NULL) shared_reply(t, cd);
+}
+
+/** Service the control plane of a worker
+ *
+ */
+static void shared_evfilt_user(UNUSED int kq, UNUSED struct kevent const *kev, void *ctx)
+{
+	rlm_radius_udp_shared_thread_t	*t = ctx;
+	char				data[256];
+
+	fr_control_service(t->control, data, sizeof(data), fr_time());
+}
+
+/** Unlink a request from its packet in the proxy thread
+ *
+ */
+static int shared_request_free(rlm_radius_udp_shared_request_t *u)
+{
+	if (u->pending) u->pending->u = NULL;
+
+	return 0;
+}
+
+static rlm_rcode_t mod_push(void *instance, REQUEST *request, rlm_radius_link_t *link, void *thread)
+{
+	rlm_radius_udp_shared_t		*inst = talloc_get_type_abort(instance, rlm_radius_udp_shared_t);
+	rlm_radius_udp_shared_thread_t	*t = talloc_get_type_abort(thread, rlm_radius_udp_shared_thread_t);
+	rlm_radius_udp_shared_request_t	*u = link->request_io_ctx;
+	fr_channel_data_t		*cd, *reply = NULL;
+	ssize_t				packet_len;
+
+	rad_assert(request->packet->code > 0);
+	rad_assert(request->packet->code < FR_MAX_PACKET_CODE);
+
+	if (!t->ch || !fr_channel_active(t->ch)) {
+		REDEBUG("No proxy thread is available");
+		return RLM_MODULE_FAIL;
+	}
+
+	u->thread = t;
+	u->link = link;
+	u->code = request->packet->code;
+
+	cd = (fr_channel_data_t *) fr_message_reserve(t->ms, inst->max_packet_size);
+	if (!cd) {
+		REDEBUG("Failed allocating message for proxy thread");
+		return RLM_MODULE_FAIL;
+	}
+
+	packet_len = shared_encode(inst, u, request, cd->m.data, inst->max_packet_size);
+	if (packet_len < 0) {
+		REDEBUG("Failed encoding packet");
+		fr_message_done(&cd->m);
+		return RLM_MODULE_FAIL;
+	}
+	(void) fr_message_alloc(t->ms, &cd->m, packet_len);
+
+	MEM(u->pending = talloc_zero(t, rlm_radius_udp_shared_pending_t));
+	u->pending->u = u;
+	talloc_set_destructor(u, shared_request_free);
+
+	u->link->time_sent = fr_time();
+
+	cd->m.when = u->link->time_sent;
+	cd->request.recv_time = NULL;
+	cd->priority = PRIORITY_NORMAL;
+	cd->packet_ctx = u->pending;
+	cd->listen = NULL;
+
+	if (fr_channel_send_request(t->ch, cd, &reply) < 0) {
+		REDEBUG("Failed sending packet to proxy thread");
+		fr_message_done(&cd->m);
+		TALLOC_FREE(u->pending);
+		if (reply) shared_reply(t, reply);
+		while ((reply = fr_channel_recv_reply(t->ch)) != NULL) shared_reply(t, reply);
+		return RLM_MODULE_FAIL;
+	}
+
+	/*
+	 *	Replicating.  The proxy thread sends the packet, and
+	 *	we don't care about the reply.
+	 */
+	if (inst->replicate) {
+		u->pending->u = NULL;
+		u->pending = NULL;
+	} else {
+		u->yielded = true;
+	}
+
+	/*
+	 *	Sending the packet also polls for replies.  None of
+	 *	them can be for this packet, as the proxy thread
+	 *	hasn't seen it yet.
+	 */
+	if (reply) {
+		shared_reply(t, reply);
+		while ((reply = fr_channel_recv_reply(t->ch)) != NULL) shared_reply(t, reply);
+	}
+
+	if (inst->replicate) return RLM_MODULE_OK;
+
+	return RLM_MODULE_YIELD;
+}
+
+
+/** Bootstrap the module
+ *
+ * @param[in] instance	Ctx data for this module
+ * @param[in] conf    our configuration section parsed to give us instance.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+static int mod_bootstrap(void *instance, CONF_SECTION *conf)
+{
+	rlm_radius_udp_shared_t *inst = talloc_get_type_abort(instance, rlm_radius_udp_shared_t);
+
+	(void) talloc_set_type(inst, rlm_radius_udp_shared_t);
+	inst->config = conf;
+
+	fr_radius_secret_init(&inst->radius_secret, (uint8_t const *) inst->secret, strlen(inst->secret));
+
+	return 0;
+}
+
+
+/** Instantiate the module, and start the proxy threads
+ *
+ * @param[in] parent    rlm_radius_t
+ * @param[in] instance	Ctx data for this module
+ * @param[in] conf	our configuration section parsed to give us instance.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+static int mod_instantiate(rlm_radius_t *parent, void *instance, CONF_SECTION *conf)
+{
+	rlm_radius_udp_shared_t *inst = talloc_get_type_abort(instance, rlm_radius_udp_shared_t);
+	uint32_t		i;
+	uint32_t		next_io = 0;
+
+	inst->parent = parent;
+	inst->replicate = parent->replicate;
+
+	/*
+	 *	Ensure that we have a destination address.
+	 */
+	if (inst->dst_ipaddr.af == AF_UNSPEC) {
+		cf_log_err(conf, "A value must be given for 'ipaddr'");
+		return -1;
+	}
+
+	/*
+	 *	If src_ipaddr isn't set, make sure it's INADDR_ANY, of
+	 *	the same address family as dst_ipaddr.
+	 */
+	if (inst->src_ipaddr.af == AF_UNSPEC) {
+		memset(&inst->src_ipaddr, 0, sizeof(inst->src_ipaddr));
+
+		inst->src_ipaddr.af = inst->dst_ipaddr.af;
+
+		if (inst->src_ipaddr.af == AF_INET) {
+			inst->src_ipaddr.prefix = 32;
+		} else {
+			inst->src_ipaddr.prefix = 128;
+		}
+	}
+
+	else if (inst->src_ipaddr.af != inst->dst_ipaddr.af) {
+		cf_log_err(conf, "The 'ipaddr' and 'src_ipaddr' configuration items must "
+			   "be both of the same address family");
+		return -1;
+	}
+
+	if (!inst->dst_port) {
+		cf_log_err(conf, "A value must be given for 'port'");
+		return -1;
+	}
+
+	if (inst->recv_buff_is_set) {
+		FR_INTEGER_BOUND_CHECK("recv_buff", inst->recv_buff, >=, inst->max_packet_size);
+		FR_INTEGER_BOUND_CHECK("recv_buff", inst->recv_buff, <=, (1 << 30));
+	}
+
+	if (inst->send_buff_is_set) {
+		FR_INTEGER_BOUND_CHECK("send_buff", inst->send_buff, >=, inst->max_packet_size);
+		FR_INTEGER_BOUND_CHECK("send_buff", inst->send_buff, <=, (1 << 30));
+	}
+
+	FR_INTEGER_BOUND_CHECK("max_packet_size", inst->max_packet_size, >=, 64);
+	FR_INTEGER_BOUND_CHECK("max_packet_size", inst->max_packet_size, <=, 65535);
+
+	FR_INTEGER_BOUND_CHECK("threads", inst->num_threads, >=, 1);
+	FR_INTEGER_BOUND_CHECK("threads", inst->num_threads, <=, 32);
+
+	FR_INTEGER_BOUND_CHECK("sockets", inst->num_sockets, >=, 1);
+	FR_INTEGER_BOUND_CHECK("sockets", inst->num_sockets, <=, 256);
+
+	/*
+	 *	The sockets are shared, so they all count against
+	 *	max_connections.
+	 */
+	if ((inst->num_threads * inst->num_sockets) > parent->max_connections) {
+		cf_log_err(conf, "The number of 'threads' times 'sockets' must be no more than 'max_connections'");
+		return -1;
+	}
+
+	if (parent->status_check && (status_packet_init(inst) < 0)) return -1;
+
+	store(inst->next_io, next_io);
+
+	MEM(inst->io = talloc_zero_array(inst, rlm_radius_udp_shared_io_t *, inst->num_threads));
+
+	for (i = 0; i < inst->num_threads; i++) {
+		rlm_radius_udp_shared_io_t *io;
+
+		io = inst->io[i] = io_alloc(inst, i);
+		if (!io) return -1;
+
+		if (pthread_create(&io->pthread_id, NULL, io_thread, io) != 0) {
+			ERROR("%s - Failed creating proxy thread: %s", parent->name, fr_syserror(errno));
+			return -1;
+		}
+		io->running = true;
+	}
+
+	return 0;
+}
+
+
+/** Stop the proxy threads
+ *
+ */
+static int mod_detach(void *instance)
+{
+	rlm_radius_udp_shared_t *inst = talloc_get_type_abort(instance, rlm_radius_udp_shared_t);
+	uint32_t		i;
+
+	if (!inst->io) return 0;
+
+	for (i = 0; i < inst->num_threads; i++) {
+		if (!inst->io[i]) continue;
+
+		io_free(inst->io[i]);
+		inst->io[i] = NULL;
+	}
+
+	return 0;
+}
+
+
+/** Instantiate thread data for the submodule.
+ *
+ *  Each worker gets a channel to one of the proxy threads.
+ */
+static int mod_thread_instantiate(UNUSED CONF_SECTION const *cs, void *instance, fr_event_list_t *el, void *thread)
+{
+	rlm_radius_udp_shared_thread_t	*t = thread;
+	rlm_radius_udp_shared_t		*inst = talloc_get_type_abort(instance, rlm_radius_udp_shared_t);
+	rlm_radius_udp_shared_io_t	*io;
+	uint32_t			next_io, closed = 0;
+
+	(void) talloc_set_type(t, rlm_radius_udp_shared_thread_t);
+	t->inst = inst;
+	t->el = el;
+	store(t->closed, closed);
+
+	/*
+	 *	Spread the workers across the proxy threads.
+	 */
+	while (true) {
+		next_io = load(inst->next_io);
+		if (cas_incr(inst->next_io, next_io)) break;
+	}
+	io = inst->io[next_io % inst->num_threads];
+
+	t->aq_control = fr_atomic_queue_create(t, 1024);
+	if (!t->aq_control) {
+		ERROR("%s - Failed creating atomic queue", inst->parent->name);
+		return -1;
+	}
+
+	t->aq_ident = fr_event_user_insert(el, shared_evfilt_user, t);
+	if (!t->aq_ident) {
+		PERROR("%s - Failed updating event list", inst->parent->name);
+		return -1;
+	}
+
+	t->control = fr_control_create(t, fr_event_list_kq(el), t->aq_control, t->aq_ident);
+	if (!t->control) {
+		PERROR("%s - Failed creating control plane", inst->parent->name);
+		return -1;
+	}
+
+	if (fr_control_callback_add(t->control, FR_CONTROL_ID_CHANNEL, t, shared_channel_callback) < 0) {
+		PERROR("%s - Failed adding channel callback", inst->parent->name);
+		return -1;
+	}
+
+	t->ms = fr_message_set_create(t, SHARED_NUM_MESSAGES, sizeof(fr_channel_data_t), SHARED_RING_BUFFER_SIZE);
+	if (!t->ms) {
+		PERROR("%s - Failed creating message set", inst->parent->name);
+		return -1;
+	}
+
+	t->ch = fr_channel_create(t, t->control, io->control);
+	if (!t->ch) {
+		PERROR("%s - Failed creating channel to proxy thread", inst->parent->name);
+		return -1;
+	}
+	fr_channel_master_ctx_add(t->ch, t);
+
+	if (fr_channel_signal_open(t->ch) < 0) {
+		PERROR("%s - Failed opening channel to proxy thread", inst->parent->name);
+		TALLOC_FREE(t->ch);
+		return -1;
+	}
+
+	return 0;
+}
+
+/** Destroy thread data for the IO submodule.
+ *
+ *  Tell the proxy thread that we're going away, and wait for it to
+ *  forget about our packets.
+ */
+static int mod_thread_detach(fr_event_list_t *el, void *thread)
+{
+	rlm_radius_udp_shared_thread_t *t = talloc_get_type_abort(thread, rlm_radius_udp_shared_thread_t);
+	int i;
+
+	if (t->ch) {
+		(void) fr_channel_signal_worker_close(t->ch);
+
+		for (i = 0; (i < 1000) && !aquire(t->closed); i++) usleep(1000);
+
+		/*
+		 *	The proxy thread may still use the channel, and
+		 *	our control plane.  Leak them, rather than
+		 *	freeing memory which is still in use.
+		 */
+		if (!aquire(t->closed)) {
+			ERROR("%s - Proxy thread did not close the channel", t->inst->parent->name);
+			(void) talloc_steal(NULL, t->ch);
+			(void) talloc_steal(NULL, t->ms);
+			(void) talloc_steal(NULL, t->control);
+			(void) talloc_steal(NULL, t->aq_control);
+		}
+	}
+
+	if (t->aq_ident) (void) fr_event_user_delete(el, shared_evfilt_user, t);
+
+	/*
+	 *	Free the channel, and any packets which are still
+	 *	waiting for replies.
+	 */
+	talloc_free_children(t);
+
+	return 0;
+}
+
+/*
+ *	The module name should be the only globally exported symbol.
+ *	That is, everything else should be 'static'.
+ */
+extern fr_radius_client_io_t rlm_radius_udp_shared;
+fr_radius_client_io_t rlm_radius_udp_shared = {
+	.magic			= RLM_MODULE_INIT,
+	.name			= "radius_udp_shared",
+	.inst_size		= sizeof(rlm_radius_udp_shared_t),
+	.detach			= mod_detach,
+
+	.request_inst_size 	= sizeof(rlm_radius_udp_shared_request_t),
+	.request_inst_type	= "rlm_radius_udp_shared_request_t",
+
+	.thread_inst_size	= sizeof(rlm_radius_udp_shared_thread_t),
+
+	.config			= module_config,
+	.bootstrap		= mod_bootstrap,
+	.instantiate		= mod_instantiate,
+	.thread_instantiate 	= mod_thread_instantiate,
+	.thread_detach		= mod_thread_detach,
+
+	.push			= mod_push,
+};
@@ -0,0 +1,5 @@
+TARGET		:= rlm_radius_udp_shared.a
+
+SOURCES		:= rlm_radius_udp_shared.c track.c
+
+TGT_PREREQS	:= libfreeradius-radius.a libfreeradius-io.a libfreeradius-util.a
@@ -36,7 +36,7 @@ RCSID("$Id$")
  */
 static int rr_track_free(rlm_radius_id_t *id)
 {
-	int i;
+	uint32_t i;
 
 	for (i = 0; i < 256; i++) {
 		if (!id->id[i].request) continue;
@@ -48,6 +48,14 @@ static int rr_track_free(rlm_radius_id_t *id)
 		if (id->id[i].timer->ev) talloc_const_free(id->id[i].timer->ev);
 	}
 
+	if (!id->extended) return 0;
+
+	for (i = 0; i < id->num_extended; i++) {
+		if (!id->extended[i].request) continue;
+
+		if (id->extended[i].timer->ev) talloc_const_free(id->extended[i].timer->ev);
+	}
+
 	return 0;
 }
 
@@ -131,7 +139,7 @@ retry:
 		 *	don't use it".  Ensure that we only return IDs
 		 *	which are in the static array.
 		 */
-		if (!id->use_authenticator &&
+		if (!id->use_authenticator && !rr->extended &&
 		    (rr != &id->id[rr->id])) {
 			talloc_free(rr);
 			goto retry;
@@ -144,7 +152,7 @@ retry:
 	 *	There are no free entries, and we can't use the
 	 *	Request Authenticator.  Oh well...
 	 */
-	if (!id->use_authenticator) return NULL;
+	if (!id->use_authenticator || id->use_extended_id) return NULL;
 
 	/*
 	 *	Get a new ID.  It's value doesn't matter at this
@@ -208,7 +216,7 @@ int rr_track_update(rlm_radius_id_t *id, rlm_radius_request_t *rr, uint8_t *vect
 	 *	@todo - gracefully handle fallback if the server screws up.
 	 */
 	if (!id->use_authenticator) {
-		rad_assert(rr == &id->id[rr->id]);
+		rad_assert(rr->extended || (rr == &id->id[rr->id]));
 		return 0;
 	}
 
@@ -244,6 +252,18 @@ int rr_track_delete(rlm_radius_id_t *id, rlm_radius_request_t *rr)
 	rad_assert(id->num_requests > 0);
 	id->num_requests--;
 
+	/*
+	 *	Entries from the extended array only go back on the
+	 *	free list if we're still using extended IDs.  If not,
+	 *	rr_track_use_extended_id() has already rebuilt the
+	 *	free list from the static array.
+	 */
+	if (rr->extended) {
+		if (!id->use_extended_id) return 0;
+
+		goto done;
+	}
+
 	/*
 	 *	We're freeing a static ID, just go do that...
 	 */
@@ -254,6 +274,11 @@ int rr_track_delete(rlm_radius_id_t *id, rlm_radius_request_t *rr)
 		 */
 		if (id->subtree[rr->id]) (void) rbtree_deletebydata(id->subtree[rr->id], rr);
 
+		/*
+		 *	And the reverse.
+		 */
+		if (id->use_extended_id) return 0;
+
 		goto done;
 	}
 
@@ -381,6 +406,240 @@ void rr_track_use_authenticator(rlm_radius_id_t *id, bool flag)
 	id->use_authenticator = flag;
 }
 
+/** Use FreeRADIUS-Extended-Identifier (or not) as an Identifier
+ *
+ *  The extended array is allocated the first time it's needed, and
+ *  kept until the tracking table is freed.  The free list is rebuilt
+ *  from whichever array we're now using.  Entries which are still in
+ *  use stay valid, and are discarded when they're deleted.
+ *
+ * @param id		The rlm_radius_id_t tracking table
+ * @param flag		Whether or not to use it.
+ * @param num		How many packets can be outstanding, when
+ *			the array is allocated.
+ * @return
+ *	- <0 on error
+ *	- 0 on success
+ */
+int rr_track_use_extended_id(rlm_radius_id_t *id, bool flag, uint32_t num)
+{
+	uint32_t i;
+	fr_dlist_t *entry;
+
+	(void) talloc_get_type_abort(id, rlm_radius_id_t);
+
+	if (id->use_extended_id == flag) return 0;
+
+	if (flag && !id->extended) {
+		if (!num || (num > RR_TRACK_EXTENDED_MAX)) return -1;
+
+		id->extended = talloc_zero_array(id, rlm_radius_request_t, num);
+		if (!id->extended) return -1;
+		id->num_extended = num;
+
+		for (i = 0; i < num; i++) {
+			id->extended[i].id = i & 0xff;
+			id->extended[i].extended_id = i;
+			id->extended[i].extended = true;
+		}
+	}
+
+	/*
+	 *	Empty the free list, freeing any entries which were
+	 *	allocated for the Request Authenticator.
+	 */
+	while ((entry = FR_DLIST_FIRST(id->free_list)) != NULL) {
+		rlm_radius_request_t *rr;
+
+		rr = fr_ptr_to_type(rlm_radius_request_t, entry, entry);
+		fr_dlist_remove(&rr->entry);
+
+		if (!rr->extended && (rr != &id->id[rr->id])) talloc_free(rr);
+	}
+	id->num_free = 0;
+
+	id->use_extended_id = flag;
+
+	if (flag) {
+		for (i = 0; i < id->num_extended; i++) {
+			if (id->extended[i].request) continue;
+
+			fr_dlist_insert_tail(&id->free_list, &id->extended[i].entry);
+			id->num_free++;
+		}
+		return 0;
+	}
+
+	for (i = 0; i < 256; i++) {
+		if (id->id[i].request) continue;
+
+		fr_dlist_insert_tail(&id->free_list, &id->id[i].entry);
+		id->num_free++;
+	}
+
+	return 0;
+}
+
+
+/** Find a tracking entry from a FreeRADIUS-Extended-Identifier
+ *
+ * @param id		The rlm_radius_id_t tracking table
+ * @param extended_id	from the reply packet.
+ * @return
+ *	- NULL on "not found"
+ *	- rlm_radius_request_t on success
+ */
+rlm_radius_request_t *rr_track_find_extended(rlm_radius_id_t *id, uint32_t extended_id)
+{
+	rlm_radius_request_t *rr;
+
+	if (!id->extended || (extended_id >= id->num_extended)) return NULL;
+
+	rr = &id->extended[extended_id];
+	if (!rr->request) return NULL;
+
+	return rr;
+}
+
+
+/** Encode a FreeRADIUS-Extended-Identifier VSA
+ *
+ * @param out		Where to write the attribute.  Must have room
+ *			for RR_TRACK_EXTENDED_LEN bytes.
+ * @param extended_id	to encode.
+ */
+void rr_track_extended_id_encode(uint8_t *out, uint32_t extended_id)
+{
+	uint32_t vendor = htonl(VENDORPEC_FREERADIUS);
+
+	extended_id = htonl(extended_id);
+
+	out[0] = FR_VENDOR_SPECIFIC;
+	out[1] = RR_TRACK_EXTENDED_LEN;
+	memcpy(out + 2, &vendor, 4);
+	out[6] = FR_FREERADIUS_EXTENDED_IDENTIFIER;
+	out[7] = 6;
+	memcpy(out + 8, &extended_id, 4);
+}
+
+
+/** Find a FreeRADIUS-Extended-Identifier VSA in a packet
+ *
+ *  The attribute is hop-by-hop, so a reply can only contain the one
+ *  we sent.  If there are more, we can't tell which one is ours.
+ *
+ *  The packet must have already been checked by fr_radius_ok().
+ *
+ * @param[out] out		The Extended-Identifier.
+ * @param[in] packet		to search.
+ * @param[in] packet_len	of the packet.
+ * @return
+ *	- 1 if the attribute was found.
+ *	- 0 if it wasn't.
+ *	- -1 if the packet contains more than one.
+ */
+static int rr_track_extended_id_decode(uint32_t *out, uint8_t const *packet, size_t packet_len)
+{
+	uint8_t const *attr, *end;
+	uint32_t vendor = htonl(VENDORPEC_FREERADIUS);
+	int found = 0;
+
+	end = packet + packet_len;
+
+	for (attr = packet + 20; (attr + 2) <= end; attr += attr[1]) {
+		if (attr[1] < 2) break;
+
+		if ((attr[0] != FR_VENDOR_SPECIFIC) ||
+		    (attr[1] != RR_TRACK_EXTENDED_LEN) ||
+		    (attr[6] != FR_FREERADIUS_EXTENDED_IDENTIFIER) ||
+		    (attr[7] != 6) ||
+		    (memcmp(attr + 2, &vendor, 4) != 0)) continue;
+
+		if (found) return -1;
+
+		memcpy(out, attr + 8, 4);
+		*out = ntohl(*out);
+		found = 1;
+	}
+
+	return found;
+}
+
+/** Unlink FreeRADIUS-Extended-Identifier attributes from a list
+ *
+ *  The attribute is hop-by-hop.  Any the client sent us must not be
+ *  forwarded, as we add our own when we encode the packet.  They're
+ *  still needed to build the reply to the client, so the caller
+ *  must put them back with fr_pair_add() once the packet has been
+ *  encoded.
+ *
+ * @param[in,out] vps	to remove the attributes from.
+ * @return the removed attributes, or NULL if there were none.
+ */
+VALUE_PAIR *rr_track_extended_id_unlink(VALUE_PAIR **vps)
+{
+	VALUE_PAIR *vp, *next, **last = vps;
+	VALUE_PAIR *out = NULL, **tail = &out;
+
+	for (vp = *vps; vp; vp = next) {
+		next = vp->next;
+
+		if ((vp->da->parent->type != FR_TYPE_VENDOR) ||
+		    (vp->da->attr != FR_FREERADIUS_EXTENDED_IDENTIFIER) ||
+		    (fr_dict_vendor_num_by_da(vp->da) != VENDORPEC_FREERADIUS)) {
+			last = &vp->next;
+			continue;
+		}
+
+		*last = next;
+		vp->next = NULL;
+		*tail = vp;
+		tail = &vp->next;
+	}
+
+	return out;
+}
+
+/** Find a tracking entry for a reply packet
+ *
+ *  If we're using extended identifiers, and the reply has a
+ *  FreeRADIUS-Extended-Identifier, use that.  Otherwise fall back to
+ *  the 8-bit ID in the header.
+ *
+ *  Replies with more than one FreeRADIUS-Extended-Identifier are
+ *  ambiguous, and aren't matched to any request.
+ *
+ * @param id		The rlm_radius_id_t tracking table
+ * @param packet	The reply, already checked by fr_radius_ok().
+ * @param packet_len	of the reply.
+ * @return
+ *	- NULL on "not found"
+ *	- rlm_radius_request_t on success
+ */
+rlm_radius_request_t *rr_track_find_reply(rlm_radius_id_t *id, uint8_t const *packet, size_t packet_len)
+{
+	uint32_t		extended_id;
+	rlm_radius_request_t	*rr;
+
+	if (!id->use_extended_id) return rr_track_find(id, packet[1], NULL);
+
+	switch (rr_track_extended_id_decode(&extended_id, packet, packet_len)) {
+	case 1:
+		break;
+
+	case 0:
+		return rr_track_find(id, packet[1], NULL);
+
+	default:
+		return NULL;
+	}
+
+	rr = rr_track_find_extended(id, extended_id);
+	if (!rr || (rr->id != packet[1])) return NULL;
+
+	return rr;
+}
+
 int rr_track_retry(rlm_radius_retransmit_t *timer, struct timeval *now)
 {
 	uint32_t delay, frac;
@@ -25,6 +25,19 @@
  */
 
 #include "rlm_radius.h"
+
+/*
+ *	The most packets a connection can have outstanding when using
+ *	FreeRADIUS-Extended-Identifier.  The actual limit is
+ *	"max_outstanding".
+ */
+#define RR_TRACK_EXTENDED_MAX	(1 << 16)
+
+/*
+ *	Length of the FreeRADIUS-Extended-Identifier VSA.
+ */
+#define RR_TRACK_EXTENDED_LEN	(12)
+
 typedef struct rlm_radius_retransmit_t {
 	struct timeval		start;		//!< when we started sending the packet
 	uint32_t		count;		//!< how many times we sent this packet
@@ -43,6 +56,8 @@ typedef struct rlm_radius_request_t {
 
 	int			code;		//!< packet code (sigh)
 	int			id;		//!< our ID
+	uint32_t		extended_id;	//!< our Extended-Identifier
+	bool			extended;	//!< whether this entry is from the extended array
 
 	rlm_radius_retransmit_t *timer;		//!< retransmission
 
@@ -64,6 +79,11 @@ typedef struct rlm_radius_id_t {
 	rlm_radius_request_t	id[256];	//!< which ID was used
 
 	rbtree_t		*subtree[256];	//!< for Original-Request-Authenticator
+
+	bool			use_extended_id; //!< whether to allocate from the extended array
+	rlm_radius_request_t	*extended;	//!< flat array of num_extended entries,
+						///< indexed by Extended-Identifier.
+	uint32_t		num_extended;	//!< size of the extended array
 } rlm_radius_id_t;
 
 rlm_radius_id_t *rr_track_create(TALLOC_CTX *ctx);
@@ -74,5 +94,11 @@ rlm_radius_request_t *rr_track_find(rlm_radius_id_t *id, int packet_id, uint8_t
 int rr_track_delete(rlm_radius_id_t *id, rlm_radius_request_t *rr) CC_HINT(nonnull);
 void rr_track_use_authenticator(rlm_radius_id_t *id, bool flag) CC_HINT(nonnull);
 
+int rr_track_use_extended_id(rlm_radius_id_t *id, bool flag, uint32_t num) CC_HINT(nonnull);
+rlm_radius_request_t *rr_track_find_extended(rlm_radius_id_t *id, uint32_t extended_id) CC_HINT(nonnull);
+void rr_track_extended_id_encode(uint8_t *out, uint32_t extended_id) CC_HINT(nonnull);
+VALUE_PAIR *rr_track_extended_id_unlink(VALUE_PAIR **vps) CC_HINT(nonnull);
+rlm_radius_request_t *rr_track_find_reply(rlm_radius_id_t *id, uint8_t const *packet, size_t packet_len) CC_HINT(nonnull);
+
 int rr_track_start(rlm_radius_retransmit_t *timer) CC_HINT(nonnull);
 int rr_track_retry(rlm_radius_retransmit_t *timer, struct timeval *now) CC_HINT(nonnull);
@@ -285,22 +285,26 @@ invalid:
 	return packet_len;
 }
 
-/** Sign a previously encoded packet
+/** Prepare a packet for calculating its Message-Authenticator
  *
- * @param packet the raw RADIUS packet (request or response)
- * @param original the raw original request (if this is a response)
- * @param secret the shared secret
- * @param secret_len the length of the secret
+ * Finds the Message-Authenticator, sets the authenticator field in the
+ * header to the value used when calculating the HMAC, and zeroes the
+ * Message-Authenticator.
+ *
+ * @param[in] packet	the raw RADIUS packet (request or response).
+ * @param[in] original	the raw original request (if this is a response).
+ * @param[out] ma	Where to write a pointer to the Message-Authenticator
+ *			attribute.  NULL if the packet doesn't contain one.
  * @return
  *	- <0 on error
  *	- 0 on success
  */
-int fr_radius_sign(uint8_t *packet, uint8_t const *original,
-		   uint8_t const *secret, size_t secret_len)
+static int radius_sign_ma_prepare(uint8_t *packet, uint8_t const *original, uint8_t **ma)
 {
 	uint8_t *msg, *end;
 	size_t packet_len = (packet[2] << 8) | packet[3];
-	FR_MD5_CTX	context;
+
+	*ma = NULL;
 
 	if (packet_len < RADIUS_HDR_LEN) {
 		fr_strerror_printf("Packet must be encoded before calling fr_radius_sign()");
@@ -355,7 +359,11 @@ int fr_radius_sign(uint8_t *packet, uint8_t const *original,
 		case FR_CODE_ACCESS_REJECT:
 		case FR_CODE_ACCESS_CHALLENGE:
 		do_ack:
-			if (!original) goto need_original;
+			if (!original) {
+			need_original:
+				fr_strerror_printf("Cannot sign response packet without a request packet");
+				return -1;
+			}
 			memcpy(packet + 4, original + 4, AUTH_VECTOR_LEN);
 			break;
 
@@ -365,19 +373,33 @@ int fr_radius_sign(uint8_t *packet, uint8_t const *original,
 			break;
 
 		default:
-			goto bad_packet;
+			fr_strerror_printf("Cannot sign unknown packet code %u", packet[0]);
+			return -1;
 		}
 
 		/*
 		 *	Force Message-Authenticator to be zero,
-		 *	calculate the HMAC, and put it into the
-		 *	Message-Authenticator attribute.
+		 *	so the HMAC can be calculated.
 		 */
 		memset(msg + 2, 0, AUTH_VECTOR_LEN);
-		fr_hmac_md5(msg + 2, packet, packet_len, secret, secret_len);
+		*ma = msg;
 		break;
 	}
 
+	return 0;
+}
+
+/** Prepare a packet for calculating its Request or Response Authenticator
+ *
+ * @param[in] packet	the raw RADIUS packet (request or response).
+ * @param[in] original	the raw original request (if this is a response).
+ * @return
+ *	- <0 on error
+ *	- 0 if the authenticator is random data, and shouldn't be calculated.
+ *	- 1 if the authenticator should be calculated as MD5(packet + secret).
+ */
+static int radius_sign_auth_prepare(uint8_t *packet, uint8_t const *original)
+{
 	/*
 	 *	Initialize the request authenticator.
 	 */
@@ -398,7 +420,6 @@ int fr_radius_sign(uint8_t *packet, uint8_t const *original,
 	case FR_CODE_COA_NAK:
 	case FR_CODE_PROTOCOL_ERROR:
 		if (!original) {
-		need_original:
 			fr_strerror_printf("Cannot sign response packet without a request packet");
 			return -1;
 		}
@@ -415,22 +436,130 @@ int fr_radius_sign(uint8_t *packet, uint8_t const *original,
 		return 0;
 
 	default:
-	bad_packet:
 		fr_strerror_printf("Cannot sign unknown packet code %u", packet[0]);
 		return -1;
 	}
 
+	return 1;
+}
+
+/** Initialise a shared secret, and derive the MD5 state used for signing packets
+ *
+ * @param[out] out		to initialise.
+ * @param[in] secret		the shared secret.  Must outlive out.
+ * @param[in] secret_len	the length of the secret.
+ */
+void fr_radius_secret_init(fr_radius_secret_t *out, uint8_t const *secret, size_t secret_len)
+{
+	out->secret = secret;
+	out->secret_len = secret_len;
+	fr_hmac_md5_key_init(&out->hmac, secret, secret_len);
+}
+
+/** Sign a previously encoded packet
+ *
+ * @param packet the raw RADIUS packet (request or response)
+ * @param original the raw original request (if this is a response)
+ * @param secret the shared secret, initialised with #fr_radius_secret_init
+ * @return
+ *	- <0 on error
+ *	- 0 on success
+ */
+int fr_radius_sign(uint8_t *packet, uint8_t const *original, fr_radius_secret_t const *secret)
+{
+	uint8_t		*msg;
+	size_t		packet_len = (packet[2] << 8) | packet[3];
+	int		rcode;
+	FR_MD5_CTX	context;
+
+	if (radius_sign_ma_prepare(packet, original, &msg) < 0) return -1;
+
+	/*
+	 *	Calculate the HMAC, and put it into the
+	 *	Message-Authenticator attribute.
+	 */
+	if (msg) fr_hmac_md5_from_key(msg + 2, packet, packet_len, &secret->hmac);
+
+	rcode = radius_sign_auth_prepare(packet, original);
+	if (rcode <= 0) return rcode;
+
 	/*
 	 *	Request / Response Authenticator = MD5(packet + secret)
 	 */
 	fr_md5_init(&context);
 	fr_md5_update(&context, packet, packet_len);
-	fr_md5_update(&context, secret, secret_len);
+	fr_md5_update(&context, secret->secret, secret->secret_len);
 	fr_md5_final(packet + 4, &context);
 
 	return 0;
 }
 
+/** Sign a batch of previously encoded packets
+ *
+ * Produces the same results as calling #fr_radius_sign for each packet,
+ * but the MD5 operations for all packets in the batch are done in
+ * parallel, with #fr_hmac_md5_multi and #fr_md5_calc_multi.
+ *
+ * @param[in,out] batch	of packets to sign.  batch[i].rcode is set to the
+ *			result of signing each packet.
+ * @param[in] num	Number of packets in the batch.
+ */
+void fr_radius_sign_multi(fr_radius_batch_t *batch, size_t num)
+{
+	fr_hmac_md5_multi_t	hmac[RADIUS_BATCH_MAX];
+	fr_md5_multi_t		md5[RADIUS_BATCH_MAX];
+	size_t			i, todo, chunk;
+
+	while (num > 0) {
+		chunk = (num > RADIUS_BATCH_MAX) ? RADIUS_BATCH_MAX : num;
+
+		/*
+		 *	Message-Authenticators first, as their
+		 *	values are included in the authenticators.
+		 */
+		for (i = 0, todo = 0; i < chunk; i++) {
+			uint8_t *msg;
+
+			batch[i].rcode = radius_sign_ma_prepare(batch[i].packet, batch[i].original, &msg);
+			if ((batch[i].rcode < 0) || !msg) continue;
+
+			hmac[todo].text = batch[i].packet;
+			hmac[todo].text_len = (batch[i].packet[2] << 8) | batch[i].packet[3];
+			hmac[todo].key = batch[i].secret->secret;
+			hmac[todo].key_len = batch[i].secret->secret_len;
+			hmac[todo].digest = msg + 2;
+			todo++;
+		}
+		fr_hmac_md5_multi(hmac, todo);
+
+		/*
+		 *	Request / Response Authenticator = MD5(packet + secret)
+		 */
+		for (i = 0, todo = 0; i < chunk; i++) {
+			int rcode;
+
+			if (batch[i].rcode < 0) continue;
+
+			rcode = radius_sign_auth_prepare(batch[i].packet, batch[i].original);
+			if (rcode <= 0) {
+				batch[i].rcode = rcode;
+				continue;
+			}
+
+			md5[todo].in[0] = batch[i].packet;
+			md5[todo].inlen[0] = (batch[i].packet[2] << 8) | batch[i].packet[3];
+			md5[todo].in[1] = batch[i].secret->secret;
+			md5[todo].inlen[1] = batch[i].secret->secret_len;
+			md5[todo].out = batch[i].packet + 4;
+			todo++;
+		}
+		fr_md5_calc_multi(md5, todo);
+
+		batch += chunk;
+		num -= chunk;
+	}
+}
+
 
 /** See if the data pointed to by PTR is a valid RADIUS packet.
  *
@@ -705,14 +834,12 @@ finish:
  *
  * @param packet the raw RADIUS packet (request or response)
  * @param original the raw original request (if this is a response)
- * @param secret the shared secret
- * @param secret_len the length of the secret
+ * @param secret the shared secret, initialised with #fr_radius_secret_init
  * @return
  *	- <0 on error
  *	- 0 on success
  */
-int fr_radius_verify(uint8_t *packet, uint8_t const *original,
-		     uint8_t const *secret, size_t secret_len)
+int fr_radius_verify(uint8_t *packet, uint8_t const *original, fr_radius_secret_t const *secret)
 {
 	int rcode;
 	uint8_t *msg, *end;
@@ -768,7 +895,7 @@ int fr_radius_verify(uint8_t *packet, uint8_t const *original,
 	 *	slightly more CPU work than having verify-specific
 	 *	functions, but it ends up being cleaner in the code.
 	 */
-	rcode = fr_radius_sign(packet, original, secret, secret_len);
+	rcode = fr_radius_sign(packet, original, secret);
 	if (rcode < 0) {
 		fr_strerror_printf_push("Failed calculating correct authenticator");
 		return -1;
@@ -814,6 +941,100 @@ int fr_radius_verify(uint8_t *packet, uint8_t const *original,
 	return 0;
 }
 
+/** Verify a batch of request / response packets
+ *
+ * Produces the same results as calling #fr_radius_verify for each packet,
+ * but the MD5 operations for all packets in the batch are done in parallel.
+ * This is useful where multiple packets have been read from a socket at once.
+ *
+ * @param[in,out] batch	of packets to verify.  batch[i].rcode is set to the
+ *			result of verifying each packet.  If more than one
+ *			packet fails verification, only the error for the last
+ *			one is available via fr_strerror().
+ * @param[in] num	Number of packets in the batch.
+ */
+void fr_radius_verify_multi(fr_radius_batch_t *batch, size_t num)
+{
+	uint8_t		request_authenticator[RADIUS_BATCH_MAX][AUTH_VECTOR_LEN];
+	uint8_t		message_authenticator[RADIUS_BATCH_MAX][AUTH_VECTOR_LEN];
+	uint8_t		*ma[RADIUS_BATCH_MAX];
+	size_t		i, chunk;
+
+	while (num > 0) {
+		chunk = (num > RADIUS_BATCH_MAX) ? RADIUS_BATCH_MAX : num;
+
+		for (i = 0; i < chunk; i++) {
+			uint8_t *packet = batch[i].packet;
+			uint8_t *msg, *end;
+
+			ma[i] = NULL;
+			memcpy(request_authenticator[i], packet + 4, sizeof(request_authenticator[i]));
+
+			/*
+			 *	Save a copy of the Message-Authenticator.
+			 *	Any issues with the packet format are
+			 *	caught by fr_radius_sign_multi().
+			 */
+			msg = packet + RADIUS_HDR_LEN;
+			end = packet + ((packet[2] << 8) | packet[3]);
+			while (((msg + 2) <= end) && (msg[1] >= 2) && ((msg + msg[1]) <= end)) {
+				if ((msg[0] == FR_MESSAGE_AUTHENTICATOR) && (msg[1] >= 18)) {
+					memcpy(message_authenticator[i], msg + 2, sizeof(message_authenticator[i]));
+					ma[i] = msg;
+					break;
+				}
+				msg += msg[1];
+			}
+		}
+
+		fr_radius_sign_multi(batch, chunk);
+
+		for (i = 0; i < chunk; i++) {
+			uint8_t *packet = batch[i].packet;
+
+			if (batch[i].rcode < 0) {
+				fr_strerror_printf_push("Failed calculating correct authenticator");
+				continue;
+			}
+
+			/*
+			 *	Check the Message-Authenticator first.
+			 */
+			if (ma[i] &&
+			    (fr_digest_cmp(message_authenticator[i], ma[i] + 2, sizeof(message_authenticator[i])) != 0)) {
+				memcpy(ma[i] + 2, message_authenticator[i], sizeof(message_authenticator[i]));
+				memcpy(packet + 4, request_authenticator[i], sizeof(request_authenticator[i]));
+
+				fr_strerror_printf("invalid Message-Authenticator (shared secret is incorrect)");
+				batch[i].rcode = -1;
+				continue;
+			}
+
+			/*
+			 *	These are random numbers, so there's no point in
+			 *	comparing them.
+			 */
+			if ((packet[0] == FR_CODE_ACCESS_REQUEST) || (packet[0] == FR_CODE_STATUS_SERVER)) continue;
+
+			/*
+			 *	Check the Request Authenticator.
+			 */
+			if (fr_digest_cmp(request_authenticator[i], packet + 4, sizeof(request_authenticator[i])) != 0) {
+				memcpy(packet + 4, request_authenticator[i], sizeof(request_authenticator[i]));
+				if (batch[i].original) {
+					fr_strerror_printf("invalid Response Authenticator (shared secret is incorrect)");
+				} else {
+					fr_strerror_printf("invalid Request Authenticator (shared secret is incorrect)");
+				}
+				batch[i].rcode = -1;
+			}
+		}
+
+		batch += chunk;
+		num -= chunk;
+	}
+}
+
 /** Encode VPS into a raw RADIUS packet.
  *
  */
@@ -1011,6 +1232,7 @@ ssize_t	fr_radius_decode(TALLOC_CTX *ctx, uint8_t *packet, size_t packet_len, ui
 	packet_ctx.secret = secret;
 	packet_ctx.vector = original + 4;
 	packet_ctx.root = fr_dict_root(fr_dict_internal);
+	packet_ctx.zero_copy = false;
 
 	fr_cursor_init(&cursor, vps);
 
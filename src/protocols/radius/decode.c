@@ -526,14 +526,19 @@ static ssize_t fr_radius_decode_struct(TALLOC_CTX *ctx, fr_cursor_t *cursor,
 /** Convert a top-level VSA to a VP.
  *
  * "length" can be LONGER than just this sub-vsa.
+ *
+ * The vendor format (the width of the type and length fields) is read from
+ * the vendor attribute, where it was stored when the dictionary was loaded,
+ * so we don't need to look up the #fr_dict_vendor_t for every VSA.
  */
 static ssize_t decode_vsa_internal(TALLOC_CTX *ctx, fr_cursor_t *cursor,
 				   fr_dict_attr_t const *parent,
 				   uint8_t const *data, size_t data_len,
-				   void *decoder_ctx, fr_dict_vendor_t const *dv)
+				   void *decoder_ctx)
 {
 	unsigned int		attribute;
 	ssize_t			attrlen, my_len;
+	size_t			hdr_len;
 	fr_dict_attr_t const	*da;
 
 	/*
@@ -546,14 +551,16 @@ static ssize_t decode_vsa_internal(TALLOC_CTX *ctx, fr_cursor_t *cursor,
 
 	FR_PROTO_TRACE("Length %u", (unsigned int)data_len);
 
+	hdr_len = parent->flags.type_size + parent->flags.length;
+
 #ifndef NDEBUG
-	if (data_len <= (dv->type + dv->length)) {
+	if (data_len <= hdr_len) {
 		fr_strerror_printf("%s: Failure to call fr_radius_decode_tlv_ok", __FUNCTION__);
 		return -1;
 	}
 #endif
 
-	switch (dv->type) {
+	switch (parent->flags.type_size) {
 	case 4:
 		/* data[0] must be zero */
 		attribute = data[1] << 16;
@@ -575,14 +582,14 @@ static ssize_t decode_vsa_internal(TALLOC_CTX *ctx, fr_cursor_t *cursor,
 		return -1;
 	}
 
-	switch (dv->length) {
+	switch (parent->flags.length) {
 	case 2:
-		/* data[dv->type] must be zero, from fr_radius_decode_tlv_ok() */
-		attrlen = data[dv->type + 1];
+		/* data[type_size] must be zero, from fr_radius_decode_tlv_ok() */
+		attrlen = data[parent->flags.type_size + 1];
 		break;
 
 	case 1:
-		attrlen = data[dv->type];
+		attrlen = data[parent->flags.type_size];
 		break;
 
 	case 0:
@@ -598,12 +605,12 @@ static ssize_t decode_vsa_internal(TALLOC_CTX *ctx, fr_cursor_t *cursor,
 	 *	See if the VSA is known.
 	 */
 	da = fr_dict_attr_child_by_num(parent, attribute);
-	if (!da) da = fr_dict_unknown_afrom_fields(ctx, parent, dv->pen, attribute);
+	if (!da) da = fr_dict_unknown_afrom_fields(ctx, parent, parent->attr, attribute);
 	if (!da) return -1;
 	FR_PROTO_TRACE("decode context changed %s -> %s", da->parent->name, da->name);
 
-	my_len = fr_radius_decode_pair_value(ctx, cursor, da, data + dv->type + dv->length,
-					     attrlen - (dv->type + dv->length), attrlen - (dv->type + dv->length),
+	my_len = fr_radius_decode_pair_value(ctx, cursor, da, data + hdr_len,
+					     attrlen - hdr_len, attrlen - hdr_len,
 					     decoder_ctx);
 	if (my_len < 0) return my_len;
 
@@ -882,9 +889,7 @@ static ssize_t decode_vsa(TALLOC_CTX *ctx, fr_cursor_t *cursor, fr_dict_attr_t c
 	size_t			total;
 	ssize_t			rcode;
 	uint32_t		vendor;
-	fr_dict_vendor_t const	*dv;
 	VALUE_PAIR		*head = NULL;
-	fr_dict_vendor_t	my_dv;
 	fr_dict_attr_t const	*vendor_da;
 	fr_cursor_t		tlv_cursor;
 
@@ -924,40 +929,37 @@ static ssize_t decode_vsa(TALLOC_CTX *ctx, fr_cursor_t *cursor, fr_dict_attr_t c
 		if (fr_dict_unknown_vendor_afrom_num(ctx, &n, parent, vendor) < 0) return -1;
 		vendor_da = n;
 
-		/*
-		 *	Create an unknown DV too...
-		 */
-		memset(&my_dv, 0, sizeof(my_dv));
-
-		my_dv.pen = vendor;
-		my_dv.type = 1;
-		my_dv.length = 1;
+		goto create_attrs;
+	}
+	FR_PROTO_TRACE("decode context %s -> %s", parent->name, vendor_da->name);
 
-		dv = &my_dv;
+	/*
+	 *	WiMAX craziness
+	 *
+	 *	Only WiMAX needs the vendor definition (for the
+	 *	continuation flag).  The format of every other
+	 *	vendor is stored in the vendor attribute.
+	 */
+	if (vendor == VENDORPEC_WIMAX) {
+		fr_dict_vendor_t const *dv;
 
-		goto create_attrs;
-	} else {
 		/*
 		 *	We found an attribute representing the vendor
 		 *	so it *MUST* exist in the vendor tree.
 		 */
 		dv = fr_dict_vendor_by_num(NULL, vendor);
 		if (!fr_cond_assert(dv)) return -1;
-	}
-	FR_PROTO_TRACE("decode context %s -> %s", parent->name, vendor_da->name);
 
-	/*
-	 *	WiMAX craziness
-	 */
-	if ((vendor == VENDORPEC_WIMAX) && dv->flags) {
-		rcode = decode_wimax(ctx, cursor, vendor_da, data, attr_len, packet_len, decoder_ctx, vendor);
-		return rcode;
+		if (dv->flags) {
+			rcode = decode_wimax(ctx, cursor, vendor_da, data, attr_len, packet_len, decoder_ctx, vendor);
+			return rcode;
+		}
 	}
 
 	/*
 	 *	VSAs should normally be in TLV format.
 	 */
-	if (fr_radius_decode_tlv_ok(data + 4, attr_len - 4, dv->type, dv->length) < 0) {
+	if (fr_radius_decode_tlv_ok(data + 4, attr_len - 4, vendor_da->flags.type_size, vendor_da->flags.length) < 0) {
 		FR_PROTO_TRACE("TLVs not OK: %s", fr_strerror());
 		return -1;
 	}
@@ -979,7 +981,7 @@ create_attrs:
 		/*
 		 *	Vendor attributes can have subattributes (if you hadn't guessed)
 		 */
-		vsa_len = decode_vsa_internal(ctx, &tlv_cursor, vendor_da, data, attr_len, decoder_ctx, dv);
+		vsa_len = decode_vsa_internal(ctx, &tlv_cursor, vendor_da, data, attr_len, decoder_ctx);
 		if (vsa_len < 0) {
 			fr_strerror_printf("%s: Internal sanity check %d", __FUNCTION__, __LINE__);
 			fr_pair_list_free(&head);
@@ -1383,8 +1385,24 @@ ssize_t fr_radius_decode_pair_value(TALLOC_CTX *ctx, fr_cursor_t *cursor, fr_dic
 	vp->tag = tag;
 
 	switch (parent->type) {
-	case FR_TYPE_STRING:
 	case FR_TYPE_OCTETS:
+		/*
+		 *	Reference the value in the packet instead of
+		 *	copying it, if we've been asked to, and it's
+		 *	not in a temporary (decrypted / reassembled)
+		 *	buffer.
+		 *
+		 *	Strings are always copied, as everything
+		 *	expects them to be \0 terminated.
+		 */
+		if (packet_ctx && packet_ctx->zero_copy &&
+		    (p >= packet_ctx->data) && ((p + data_len) <= packet_ctx->end)) {
+			fr_value_box_memborrow(&vp->data, vp->da, p, data_len, true);
+			break;
+		}
+		/* FALL-THROUGH */
+
+	case FR_TYPE_STRING:
 	case FR_TYPE_IPV4_ADDR:
 	case FR_TYPE_IPV6_ADDR:
 	case FR_TYPE_BOOL:
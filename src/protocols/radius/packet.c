@@ -29,6 +29,7 @@ RCSID("$Id$")
 
 #ifdef WITH_UDPFROMTO
 #include <freeradius-devel/udpfromto.h>
+#include <freeradius-devel/io/test_point.h>
 #endif
 
 #include <fcntl.h>
@@ -100,27 +101,31 @@ int fr_radius_packet_encode(RADIUS_PACKET *packet, RADIUS_PACKET const *original
 }
 
 
-/** Calculate/check digest, and decode radius attributes
+/** Initialise the decoder context for a packet
+ *
+ * Works out which vector is used to decrypt attributes, based on the packet code.
  *
+ * @param[out] packet_ctx		to initialise.
+ * @param[in] packet			to decode.
+ * @param[in] original			request, if the packet is a reply.
+ * @param[in] tunnel_password_zeros	check for trailing zeros in Tunnel-Password.
+ * @param[in] zero_copy			Reference "octets" values in packet->data.
+ * @param[in] secret			shared with the client or home server.
  * @return
- *	- 0 on success
- *	- -1 on decoding error.
+ *	- 0 on success.
+ *	- -1 if the packet code is unknown.
  */
-int fr_radius_packet_decode(RADIUS_PACKET *packet, RADIUS_PACKET *original,
-			    uint32_t max_attributes, bool tunnel_password_zeros, char const *secret)
+static int packet_decode_ctx_init(fr_radius_ctx_t *packet_ctx, RADIUS_PACKET *packet, RADIUS_PACKET const *original,
+				  bool tunnel_password_zeros, bool zero_copy, char const *secret)
 {
-	int			packet_length;
-	uint32_t		num_attributes;
-	uint8_t			*ptr;
-	radius_packet_t		*hdr;
-	VALUE_PAIR		*head = NULL;
-	fr_cursor_t		cursor, out;
-	fr_radius_ctx_t		packet_ctx;
+	packet_ctx->secret = secret;
+	packet_ctx->vector = packet->vector;
+	packet_ctx->tunnel_password_zeros = tunnel_password_zeros;
+	packet_ctx->root = fr_dict_root(fr_dict_internal);
+	packet_ctx->zero_copy = zero_copy;
+	packet_ctx->data = packet->data;
+	packet_ctx->end = packet->data + packet->data_len;
 
-	packet_ctx.secret = secret;
-	packet_ctx.vector = packet->vector;
-	packet_ctx.tunnel_password_zeros = tunnel_password_zeros;
-	packet_ctx.root = fr_dict_root(fr_dict_internal);
 	switch (packet->code) {
 	case FR_CODE_ACCESS_REQUEST:
 	case FR_CODE_STATUS_SERVER:
@@ -138,7 +143,7 @@ int fr_radius_packet_decode(RADIUS_PACKET *packet, RADIUS_PACKET *original,
 		 *	radsniff doesn't always have a response
 		 */
 		if (original) {
- 			packet_ctx.vector = original->vector;
+ 			packet_ctx->vector = original->vector;
 		} else {
 			memset(packet->vector, 0, sizeof(packet->vector));
 		}
@@ -158,6 +163,38 @@ int fr_radius_packet_decode(RADIUS_PACKET *packet, RADIUS_PACKET *original,
 		return -1;
 	}
 
+	return 0;
+}
+
+/** Calculate/check digest, and decode radius attributes
+ *
+ * @param[in] packet			to decode.  The VPs are allocated in the packet.
+ * @param[in] original			request, if the packet is a reply.
+ * @param[in] max_attributes		to decode.  0 means no limit.
+ * @param[in] tunnel_password_zeros	check for trailing zeros in Tunnel-Password.
+ * @param[in] zero_copy			Reference "octets" values in packet->data instead
+ *					of copying them.  packet->data must not be freed
+ *					or modified while the VPs exist.
+ * @param[in] secret			shared with the client or home server.
+ * @return
+ *	- 0 on success
+ *	- -1 on decoding error.
+ */
+int fr_radius_packet_decode(RADIUS_PACKET *packet, RADIUS_PACKET *original,
+			    uint32_t max_attributes, bool tunnel_password_zeros, bool zero_copy,
+			    char const *secret)
+{
+	int			packet_length;
+	uint32_t		num_attributes;
+	uint8_t			*ptr;
+	radius_packet_t		*hdr;
+	VALUE_PAIR		*head = NULL;
+	fr_cursor_t		cursor, out;
+	fr_radius_ctx_t		packet_ctx;
+
+	if (packet_decode_ctx_init(&packet_ctx, packet, original,
+				   tunnel_password_zeros, zero_copy, secret) < 0) return -1;
+
 	/*
 	 *	Extract attribute-value pairs
 	 */
@@ -231,6 +268,333 @@ int fr_radius_packet_decode(RADIUS_PACKET *packet, RADIUS_PACKET *original,
 }
 
 
+/** An attribute in a packet which has been indexed, but maybe not decoded
+ *
+ */
+typedef struct {
+	uint8_t const		*attr;			//!< Start of the attribute in the packet data.
+	uint32_t		sub;			//!< Vendor PEN for Vendor-Specific attributes,
+							///< extended type for extended attributes, else 0.
+	bool			decoded;		//!< VPs have been created from this attribute.
+} radius_index_entry_t;
+
+/** Offsets of the attributes in a packet
+ *
+ */
+struct fr_radius_index_s {
+	fr_radius_ctx_t		packet_ctx;		//!< Used to decode attributes on demand.
+	uint8_t const		*end;			//!< End of the packet data.
+	radius_index_entry_t	*entry;			//!< One per top level attribute, in packet order.
+	size_t			num;			//!< Number of entries.
+};
+
+/** Whether an attribute has to be decoded when the packet is indexed
+ *
+ * Encrypted attributes depend on the shared secret and the authenticator, and
+ * Message-Authenticator has to be checked.  We can't tell which vendor
+ * attributes are encrypted without looking at them, so VSAs which don't use
+ * the standard format are decoded too.
+ */
+static bool index_entry_must_decode(fr_dict_attr_t const *root, uint8_t const *attr)
+{
+	fr_dict_attr_t const	*da, *vendor, *child;
+	uint8_t const		*p, *end;
+	uint32_t		pen;
+
+	if (attr[0] == FR_MESSAGE_AUTHENTICATOR) return true;
+
+	da = fr_dict_attr_child_by_num(root, attr[0]);
+	if (!da) return false;				/* Unknown, forward it as-is */
+
+	if (da->flags.encrypt != FLAG_ENCRYPT_NONE) return true;
+
+	if ((da->type != FR_TYPE_VSA) || (attr[1] < 7)) return false;
+
+	memcpy(&pen, attr + 2, sizeof(pen));
+	vendor = fr_dict_attr_child_by_num(da, ntohl(pen));
+	if (!vendor) return false;
+
+	if ((vendor->flags.type_size != 1) || (vendor->flags.length != 1)) return true;
+
+	end = attr + attr[1];
+	for (p = attr + 6; (p + 2) <= end; p += p[1]) {
+		if (p[1] < 2) return true;		/* Malformed, let the decoder deal with it */
+
+		child = fr_dict_attr_child_by_num(vendor, p[0]);
+		if (child && (child->flags.encrypt != FLAG_ENCRYPT_NONE)) return true;
+	}
+
+	return false;
+}
+
+/** Decode an indexed attribute, and any attributes it was reassembled from
+ *
+ */
+static int index_entry_decode(fr_cursor_t *cursor, RADIUS_PACKET *packet, fr_radius_index_t *idx, size_t i)
+{
+	radius_index_entry_t	*e = &idx->entry[i];
+	ssize_t			slen;
+
+	if (e->decoded) return 0;
+
+	slen = fr_radius_decode_pair(packet, cursor, e->attr, idx->end - e->attr, &idx->packet_ctx);
+	if (slen < 0) return -1;
+
+	/*
+	 *	Concatenated, and long extended attributes consume
+	 *	the attributes which follow them.
+	 */
+	for (; (i < idx->num) && (idx->entry[i].attr < (e->attr + slen)); i++) idx->entry[i].decoded = true;
+
+	return 0;
+}
+
+/** Index the attributes in a packet, without decoding them
+ *
+ * Only the offsets of the attributes are recorded.  VPs are created later, by
+ * #fr_radius_packet_index_decode, when the attributes are needed.
+ *
+ * Encrypted attributes, and Message-Authenticator depend on the secret, so
+ * they're always decoded, and added to packet->vps.
+ *
+ * fr_radius_packet_ok() must have been called on the packet.
+ *
+ * @param[in] packet			to index.  The index is allocated in the packet.
+ * @param[in] original			request, if the packet is a reply.
+ * @param[in] tunnel_password_zeros	check for trailing zeros in Tunnel-Password.
+ * @param[in] secret			shared with the client or home server.
+ *					Must remain valid while the index is used.
+ * @return
+ *	- A new index.
+ *	- NULL on error.
+ */
+fr_radius_index_t *fr_radius_packet_index(RADIUS_PACKET *packet, RADIUS_PACKET const *original,
+					  bool tunnel_password_zeros, char const *secret)
+{
+	fr_radius_index_t	*idx;
+	uint8_t const		*p, *end;
+	size_t			i;
+	fr_cursor_t		cursor;
+
+	idx = talloc_zero(packet, fr_radius_index_t);
+	if (!idx) {
+	oom:
+		fr_strerror_printf("Out of memory");
+		return NULL;
+	}
+
+	if (packet_decode_ctx_init(&idx->packet_ctx, packet, original,
+				   tunnel_password_zeros, false, secret) < 0) {
+	error:
+		talloc_free(idx);
+		return NULL;
+	}
+
+	p = packet->data + RADIUS_HDR_LEN;
+	end = idx->end = packet->data + packet->data_len;
+
+	/*
+	 *	Every attribute is at least 2 bytes, so this
+	 *	is the most entries we can need.
+	 */
+	idx->entry = talloc_array(idx, radius_index_entry_t, (packet->data_len - RADIUS_HDR_LEN) / 2);
+	if (!idx->entry) {
+		talloc_free(idx);
+		goto oom;
+	}
+
+	while (p < end) {
+		radius_index_entry_t *e;
+
+		if (((p + 2) > end) || (p[1] < 2) || ((p + p[1]) > end)) {
+			fr_strerror_printf("Malformed attribute at offset %zu", (size_t)(p - packet->data));
+			goto error;
+		}
+
+		e = &idx->entry[idx->num++];
+		e->attr = p;
+		e->decoded = false;
+
+		if ((p[0] == FR_VENDOR_SPECIFIC) && (p[1] >= 6)) {
+			uint32_t pen;
+
+			memcpy(&pen, p + 2, sizeof(pen));
+			e->sub = ntohl(pen);
+		} else if ((p[0] >= FR_EXTENDED_ATTRIBUTE_1) && (p[1] >= 3)) {
+			e->sub = p[2];
+		} else {
+			e->sub = 0;
+		}
+
+		p += p[1];
+	}
+
+	fr_cursor_init(&cursor, &packet->vps);
+	fr_cursor_tail(&cursor);
+
+	for (i = 0; i < idx->num; i++) {
+		if (!index_entry_must_decode(idx->packet_ctx.root, idx->entry[i].attr)) continue;
+
+		if (index_entry_decode(&cursor, packet, idx, i) < 0) goto error;
+	}
+
+	return idx;
+}
+
+/** Decode all instances of an attribute from an indexed packet
+ *
+ * The VPs are added to packet->vps.  Attributes which have already been decoded
+ * are skipped, so this may be called multiple times for the same attribute.
+ *
+ * @param[in] packet	the index was created from.
+ * @param[in] idx	of the packet.
+ * @param[in] da	to decode.  May be a top level attribute, a vendor,
+ *			or an attribute within a VSA or an extended attribute.
+ * @return
+ *	- 0 on success (even if no attributes matched).
+ *	- -1 on decoding error.
+ */
+int fr_radius_packet_index_decode(RADIUS_PACKET *packet, fr_radius_index_t *idx, fr_dict_attr_t const *da)
+{
+	fr_dict_attr_t const	*top, *sub = NULL;
+	fr_cursor_t		cursor;
+	size_t			i;
+
+	/*
+	 *	Find the top level attribute, and the one below it,
+	 *	which identifies the vendor or extended type.
+	 */
+	for (top = da; top->parent && !top->parent->flags.is_root; top = top->parent) sub = top;
+	if (top->attr > UINT8_MAX) return 0;
+
+	switch (top->type) {
+	case FR_TYPE_VSA:
+	case FR_TYPE_EXTENDED:
+	case FR_TYPE_LONG_EXTENDED:
+		break;
+
+	default:
+		sub = NULL;
+		break;
+	}
+
+	fr_cursor_init(&cursor, &packet->vps);
+	fr_cursor_tail(&cursor);
+
+	for (i = 0; i < idx->num; i++) {
+		radius_index_entry_t *e = &idx->entry[i];
+
+		if (e->decoded || (e->attr[0] != top->attr) || (sub && (e->sub != sub->attr))) continue;
+
+		if (index_entry_decode(&cursor, packet, idx, i) < 0) return -1;
+	}
+
+	return 0;
+}
+
+/** Decode all attributes in an indexed packet which haven't been decoded yet
+ *
+ * @param[in] packet	the index was created from.
+ * @param[in] idx	of the packet.
+ * @return
+ *	- 0 on success.
+ *	- -1 on decoding error.
+ */
+int fr_radius_packet_index_decode_all(RADIUS_PACKET *packet, fr_radius_index_t *idx)
+{
+	fr_cursor_t	cursor;
+	size_t		i;
+
+	fr_cursor_init(&cursor, &packet->vps);
+	fr_cursor_tail(&cursor);
+
+	for (i = 0; i < idx->num; i++) {
+		if (index_entry_decode(&cursor, packet, idx, i) < 0) return -1;
+	}
+
+	return 0;
+}
+
+/** Decode attributes via an index, for the "decode-pair" test point
+ *
+ * The attributes are put into an Access-Request, which is indexed, and then
+ * decoded in full.  Encrypted attributes and Message-Authenticator are decoded
+ * when the packet is indexed, so they come before any other attributes.
+ */
+static ssize_t index_test_decode(TALLOC_CTX *ctx, fr_cursor_t *cursor,
+				 uint8_t const *data, size_t data_len, void *decoder_ctx)
+{
+	fr_radius_ctx_t		*test_ctx = decoder_ctx;
+	RADIUS_PACKET		*packet;
+	fr_radius_index_t	*idx;
+	VALUE_PAIR		*vp, *next;
+	uint8_t			*buffer;
+
+	if ((RADIUS_HDR_LEN + data_len) > MAX_PACKET_LEN) {
+		fr_strerror_printf("Attributes are too long for a packet");
+		return -1;
+	}
+
+	packet = fr_radius_alloc(ctx, false);
+	if (!packet) return -1;
+
+	packet->code = FR_CODE_ACCESS_REQUEST;
+	packet->data_len = RADIUS_HDR_LEN + data_len;
+	packet->data = buffer = talloc_zero_array(packet, uint8_t, packet->data_len);
+	if (!packet->data) {
+		talloc_free(packet);
+		return -1;
+	}
+
+	buffer[0] = packet->code;
+	buffer[2] = (packet->data_len >> 8) & 0xff;
+	buffer[3] = packet->data_len & 0xff;
+	memcpy(buffer + 4, test_ctx->vector, AUTH_VECTOR_LEN);
+	memcpy(packet->vector, test_ctx->vector, AUTH_VECTOR_LEN);
+	memcpy(buffer + RADIUS_HDR_LEN, data, data_len);
+
+	idx = fr_radius_packet_index(packet, NULL, false, test_ctx->secret);
+	if (!idx || (fr_radius_packet_index_decode_all(packet, idx) < 0)) {
+		talloc_free(packet);
+		return -1;
+	}
+
+	for (vp = packet->vps; vp; vp = next) {
+		next = vp->next;
+		vp->next = NULL;
+		(void) talloc_steal(ctx, vp);
+		fr_cursor_append(cursor, vp);
+	}
+	packet->vps = NULL;
+	talloc_free(packet);
+
+	return data_len;
+}
+
+static void *index_test_ctx(TALLOC_CTX *ctx)
+{
+	static uint8_t vector[] = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f };
+
+	static fr_radius_ctx_t	test_ctx = {
+		.vector = vector
+	};
+
+	test_ctx.secret = talloc_strdup(ctx, "testing123");
+	test_ctx.root = fr_dict_root(fr_dict_internal);
+
+	return &test_ctx;
+}
+
+/*
+ *	Test points
+ */
+extern fr_test_point_pair_decode_t radius_tp_decode_index;
+fr_test_point_pair_decode_t radius_tp_decode_index = {
+	.test_ctx	= index_test_ctx,
+	.func		= index_test_decode
+};
+
+
 /** See if the data pointed to by PTR is a valid RADIUS packet.
  *
  * Packet is not 'const * const' because we may update data_len, if there's more data
@@ -270,8 +634,9 @@ bool fr_radius_packet_ok(RADIUS_PACKET *packet, uint32_t max_attributes, bool re
  */
 int fr_radius_packet_verify(RADIUS_PACKET *packet, RADIUS_PACKET *original, char const *secret)
 {
-	uint8_t const	*original_data;
-	char		buffer[INET6_ADDRSTRLEN];
+	uint8_t const		*original_data;
+	char			buffer[INET6_ADDRSTRLEN];
+	fr_radius_secret_t	radius_secret;
 
 	if (!packet->data) return -1;
 
@@ -281,8 +646,9 @@ int fr_radius_packet_verify(RADIUS_PACKET *packet, RADIUS_PACKET *original, char
 		original_data = NULL;
 	}
 
-	if (fr_radius_verify(packet->data, original_data,
-			     (uint8_t const *) secret, talloc_array_length(secret) - 1) < 0) {
+	fr_radius_secret_init(&radius_secret, (uint8_t const *) secret, talloc_array_length(secret) - 1);
+
+	if (fr_radius_verify(packet->data, original_data, &radius_secret) < 0) {
 		fr_strerror_printf_push("Received invalid packet from %s",
 					inet_ntop(packet->src_ipaddr.af, &packet->src_ipaddr.addr,
 						  buffer, sizeof(buffer)));
@@ -299,8 +665,9 @@ int fr_radius_packet_verify(RADIUS_PACKET *packet, RADIUS_PACKET *original, char
 int fr_radius_packet_sign(RADIUS_PACKET *packet, RADIUS_PACKET const *original,
 			  char const *secret)
 {
-	int rcode;
-	uint8_t const *original_data;
+	int			rcode;
+	uint8_t const		*original_data;
+	fr_radius_secret_t	radius_secret;
 
 	if (original) {
 		original_data = original->data;
@@ -318,8 +685,9 @@ int fr_radius_packet_sign(RADIUS_PACKET *packet, RADIUS_PACKET const *original,
 		memcpy(packet->data + 4, packet->vector, sizeof(packet->vector));
 	}
 
-	rcode = fr_radius_sign(packet->data, original_data,
-			       (uint8_t const *) secret, talloc_array_length(secret) - 1);
+	fr_radius_secret_init(&radius_secret, (uint8_t const *) secret, talloc_array_length(secret) - 1);
+
+	rcode = fr_radius_sign(packet->data, original_data, &radius_secret);
 	if (rcode < 0) return rcode;
 
 	memcpy(packet->vector, packet->data + 4, AUTH_VECTOR_LEN);
@@ -27,6 +27,7 @@
 #include <freeradius-devel/cursor.h>
 #include <freeradius-devel/packet.h>
 #include <freeradius-devel/fr_log.h>
+#include <freeradius-devel/md5.h>
 
 #define AUTH_VECTOR_LEN		16
 #define CHAP_VALUE_LENGTH       16
@@ -78,10 +79,41 @@ typedef enum {
  */
 size_t		fr_radius_attr_len(VALUE_PAIR const *vp);
 
+/** A shared secret, and the MD5 state derived from it
+ *
+ * Initialise with fr_radius_secret_init() when the secret is set (i.e. per
+ * client or home server, not per packet), and pass it to fr_radius_sign()
+ * and fr_radius_verify().
+ */
+typedef struct {
+	uint8_t const		*secret;		//!< The shared secret.  Must outlive this structure.
+	size_t			secret_len;		//!< The length of the secret.
+	fr_hmac_md5_key_t	hmac;			//!< Message-Authenticator key, with the pads absorbed.
+} fr_radius_secret_t;
+
+void		fr_radius_secret_init(fr_radius_secret_t *out,
+				      uint8_t const *secret, size_t secret_len) CC_HINT(nonnull);
+
 int		fr_radius_sign(uint8_t *packet, uint8_t const *original,
-			       uint8_t const *secret, size_t secret_len) CC_HINT(nonnull (1,3));
+			       fr_radius_secret_t const *secret) CC_HINT(nonnull (1,3));
 int		fr_radius_verify(uint8_t *packet, uint8_t const *original,
-				 uint8_t const *secret, size_t secret_len) CC_HINT(nonnull (1,3));
+				 fr_radius_secret_t const *secret) CC_HINT(nonnull (1,3));
+
+#define RADIUS_BATCH_MAX	32			//!< Number of packets signed or verified in parallel.
+
+/** A packet to sign or verify with fr_radius_sign_multi() or fr_radius_verify_multi()
+ *
+ */
+typedef struct {
+	uint8_t			*packet;		//!< The raw RADIUS packet (request or response).
+	uint8_t const		*original;		//!< The raw original request (if this is a response).
+	fr_radius_secret_t const *secret;		//!< The shared secret.
+	int			rcode;			//!< Result, as returned by fr_radius_sign()
+							///< or fr_radius_verify().
+} fr_radius_batch_t;
+
+void		fr_radius_sign_multi(fr_radius_batch_t *batch, size_t num) CC_HINT(nonnull);
+void		fr_radius_verify_multi(fr_radius_batch_t *batch, size_t num) CC_HINT(nonnull);
 bool		fr_radius_ok(uint8_t const *packet, size_t *packet_len_p,
 			     uint32_t max_attributes, bool require_ma, decode_fail_t *reason) CC_HINT(nonnull (1,2));
 
@@ -110,8 +142,16 @@ void		fr_radius_free(RADIUS_PACKET **);
 int		fr_radius_packet_encode(RADIUS_PACKET *packet, RADIUS_PACKET const *original,
 					char const *secret) CC_HINT(nonnull (1,3));
 int		fr_radius_packet_decode(RADIUS_PACKET *packet, RADIUS_PACKET *original,
-					uint32_t max_attributes, bool tunnel_password_zeros,
-					char const *secret) CC_HINT(nonnull (1,5));
+					uint32_t max_attributes, bool tunnel_password_zeros, bool zero_copy,
+					char const *secret) CC_HINT(nonnull (1,6));
+
+typedef struct fr_radius_index_s fr_radius_index_t;
+
+fr_radius_index_t *fr_radius_packet_index(RADIUS_PACKET *packet, RADIUS_PACKET const *original,
+					  bool tunnel_password_zeros, char const *secret) CC_HINT(nonnull (1,4));
+int		fr_radius_packet_index_decode(RADIUS_PACKET *packet, fr_radius_index_t *idx,
+					      fr_dict_attr_t const *da) CC_HINT(nonnull);
+int		fr_radius_packet_index_decode_all(RADIUS_PACKET *packet, fr_radius_index_t *idx) CC_HINT(nonnull);
 
 bool		fr_radius_packet_ok(RADIUS_PACKET *packet, uint32_t max_attributes, bool require_ma,
 				    decode_fail_t *reason) CC_HINT(nonnull (1));
@@ -133,6 +173,12 @@ typedef struct fr_radius_ctx {
 	char const		*secret;		//!< shared secret.  MUST be talloc'd
 	bool 			tunnel_password_zeros;
 	fr_dict_attr_t const	*root;
+
+	bool			zero_copy;		//!< Reference "octets" values in the packet data,
+							///< instead of copying them.
+	uint8_t const		*data;			//!< Packet data, which must outlive the decoded VPs
+							///< if zero_copy is true.
+	uint8_t const		*end;			//!< End of the packet data.
 } fr_radius_ctx_t;
 
 /*
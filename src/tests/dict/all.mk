@@ -28,3 +28,18 @@ TESTS.DICT_FILES := $(addprefix $(BUILD_DIR)/tests/dict/,$(notdir $(FILES)))
 $(TESTS.DICT_FILES): | $(BUILD_DIR)/tests/dict
 
 tests.dict: $(TESTS.DICT_FILES)
+
+#
+#  Round trip the main dictionary through the binary cache, and
+#  check stale or corrupt caches are rejected.
+#
+$(BUILD_DIR)/tests/dict/cache: $(BUILD_DIR)/bin/dict_cache_test $(TESTBINDIR)/dict_cache_test | $(BUILD_DIR)/tests/dict
+	${Q}echo UNIT-TEST dict_cache
+	${Q}if ! $(TESTBIN)/dict_cache_test -D share > $@.log 2>&1; then \
+		cat $@.log; \
+		echo "$(TESTBIN)/dict_cache_test -D share"; \
+		exit 1; \
+	fi
+	${Q}touch $@
+
+tests.dict: $(BUILD_DIR)/tests/dict/cache
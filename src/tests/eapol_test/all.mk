@@ -147,10 +147,19 @@ $(foreach x,$(EAPOL_TEST_FILES),$(eval \
 #
 #  Run eapol_test if it exists.  Otherwise do nothing
 #
+#  Test files may contain the comments:
+#
+#	eapol_test_args: <args>		extra arguments passed to eapol_test.
+#	expect_server_log: <regex>	the server log must match <regex>
+#					after the test has run.
+#
 $(OUTPUT_DIR)/%.ok: $(DIR)/%.conf | radiusd.kill $(CONFIG_PATH)/radiusd.pid
 	${Q}echo EAPOL_TEST $(notdir $(patsubst %.conf,%,$<))
-	${Q}if ( grep 'key_mgmt=NONE' '$<' > /dev/null && $(EAPOL_TEST) -t 2 -c $< -p $(PORT) -s $(SECRET) -n > $(patsubst %.conf,%.log,$@) 2>&1 ) || \
-		$(EAPOL_TEST) -t 2 -c $< -p $(PORT) -s $(SECRET) > $(patsubst %.conf,%.log,$@) 2>&1; then\
+	${Q}args=`sed -n 's/^#[[:space:]]*eapol_test_args:[[:space:]]*//p' '$<'`; \
+	expect=`sed -n 's/^#[[:space:]]*expect_server_log:[[:space:]]*//p' '$<'`; \
+	if { ( grep 'key_mgmt=NONE' '$<' > /dev/null && $(EAPOL_TEST) -t 2 $$args -c $< -p $(PORT) -s $(SECRET) -n > $(patsubst %.conf,%.log,$@) 2>&1 ) || \
+		$(EAPOL_TEST) -t 2 $$args -c $< -p $(PORT) -s $(SECRET) > $(patsubst %.conf,%.log,$@) 2>&1; } && \
+		{ [ -z "$$expect" ] || grep -E "$$expect" "$(RADIUS_LOG)" > /dev/null; }; then\
 		touch $@; \
 	else \
 		echo "Last entries in supplicant log ($(patsubst %.conf,%.log,$<)):"; \
@@ -0,0 +1,324 @@
+# -*- makefile -*-
+##
+## Makefile -- Build and run proxy tests for the server.
+##
+##	http://www.freeradius.org/
+##	$Id$
+##
+#
+#  One server runs all of the virtual servers in config/servers.conf,
+#  which proxy packets to each other.
+#
+#  The test files are files without extensions, and contain the
+#  packets radclient sends.  FOO.reply contains the filters which
+#  the replies must match.
+#
+#  Tests which radclient can't do have their own programs.
+#
+#  The "tcp", "tls", "balance" and "shared" tests proxy to home_standin, a
+#  home server stand-in which misbehaves in the ways the tests ask
+#  it to.
+#
+SUBMAKEFILES := conflict_test.mk home_standin.mk
+
+PROXY_TEST_PATH := ${top_srcdir}/src/tests/proxy
+PROXY_CONFIG_PATH := $(PROXY_TEST_PATH)/config
+
+PROXY_OUTPUT_DIR := $(BUILD_DIR)/tests/proxy
+PROXY_RADIUS_LOG := $(PROXY_OUTPUT_DIR)/radius.log
+PROXY_GDB_LOG := $(PROXY_OUTPUT_DIR)/gdb.log
+
+#
+#   This ensures that FreeRADIUS uses modules from the build directory
+#
+FR_LIBRARY_PATH := $(BUILD_DIR)/lib/local/.libs/
+export FR_LIBRARY_PATH
+
+PROXY_PORT := 12360
+PROXY_HOP_PORT := 12361
+PROXY_HOME_PORT := 12362
+PROXY_SLOW_PORT := 12363
+PROXY_TCP_PORT := 12364
+PROXY_TCP_HOME_PORT := 12365
+PROXY_TLS_PORT := 12366
+PROXY_TLS_HOME_PORT := 12367
+PROXY_BALANCE_PORT := 12368
+PROXY_BALANCE_HOME_PORT := 12369
+PROXY_SHARED_PORT := 12370
+PROXY_SHARED_HOME_PORT := 12371
+PROXY_SECRET := testing123
+
+PROXY_ENV := TEST_PORT=$(PROXY_PORT) TEST_HOP_PORT=$(PROXY_HOP_PORT) TEST_HOME_PORT=$(PROXY_HOME_PORT) TEST_SLOW_PORT=$(PROXY_SLOW_PORT) \
+	TEST_TCP_PORT=$(PROXY_TCP_PORT) TEST_TCP_HOME_PORT=$(PROXY_TCP_HOME_PORT) \
+	TEST_TLS_PORT=$(PROXY_TLS_PORT) TEST_TLS_HOME_PORT=$(PROXY_TLS_HOME_PORT) \
+	TEST_BALANCE_PORT=$(PROXY_BALANCE_PORT) TEST_BALANCE_HOME_PORT=$(PROXY_BALANCE_HOME_PORT) \
+	TEST_SHARED_PORT=$(PROXY_SHARED_PORT) TEST_SHARED_HOME_PORT=$(PROXY_SHARED_HOME_PORT)
+
+PROXY_FILES := $(filter-out %.reply %.mk %.c %~ %.rej,$(subst $(DIR)/,,$(wildcard $(DIR)/*)))
+PROXY_FILES := $(filter-out config,$(PROXY_FILES))
+
+ifeq "$(OPENSSL_LIBS)" ""
+PROXY_FILES := $(filter-out tls,$(PROXY_FILES))
+endif
+PROXY_OK_FILES := $(addprefix $(PROXY_OUTPUT_DIR)/,$(addsuffix .ok,$(PROXY_FILES)))
+
+.PHONY: $(PROXY_OUTPUT_DIR)
+$(PROXY_OUTPUT_DIR):
+	${Q}mkdir -p $@
+
+.PHONY: clean.tests.proxy
+clean: clean.tests.proxy
+
+# This gets called recursively, so has to be outside of the condition below
+# We can't make this depend on radiusd.pid, because then make will create
+# radiusd.pid when we make proxy.radiusd.kill, which we don't want.
+.PHONY: proxy.radiusd.kill
+proxy.radiusd.kill: | $(PROXY_OUTPUT_DIR)
+	${Q}for pid in $(PROXY_OUTPUT_DIR)/*.standin.pid; do \
+		if [ -f $$pid ]; then \
+			kill -TERM `cat $$pid` >/dev/null 2>&1; \
+			rm -f $$pid; \
+		fi; \
+	done
+	${Q}if [ -f $(PROXY_CONFIG_PATH)/radiusd.pid ]; then \
+		ret=0; \
+		if ! ps `cat $(PROXY_CONFIG_PATH)/radiusd.pid` >/dev/null 2>&1; then \
+		    rm -f $(PROXY_CONFIG_PATH)/radiusd.pid; \
+		    echo "FreeRADIUS terminated during test"; \
+		    echo "GDB output was:"; \
+		    cat "$(PROXY_GDB_LOG)"; \
+		    echo "--------------------------------------------------"; \
+		    tail -n 40 "$(PROXY_RADIUS_LOG)"; \
+		    echo "Last entries in server log ($(PROXY_RADIUS_LOG)):"; \
+		    ret=1; \
+		fi; \
+		if ! kill -TERM `cat $(PROXY_CONFIG_PATH)/radiusd.pid` >/dev/null 2>&1; then \
+			ret=1; \
+		fi; \
+		rm -f $(PROXY_CONFIG_PATH)/radiusd.pid; \
+		exit $$ret; \
+	fi
+
+clean.tests.proxy:
+	${Q}rm -f $(PROXY_OUTPUT_DIR)/*.ok $(PROXY_OUTPUT_DIR)/*.log $(PROXY_OUTPUT_DIR)/*.requests
+	${Q}rm -f "$(PROXY_CONFIG_PATH)/test.conf"
+	${Q}rm -f "$(PROXY_CONFIG_PATH)/dictionary"
+
+$(PROXY_CONFIG_PATH)/dictionary:
+	${Q}echo "# test dictionary not install.  Delete at any time." > $@
+	${Q}echo '$$INCLUDE ' $(top_builddir)/share/dictionary >> $@
+	${Q}echo '$$INCLUDE ' $(top_builddir)/src/tests/dictionary.test >> $@
+
+$(PROXY_CONFIG_PATH)/test.conf: $(PROXY_CONFIG_PATH)/dictionary src/tests/proxy/all.mk
+	${Q}echo "# test configuration file.  Do not install.  Delete at any time." > $@
+	${Q}echo 'testdir =' $(PROXY_CONFIG_PATH) >> $@
+	${Q}echo 'logdir =' $(PROXY_OUTPUT_DIR) >> $@
+	${Q}echo 'maindir = ${top_builddir}/raddb/' >> $@
+	${Q}echo 'radacctdir = $${testdir}' >> $@
+	${Q}echo 'pidfile = $${testdir}/radiusd.pid' >> $@
+	${Q}echo 'panic_action = "gdb -batch -x ${top_srcdir}/src/tests/panic.gdb %e %p > $(PROXY_GDB_LOG) 2>&1; cat $(PROXY_GDB_LOG)"' >> $@
+	${Q}echo >> $@
+	${Q}echo 'modconfdir = $${maindir}mods-config' >> $@
+ifneq "$(OPENSSL_LIBS)" ""
+	${Q}echo 'tls_client = $${testdir}/tls_client.conf' >> $@
+else
+	${Q}echo 'tls_client = $${testdir}/no_tls.conf' >> $@
+endif
+	${Q}echo '$$INCLUDE $${testdir}/servers.conf' >> $@
+
+#
+#  The home server stand-ins.  Each writes its PID file once it's
+#  listening.
+#
+#  "tcp" answers pipelined requests in reverse order, writes its
+#  replies a few bytes at a time, and closes each connection after
+#  3 replies.  "tls" does the same over RADIUS/TLS, but doesn't
+#  close connections.
+#
+#  The "balance" stand-ins log the packets they answer.  The second
+#  is slow, and the third doesn't answer the first two packets.
+#
+#  "shared" doesn't answer the first packet.
+#
+PROXY_STANDINS := $(addprefix $(PROXY_OUTPUT_DIR)/,tcp.standin.pid balance1.standin.pid balance2.standin.pid balance3.standin.pid shared.standin.pid)
+
+$(PROXY_OUTPUT_DIR)/tcp.standin.pid: PROXY_STANDIN_ARGS := -P tcp -r -f -c 3 127.0.0.1:$(PROXY_TCP_HOME_PORT)
+$(PROXY_OUTPUT_DIR)/balance1.standin.pid: PROXY_STANDIN_ARGS := 127.0.0.1:$(PROXY_BALANCE_HOME_PORT)
+$(PROXY_OUTPUT_DIR)/balance2.standin.pid: PROXY_STANDIN_ARGS := -d 200 127.0.0.2:$(PROXY_BALANCE_HOME_PORT)
+$(PROXY_OUTPUT_DIR)/balance3.standin.pid: PROXY_STANDIN_ARGS := -n 2 127.0.0.3:$(PROXY_BALANCE_HOME_PORT)
+$(PROXY_OUTPUT_DIR)/shared.standin.pid: PROXY_STANDIN_ARGS := -n 1 127.0.0.1:$(PROXY_SHARED_HOME_PORT)
+
+ifneq "$(OPENSSL_LIBS)" ""
+PROXY_STANDINS += $(PROXY_OUTPUT_DIR)/tls.standin.pid
+
+$(PROXY_OUTPUT_DIR)/tls.standin.pid: PROXY_STANDIN_ARGS := -P tcp -r -f -T $(top_builddir)/raddb/certs/rsa/server.pem -w whatever 127.0.0.1:$(PROXY_TLS_HOME_PORT)
+$(PROXY_OUTPUT_DIR)/tls.standin.pid: | $(top_builddir)/raddb/certs/rsa/server.pem $(top_builddir)/raddb/certs/rsa/client.pem
+endif
+
+$(PROXY_OUTPUT_DIR)/%.standin.pid: $(TESTBINDIR)/home_standin | $(PROXY_OUTPUT_DIR)
+	${Q}rm -f $@ $(PROXY_OUTPUT_DIR)/$*.requests
+	${Q}printf "Starting $* home server stand-in... "
+	${Q}$(TESTBIN)/home_standin -s $(PROXY_SECRET) -p $@ -l $(PROXY_OUTPUT_DIR)/$*.requests $(PROXY_STANDIN_ARGS) > $(PROXY_OUTPUT_DIR)/$*.standin.log 2>&1 &
+	${Q}for i in 1 2 3 4 5 6 7 8 9 10; do \
+		if [ -f $@ ]; then break; fi; \
+		sleep 1; \
+	done
+	${Q}if [ ! -f $@ ]; then \
+		echo "FAILED STARTING HOME SERVER STAND-IN"; \
+		cat $(PROXY_OUTPUT_DIR)/$*.standin.log; \
+		exit 1; \
+	fi
+	${Q}echo "ok"
+
+$(PROXY_CONFIG_PATH)/radiusd.pid: $(PROXY_CONFIG_PATH)/test.conf | $(PROXY_OUTPUT_DIR) $(PROXY_STANDINS)
+	${Q}rm -f $(PROXY_GDB_LOG) $(PROXY_RADIUS_LOG)
+	${Q}printf "Starting proxy test server... "
+	${Q}if ! $(PROXY_ENV) \
+		$(JLIBTOOL) --mode=execute $(BUILD_DIR)/bin/local/radiusd -Pxxxl $(PROXY_RADIUS_LOG) -d $(PROXY_CONFIG_PATH) -n test -D $(PROXY_CONFIG_PATH); then\
+		echo "FAILED STARTING RADIUSD"; \
+		tail -n 40 "$(PROXY_RADIUS_LOG)"; \
+		echo "Last entries in server log ($(PROXY_RADIUS_LOG)):"; \
+	else \
+		echo "ok"; \
+	fi
+
+#
+#  Run radclient against the first hop, checking the replies
+#  against the filters.
+#
+#  The "tcp" and "tls" tests send their packets in parallel, to
+#  other virtual servers.  They wait longer for the replies, as the
+#  proxy has to reconnect to the stand-in.
+#
+PROXY_TEST_PORT := $(PROXY_PORT)
+PROXY_TEST_ARGS := -t 5
+
+$(PROXY_OUTPUT_DIR)/tcp.ok: PROXY_TEST_PORT := $(PROXY_TCP_PORT)
+$(PROXY_OUTPUT_DIR)/tcp.ok: PROXY_TEST_ARGS := -t 40 -p 8
+
+$(PROXY_OUTPUT_DIR)/tls.ok: PROXY_TEST_PORT := $(PROXY_TLS_PORT)
+$(PROXY_OUTPUT_DIR)/tls.ok: PROXY_TEST_ARGS := -t 40 -p 8
+
+$(PROXY_OUTPUT_DIR)/%.ok: $(DIR)/% $(DIR)/%.reply $(BUILD_DIR)/bin/local/radclient | proxy.radiusd.kill $(PROXY_CONFIG_PATH)/radiusd.pid
+	${Q}echo PROXY-TEST $(notdir $<)
+	${Q}if ! $(JLIBTOOL) --mode=execute $(BUILD_DIR)/bin/local/radclient -x $(PROXY_TEST_ARGS) -r 1 -D $(PROXY_CONFIG_PATH) -d $(top_builddir)/raddb \
+		-f $<:$<.reply 127.0.0.1:$(PROXY_TEST_PORT) auth $(PROXY_SECRET) > $(patsubst %.ok,%.log,$@) 2>&1; then \
+		echo "Last entries in radclient log ($(patsubst %.ok,%.log,$@)):"; \
+		tail -n 40 "$(patsubst %.ok,%.log,$@)"; \
+		echo "--------------------------------------------------"; \
+		tail -n 40 "$(PROXY_RADIUS_LOG)"; \
+		echo "Last entries in server log ($(PROXY_RADIUS_LOG)):"; \
+		echo "--------------------------------------------------"; \
+		echo "$(PROXY_ENV) $(JLIBTOOL) --mode=execute $(BUILD_DIR)/bin/local/radiusd -PX -d \"$(PROXY_CONFIG_PATH)\" -n test -D \"$(PROXY_CONFIG_PATH)\""; \
+		$(MAKE) proxy.radiusd.kill; \
+		exit 1;\
+	fi
+	${Q}touch $@
+
+#
+#  Send a forged packet which conflicts with one the "slow" virtual
+#  server is still processing.
+#
+$(PROXY_OUTPUT_DIR)/conflict.ok: $(TESTBINDIR)/conflict_test | proxy.radiusd.kill $(PROXY_CONFIG_PATH)/radiusd.pid
+	${Q}echo PROXY-TEST conflict
+	${Q}if ! $(TESTBIN)/conflict_test -s $(PROXY_SECRET) 127.0.0.1:$(PROXY_SLOW_PORT) > $(patsubst %.ok,%.log,$@) 2>&1; then \
+		cat "$(patsubst %.ok,%.log,$@)"; \
+		echo "--------------------------------------------------"; \
+		tail -n 40 "$(PROXY_RADIUS_LOG)"; \
+		echo "Last entries in server log ($(PROXY_RADIUS_LOG)):"; \
+		$(MAKE) proxy.radiusd.kill; \
+		exit 1;\
+	fi
+	${Q}touch $@
+
+PROXY_OK_FILES += $(PROXY_OUTPUT_DIR)/conflict.ok
+
+#
+#  Balance packets across the three "balance" stand-ins.  The
+#  packets are sent one at a time, so that each one sees the round
+#  trip times from the ones before.
+#
+#  - The slow home server has a much higher round trip time, so it
+#    only gets packets before that's known.  That's at most one
+#    per worker thread.
+#
+#  - 127.0.0.3 doesn't answer the first two packets, so it's
+#    ejected.  Its packet is retransmitted, and still succeeds.
+#
+#  - Once the ejection period is over, it gets packets again.
+#
+PROXY_BALANCE_RADCLIENT := $(JLIBTOOL) --mode=execute $(BUILD_DIR)/bin/local/radclient -x -t 20 -r 1 -D $(PROXY_CONFIG_PATH) -d $(top_builddir)/raddb \
+	-f $(DIR)/balance:$(DIR)/balance.reply 127.0.0.1:$(PROXY_BALANCE_PORT) auth $(PROXY_SECRET)
+
+$(PROXY_OUTPUT_DIR)/balance.ok: $(DIR)/balance $(DIR)/balance.reply $(BUILD_DIR)/bin/local/radclient | proxy.radiusd.kill $(PROXY_CONFIG_PATH)/radiusd.pid
+	${Q}echo PROXY-TEST balance
+	${Q}if ! ( $(PROXY_BALANCE_RADCLIENT) && \
+		slow=`wc -l < $(PROXY_OUTPUT_DIR)/balance2.requests` && \
+		echo "slow home server answered $$slow packets" && \
+		test $$slow -le 4 && \
+		grep "Ejecting home server 127.0.0.3 " $(PROXY_RADIUS_LOG) && \
+		before=`wc -l < $(PROXY_OUTPUT_DIR)/balance3.requests` && \
+		sleep 6 && \
+		$(PROXY_BALANCE_RADCLIENT) && \
+		after=`wc -l < $(PROXY_OUTPUT_DIR)/balance3.requests` && \
+		echo "127.0.0.3 answered $$before packets, then $$after" && \
+		test $$after -gt $$before ) > $(patsubst %.ok,%.log,$@) 2>&1; then \
+		echo "Last entries in balance log ($(patsubst %.ok,%.log,$@)):"; \
+		tail -n 40 "$(patsubst %.ok,%.log,$@)"; \
+		echo "--------------------------------------------------"; \
+		tail -n 40 "$(PROXY_RADIUS_LOG)"; \
+		echo "Last entries in server log ($(PROXY_RADIUS_LOG)):"; \
+		$(MAKE) proxy.radiusd.kill; \
+		exit 1;\
+	fi
+	${Q}touch $@
+
+#
+#  Check how the udp_shared transport tracks the home server.
+#
+#  - The first packet isn't answered, and isn't retransmitted.  As
+#    there were no replies for zombie_period, the home server is
+#    marked zombie.  It answers the Status-Server, and is marked
+#    alive again.
+#
+#  - The other packets are then proxied as usual.
+#
+#  - Once the stand-in is stopped, the next packet times out, the
+#    Status-Server checks aren't answered, and the home server is
+#    marked dead.
+#
+PROXY_SHARED_HOME := home server 127.0.0.1 port $(PROXY_SHARED_HOME_PORT)
+PROXY_SHARED_RADCLIENT := $(JLIBTOOL) --mode=execute $(BUILD_DIR)/bin/local/radclient -x -t 5 -r 1 -D $(PROXY_CONFIG_PATH) -d $(top_builddir)/raddb
+
+$(PROXY_OUTPUT_DIR)/shared.ok: $(DIR)/shared $(DIR)/shared.reply $(BUILD_DIR)/bin/local/radclient | proxy.radiusd.kill $(PROXY_CONFIG_PATH)/radiusd.pid
+	${Q}echo PROXY-TEST shared
+	${Q}if ! ( ( echo 'User-Name = "zombie"' | $(PROXY_SHARED_RADCLIENT) 127.0.0.1:$(PROXY_SHARED_PORT) auth $(PROXY_SECRET) || true ) && \
+		sleep 1 && \
+		grep "marking $(PROXY_SHARED_HOME) zombie" $(PROXY_RADIUS_LOG) && \
+		grep "marking $(PROXY_SHARED_HOME) alive" $(PROXY_RADIUS_LOG) && \
+		$(PROXY_SHARED_RADCLIENT) -f $(DIR)/shared:$(DIR)/shared.reply 127.0.0.1:$(PROXY_SHARED_PORT) auth $(PROXY_SECRET) && \
+		kill -TERM `cat $(PROXY_OUTPUT_DIR)/shared.standin.pid` && \
+		rm -f $(PROXY_OUTPUT_DIR)/shared.standin.pid && \
+		( echo 'User-Name = "dead"' | $(PROXY_SHARED_RADCLIENT) 127.0.0.1:$(PROXY_SHARED_PORT) auth $(PROXY_SECRET) || true ) && \
+		sleep 4 && \
+		grep "marking $(PROXY_SHARED_HOME) dead" $(PROXY_RADIUS_LOG) ) > $(patsubst %.ok,%.log,$@) 2>&1; then \
+		echo "Last entries in shared log ($(patsubst %.ok,%.log,$@)):"; \
+		tail -n 40 "$(patsubst %.ok,%.log,$@)"; \
+		echo "--------------------------------------------------"; \
+		tail -n 40 "$(PROXY_RADIUS_LOG)"; \
+		echo "Last entries in server log ($(PROXY_RADIUS_LOG)):"; \
+		$(MAKE) proxy.radiusd.kill; \
+		exit 1;\
+	fi
+	${Q}touch $@
+
+#
+#  Only run the tests if rlm_radius was built.
+#
+ifneq "$(filter rlm_radius.la,$(ALL_TGTS))" ""
+tests.proxy: $(PROXY_OK_FILES)
+	${Q}$(MAKE) proxy.radiusd.kill
+else
+tests.proxy:
+	${Q}echo "Skipping proxy tests, as rlm_radius was not built"
+endif
@@ -0,0 +1,231 @@
+/*
+ * conflict_test.c	Check that forged packets can't replace a request in progress
+ *
+ * Version:	$Id$
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ *
+ * @copyright 2018 The FreeRADIUS server project
+ */
+
+/*
+ *	An Access-Request is sent to a virtual server which delays
+ *	its reply.  While it's being processed, a second packet with
+ *	the same source port and ID, but a different authenticator,
+ *	is sent.  The second packet has a Message-Authenticator which
+ *	was made with the wrong secret.
+ *
+ *	The server must discard the forged packet, and still reply
+ *	to the first one.
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/libradius.h>
+#include <freeradius-devel/radius/radius.h>
+#include <freeradius-devel/net.h>
+#include <freeradius-devel/rad_assert.h>
+#include <sys/time.h>
+
+#ifdef HAVE_GETOPT_H
+#	include <getopt.h>
+#endif
+
+#define PACKET_ID	(42)
+
+static uint8_t const forged_secret[] = "not-the-secret";
+
+static void NEVER_RETURNS usage(void)
+{
+	fprintf(stderr, "usage: conflict_test [OPTS] server:port\n");
+	fprintf(stderr, "  -d <delay>             Seconds to wait before sending the forged packet (defaults to 0.2).\n");
+	fprintf(stderr, "  -s <secret>            Shared secret (defaults to testing123).\n");
+	fprintf(stderr, "  -t <timeout>           Seconds to wait for the reply (defaults to 5).\n");
+
+	exit(EXIT_FAILURE);
+}
+
+/** Build an Access-Request with a User-Name and a Message-Authenticator
+ *
+ */
+static size_t packet_init(uint8_t *packet, size_t len, char const *user_name, fr_radius_secret_t const *secret)
+{
+	uint8_t		*p = packet + RADIUS_HDR_LEN;
+	size_t		name_len = strlen(user_name);
+	size_t		packet_len = RADIUS_HDR_LEN + 2 + name_len + 18;
+	int		i;
+
+	rad_assert(packet_len <= len);
+
+	memset(packet, 0, packet_len);
+	packet[0] = FR_CODE_ACCESS_REQUEST;
+	packet[1] = PACKET_ID;
+	packet[2] = packet_len >> 8;
+	packet[3] = packet_len & 0xff;
+
+	for (i = 0; i < AUTH_VECTOR_LEN; i += sizeof(uint32_t)) {
+		uint32_t r = fr_rand();
+
+		memcpy(packet + 4 + i, &r, sizeof(r));
+	}
+
+	p[0] = FR_USER_NAME;
+	p[1] = 2 + name_len;
+	memcpy(p + 2, user_name, name_len);
+	p += p[1];
+
+	p[0] = FR_MESSAGE_AUTHENTICATOR;
+	p[1] = 18;
+
+	if (fr_radius_sign(packet, NULL, secret) < 0) {
+		fr_perror("conflict_test");
+		exit(EXIT_FAILURE);
+	}
+
+	return packet_len;
+}
+
+/** Find the Reply-Message in a reply
+ *
+ */
+static bool reply_message_is(uint8_t const *packet, size_t packet_len, char const *value)
+{
+	uint8_t const	*p, *end = packet + packet_len;
+	size_t		len = strlen(value);
+
+	for (p = packet + RADIUS_HDR_LEN; (p + 2) <= end; p += p[1]) {
+		if ((p[1] < 2) || ((p + p[1]) > end)) return false;
+
+		if ((p[0] == FR_REPLY_MESSAGE) && ((size_t) (p[1] - 2) == len) &&
+		    (memcmp(p + 2, value, len) == 0)) return true;
+	}
+
+	return false;
+}
+
+int main(int argc, char *argv[])
+{
+	int			c, sockfd;
+	fr_ipaddr_t		ipaddr;
+	uint16_t		port;
+	char const		*secret = "testing123";
+	double			delay = 0.2, timeout = 5;
+	fr_radius_secret_t	radius_secret, radius_forged;
+	uint8_t			genuine[256], forged[256], reply[4096];
+	size_t			genuine_len, forged_len;
+	struct timeval		tv;
+	fd_set			fds;
+
+	while ((c = getopt(argc, argv, "d:s:t:h")) != EOF) switch (c) {
+		case 'd':
+			delay = strtod(optarg, NULL);
+			break;
+
+		case 's':
+			secret = optarg;
+			break;
+
+		case 't':
+			timeout = strtod(optarg, NULL);
+			break;
+
+		case 'h':
+		default:
+			usage();
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (argc != 1) usage();
+
+	if (fr_inet_pton_port(&ipaddr, &port, argv[0], -1, AF_UNSPEC, true, true) < 0) {
+		fr_perror("conflict_test");
+		exit(EXIT_FAILURE);
+	}
+
+	sockfd = fr_socket_client_udp(NULL, NULL, &ipaddr, port, false);
+	if (sockfd < 0) {
+		fr_perror("conflict_test");
+		exit(EXIT_FAILURE);
+	}
+
+	fr_radius_secret_init(&radius_secret, (uint8_t const *) secret, strlen(secret));
+	fr_radius_secret_init(&radius_forged, forged_secret, sizeof(forged_secret) - 1);
+
+	genuine_len = packet_init(genuine, sizeof(genuine), "genuine", &radius_secret);
+	forged_len = packet_init(forged, sizeof(forged), "forged", &radius_forged);
+
+	if (write(sockfd, genuine, genuine_len) < 0) {
+		fprintf(stderr, "conflict_test: Failed sending packet: %s\n", fr_syserror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	/*
+	 *	The server is still processing the first packet.
+	 */
+	tv.tv_sec = delay;
+	tv.tv_usec = (delay - tv.tv_sec) * 1000000;
+	select(0, NULL, NULL, NULL, &tv);
+
+	if (write(sockfd, forged, forged_len) < 0) {
+		fprintf(stderr, "conflict_test: Failed sending packet: %s\n", fr_syserror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	tv.tv_sec = timeout;
+	tv.tv_usec = (timeout - tv.tv_sec) * 1000000;
+
+	for (;;) {
+		ssize_t reply_len;
+
+		FD_ZERO(&fds);
+		FD_SET(sockfd, &fds);
+
+		/*
+		 *	Linux updates "tv" with the time remaining.
+		 *	Elsewhere, we may wait a little longer.
+		 */
+		if (select(sockfd + 1, &fds, NULL, NULL, &tv) <= 0) {
+			fprintf(stderr, "conflict_test: No reply to the genuine packet\n");
+			exit(EXIT_FAILURE);
+		}
+
+		reply_len = read(sockfd, reply, sizeof(reply));
+		if (reply_len < RADIUS_HDR_LEN) continue;
+		if (reply[1] != PACKET_ID) continue;
+
+		if (fr_radius_verify(reply, forged, &radius_forged) == 0) {
+			fprintf(stderr, "conflict_test: The server replied to the forged packet\n");
+			exit(EXIT_FAILURE);
+		}
+
+		if (fr_radius_verify(reply, genuine, &radius_secret) < 0) {
+			fprintf(stderr, "conflict_test: Reply doesn't match the genuine packet\n");
+			exit(EXIT_FAILURE);
+		}
+
+		if ((reply[0] != FR_CODE_ACCESS_ACCEPT) || !reply_message_is(reply, reply_len, "genuine")) {
+			fprintf(stderr, "conflict_test: Expected an Access-Accept for the genuine packet\n");
+			exit(EXIT_FAILURE);
+		}
+
+		break;
+	}
+
+	close(sockfd);
+
+	printf("ok\n");
+
+	return 0;
+}
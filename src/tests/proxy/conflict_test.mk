@@ -0,0 +1,6 @@
+TARGET		:= conflict_test
+SOURCES		:= conflict_test.c
+
+TGT_PREREQS	:= libfreeradius-radius.a libfreeradius-util.a
+TGT_LDLIBS	:= $(LIBS)
+TGT_INSTALLDIR	:=
@@ -0,0 +1,637 @@
+/*
+ * home_standin.c	A home server stand-in, for testing rlm_radius
+ *
+ * Version:	$Id$
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ *
+ * @copyright 2018 The FreeRADIUS server project
+ */
+
+/*
+ *	Answers every request with an Access-Accept (or an
+ *	Accounting-Response), containing a Reply-Message which is the
+ *	User-Name from the request.  Proxy-State and
+ *	FreeRADIUS-Extended-Identifier are copied to the reply, as a
+ *	real home server would.
+ *
+ *	The options make it misbehave in the ways a real home server
+ *	might.  It can be slow, not answer, answer pipelined requests
+ *	out of order, write replies in pieces, and close connections.
+ *
+ *	Each request it answers is logged to a file, so that tests can
+ *	see which home server got which packets.
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/libradius.h>
+#include <freeradius-devel/radius/radius.h>
+#include <freeradius-devel/net.h>
+#include <sys/time.h>
+#include <netinet/tcp.h>
+
+#ifdef HAVE_GETOPT_H
+#	include <getopt.h>
+#endif
+
+#ifdef WITH_TLS
+#	include <openssl/ssl.h>
+#	include <openssl/err.h>
+#endif
+
+#define MAX_CONNECTIONS		(16)
+#define MAX_PIPELINED		(256)
+#define FR_EXTENDED_ID_LEN	(12)
+
+typedef struct {
+	int			fd;
+#ifdef WITH_TLS
+	SSL			*ssl;
+#endif
+	uint8_t			buffer[MAX_PACKET_LEN * 2];
+	size_t			used;			//!< Bytes of (partial) packets in the buffer.
+	int			replies;		//!< Sent on this connection.
+} standin_conn_t;
+
+static fr_radius_secret_t	radius_secret;
+static int			delay_msec = 0;		//!< Delay before each reply.
+static int			drop = 0;		//!< Don't answer this many requests.
+static bool			reverse = false;	//!< Answer pipelined requests in reverse order.
+static bool			fragment = false;	//!< Write replies in pieces.
+static int			close_after = 0;	//!< Close connections after this many replies.
+static FILE			*log_fp = NULL;
+
+#ifdef WITH_TLS
+static SSL_CTX			*ssl_ctx = NULL;
+static char const		*tls_password = NULL;
+#endif
+
+static void NEVER_RETURNS usage(void)
+{
+	fprintf(stderr, "usage: home_standin [OPTS] address:port\n");
+	fprintf(stderr, "  -c <num>               Close each TCP connection after <num> replies.\n");
+	fprintf(stderr, "  -d <msec>              Wait <msec> milliseconds before each reply.\n");
+	fprintf(stderr, "  -f                     Write TCP replies a few bytes at a time.\n");
+	fprintf(stderr, "  -l <file>              Log the User-Name of each request answered to <file>.\n");
+	fprintf(stderr, "  -n <num>               Don't answer the first <num> requests.\n");
+	fprintf(stderr, "  -P <proto>             Use proto (tcp or udp) for transport.  Default is udp.\n");
+	fprintf(stderr, "  -p <file>              Write our PID to <file>.\n");
+	fprintf(stderr, "  -r                     Answer pipelined TCP requests in reverse order.\n");
+	fprintf(stderr, "  -s <secret>            Shared secret (defaults to testing123).\n");
+#ifdef WITH_TLS
+	fprintf(stderr, "  -T <file>              Use RADIUS/TLS, with the certificate and key in <file>.\n");
+	fprintf(stderr, "  -w <password>          Password for the key given with -T.\n");
+#endif
+
+	exit(EXIT_FAILURE);
+}
+
+/** Is this attribute a FreeRADIUS-Extended-Identifier?
+ *
+ */
+static bool attr_is_extended_id(uint8_t const *attr)
+{
+	uint32_t vendor = htonl(VENDORPEC_FREERADIUS);
+
+	return ((attr[0] == FR_VENDOR_SPECIFIC) && (attr[1] == FR_EXTENDED_ID_LEN) &&
+		(memcmp(attr + 2, &vendor, 4) == 0) &&
+		(attr[6] == FR_FREERADIUS_EXTENDED_IDENTIFIER) && (attr[7] == 6));
+}
+
+/** Build the reply to a request
+ *
+ * @return
+ *	- >0 the length of the reply.
+ *	- 0 if the request shouldn't be answered.
+ */
+static size_t reply_build(uint8_t *reply, size_t reply_len, uint8_t *packet, size_t packet_len)
+{
+	uint8_t		*p = reply + RADIUS_HDR_LEN, *end = reply + reply_len;
+	uint8_t const	*attr, *attr_end = packet + packet_len;
+	uint8_t const	*user_name = NULL;
+
+	if (fr_radius_verify(packet, NULL, &radius_secret) < 0) {
+		fr_perror("home_standin: Discarding request");
+		return 0;
+	}
+
+	switch (packet[0]) {
+	case FR_CODE_ACCESS_REQUEST:
+	case FR_CODE_STATUS_SERVER:
+		reply[0] = FR_CODE_ACCESS_ACCEPT;
+		break;
+
+	case FR_CODE_ACCOUNTING_REQUEST:
+		reply[0] = FR_CODE_ACCOUNTING_RESPONSE;
+		break;
+
+	default:
+		return 0;
+	}
+	reply[1] = packet[1];
+
+	for (attr = packet + RADIUS_HDR_LEN; (attr + 2) <= attr_end; attr += attr[1]) {
+		if ((attr[1] < 2) || ((attr + attr[1]) > attr_end)) return 0;
+
+		if (attr[0] == FR_USER_NAME) {
+			user_name = attr;
+			continue;
+		}
+
+		if ((attr[0] != FR_PROXY_STATE) && !attr_is_extended_id(attr)) continue;
+
+		if ((p + attr[1]) > end) return 0;
+		memcpy(p, attr, attr[1]);
+		p += attr[1];
+	}
+
+	/*
+	 *	Status-Server checks don't count as requests.
+	 */
+	if (packet[0] != FR_CODE_STATUS_SERVER) {
+		if (drop > 0) {
+			drop--;
+			return 0;
+		}
+
+		if (log_fp) {
+			if (user_name) fwrite(user_name + 2, user_name[1] - 2, 1, log_fp);
+			fputc('\n', log_fp);
+			fflush(log_fp);
+		}
+
+		if (user_name) {
+			if ((p + user_name[1]) > end) return 0;
+			p[0] = FR_REPLY_MESSAGE;
+			memcpy(p + 1, user_name + 1, user_name[1] - 1);
+			p += p[1];
+		}
+	}
+
+	if (reply[0] == FR_CODE_ACCESS_ACCEPT) {
+		if ((p + 18) > end) return 0;
+		p[0] = FR_MESSAGE_AUTHENTICATOR;
+		p[1] = 18;
+		memset(p + 2, 0, 16);
+		p += 18;
+	}
+
+	reply[2] = (p - reply) >> 8;
+	reply[3] = (p - reply) & 0xff;
+
+	if (fr_radius_sign(reply, packet, &radius_secret) < 0) {
+		fr_perror("home_standin");
+		return 0;
+	}
+
+	if (delay_msec) usleep(delay_msec * 1000);
+
+	return p - reply;
+}
+
+static void udp_loop(int sockfd)
+{
+	uint8_t			packet[MAX_PACKET_LEN], reply[MAX_PACKET_LEN];
+	struct sockaddr_storage	src;
+	socklen_t		src_len;
+	ssize_t			data_len;
+	size_t			packet_len, reply_len;
+	decode_fail_t		reason;
+
+	for (;;) {
+		src_len = sizeof(src);
+		data_len = recvfrom(sockfd, packet, sizeof(packet), 0, (struct sockaddr *) &src, &src_len);
+		if (data_len < 0) {
+			if (errno == EINTR) continue;
+			fprintf(stderr, "home_standin: Failed reading packet: %s\n", fr_syserror(errno));
+			exit(EXIT_FAILURE);
+		}
+
+		packet_len = data_len;
+		if (!fr_radius_ok(packet, &packet_len, 0, false, &reason)) continue;
+
+		reply_len = reply_build(reply, sizeof(reply), packet, packet_len);
+		if (!reply_len) continue;
+
+		(void) sendto(sockfd, reply, reply_len, 0, (struct sockaddr *) &src, src_len);
+	}
+}
+
+static ssize_t conn_recv(standin_conn_t *conn, uint8_t *buffer, size_t buflen)
+{
+#ifdef WITH_TLS
+	if (conn->ssl) {
+		int ret;
+
+		ret = SSL_read(conn->ssl, buffer, buflen);
+		if (ret > 0) return ret;
+		if (SSL_get_error(conn->ssl, ret) == SSL_ERROR_ZERO_RETURN) return 0;
+		return -1;
+	}
+#endif
+
+	return read(conn->fd, buffer, buflen);
+}
+
+static int conn_send(standin_conn_t *conn, uint8_t const *buffer, size_t buflen)
+{
+	while (buflen > 0) {
+		ssize_t ret;
+
+#ifdef WITH_TLS
+		if (conn->ssl) {
+			ret = SSL_write(conn->ssl, buffer, buflen);
+			if (ret <= 0) return -1;
+		} else
+#endif
+		{
+			ret = write(conn->fd, buffer, buflen);
+			if (ret < 0) {
+				if (errno == EINTR) continue;
+				return -1;
+			}
+		}
+
+		buffer += ret;
+		buflen -= ret;
+	}
+
+	return 0;
+}
+
+/** Write a reply, in pieces if we're asked to
+ *
+ *  The pieces are written separately, with TCP_NODELAY set, and a
+ *  pause in between.  So the other end has to read the header, the
+ *  attributes, and possibly the next packet, with different reads.
+ */
+static int conn_reply(standin_conn_t *conn, uint8_t const *reply, size_t reply_len)
+{
+	size_t		chunk;
+
+	if (!fragment) return conn_send(conn, reply, reply_len);
+
+	while (reply_len > 0) {
+		chunk = (reply_len > 7) ? 7 : reply_len;
+
+		if (conn_send(conn, reply, chunk) < 0) return -1;
+		reply += chunk;
+		reply_len -= chunk;
+
+		usleep(1000);
+	}
+
+	return 0;
+}
+
+static void conn_free(standin_conn_t **conn_p)
+{
+	standin_conn_t *conn = *conn_p;
+
+#ifdef WITH_TLS
+	if (conn->ssl) {
+		SSL_shutdown(conn->ssl);
+		SSL_free(conn->ssl);
+	}
+#endif
+	close(conn->fd);
+	talloc_free(conn);
+	*conn_p = NULL;
+}
+
+/** Read all of the complete packets from a connection, and answer them
+ *
+ * @return
+ *	- 0 if the connection is still open.
+ *	- -1 if it should be closed.
+ */
+static int conn_read(standin_conn_t *conn)
+{
+	ssize_t		data_len;
+	size_t		packet_len, reply_len;
+	uint8_t		*p, *end;
+	uint8_t		*packets[MAX_PIPELINED];
+	size_t		lengths[MAX_PIPELINED];
+	int		i, num = 0;
+	uint8_t		reply[MAX_PACKET_LEN];
+	decode_fail_t	reason;
+
+	data_len = conn_recv(conn, conn->buffer + conn->used, sizeof(conn->buffer) - conn->used);
+	if (data_len <= 0) return -1;
+
+	conn->used += data_len;
+
+	p = conn->buffer;
+	end = conn->buffer + conn->used;
+
+	/*
+	 *	Find all of the complete packets.  Anything left over
+	 *	is the start of the next one.
+	 */
+	while (((end - p) >= 4) && (num < MAX_PIPELINED)) {
+		packet_len = (p[2] << 8) | p[3];
+		if ((packet_len < RADIUS_HDR_LEN) || (packet_len > MAX_PACKET_LEN)) {
+			fprintf(stderr, "home_standin: Invalid packet length %zu, closing connection\n", packet_len);
+			return -1;
+		}
+
+		if ((size_t) (end - p) < packet_len) break;
+
+		if (fr_radius_ok(p, &packet_len, 0, false, &reason)) {
+			packets[num] = p;
+			lengths[num++] = packet_len;
+		}
+
+		p += (p[2] << 8) | p[3];
+	}
+
+	for (i = 0; i < num; i++) {
+		int j = reverse ? (num - 1 - i) : i;
+
+		reply_len = reply_build(reply, sizeof(reply), packets[j], lengths[j]);
+		if (!reply_len) continue;
+
+		if (conn_reply(conn, reply, reply_len) < 0) return -1;
+
+		/*
+		 *	Any requests we didn't answer will have to
+		 *	be sent again on a new connection.
+		 */
+		if (close_after && (++conn->replies >= close_after)) return -1;
+	}
+
+	conn->used = end - p;
+	if (conn->used && (p != conn->buffer)) memmove(conn->buffer, p, conn->used);
+
+	return 0;
+}
+
+static standin_conn_t *conn_accept(int listen_fd)
+{
+	int		fd, on = 1;
+	standin_conn_t	*conn;
+
+	fd = accept(listen_fd, NULL, NULL);
+	if (fd < 0) {
+		fprintf(stderr, "home_standin: Failed accepting connection: %s\n", fr_syserror(errno));
+		return NULL;
+	}
+
+	(void) setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+	conn = talloc_zero(NULL, standin_conn_t);
+	if (!conn) {
+		fprintf(stderr, "home_standin: Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	conn->fd = fd;
+
+#ifdef WITH_TLS
+	if (ssl_ctx) {
+		conn->ssl = SSL_new(ssl_ctx);
+		if (!conn->ssl) goto error;
+
+		SSL_set_fd(conn->ssl, fd);
+		if (SSL_accept(conn->ssl) != 1) {
+			fprintf(stderr, "home_standin: TLS handshake failed\n");
+			ERR_print_errors_fp(stderr);
+		error:
+			conn_free(&conn);
+			return NULL;
+		}
+	}
+#endif
+
+	return conn;
+}
+
+static void tcp_loop(int listen_fd)
+{
+	standin_conn_t	*conns[MAX_CONNECTIONS];
+	fd_set		fds;
+	int		i, max_fd;
+
+	memset(conns, 0, sizeof(conns));
+
+	for (;;) {
+		FD_ZERO(&fds);
+		FD_SET(listen_fd, &fds);
+		max_fd = listen_fd;
+
+		for (i = 0; i < MAX_CONNECTIONS; i++) {
+			if (!conns[i]) continue;
+
+#ifdef WITH_TLS
+			/*
+			 *	OpenSSL may have read more than it
+			 *	gave us last time.
+			 */
+			if (conns[i]->ssl && SSL_pending(conns[i]->ssl)) {
+				if (conn_read(conns[i]) < 0) conn_free(&conns[i]);
+				continue;
+			}
+#endif
+
+			FD_SET(conns[i]->fd, &fds);
+			if (conns[i]->fd > max_fd) max_fd = conns[i]->fd;
+		}
+
+		if (select(max_fd + 1, &fds, NULL, NULL, NULL) < 0) {
+			if (errno == EINTR) continue;
+			fprintf(stderr, "home_standin: select failed: %s\n", fr_syserror(errno));
+			exit(EXIT_FAILURE);
+		}
+
+		for (i = 0; i < MAX_CONNECTIONS; i++) {
+			if (!conns[i] || !FD_ISSET(conns[i]->fd, &fds)) continue;
+
+			if (conn_read(conns[i]) < 0) conn_free(&conns[i]);
+		}
+
+		if (!FD_ISSET(listen_fd, &fds)) continue;
+
+		for (i = 0; i < MAX_CONNECTIONS; i++) {
+			if (!conns[i]) break;
+		}
+
+		if (i == MAX_CONNECTIONS) {
+			close(accept(listen_fd, NULL, NULL));
+			continue;
+		}
+
+		conns[i] = conn_accept(listen_fd);
+	}
+}
+
+#ifdef WITH_TLS
+static int tls_password_cb(char *buf, int size, UNUSED int rwflag, UNUSED void *userdata)
+{
+	strlcpy(buf, tls_password, size);
+	return strlen(buf);
+}
+
+static SSL_CTX *tls_ctx_alloc(char const *file)
+{
+	SSL_CTX *ctx;
+
+	SSL_library_init();
+	SSL_load_error_strings();
+
+	ctx = SSL_CTX_new(SSLv23_server_method());
+	if (!ctx) goto error;
+
+	if (tls_password) SSL_CTX_set_default_passwd_cb(ctx, tls_password_cb);
+
+	if ((SSL_CTX_use_certificate_chain_file(ctx, file) != 1) ||
+	    (SSL_CTX_use_PrivateKey_file(ctx, file, SSL_FILETYPE_PEM) != 1)) {
+	error:
+		fprintf(stderr, "home_standin: Failed loading certificate from %s\n", file);
+		ERR_print_errors_fp(stderr);
+		exit(EXIT_FAILURE);
+	}
+
+	return ctx;
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+	int			c, sockfd;
+	fr_ipaddr_t		ipaddr;
+	uint16_t		port;
+	int			proto = IPPROTO_UDP;
+	char const		*secret = "testing123";
+	char const		*pid_file = NULL;
+#ifdef WITH_TLS
+	char const		*tls_file = NULL;
+#endif
+
+	while ((c = getopt(argc, argv, "c:d:fl:n:P:p:rs:T:w:h")) != EOF) switch (c) {
+		case 'c':
+			close_after = atoi(optarg);
+			break;
+
+		case 'd':
+			delay_msec = atoi(optarg);
+			break;
+
+		case 'f':
+			fragment = true;
+			break;
+
+		case 'l':
+			log_fp = fopen(optarg, "a");
+			if (!log_fp) {
+				fprintf(stderr, "home_standin: Failed opening %s: %s\n", optarg, fr_syserror(errno));
+				exit(EXIT_FAILURE);
+			}
+			break;
+
+		case 'n':
+			drop = atoi(optarg);
+			break;
+
+		case 'P':
+			if (strcmp(optarg, "tcp") == 0) {
+				proto = IPPROTO_TCP;
+			} else if (strcmp(optarg, "udp") != 0) {
+				usage();
+			}
+			break;
+
+		case 'p':
+			pid_file = optarg;
+			break;
+
+		case 'r':
+			reverse = true;
+			break;
+
+		case 's':
+			secret = optarg;
+			break;
+
+#ifdef WITH_TLS
+		case 'T':
+			tls_file = optarg;
+			break;
+
+		case 'w':
+			tls_password = optarg;
+			break;
+#endif
+
+		case 'h':
+		default:
+			usage();
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (argc != 1) usage();
+
+	if (fr_inet_pton_port(&ipaddr, &port, argv[0], -1, AF_UNSPEC, true, true) < 0) {
+		fr_perror("home_standin");
+		exit(EXIT_FAILURE);
+	}
+
+	fr_radius_secret_init(&radius_secret, (uint8_t const *) secret, strlen(secret));
+
+#ifdef WITH_TLS
+	if (tls_file) {
+		if (proto != IPPROTO_TCP) usage();
+		ssl_ctx = tls_ctx_alloc(tls_file);
+	}
+#endif
+
+	if (proto == IPPROTO_TCP) {
+		sockfd = fr_socket_server_tcp(&ipaddr, &port, NULL, false);
+	} else {
+		sockfd = fr_socket_server_udp(&ipaddr, &port, NULL, false);
+	}
+	if ((sockfd < 0) || (fr_socket_bind(sockfd, &ipaddr, &port, NULL) < 0)) {
+		fr_perror("home_standin");
+		exit(EXIT_FAILURE);
+	}
+
+	if ((proto == IPPROTO_TCP) && (listen(sockfd, 8) < 0)) {
+		fprintf(stderr, "home_standin: Failed listening: %s\n", fr_syserror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	/*
+	 *	Written once we're listening, so the caller can wait
+	 *	for the file to appear.
+	 */
+	if (pid_file) {
+		FILE *fp;
+
+		fp = fopen(pid_file, "w");
+		if (!fp) {
+			fprintf(stderr, "home_standin: Failed opening %s: %s\n", pid_file, fr_syserror(errno));
+			exit(EXIT_FAILURE);
+		}
+		fprintf(fp, "%d\n", (int) getpid());
+		fclose(fp);
+	}
+
+	if (proto == IPPROTO_TCP) {
+		tcp_loop(sockfd);
+	} else {
+		udp_loop(sockfd);
+	}
+
+	return 0;
+}
@@ -0,0 +1,6 @@
+TARGET		:= home_standin
+SOURCES		:= home_standin.c
+
+TGT_PREREQS	:= libfreeradius-radius.a libfreeradius-util.a
+TGT_LDLIBS	:= $(LIBS)
+TGT_INSTALLDIR	:=
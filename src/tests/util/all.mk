@@ -1,4 +1,4 @@
-SUBMAKEFILES := ring_buffer_test.mk message_set_test.mk atomic_queue_test.mk control_test.mk 
+SUBMAKEFILES := ring_buffer_test.mk message_set_test.mk atomic_queue_test.mk control_test.mk cache_serialize_test.mk radius_codec_test.mk md5_multi_test.mk cond_eval_test.mk dict_cache_test.mk 
 
 #
 #  These require pthread.
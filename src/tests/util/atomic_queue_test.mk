@@ -1,6 +1,6 @@
 TARGET := atomic_queue_test
 
-SOURCES		:= atomic_queue_test.c
+SOURCES		:= atomic_queue_test.c request_stub.c
 
 TGT_PREREQS	:= $(LIBFREERADIUS_SERVER) libfreeradius-io.a libfreeradius-util.a
 TGT_LDLIBS	:= $(LIBS)
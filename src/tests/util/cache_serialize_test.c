@@ -0,0 +1,263 @@
+/*
+ * cache_serialize_test.c	Compare the text and binary rlm_cache serialization formats
+ *
+ * Version:	$Id$
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ *
+ * @copyright 2018 The FreeRADIUS server project
+ */
+
+RCSID("$Id$")
+
+#include <freeradius-devel/radiusd.h>
+#include <freeradius-devel/modpriv.h>
+#include <freeradius-devel/rad_assert.h>
+#include <sys/time.h>
+
+#include "../../modules/rlm_cache/rlm_cache.h"
+#include "../../modules/rlm_cache/serialize.h"
+
+#ifdef HAVE_GETOPT_H
+#	include <getopt.h>
+#endif
+
+/* Linker hacks */
+char const *get_radius_dir(void)
+{
+	return NULL;
+}
+
+module_instance_t *module_find_with_method(UNUSED rlm_components_t *method,
+					   UNUSED CONF_SECTION *modules, UNUSED char const *name)
+{
+	return NULL;
+}
+
+main_config_t		main_config;				//!< Main server configuration.
+
+module_thread_instance_t *module_thread_instance_find(UNUSED module_instance_t *mi)
+{
+	return NULL;
+}
+/* Linker hacks */
+
+/*
+ *	A representative cache entry, one map per line, in the
+ *	same format the text serializer produces.
+ */
+static char const entry_text[] =
+	"&control:Cache-Created = 1514764800\n"
+	"&control:Cache-Expires = 1514768400\n"
+	"&reply:Reply-Message = 'Hello from the cache'\n"
+	"&reply:Reply-Message += 'A second, somewhat longer, message to copy around'\n"
+	"&reply:Session-Timeout = 3600\n"
+	"&reply:Idle-Timeout = 600\n"
+	"&reply:Framed-IP-Address = 192.0.2.1\n"
+	"&reply:Framed-IP-Netmask = 255.255.255.0\n"
+	"&reply:Framed-MTU = 1500\n"
+	"&reply:Class = 0x0102030405060708090a0b0c0d0e0f10\n"
+	"&reply:Filter-Id = 'std.ingress'\n"
+	"&reply:Framed-IPv6-Prefix = 2001:db8::/64\n"
+	"&reply:Acct-Interim-Interval = 300\n"
+	"&control:Cleartext-Password = 'hello'\n";
+
+static void NEVER_RETURNS usage(void)
+{
+	fprintf(stderr, "usage: cache_serialize_test [OPTS]\n");
+	fprintf(stderr, "  -D <dictdir>           Set main dictionary directory (defaults to " DICTDIR ").\n");
+	fprintf(stderr, "  -n <iterations>        Number of rounds for each operation (defaults to 100000).\n");
+	fprintf(stderr, "  -x                     Debugging mode.\n");
+
+	exit(EXIT_FAILURE);
+}
+
+static uint64_t elapsed_usec(struct timeval const *start, struct timeval const *end)
+{
+	return ((uint64_t)(end->tv_sec - start->tv_sec) * 1000000) + end->tv_usec - start->tv_usec;
+}
+
+static void report(char const *what, size_t iterations, struct timeval const *start, struct timeval const *end)
+{
+	uint64_t usec = elapsed_usec(start, end);
+
+	printf("%-24s %8" PRIu64 " usec total, %8.3f usec/op\n", what, usec, (double)usec / iterations);
+}
+
+int main(int argc, char *argv[])
+{
+	int			c;
+	size_t			i, iterations = 100000;
+	char const		*dict_dir = DICTDIR;
+	fr_dict_t		*dict = NULL;
+	TALLOC_CTX		*autofree = talloc_init("main");
+
+	rlm_cache_entry_t	*entry;
+	char			*text = NULL;
+	size_t			text_len;
+	uint8_t			*binary = NULL;
+	ssize_t			binary_len;
+	struct timeval		start, end;
+
+	while ((c = getopt(argc, argv, "D:n:xh")) != EOF) switch (c) {
+		case 'D':
+			dict_dir = optarg;
+			break;
+
+		case 'n':
+			iterations = strtoul(optarg, NULL, 10);
+			if (!iterations) usage();
+			break;
+
+		case 'x':
+			fr_debug_lvl++;
+			break;
+
+		case 'h':
+		default:
+			usage();
+	}
+
+	if (fr_check_lib_magic(RADIUSD_MAGIC_NUMBER) < 0) {
+		fr_perror("cache_serialize_test");
+		exit(EXIT_FAILURE);
+	}
+
+	if (fr_dict_from_file(autofree, &dict, dict_dir, FR_DICTIONARY_FILE, "radius") < 0) {
+		fr_perror("cache_serialize_test");
+		exit(EXIT_FAILURE);
+	}
+
+	/*
+	 *	Build the reference entry from the text form.
+	 */
+	entry = talloc_zero(autofree, rlm_cache_entry_t);
+	text = talloc_strdup(entry, entry_text);
+	if (cache_deserialize(entry, text, -1) < 0) {
+		fr_perror("cache_serialize_test");
+		exit(EXIT_FAILURE);
+	}
+	talloc_free(text);
+
+	if (cache_serialize(autofree, &text, entry) < 0) {
+		fr_perror("cache_serialize_test");
+		exit(EXIT_FAILURE);
+	}
+	text_len = talloc_array_length(text) - 1;
+
+	binary_len = cache_serialize_binary(autofree, &binary, entry);
+	if (binary_len < 0) {
+		fr_perror("cache_serialize_test");
+		exit(EXIT_FAILURE);
+	}
+
+	printf("%zu iterations, text entry %zu bytes, binary entry %zd bytes\n\n",
+	       iterations, text_len, binary_len);
+
+	/*
+	 *	Round trip the binary form, and check we get
+	 *	the same text back out.
+	 */
+	{
+		rlm_cache_entry_t	*check;
+		char			*check_text;
+
+		check = talloc_zero(autofree, rlm_cache_entry_t);
+		if (cache_deserialize_binary(check, binary, binary_len) < 0) {
+			fr_perror("cache_serialize_test");
+			exit(EXIT_FAILURE);
+		}
+
+		if (cache_serialize(check, &check_text, check) < 0) {
+			fr_perror("cache_serialize_test");
+			exit(EXIT_FAILURE);
+		}
+
+		if (strcmp(check_text, text) != 0) {
+			fprintf(stderr, "cache_serialize_test: Binary round trip mismatch\n"
+				"expected:\n%s\ngot:\n%s\n", text, check_text);
+			exit(EXIT_FAILURE);
+		}
+		talloc_free(check);
+	}
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < iterations; i++) {
+		char *out;
+
+		if (cache_serialize(NULL, &out, entry) < 0) {
+			fr_perror("cache_serialize_test");
+			exit(EXIT_FAILURE);
+		}
+		talloc_free(out);
+	}
+	gettimeofday(&end, NULL);
+	report("serialize text", iterations, &start, &end);
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < iterations; i++) {
+		uint8_t *out;
+
+		if (cache_serialize_binary(NULL, &out, entry) < 0) {
+			fr_perror("cache_serialize_test");
+			exit(EXIT_FAILURE);
+		}
+		talloc_free(out);
+	}
+	gettimeofday(&end, NULL);
+	report("serialize binary", iterations, &start, &end);
+
+	/*
+	 *	The text deserializer modifies its input, so both
+	 *	loops work on a fresh copy of the serialized data.
+	 */
+	gettimeofday(&start, NULL);
+	for (i = 0; i < iterations; i++) {
+		rlm_cache_entry_t	*out;
+		char			*in;
+
+		out = talloc_zero(NULL, rlm_cache_entry_t);
+		in = talloc_memdup(out, text, text_len + 1);
+		if (cache_deserialize(out, in, text_len) < 0) {
+			fr_perror("cache_serialize_test");
+			exit(EXIT_FAILURE);
+		}
+		talloc_free(out);
+	}
+	gettimeofday(&end, NULL);
+	report("deserialize text", iterations, &start, &end);
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < iterations; i++) {
+		rlm_cache_entry_t	*out;
+		uint8_t			*in;
+
+		out = talloc_zero(NULL, rlm_cache_entry_t);
+		in = talloc_memdup(out, binary, binary_len);
+		if (cache_deserialize_binary(out, in, binary_len) < 0) {
+			fr_perror("cache_serialize_test");
+			exit(EXIT_FAILURE);
+		}
+		talloc_free(out);
+	}
+	gettimeofday(&end, NULL);
+	report("deserialize binary", iterations, &start, &end);
+
+	xlat_free();
+	fr_strerror_free();
+	talloc_free(autofree);
+
+	return 0;
+}
@@ -0,0 +1,5 @@
+TARGET		:= cache_serialize_test
+SOURCES		:= cache_serialize_test.c ../../modules/rlm_cache/serialize.c
+
+TGT_PREREQS	:= $(LIBFREERADIUS_SERVER) libfreeradius-util.a
+TGT_LDLIBS	:= $(LIBS)
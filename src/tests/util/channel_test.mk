@@ -1,6 +1,6 @@
 TARGET := channel_test
 
-SOURCES		:= channel_test.c
+SOURCES		:= channel_test.c request_stub.c
 
 TGT_PREREQS	:= $(LIBFREERADIUS_SERVER) libfreeradius-io.a libfreeradius-util.a
 TGT_LDLIBS	:= $(LIBS)
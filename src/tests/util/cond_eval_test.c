@@ -0,0 +1,269 @@
+/*
+ * cond_eval_test.c	Compare compiled and tree walking condition evaluation
+ *
+ * Version:	$Id$
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ *
+ * @copyright 2018 The FreeRADIUS server project
+ */
+
+RCSID("$Id$")
+
+#include <freeradius-devel/radiusd.h>
+#include <freeradius-devel/parser.h>
+#include <freeradius-devel/unlang.h>
+#include <sys/time.h>
+
+#ifdef HAVE_GETOPT_H
+#	include <getopt.h>
+#endif
+
+#define MAX_CONDS	1024
+
+static fr_cond_t	*conds[MAX_CONDS];
+static fr_cond_prog_t	*progs[MAX_CONDS];
+static int		num_conds;
+
+/** Attributes referenced by the conditions in tests/unit/condition.txt
+ *
+ */
+static struct {
+	bool		reply;
+	char const	*attr;
+	char const	*value;
+} const test_pairs[] = {
+	{ false, "User-Name",		"bob" },
+	{ false, "User-Password",	"hello" },
+	{ false, "Filter-Id",		"127.0.0.1" },
+	{ false, "Filter-Id",		"192.168.1.1" },
+	{ false, "Framed-IP-Address",	"192.168.1.1" },
+	{ false, "NAS-IP-Address",	"127.0.0.1" },
+	{ false, "Session-Timeout",	"10" },
+	{ false, "NAS-Port",		"5" },
+	{ false, "Tmp-Integer64-0",	"100" },
+	{ false, "Class",		"0x7f000001" },
+	{ true, "User-Name",		"bob" },
+	{ true, "Reply-Message",	"hello" }
+};
+
+static void NEVER_RETURNS usage(void)
+{
+	fprintf(stderr, "usage: cond_eval_test [OPTS] <unit test file> ...\n");
+	fprintf(stderr, "  -d <raddb>             Set user dictionary directory (defaults to " RADDBDIR ").\n");
+	fprintf(stderr, "  -D <dictdir>           Set main dictionary directory (defaults to " DICTDIR ").\n");
+	fprintf(stderr, "  -n <iterations>        Number of rounds over all conditions (defaults to 100000).\n");
+
+	exit(EXIT_FAILURE);
+}
+
+static uint64_t elapsed_usec(struct timeval const *start, struct timeval const *end)
+{
+	return ((uint64_t)(end->tv_sec - start->tv_sec) * 1000000) + end->tv_usec - start->tv_usec;
+}
+
+static void report(char const *what, size_t ops, struct timeval const *start, struct timeval const *end)
+{
+	uint64_t usec = elapsed_usec(start, end);
+
+	printf("%-24s %8" PRIu64 " usec total, %8.3f usec/op\n", what, usec, (double)usec / ops);
+}
+
+static bool tmpl_usable(vp_tmpl_t const *vpt)
+{
+	switch (vpt->type) {
+	case TMPL_TYPE_ATTR:
+	case TMPL_TYPE_LIST:
+	case TMPL_TYPE_DATA:
+	case TMPL_TYPE_UNPARSED:
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+/** Skip conditions which need xlats, execs, or pass2 fixups
+ *
+ */
+static bool cond_usable(UNUSED void *ctx, fr_cond_t *c)
+{
+	switch (c->type) {
+	case COND_TYPE_EXISTS:
+		return tmpl_usable(c->data.vpt);
+
+	case COND_TYPE_MAP:
+		return (c->pass2_fixup == PASS2_FIXUP_NONE) &&
+			tmpl_usable(c->data.map->lhs) && tmpl_usable(c->data.map->rhs);
+
+	default:
+		return true;
+	}
+}
+
+static int conds_load(TALLOC_CTX *ctx, char const *filename)
+{
+	FILE	*fp;
+	char	buffer[8192];
+
+	fp = fopen(filename, "r");
+	if (!fp) {
+		fprintf(stderr, "cond_eval_test: Failed opening %s: %s\n", filename, fr_syserror(errno));
+		return -1;
+	}
+
+	while (fgets(buffer, sizeof(buffer), fp) && (num_conds < MAX_CONDS)) {
+		char		*p = strchr(buffer, '\n');
+		char const	*error = NULL;
+		ssize_t		slen;
+		fr_cond_t	*cond;
+
+		if (p) *p = '\0';
+
+		if (strncmp(buffer, "condition ", 10) != 0) continue;
+
+		slen = fr_cond_tokenize(ctx, NULL, buffer + 10, &cond, &error, FR_COND_ONE_PASS);
+		if (slen <= 0) continue;
+
+		if ((buffer[10 + slen] != '\0') || !fr_cond_walk(cond, cond_usable, NULL)) {
+			talloc_free(cond);
+			continue;
+		}
+
+		conds[num_conds] = cond;
+		progs[num_conds] = unlang_cond_compile(ctx, cond);
+		if (!progs[num_conds]) {
+			fprintf(stderr, "cond_eval_test: Failed compiling condition \"%s\"\n", buffer + 10);
+			fclose(fp);
+			return -1;
+		}
+		num_conds++;
+	}
+	fclose(fp);
+	fr_strerror_free();
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int			c, i;
+	size_t			j, iterations = 100000;
+	char const		*dict_dir = DICTDIR;
+	char const		*raddb_dir = RADDBDIR;
+	fr_dict_t		*dict = NULL;
+	TALLOC_CTX		*autofree = talloc_init("main");
+	REQUEST			*request;
+	struct timeval		start, end;
+	int			matched = 0;
+
+	while ((c = getopt(argc, argv, "d:D:n:h")) != EOF) switch (c) {
+		case 'd':
+			raddb_dir = optarg;
+			break;
+
+		case 'D':
+			dict_dir = optarg;
+			break;
+
+		case 'n':
+			iterations = strtoul(optarg, NULL, 10);
+			if (!iterations) usage();
+			break;
+
+		case 'h':
+		default:
+			usage();
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (argc < 1) usage();
+
+	if (fr_check_lib_magic(RADIUSD_MAGIC_NUMBER) < 0) {
+		fr_perror("cond_eval_test");
+		exit(EXIT_FAILURE);
+	}
+
+	if (fr_dict_from_file(autofree, &dict, dict_dir, FR_DICTIONARY_FILE, "radius") < 0) {
+		fr_perror("cond_eval_test");
+		exit(EXIT_FAILURE);
+	}
+
+	if (fr_dict_read(dict, raddb_dir, FR_DICTIONARY_FILE) == -1) {
+		fr_perror("cond_eval_test");
+		exit(EXIT_FAILURE);
+	}
+
+	for (i = 0; i < argc; i++) if (conds_load(autofree, argv[i]) < 0) exit(EXIT_FAILURE);
+
+	if (!num_conds) {
+		fprintf(stderr, "cond_eval_test: No usable conditions found\n");
+		exit(EXIT_FAILURE);
+	}
+
+	request = request_alloc(autofree);
+	request->packet = fr_radius_alloc(request, false);
+	request->reply = fr_radius_alloc(request, false);
+
+	for (i = 0; i < (int)(sizeof(test_pairs) / sizeof(test_pairs[0])); i++) {
+		RADIUS_PACKET *packet = test_pairs[i].reply ? request->reply : request->packet;
+
+		if (!fr_pair_make(packet, &packet->vps, test_pairs[i].attr, test_pairs[i].value, T_OP_ADD)) {
+			fr_perror("cond_eval_test");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	/*
+	 *	Both evaluators must agree on every condition
+	 */
+	for (i = 0; i < num_conds; i++) {
+		int a, b;
+
+		a = cond_eval(request, RLM_MODULE_OK, 0, conds[i]);
+		b = cond_eval_prog(request, RLM_MODULE_OK, progs[i]);
+		if (a != b) {
+			char buffer[1024];
+
+			cond_snprint(buffer, sizeof(buffer), conds[i]);
+			fprintf(stderr, "cond_eval_test: cond_eval returned %i, cond_eval_prog returned %i for \"%s\"\n",
+				a, b, buffer);
+			exit(EXIT_FAILURE);
+		}
+		if (a == 1) matched++;
+	}
+
+	printf("%zu iterations, %i conditions (%i matched)\n\n", iterations, num_conds, matched);
+
+	gettimeofday(&start, NULL);
+	for (j = 0; j < iterations; j++) {
+		for (i = 0; i < num_conds; i++) (void) cond_eval(request, RLM_MODULE_OK, 0, conds[i]);
+	}
+	gettimeofday(&end, NULL);
+	report("cond_eval", iterations * num_conds, &start, &end);
+
+	gettimeofday(&start, NULL);
+	for (j = 0; j < iterations; j++) {
+		for (i = 0; i < num_conds; i++) (void) cond_eval_prog(request, RLM_MODULE_OK, progs[i]);
+	}
+	gettimeofday(&end, NULL);
+	report("cond_eval_prog", iterations * num_conds, &start, &end);
+
+	fr_strerror_free();
+	talloc_free(autofree);
+
+	return 0;
+}
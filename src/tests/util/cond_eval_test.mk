@@ -0,0 +1,5 @@
+TARGET		:= cond_eval_test
+SOURCES		:= cond_eval_test.c
+
+TGT_PREREQS	:= $(LIBFREERADIUS_SERVER) libfreeradius-radius.a libfreeradius-util.a
+TGT_LDLIBS	:= $(LIBS)
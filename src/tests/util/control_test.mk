@@ -1,6 +1,6 @@
 TARGET := control_test
 
-SOURCES		:= control_test.c
+SOURCES		:= control_test.c request_stub.c
 
 TGT_PREREQS	:= $(LIBFREERADIUS_SERVER) libfreeradius-io.a libfreeradius-util.a
 TGT_LDLIBS	:= $(LIBS)
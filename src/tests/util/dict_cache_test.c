@@ -0,0 +1,317 @@
+/*
+ * dict_cache_test.c	Check the binary dictionary cache round trips, and is rejected when stale or corrupt
+ *
+ * Version:	$Id$
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ *
+ * @copyright 2018 The FreeRADIUS server project
+ */
+
+/*
+ *	The main dictionary is parsed, written to the cache, and
+ *	loaded back from it.  The two must be the same.
+ *
+ *	The remaining checks use a small dictionary in a temporary
+ *	directory, which is rewritten with the same size and mtime,
+ *	but a different attribute name.  So if the old attribute is
+ *	found, the cache was used, and if the new one is found, the
+ *	cache was rejected.
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/libradius.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#ifdef HAVE_GETOPT_H
+#	include <getopt.h>
+#endif
+
+/*
+ *	Offsets of fields in the cache header, see dict_cache_hdr_t
+ *	in src/lib/util/dict.c.  The first file record follows the
+ *	header.
+ */
+#define HDR_MAGIC		(0)
+#define HDR_LIB_MAGIC		(8)
+#define HDR_NUM_ATTRS		(28)
+#define HDR_LEN			(40)
+
+/*
+ *	Every version of the test dictionary must be the same size.
+ */
+static char const dict_text[] =
+	"ATTRIBUTE	Cache-Test-%c		1	string\n"
+	"ATTRIBUTE	Cache-Test-Integer	2	integer\n"
+	"VALUE	Cache-Test-Integer	One	1\n"
+	"VALUE	Cache-Test-Integer	Two	2\n";
+
+static char const dict_extra[] =
+	"ATTRIBUTE	Cache-Test-Extra	3	string\n";
+
+static TALLOC_CTX	*autofree;
+static char		tmp_dir[] = "/tmp/dict_cache_test.XXXXXX";
+static char		*dict_dir, *dict_file, *cache_file;
+
+static void NEVER_RETURNS usage(void)
+{
+	fprintf(stderr, "usage: dict_cache_test [OPTS]\n");
+	fprintf(stderr, "  -D <dictdir>           Set main dictionary directory (defaults to " DICTDIR ").\n");
+	fprintf(stderr, "  -x                     Debugging mode.\n");
+
+	exit(EXIT_FAILURE);
+}
+
+static void NEVER_RETURNS fail(char const *what)
+{
+	fprintf(stderr, "dict_cache_test: %s (files left in %s)\n", what, tmp_dir);
+	exit(EXIT_FAILURE);
+}
+
+/** Write the test dictionary, and set its mtime
+ *
+ */
+static void dict_write(char letter, bool extra, time_t mtime)
+{
+	FILE		*fp;
+	struct timeval	tv[2];
+
+	fp = fopen(dict_file, "w");
+	if (!fp || (fprintf(fp, dict_text, letter) < 0) || (extra && (fputs(dict_extra, fp) < 0)) ||
+	    (fclose(fp) != 0)) {
+		fprintf(stderr, "dict_cache_test: Failed writing \"%s\": %s\n", dict_file, fr_syserror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	tv[0].tv_sec = tv[1].tv_sec = mtime;
+	tv[0].tv_usec = tv[1].tv_usec = 0;
+	if (utimes(dict_file, tv) < 0) {
+		fprintf(stderr, "dict_cache_test: Failed setting mtime of \"%s\": %s\n", dict_file, fr_syserror(errno));
+		exit(EXIT_FAILURE);
+	}
+}
+
+/** Overwrite the cache
+ *
+ */
+static void cache_write(uint8_t const *data, size_t len, mode_t mode)
+{
+	FILE *fp;
+
+	fp = fopen(cache_file, "w");
+	if (!fp || (len && (fwrite(data, len, 1, fp) != 1)) || (fclose(fp) != 0) || (chmod(cache_file, mode) < 0)) {
+		fprintf(stderr, "dict_cache_test: Failed writing \"%s\": %s\n", cache_file, fr_syserror(errno));
+		exit(EXIT_FAILURE);
+	}
+}
+
+/** Load the test dictionary via the cache, and check which version we got
+ *
+ */
+static void dict_expect(fr_dict_t **dict, char const *present, char const *absent, char const *what)
+{
+	char buffer[256];
+
+	if (fr_dict_from_file_cached(autofree, dict, dict_dir, FR_DICTIONARY_FILE, "cache_test", cache_file) < 0) {
+		snprintf(buffer, sizeof(buffer), "%s: %s", what, fr_strerror());
+		fail(buffer);
+	}
+
+	if (!fr_dict_attr_by_name(*dict, present) || (absent && fr_dict_attr_by_name(*dict, absent))) {
+		snprintf(buffer, sizeof(buffer), "%s: expected %s, not %s", what, present, absent ? absent : "nothing");
+		fail(buffer);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	int			c;
+	char const		*main_dir = DICTDIR;
+	fr_dict_t		*parsed = NULL, *built = NULL, *cached = NULL, *dict = NULL;
+	struct stat		before, after;
+	time_t			mtime;
+	uint8_t			*good, *bad;
+	size_t			good_len;
+	FILE			*fp;
+	uint32_t		num;
+
+	autofree = talloc_init("main");
+
+	while ((c = getopt(argc, argv, "D:xh")) != EOF) switch (c) {
+		case 'D':
+			main_dir = optarg;
+			break;
+
+		case 'x':
+			fr_debug_lvl++;
+			break;
+
+		case 'h':
+		default:
+			usage();
+	}
+
+	if (fr_check_lib_magic(RADIUSD_MAGIC_NUMBER) < 0) {
+		fr_perror("dict_cache_test");
+		exit(EXIT_FAILURE);
+	}
+
+	if (!mkdtemp(tmp_dir)) {
+		fprintf(stderr, "dict_cache_test: Failed creating temporary directory: %s\n", fr_syserror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	dict_dir = talloc_asprintf(autofree, "%s/dict", tmp_dir);
+	dict_file = talloc_asprintf(autofree, "%s/%s", dict_dir, FR_DICTIONARY_FILE);
+	cache_file = talloc_asprintf(autofree, "%s/dictionary.cache", tmp_dir);
+	if (mkdir(dict_dir, 0700) < 0) fail("Failed creating dictionary directory");
+
+	/*
+	 *	Round trip the main dictionary.
+	 */
+	if (fr_dict_from_file(autofree, &parsed, main_dir, FR_DICTIONARY_FILE, "radius") < 0) {
+		fr_perror("dict_cache_test");
+		fail("Failed parsing the main dictionary");
+	}
+
+	if (fr_dict_from_file_cached(autofree, &built, main_dir, FR_DICTIONARY_FILE, "radius", cache_file) < 0) {
+		fr_perror("dict_cache_test");
+		fail("Failed parsing the main dictionary");
+	}
+
+	if (stat(cache_file, &before) < 0) fail("The main dictionary wasn't written to the cache");
+
+	if (fr_dict_from_file_cached(autofree, &cached, main_dir, FR_DICTIONARY_FILE, "radius", cache_file) < 0) {
+		fr_perror("dict_cache_test");
+		fail("Failed loading the main dictionary from the cache");
+	}
+
+	/*
+	 *	A rejected cache is rewritten, via a rename().
+	 */
+	if ((stat(cache_file, &after) < 0) || (after.st_ino != before.st_ino)) {
+		fail("The cache of the main dictionary was rejected");
+	}
+
+	if (fr_dict_cmp(parsed, cached) < 0) {
+		fr_perror("dict_cache_test");
+		fail("The main dictionary loaded from the cache differs from the parsed one");
+	}
+
+	if (fr_dict_cmp(cached, parsed) < 0) {
+		fr_perror("dict_cache_test");
+		fail("The parsed main dictionary differs from the one loaded from the cache");
+	}
+
+	talloc_free(built);
+	talloc_free(cached);
+	unlink(cache_file);
+
+	/*
+	 *	An older mtime, so touching the file changes it.
+	 */
+	mtime = time(NULL) - 100;
+
+	dict_write('A', false, mtime);
+	dict_expect(&dict, "Cache-Test-A", "Cache-Test-B", "Parsing the test dictionary");
+
+	/*
+	 *	Same size and mtime, the cache is used.
+	 */
+	dict_write('B', false, mtime);
+	dict_expect(&dict, "Cache-Test-A", "Cache-Test-B", "Loading an up to date cache");
+
+	fp = fopen(cache_file, "r");
+	if (!fp) fail("Failed opening the cache");
+	good = talloc_array(autofree, uint8_t, 1024 * 1024);
+	good_len = fread(good, 1, talloc_array_length(good), fp);
+	fclose(fp);
+	if ((good_len <= HDR_LEN) || (good_len == talloc_array_length(good))) fail("Unexpected cache size");
+
+	/*
+	 *	Stale caches.
+	 */
+	dict_write('B', false, mtime + 10);
+	dict_expect(&dict, "Cache-Test-B", "Cache-Test-A", "Loading a cache with a different mtime");
+
+	dict_write('A', true, mtime + 10);
+	dict_expect(&dict, "Cache-Test-Extra", "Cache-Test-B", "Loading a cache with a different size");
+
+	/*
+	 *	Corrupt caches.  The good cache was built from
+	 *	"A", so they must all give us "B".
+	 */
+	dict_write('B', false, mtime);
+
+	cache_write(good, good_len, 0644);
+	dict_expect(&dict, "Cache-Test-A", "Cache-Test-B", "Loading the good cache");
+
+	cache_write(good, 0, 0644);
+	dict_expect(&dict, "Cache-Test-B", "Cache-Test-A", "Loading an empty cache");
+
+	cache_write(good, HDR_LEN - 1, 0644);
+	dict_expect(&dict, "Cache-Test-B", "Cache-Test-A", "Loading a cache with a truncated header");
+
+	cache_write(good, good_len - 1, 0644);
+	dict_expect(&dict, "Cache-Test-B", "Cache-Test-A", "Loading a truncated cache");
+
+	bad = talloc_memdup(autofree, good, good_len + 1);
+	bad[good_len] = '\0';
+	cache_write(bad, good_len + 1, 0644);
+	dict_expect(&dict, "Cache-Test-B", "Cache-Test-A", "Loading a cache with trailing data");
+
+	memcpy(bad, good, good_len);
+	bad[HDR_MAGIC] ^= 0xff;
+	cache_write(bad, good_len, 0644);
+	dict_expect(&dict, "Cache-Test-B", "Cache-Test-A", "Loading a cache with a bad magic number");
+
+	memcpy(bad, good, good_len);
+	bad[HDR_LIB_MAGIC] ^= 0xff;
+	cache_write(bad, good_len, 0644);
+	dict_expect(&dict, "Cache-Test-B", "Cache-Test-A", "Loading a cache from another library version");
+
+	memcpy(bad, good, good_len);
+	memcpy(&num, bad + HDR_NUM_ATTRS, sizeof(num));
+	num++;
+	memcpy(bad + HDR_NUM_ATTRS, &num, sizeof(num));
+	cache_write(bad, good_len, 0644);
+	dict_expect(&dict, "Cache-Test-B", "Cache-Test-A", "Loading a cache with the wrong number of attributes");
+
+	memcpy(bad, good, good_len);
+	num = UINT32_MAX;
+	memcpy(bad + HDR_LEN, &num, sizeof(num));
+	cache_write(bad, good_len, 0644);
+	dict_expect(&dict, "Cache-Test-B", "Cache-Test-A", "Loading a cache with a bad file name");
+
+	memcpy(bad, good, good_len);
+	bad[good_len - 1] = 'x';
+	cache_write(bad, good_len, 0644);
+	dict_expect(&dict, "Cache-Test-B", "Cache-Test-A", "Loading a cache with an unterminated string table");
+
+	cache_write(good, good_len, 0666);
+	dict_expect(&dict, "Cache-Test-B", "Cache-Test-A", "Loading a world writable cache");
+
+	unlink(cache_file);
+	unlink(dict_file);
+	rmdir(dict_dir);
+	rmdir(tmp_dir);
+
+	talloc_free(autofree);
+
+	printf("ok\n");
+
+	return 0;
+}
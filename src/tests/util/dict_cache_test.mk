@@ -0,0 +1,5 @@
+TARGET		:= dict_cache_test
+SOURCES		:= dict_cache_test.c
+
+TGT_PREREQS	:= libfreeradius-util.a
+TGT_LDLIBS	:= $(LIBS)
@@ -0,0 +1,162 @@
+/*
+ * md5_multi_test.c	Compare batched and individual RADIUS packet verification
+ *
+ * Version:	$Id$
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ *
+ * @copyright 2018 The FreeRADIUS server project
+ */
+
+RCSID("$Id$")
+
+#include <freeradius-devel/libradius.h>
+#include <freeradius-devel/radius/radius.h>
+#include <freeradius-devel/md5.h>
+#include <freeradius-devel/net.h>
+#include <sys/time.h>
+
+#ifdef HAVE_GETOPT_H
+#	include <getopt.h>
+#endif
+
+#define NUM_PACKETS	RADIUS_BATCH_MAX
+#define PACKET_LEN	200
+
+static uint8_t const secret[] = "testing123";
+static fr_radius_secret_t radius_secret;
+
+static void NEVER_RETURNS usage(void)
+{
+	fprintf(stderr, "usage: md5_multi_test [OPTS]\n");
+	fprintf(stderr, "  -n <iterations>        Number of rounds for each operation (defaults to 100000).\n");
+
+	exit(EXIT_FAILURE);
+}
+
+static uint64_t elapsed_usec(struct timeval const *start, struct timeval const *end)
+{
+	return ((uint64_t)(end->tv_sec - start->tv_sec) * 1000000) + end->tv_usec - start->tv_usec;
+}
+
+static void report(char const *what, size_t ops, struct timeval const *start, struct timeval const *end)
+{
+	uint64_t usec = elapsed_usec(start, end);
+
+	printf("%-24s %8" PRIu64 " usec total, %8.3f usec/op\n", what, usec, (double)usec / ops);
+}
+
+/** Build an Accounting-Request with a Message-Authenticator, padded out with Class attributes
+ *
+ */
+static void packet_init(uint8_t *packet, size_t len, int id)
+{
+	uint8_t *p = packet + RADIUS_HDR_LEN, *end = packet + len;
+
+	memset(packet, 0, len);
+	packet[0] = FR_CODE_ACCOUNTING_REQUEST;
+	packet[1] = id;
+	packet[2] = len >> 8;
+	packet[3] = len & 0xff;
+
+	p[0] = FR_MESSAGE_AUTHENTICATOR;
+	p[1] = 18;
+	p += 18;
+
+	while (p < end) {
+		size_t attr_len = ((end - p) > 255) ? 255 : (end - p);
+
+		p[0] = FR_CLASS;
+		p[1] = attr_len;
+		memset(p + 2, id, attr_len - 2);
+		p += attr_len;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	int			c;
+	size_t			i, j, iterations = 100000;
+	uint8_t			packets[NUM_PACKETS][PACKET_LEN];
+	fr_radius_batch_t	batch[NUM_PACKETS];
+	struct timeval		start, end;
+
+	while ((c = getopt(argc, argv, "n:h")) != EOF) switch (c) {
+		case 'n':
+			iterations = strtoul(optarg, NULL, 10);
+			if (!iterations) usage();
+			break;
+
+		case 'h':
+		default:
+			usage();
+	}
+
+	fr_radius_secret_init(&radius_secret, secret, sizeof(secret) - 1);
+
+	/*
+	 *	Packets of varying lengths, so the lanes
+	 *	finish at different times.
+	 */
+	for (i = 0; i < NUM_PACKETS; i++) {
+		packet_init(packets[i], PACKET_LEN - (i * 3), i);
+		if (fr_radius_sign(packets[i], NULL, &radius_secret) < 0) {
+			fr_perror("md5_multi_test");
+			exit(EXIT_FAILURE);
+		}
+
+		batch[i].packet = packets[i];
+		batch[i].original = NULL;
+		batch[i].secret = &radius_secret;
+	}
+
+	/*
+	 *	Check the batched verification agrees with
+	 *	the individual signatures, and catches bad ones.
+	 */
+	fr_radius_verify_multi(batch, NUM_PACKETS);
+	for (i = 0; i < NUM_PACKETS; i++) {
+		if (batch[i].rcode < 0) {
+			fprintf(stderr, "md5_multi_test: Packet %zu failed batched verification\n", i);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	packets[NUM_PACKETS / 2][RADIUS_HDR_LEN + 20] ^= 0xff;
+	fr_radius_verify_multi(batch, NUM_PACKETS);
+	for (i = 0; i < NUM_PACKETS; i++) {
+		if ((batch[i].rcode < 0) != (i == (NUM_PACKETS / 2))) {
+			fprintf(stderr, "md5_multi_test: Wrong batched verification result for packet %zu\n", i);
+			exit(EXIT_FAILURE);
+		}
+	}
+	packets[NUM_PACKETS / 2][RADIUS_HDR_LEN + 20] ^= 0xff;
+
+	printf("%zu iterations, %i packets per batch\n\n", iterations, NUM_PACKETS);
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < iterations; i++) {
+		for (j = 0; j < NUM_PACKETS; j++) (void) fr_radius_verify(packets[j], NULL, &radius_secret);
+	}
+	gettimeofday(&end, NULL);
+	report("fr_radius_verify", iterations * NUM_PACKETS, &start, &end);
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < iterations; i++) fr_radius_verify_multi(batch, NUM_PACKETS);
+	gettimeofday(&end, NULL);
+	report("fr_radius_verify_multi", iterations * NUM_PACKETS, &start, &end);
+
+	return 0;
+}
@@ -0,0 +1,5 @@
+TARGET		:= md5_multi_test
+SOURCES		:= md5_multi_test.c
+
+TGT_PREREQS	:= libfreeradius-radius.a libfreeradius-util.a
+TGT_LDLIBS	:= $(LIBS)
@@ -1,6 +1,6 @@
 TARGET := message_set_test
 
-SOURCES		:= message_set_test.c
+SOURCES		:= message_set_test.c request_stub.c
 
 TGT_PREREQS	:= $(LIBFREERADIUS_SERVER) libfreeradius-io.a libfreeradius-util.a
 TGT_LDLIBS	:= $(LIBS)
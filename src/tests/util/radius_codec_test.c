@@ -0,0 +1,293 @@
+/*
+ * radius_codec_test.c	Benchmark the RADIUS attribute encoder and decoder
+ *
+ * Version:	$Id$
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ *
+ * @copyright 2018 The FreeRADIUS server project
+ */
+
+RCSID("$Id$")
+
+#include <freeradius-devel/libradius.h>
+#include <freeradius-devel/radius/radius.h>
+#include <freeradius-devel/rad_assert.h>
+#include <sys/time.h>
+#include <ctype.h>
+
+#ifdef HAVE_GETOPT_H
+#	include <getopt.h>
+#endif
+
+#define MAX_VECTORS	1024
+
+/** Encoded attributes taken from the tests/unit files
+ *
+ */
+typedef struct {
+	uint8_t		*data;
+	size_t		len;
+} codec_vector_t;
+
+static codec_vector_t	vectors[MAX_VECTORS];
+static int		num_vectors;
+
+static void NEVER_RETURNS usage(void)
+{
+	fprintf(stderr, "usage: radius_codec_test [OPTS] <unit test file> ...\n");
+	fprintf(stderr, "  -D <dictdir>           Set main dictionary directory (defaults to " DICTDIR ").\n");
+	fprintf(stderr, "  -n <iterations>        Number of rounds over all vectors (defaults to 10000).\n");
+	fprintf(stderr, "  -x                     Debugging mode.\n");
+
+	exit(EXIT_FAILURE);
+}
+
+static uint64_t elapsed_usec(struct timeval const *start, struct timeval const *end)
+{
+	return ((uint64_t)(end->tv_sec - start->tv_sec) * 1000000) + end->tv_usec - start->tv_usec;
+}
+
+static void report(char const *what, size_t ops, struct timeval const *start, struct timeval const *end)
+{
+	uint64_t usec = elapsed_usec(start, end);
+
+	printf("%-24s %8" PRIu64 " usec total, %8.3f usec/op\n", what, usec, (double)usec / ops);
+}
+
+/** Add a vector from a "decode-pair" or "data" line, if it's hex
+ *
+ * Lines containing anything other than hex octets are skipped.
+ */
+static void vector_add(TALLOC_CTX *ctx, char const *p)
+{
+	uint8_t	buffer[4096];
+	size_t	len = 0;
+
+	if (num_vectors >= MAX_VECTORS) return;
+
+	while (*p) {
+		while (isspace((int) *p)) p++;
+		if (!*p) break;
+
+		if (!isxdigit((int) p[0]) || !isxdigit((int) p[1]) ||
+		    (p[2] && !isspace((int) p[2]))) return;
+
+		if (len >= sizeof(buffer)) return;
+		if (fr_hex2bin(buffer + len, 1, p, 2) != 1) return;
+		len++;
+		p += 2;
+	}
+
+	/*
+	 *	Must be at least one complete attribute.
+	 */
+	if ((len < 2) || (buffer[1] < 2) || (buffer[1] > len)) return;
+
+	vectors[num_vectors].data = talloc_memdup(ctx, buffer, len);
+	vectors[num_vectors].len = len;
+	num_vectors++;
+}
+
+static int vectors_load(TALLOC_CTX *ctx, char const *filename)
+{
+	FILE	*fp;
+	char	buffer[8192];
+
+	fp = fopen(filename, "r");
+	if (!fp) {
+		fprintf(stderr, "radius_codec_test: Failed opening %s: %s\n", filename, fr_syserror(errno));
+		return -1;
+	}
+
+	while (fgets(buffer, sizeof(buffer), fp)) {
+		char *p = strchr(buffer, '\n');
+
+		if (p) *p = '\0';
+
+		if (strncmp(buffer, "decode-pair ", 12) == 0) {
+			vector_add(ctx, buffer + 12);
+			continue;
+		}
+
+		if (strncmp(buffer, "data ", 5) == 0) vector_add(ctx, buffer + 5);
+	}
+	fclose(fp);
+
+	return 0;
+}
+
+/** Decode all the attributes in a vector
+ *
+ * @return
+ *	- 0 on success.
+ *	- -1 if the vector is malformed (which is expected for some of the test vectors).
+ */
+static int vector_decode(TALLOC_CTX *ctx, VALUE_PAIR **head, codec_vector_t const *vector, fr_radius_ctx_t *packet_ctx)
+{
+	fr_cursor_t	cursor;
+	uint8_t const	*p = vector->data, *end = p + vector->len;
+
+	fr_cursor_init(&cursor, head);
+	while (p < end) {
+		ssize_t slen;
+
+		slen = fr_radius_decode_pair(ctx, &cursor, p, end - p, packet_ctx);
+		if (slen <= 0) return -1;
+
+		p += slen;
+	}
+
+	return 0;
+}
+
+static void vector_encode(VALUE_PAIR *head, fr_radius_ctx_t *packet_ctx)
+{
+	fr_cursor_t	cursor;
+	uint8_t		buffer[4096];
+	uint8_t		*p = buffer, *end = buffer + sizeof(buffer);
+
+	fr_cursor_init(&cursor, &head);
+	while (fr_cursor_current(&cursor) && (p < end)) {
+		ssize_t slen;
+
+		slen = fr_radius_encode_pair(p, end - p, &cursor, packet_ctx);
+		if (slen <= 0) break;
+
+		p += slen;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	int			c, i;
+	size_t			j, iterations = 10000;
+	char const		*dict_dir = DICTDIR;
+	fr_dict_t		*dict = NULL;
+	TALLOC_CTX		*autofree = talloc_init("main");
+	struct timeval		start, end;
+	bool			valid[MAX_VECTORS];
+	int			num_valid = 0;
+
+	static uint8_t		vector[] = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+					     0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f };
+	fr_radius_ctx_t		packet_ctx = {
+					.vector = vector
+				};
+
+	while ((c = getopt(argc, argv, "D:n:xh")) != EOF) switch (c) {
+		case 'D':
+			dict_dir = optarg;
+			break;
+
+		case 'n':
+			iterations = strtoul(optarg, NULL, 10);
+			if (!iterations) usage();
+			break;
+
+		case 'x':
+			fr_debug_lvl++;
+			break;
+
+		case 'h':
+		default:
+			usage();
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (argc < 1) usage();
+
+	if (fr_check_lib_magic(RADIUSD_MAGIC_NUMBER) < 0) {
+		fr_perror("radius_codec_test");
+		exit(EXIT_FAILURE);
+	}
+
+	if (fr_dict_from_file(autofree, &dict, dict_dir, FR_DICTIONARY_FILE, "radius") < 0) {
+		fr_perror("radius_codec_test");
+		exit(EXIT_FAILURE);
+	}
+
+	packet_ctx.secret = talloc_strdup(autofree, "testing123");
+	packet_ctx.root = fr_dict_root(fr_dict_internal);
+
+	for (i = 0; i < argc; i++) if (vectors_load(autofree, argv[i]) < 0) exit(EXIT_FAILURE);
+
+	/*
+	 *	Weed out the vectors which are supposed to
+	 *	fail, so we only benchmark the common path.
+	 */
+	for (i = 0; i < num_vectors; i++) {
+		TALLOC_CTX	*ctx = talloc_init("check");
+		VALUE_PAIR	*head = NULL;
+
+		valid[i] = (vector_decode(ctx, &head, &vectors[i], &packet_ctx) == 0);
+		if (valid[i]) num_valid++;
+
+		talloc_free(ctx);
+	}
+	fr_strerror_free();
+
+	if (!num_valid) {
+		fprintf(stderr, "radius_codec_test: No valid vectors found\n");
+		exit(EXIT_FAILURE);
+	}
+
+	printf("%zu iterations, %i vectors (%i valid)\n\n", iterations, num_vectors, num_valid);
+
+	gettimeofday(&start, NULL);
+	for (j = 0; j < iterations; j++) {
+		for (i = 0; i < num_vectors; i++) {
+			TALLOC_CTX	*ctx;
+			VALUE_PAIR	*head = NULL;
+
+			if (!valid[i]) continue;
+
+			ctx = talloc_init("decode");
+			(void) vector_decode(ctx, &head, &vectors[i], &packet_ctx);
+			talloc_free(ctx);
+		}
+	}
+	gettimeofday(&end, NULL);
+	report("decode", iterations * num_valid, &start, &end);
+
+	/*
+	 *	Encode the pairs from a single decode, so we're
+	 *	only timing the encoder.
+	 */
+	{
+		TALLOC_CTX	*ctx = talloc_init("encode");
+		VALUE_PAIR	*heads[MAX_VECTORS];
+
+		for (i = 0; i < num_vectors; i++) {
+			heads[i] = NULL;
+			if (valid[i]) (void) vector_decode(ctx, &heads[i], &vectors[i], &packet_ctx);
+		}
+
+		gettimeofday(&start, NULL);
+		for (j = 0; j < iterations; j++) {
+			for (i = 0; i < num_vectors; i++) if (valid[i]) vector_encode(heads[i], &packet_ctx);
+		}
+		gettimeofday(&end, NULL);
+		report("encode", iterations * num_valid, &start, &end);
+
+		talloc_free(ctx);
+	}
+
+	fr_strerror_free();
+	talloc_free(autofree);
+
+	return 0;
+}
@@ -0,0 +1,5 @@
+TARGET		:= radius_codec_test
+SOURCES		:= radius_codec_test.c
+
+TGT_PREREQS	:= libfreeradius-radius.a libfreeradius-util.a
+TGT_LDLIBS	:= $(LIBS)
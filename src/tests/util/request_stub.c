@@ -0,0 +1,38 @@
+/*
+ * request_stub.c	Stubs for request functions used by libfreeradius-io
+ *
+ * Version:	$Id$
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ *
+ * @copyright 2018 The FreeRADIUS server project
+ */
+
+RCSID("$Id$")
+
+#include <freeradius-devel/radiusd.h>
+
+/*
+ *	The tests here link against libfreeradius-io, but not the
+ *	request code in the server library.  The worker allocates
+ *	requests with request_alloc_pooled(), so the linker needs
+ *	something to resolve it to.
+ *
+ *	Add this file to the SOURCES of any test which needs it.
+ */
+REQUEST *request_alloc_pooled(UNUSED TALLOC_CTX *ctx, UNUSED size_t num_children, UNUSED size_t pool_size)
+{
+	return NULL;
+}
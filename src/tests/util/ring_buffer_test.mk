@@ -1,6 +1,6 @@
 TARGET := ring_buffer_test
 
-SOURCES		:= ring_buffer_test.c
+SOURCES		:= ring_buffer_test.c request_stub.c
 
 TGT_PREREQS	:= $(LIBFREERADIUS_SERVER) libfreeradius-io.a libfreeradius-util.a
 TGT_LDLIBS	:= $(LIBS)
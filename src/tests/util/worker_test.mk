@@ -1,6 +1,6 @@
 TARGET := worker_test
 
-SOURCES		:= worker_test.c
+SOURCES		:= worker_test.c request_stub.c
 
 TGT_PREREQS	:= $(LIBFREERADIUS_SERVER) libfreeradius-io.a libfreeradius-util.a
 TGT_LDLIBS	:= $(LIBS)
@@ -828,6 +828,268 @@ static bool pass2_cond_callback(void *ctx, fr_cond_t *c)
 	return true;
 }
 
+/** Count the instructions needed to evaluate a list of conditions
+ *
+ */
+static int cond_prog_len(fr_cond_t const *c)
+{
+	int len = 0;
+
+	for (; c; c = c->next) {
+		if (c->type == COND_TYPE_CHILD) {
+			len += cond_prog_len(c->data.child);
+			continue;
+		}
+		len++;
+	}
+
+	return len;
+}
+
+/** Lower an "attribute op literal" comparison to a #COND_INST_CMP
+ *
+ * The literal is cast to the comparison type here, so that only the
+ * attribute values need to be cast (if at all) when the condition
+ * is evaluated.
+ *
+ * "attribute op attribute" comparisons are lowered to a
+ * #COND_INST_CMP_ATTR if the RHS attribute doesn't need a cast.
+ *
+ * @return
+ *	- true if the comparison was lowered.
+ *	- false if it must be evaluated with cond_eval_map().
+ */
+static bool cond_lower_cmp(fr_cond_prog_t *prog, fr_cond_inst_t *inst, fr_cond_t const *c)
+{
+	vp_map_t const		*map = c->data.map;
+	fr_dict_attr_t const	*cast;
+	fr_value_box_t		src;
+
+	if (c->pass2_fixup != PASS2_FIXUP_NONE) return false;
+	if (map->lhs->type != TMPL_TYPE_ATTR) return false;
+
+	switch (map->op) {
+	case T_OP_CMP_EQ:
+	case T_OP_NE:
+	case T_OP_LT:
+	case T_OP_LE:
+	case T_OP_GT:
+	case T_OP_GE:
+		break;
+
+	default:
+		return false;
+	}
+
+	cast = c->cast ? c->cast : map->lhs->tmpl_da;
+
+	switch (map->rhs->type) {
+	case TMPL_TYPE_DATA:
+		if (map->rhs->tmpl_value_type == cast->type) {
+			if (fr_value_box_copy(prog, &inst->rhs, &map->rhs->tmpl_value) < 0) return false;
+			break;
+		}
+		if (fr_value_box_cast(prog, &inst->rhs, cast->type, cast, &map->rhs->tmpl_value) < 0) return false;
+		break;
+
+	case TMPL_TYPE_UNPARSED:
+		memset(&src, 0, sizeof(src));
+		src.type = FR_TYPE_STRING;
+		src.vb_strvalue = map->rhs->name;
+		src.datum.length = map->rhs->len;
+
+		if (fr_value_box_cast(prog, &inst->rhs, cast->type, cast, &src) < 0) return false;
+		break;
+
+	case TMPL_TYPE_ATTR:
+		if (map->rhs->tmpl_da->type != cast->type) return false;
+
+		inst->type = COND_INST_CMP_ATTR;
+		inst->rhs_attr = map->rhs;
+		goto done;
+
+	default:
+		return false;
+	}
+
+	inst->type = COND_INST_CMP;
+
+done:
+	inst->lhs = map->lhs;
+	inst->cast = (cast->type != map->lhs->tmpl_da->type) ? cast : NULL;
+	inst->op = map->op;
+	inst->cmp = cond_cmp_func(cast->type);
+
+	return true;
+}
+
+/** Lower a single condition to an instruction
+ *
+ */
+static void cond_lower_inst(fr_cond_prog_t *prog, fr_cond_inst_t *inst, fr_cond_t const *c)
+{
+	inst->c = c;
+
+	switch (c->type) {
+	case COND_TYPE_TRUE:
+		inst->type = COND_INST_TRUE;
+		return;
+
+	case COND_TYPE_FALSE:
+		inst->type = COND_INST_FALSE;
+		return;
+
+	case COND_TYPE_EXISTS:
+		inst->vpt = c->data.vpt;
+
+		switch (c->data.vpt->type) {
+		/*
+		 *	Either a return code, or a literal which is
+		 *	true if it's not empty.
+		 */
+		case TMPL_TYPE_UNPARSED:
+			inst->modcode = fr_str2int(modreturn_table, c->data.vpt->name, RLM_MODULE_UNKNOWN);
+			if (inst->modcode != RLM_MODULE_UNKNOWN) {
+				inst->type = COND_INST_RCODE;
+				return;
+			}
+			inst->type = (*c->data.vpt->name != '\0') ? COND_INST_TRUE : COND_INST_FALSE;
+			return;
+
+		case TMPL_TYPE_ATTR:
+		case TMPL_TYPE_LIST:
+			inst->type = COND_INST_EXISTS;
+			return;
+
+		default:
+			inst->type = COND_INST_TMPL;
+			return;
+		}
+
+	case COND_TYPE_MAP:
+		if (cond_lower_cmp(prog, inst, c)) return;
+
+#ifdef HAVE_REGEX
+		/*
+		 *	The regex was compiled by pass2_fixup_regex().
+		 */
+		if ((c->pass2_fixup == PASS2_FIXUP_NONE) && !c->cast &&
+		    (c->data.map->op == T_OP_REG_EQ) &&
+		    (c->data.map->lhs->type == TMPL_TYPE_ATTR) &&
+		    (c->data.map->lhs->tmpl_da->type == FR_TYPE_STRING) &&
+		    (c->data.map->rhs->type == TMPL_TYPE_REGEX_STRUCT)) {
+			inst->type = COND_INST_REGEX;
+			inst->lhs = c->data.map->lhs;
+			return;
+		}
+#endif
+		inst->type = COND_INST_MAP;
+		return;
+
+	default:
+		rad_assert(0);
+		inst->type = COND_INST_INVALID;
+		return;
+	}
+}
+
+/** Lower a list of conditions joined by && or ||
+ *
+ * Each condition jumps to the next one in the list, or straight to
+ * the list's own targets if the result of the list is already known.
+ * Negated conditions have their targets swapped.
+ *
+ * @param[in] prog	being built.
+ * @param[in] start	index of the first instruction for the list.
+ * @param[in] c		first condition in the list.
+ * @param[in] on_true	where to jump if the list matches.
+ * @param[in] on_false	where to jump if it doesn't.
+ */
+static void cond_lower(fr_cond_prog_t *prog, int start, fr_cond_t const *c, int on_true, int on_false)
+{
+	int i = start;
+
+	for (; c; c = c->next) {
+		int next, t, f;
+
+		next = i + ((c->type == COND_TYPE_CHILD) ? cond_prog_len(c->data.child) : 1);
+
+		if (!c->next) {
+			t = on_true;
+			f = on_false;
+
+		/*
+		 *	FALSE && ... = FALSE
+		 */
+		} else if (c->next_op == COND_AND) {
+			t = next;
+			f = on_false;
+
+		/*
+		 *	TRUE || ... = TRUE
+		 */
+		} else if (c->next_op == COND_OR) {
+			t = on_true;
+			f = next;
+
+		} else {
+			t = f = next;
+		}
+
+		if (c->negate) {
+			int tmp = t;
+
+			t = f;
+			f = tmp;
+		}
+
+		if (c->type == COND_TYPE_CHILD) {
+			rad_assert(c->data.child != NULL);
+			cond_lower(prog, i, c->data.child, t, f);
+		} else {
+			cond_lower_inst(prog, &prog->inst[i], c);
+			prog->inst[i].on_true = t;
+			prog->inst[i].on_false = f;
+		}
+
+		i = next;
+	}
+}
+
+/** Compile a condition to a flat sequence of instructions
+ *
+ * The condition must already have had its pass2 fixups applied.
+ * Comparisons between attributes and literals get the literal cast
+ * to the comparison type, and a comparator specialised for that
+ * type.  Anything else is evaluated by the generic functions in
+ * cond_eval.c.
+ *
+ * @param[in] ctx	to allocate the program in.
+ * @param[in] cond	to compile.
+ * @return
+ *	- A new #fr_cond_prog_t, to be evaluated with cond_eval_prog().
+ *	- NULL on error.
+ */
+fr_cond_prog_t *unlang_cond_compile(TALLOC_CTX *ctx, fr_cond_t const *cond)
+{
+	fr_cond_prog_t *prog;
+
+	prog = talloc_zero(ctx, fr_cond_prog_t);
+	if (!prog) return NULL;
+
+	prog->cond = cond;
+	prog->num_insts = cond_prog_len(cond);
+	prog->inst = talloc_zero_array(prog, fr_cond_inst_t, prog->num_insts);
+	if (!prog->inst) {
+		talloc_free(prog);
+		return NULL;
+	}
+
+	cond_lower(prog, 0, cond, COND_JUMP_TRUE, COND_JUMP_FALSE);
+
+	return prog;
+}
+
 
 /*
  *	Compile the RHS of update sections to xlat_exp_t
@@ -2272,6 +2534,9 @@ static unlang_t *compile_if(unlang_t *parent, unlang_compile_t *unlang_ctx, CONF
 	g = unlang_generic_to_group(c);
 	g->cond = cond;
 
+	g->cond_prog = unlang_cond_compile(g, cond);
+	if (!g->cond_prog) return NULL;
+
 	return c;
 }
 
@@ -1598,7 +1598,11 @@ static unlang_action_t unlang_if(REQUEST *request,
 	g = unlang_generic_to_group(instruction);
 	rad_assert(g->cond != NULL);
 
-	condition = cond_eval(request, *presult, 0, g->cond);
+	if (g->cond_prog) {
+		condition = cond_eval_prog(request, *presult, g->cond_prog);
+	} else {
+		condition = cond_eval(request, *presult, 0, g->cond);
+	}
 	if (condition < 0) {
 		switch (condition) {
 		case -2:
@@ -157,7 +157,10 @@ typedef struct {
 				};
 			};
 		};
-		fr_cond_t		*cond;		//!< #UNLANG_TYPE_IF, #UNLANG_TYPE_ELSIF.
+		struct {
+			fr_cond_t		*cond;		//!< #UNLANG_TYPE_IF, #UNLANG_TYPE_ELSIF.
+			fr_cond_prog_t		*cond_prog;	//!< cond, compiled by unlang_cond_compile().
+		};
 
 		bool			clone;		//!< #UNLANG_TYPE_PARALLEL
 	};